@@ -1,146 +1,442 @@
+#include <cstring>
+
 #include "arp.hpp"
-#include "memorypool.hpp"
 #include "ethernet.hpp"
+#include "trace.hpp"
 
-Ethernet::Frame ARP::CacheManager::handleMessage(Ethernet::Frame& frame)
+Verdict::Result ARP::CacheManager::handleMessage(Ethernet::Frame& frame)
 {
-    char *buffer = frame.getPayload();
-    size_t bufferLength = frame.getPayloadSize();
-
     ARP::Header header;
-    header.readFromBuffer(buffer, bufferLength);   
-    header.debugPrint();
+    if (!header.readFromBuffer(frame.getPayload(), frame.getPayloadSize())) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
+    }
 
     if (header._hwType != HW_ETHERNET) {
-        throw std::runtime_error("arp.cpp: ARP::CacheManager::HandleMessage(): not supported hardware type\n");
+        return Verdict::drop(Verdict::Reason::ARP_HW_TYPE);
     }
 
     if (header._proType != PRO_IPV4) {
-        throw std::runtime_error("arp.cpp: ARP::CacheManager::HandleMessage(): not supported protocol type\n");
+        return Verdict::drop(Verdict::Reason::ARP_PRO_TYPE);
     }
 
     PayloadIPv4 data;
-    data.readFromBuffer(header._payload, header._payloadSize);
-    data.debugPrint();   
+    if (!data.readFromBuffer(header._payload, header._payloadSize)) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
+    }
+    Trace::packet(Trace::Event::ARP_RX, header._opCode, data._srcIP, data._dstIP);
 
-    Cache& entry = _cacheEntries[data._srcIP];
-    if (!entry._state) {
-    
-        entry._hwType = header._hwType;
-        entry._ipAddr = data._srcIP;
-        entry._macAddr = data._srcMac;
-        entry._state = true;
+    _cache.update(data._srcIP, data._srcMac, now());
 
-    } else {
+    // any message from a host we are resolving answers the question
+    if (Pending *pending = findPending(data._srcIP)) {
+        flush(*pending, data._srcMac);
+    }
+
+    switch (header._opCode) {
+        case OP_REQUEST:
+            replyMessage(frame, data);
+            return Verdict::reply();
+
+        case OP_REPLY:
+            return Verdict::accept();
+
+        default:
+            return Verdict::drop(Verdict::Reason::ARP_OPCODE);
+    }
+}
+
+void ARP::CacheManager::attach(Event::TimerWheel& timers, Transmit transmit, Verdict::DropCounters* drops)
+{
+    _timers = &timers;
+    _transmit = std::move(transmit);
+    _drops = drops;
+    _timers->schedule(SWEEP_INTERVAL, [this]() { sweep(); });
+}
+
+void ARP::CacheManager::sweep(void)
+{
+    _cache.sweep(now());
+    _timers->schedule(SWEEP_INTERVAL, [this]() { sweep(); });
+}
+
+static constexpr size_t ARP_OFFSET  = Ethernet::HeaderLayout::SIZE;
+static constexpr size_t DATA_OFFSET = ARP_OFFSET + ARP::HeaderLayout::SIZE;
+static constexpr size_t PAD_OFFSET  = DATA_OFFSET + ARP::PayloadIPv4Layout::SIZE;
+
+// minimum frame size without the FCS, which the device appends
+static constexpr size_t FRAME_SIZE  = Ethernet::MIN_FRAME_SIZE - sizeof(CRC32);
 
-        if (entry._hwType == header._hwType) {
-            entry._macAddr = data._srcMac;
+// a message always fits in a minimum size frame, so nothing is bounds checked below
+static_assert(PAD_OFFSET <= FRAME_SIZE);
+
+/* an IPv4 over ethernet message from this device, padded to the minimum frame size */
+static void writeMessage(char *buffer, ARP::OpCode opCode, const MacAddr& ethDst, IPAddr srcIP, 
+                         const MacAddr& dstMac, IPAddr dstIP)
+{
+    MacAddr addr = getDevMacAddr();
+
+    Ethernet::HeaderLayout::store(buffer, ethDst, addr, static_cast<EtherType>(PRO_ARP));
+    ARP::HeaderLayout::store(buffer + ARP_OFFSET, static_cast<HwType>(HW_ETHERNET), static_cast<ProType>(PRO_IPV4), 
+            static_cast<ARP::Size>(sizeof(MacAddr::addr)), static_cast<ARP::Size>(sizeof(IPAddr)), opCode);
+    ARP::PayloadIPv4Layout::store(buffer + DATA_OFFSET, addr, srcIP, dstMac, dstIP);
+    std::memset(buffer + PAD_OFFSET, 0, FRAME_SIZE - PAD_OFFSET);
+}
+
+void ARP::CacheManager::replyMessage(Ethernet::Frame& frame, ARP::PayloadIPv4& data)
+{
+    // the request's fields were copied out, so the reply is written over it in place.
+    if (frame.getBufferSize() + frame.getBuffer().tailroom() < FRAME_SIZE) {
+        frame.allocPacket(FRAME_SIZE);
+    }
+
+    writeMessage(frame.getData(), OP_REPLY, data._srcMac, data._dstIP, data._srcMac, data._srcIP);
+    frame.setBufferSize(FRAME_SIZE);
+    frame.parseBuffer();
+
+    uint64_t mac = 0;
+    for (uint8_t byte : data._srcMac.addr) {
+        mac = mac << 8 | byte;
+    }
+    Trace::packet(Trace::Event::ARP_REPLY, 0, data._srcIP, mac);
+}
+
+ARP::Pending* ARP::CacheManager::findPending(IPAddr addr)
+{
+    for (Pending& pending : _pending) {
+        if (pending._requests != 0 && pending._addr == addr) {
+            return &pending;
         }
     }
 
-    if (header._opCode == OP_REQUEST) {
-        
-        return replyMessage(header, data, frame.getCRC());
-    
-    } else {
-        throw std::runtime_error("arp.cpp: ARP::CacheManager::HandleMessage(): not supported opcode\n");
+    return nullptr;
+}
+
+Verdict::Result ARP::CacheManager::output(Ethernet::Frame& frame, IPAddr nextHop)
+{
+    const Entry *entry = lookup(nextHop);
+    if (entry != nullptr) {
+        if (entry->_state == State::NEGATIVE) {
+            return Verdict::drop(Verdict::Reason::ARP_UNRESOLVED);
+        }
+
+        frame.setDst(entry->_macAddr);
+        return Verdict::reply();
+    }
+
+    Pending *pending = findPending(nextHop);
+    if (pending == nullptr) {
+        for (Pending& slot : _pending) {
+            if (slot._requests == 0) {
+                pending = &slot;
+                break;
+            }
+        }
+
+        if (pending == nullptr) {
+            return Verdict::drop(Verdict::Reason::ARP_QUEUE_FULL);
+        }
+
+        pending->_addr = nextHop;
+        pending->_count = 0;
+        sendRequest(*pending);
+    }
+
+    // further frames only queue up, the retry timer paces the requests
+    if (pending->_count == PENDING_FRAMES) {
+        return Verdict::drop(Verdict::Reason::ARP_QUEUE_FULL);
     }
+
+    // the frame outlives its burst
+    if (!frame.own()) {
+        return Verdict::drop(Verdict::Reason::NO_BUFFER);
+    }
+
+    pending->_frames[pending->_count++] = std::move(frame);
+    return Verdict::accept();
 }
 
-Ethernet::Frame ARP::CacheManager::replyMessage(ARP::Header& header, ARP::PayloadIPv4& data, CRC32 oldCRC)
+void ARP::CacheManager::sendRequest(Pending& pending)
 {
-    Ethernet::Frame frame{};
-    size_t bufferLength = frame.allocPacket();
-    Ethernet::Packet *buffer = frame.getPacket();
-    MacAddr addr = getDevMacAddr();
+    ++pending._requests;
+    Trace::packet(Trace::Event::ARP_REQUEST, pending._requests, 0, pending._addr);
+
+    Ethernet::Frame request;
+    if (_transmit && request.tryAllocPacket(FRAME_SIZE)) {
+        MacAddr broadcast;
+        broadcast.addr.fill(0xff);
 
-    size_t idx = 0;
-    try {
-        Memory::write(data._srcMac, buffer->buf, idx, bufferLength);
-        Memory::write(addr, buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<EtherType>(PRO_ARP), buffer->buf, idx, bufferLength);
+        writeMessage(request.getData(), OP_REQUEST, broadcast, _localAddr, MacAddr{}, pending._addr);
+        request.setBufferSize(FRAME_SIZE);
+        request.parseBuffer();
+        _transmit(request);
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::CacheManager::replyMessage: Failed writing ethernet frame header\n";
+
+    if (_timers == nullptr) {
+        return;
     }
 
-    try {
-        Memory::write(header._hwType, buffer->buf, idx, bufferLength);
-        Memory::write(header._proType, buffer->buf, idx, bufferLength);
-        Memory::write(header._hwSize, buffer->buf, idx, bufferLength);
-        Memory::write(header._proSize, buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<ARP::OpCode>(OP_REPLY), buffer->buf, idx, bufferLength);
+    if (!_timers->reschedule(pending._timer, REQUEST_INTERVAL)) {
+        IPAddr addr = pending._addr;
+        pending._timer = _timers->schedule(REQUEST_INTERVAL, [this, addr]() { retry(addr); });
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::CacheManager::replyMessage: Failed writing ARP header\n";
+}
+
+void ARP::CacheManager::retry(IPAddr addr)
+{
+    Pending *pending = findPending(addr);
+    if (pending == nullptr) {
+        return;
     }
 
-    try {
-        Memory::write(addr, buffer->buf, idx, bufferLength);
-        Memory::write(data._dstIP, buffer->buf, idx, bufferLength);
-        Memory::write(data._srcMac, buffer->buf, idx, bufferLength);
-        Memory::write(data._srcIP, buffer->buf, idx, bufferLength);
+    if (pending->_requests < MAX_REQUESTS) {
+        sendRequest(*pending);
+    } else {
+        fail(*pending);
+    }
+}
+
+void ARP::CacheManager::flush(Pending& pending, const MacAddr& macAddr)
+{
+    for (size_t i = 0; i < pending._count; ++i) {
+        Ethernet::Frame& frame = pending._frames[i];
+        frame.setDst(macAddr);
+        if (_transmit && !_transmit(frame)) {
+            if (_drops != nullptr) {
+                _drops->count(Verdict::Reason::TX_QUEUE_FULL);
+            }
+            Trace::packet(Trace::Event::DROP, static_cast<uint32_t>(Verdict::Reason::TX_QUEUE_FULL), PRO_IPV4);
+        }
+    }
+
+    release(pending);
+}
+
+void ARP::CacheManager::fail(Pending& pending)
+{
+    _cache.markUnresolved(pending._addr, now());
+
+    if (_drops != nullptr) {
+        _drops->count(Verdict::Reason::ARP_UNRESOLVED, pending._count);
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::CacheManager::replyMessage: Failed writing ARP data\n";
+    for (size_t i = 0; i < pending._count; ++i) {
+        Trace::packet(Trace::Event::DROP, static_cast<uint32_t>(Verdict::Reason::ARP_UNRESOLVED), PRO_IPV4);
     }
 
-    while (idx < Ethernet::MIN_FRAME_SIZE - sizeof(CRC32)) {
-        Memory::write(static_cast<char>(0), buffer->buf, idx, bufferLength);
+    release(pending);
+}
+
+void ARP::CacheManager::release(Pending& pending)
+{
+    if (_timers != nullptr) {
+        _timers->cancel(pending._timer);
     }
 
-    CRC32 newCRC = htonl(Ethernet::calcCRC(oldCRC, buffer->buf, idx));
-    try {
-        Memory::write(newCRC, buffer->buf, idx, bufferLength);
-    } 
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::CacheManager::replyMessage: Failed writing ethernet frame check sequence\n";
+    // the buffers go back to the pool
+    for (size_t i = 0; i < pending._count; ++i) {
+        pending._frames[i] = Ethernet::Frame{};
     }
 
-    frame.setBufferSize(idx);
-    frame.parseBuffer();
-    frame.debugPrint();
-    return frame;
+    pending._count = 0;
+    pending._requests = 0;
+    pending._timer = 0;
 }
 
 void ARP::CacheManager::debugPrint(void)
 {
-    std::cout << "ARP cache entries:" << std::endl;
+    _cache.debugPrint();
+}
 
-    for (auto& pair : _cacheEntries) {
+ARP::Cache::Cache(size_t capacity, Event::Clock::time_point epoch)
+    : _maxSize{capacity}, _epoch{epoch}
+{
+    size_t slots = 16;
+    while (slots < 2 * capacity) {
+        slots <<= 1;
+    }
+
+    _entries.reset(new Entry[slots]);
+    _mask = slots - 1;
+}
+
+size_t ARP::Cache::home(IPAddr addr) const
+{
+    // hosts of one subnet differ in the low bits, the multiply spreads them over the table
+    return (static_cast<uint64_t>(addr) * 0x9e3779b97f4a7c15ULL >> 32) & _mask;
+}
 
-        Cache& entry = pair.second;
-        std::cout << "    hwtype: " << entry._hwType << " IP addr: " 
-            << entry._ipAddr << " MAC addr: " << entry._macAddr << std::endl;
+uint32_t ARP::Cache::stamp(Event::Clock::time_point now) const
+{
+    if (now <= _epoch) {
+        return 0;
     }
-    std::cout << std::endl;
+
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(now - _epoch).count());
 }
 
-size_t ARP::Header::readFromBuffer(char* buffer, size_t bufferLength)
+bool ARP::Cache::expired(const Entry& entry, uint32_t now) const
 {
-    _buffer = buffer;
+    constexpr uint32_t RESOLVED_MS = std::chrono::milliseconds{ENTRY_TIMEOUT}.count();
+    constexpr uint32_t NEGATIVE_MS = std::chrono::milliseconds{NEGATIVE_TIMEOUT}.count();
+
+    uint32_t age = now - entry._updated;
+    return age > ((entry._state == State::NEGATIVE) ? NEGATIVE_MS : RESOLVED_MS);
+}
+
+void ARP::Cache::erase(size_t index)
+{
+    size_t hole = index;
+
+    // backward shift, as in TCP::ConnectionTable::erase()
+    for (size_t i = (hole + 1) & _mask; _entries[i]._state != State::FREE; i = (i + 1) & _mask) {
+        size_t entryHome = home(_entries[i]._ipAddr);
+
+        bool between = (hole <= i) ? (hole < entryHome && entryHome <= i) : (hole < entryHome || entryHome <= i);
+        if (!between) {
+            _entries[hole] = _entries[i];
+            hole = i;
+        }
+    }
+
+    _entries[hole]._state = State::FREE;
+    --_size;
+}
+
+ARP::Entry* ARP::Cache::slot(IPAddr addr, uint32_t now)
+{
+    Entry *stalest = nullptr;
+    size_t probes = 0;
+
+    for (size_t i = home(addr); ; i = (i + 1) & _mask, ++probes) {
+        Entry& entry = _entries[i];
+
+        if (entry._state == State::FREE) {
+            if (_size < _maxSize) {
+                ++_size;
+                entry._ipAddr = addr;
+                return &entry;
+            }
+            break;
+        }
+
+        if (entry._ipAddr == addr) {
+            return &entry;
+        }
+
+        // an entry on the probe path can be replaced in place, later entries stay reachable
+        if (probes < EVICT_PROBES) {
+            bool staler = stalest == nullptr || (stalest->_state != State::NEGATIVE && 
+                    (entry._state == State::NEGATIVE || now - entry._updated > now - stalest->_updated));
+            if (staler) {
+                stalest = &entry;
+            }
+        }
+    }
+
+    if (stalest != nullptr) {
+        stalest->_ipAddr = addr;
+    }
+    return stalest;
+}
+
+ARP::Entry* ARP::Cache::find(IPAddr addr)
+{
+    for (size_t i = home(addr); _entries[i]._state != State::FREE; i = (i + 1) & _mask) {
+        if (_entries[i]._ipAddr == addr) {
+            return &_entries[i];
+        }
+    }
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_hwType, buffer, idx, bufferLength); 
-        Memory::consume(_proType, buffer, idx, bufferLength); 
-        Memory::consume(_hwSize, buffer, idx, bufferLength); 
-        Memory::consume(_proSize, buffer, idx, bufferLength); 
-        Memory::consume(_opCode, buffer, idx, bufferLength); 
+    return nullptr;
+}
+
+const ARP::Entry* ARP::Cache::lookup(IPAddr addr, Event::Clock::time_point now)
+{
+    Entry *entry = find(addr);
+    if (entry != nullptr && expired(*entry, stamp(now))) {
+        erase(entry - _entries.get());
+        return nullptr;
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::Header::readFromBuffer: Failed reading ARP header\n";
+
+    return entry;
+}
+
+void ARP::Cache::update(IPAddr addr, const MacAddr& macAddr, Event::Clock::time_point now)
+{
+    uint32_t time = stamp(now);
+
+    Entry *entry = slot(addr, time);
+    if (entry != nullptr) {
+        entry->_macAddr = macAddr;
+        entry->_state = State::RESOLVED;
+        entry->_updated = time;
     }
+}
 
-    _payloadSize = bufferLength - idx;
-    try {
-        Memory::consumePointer(_payload, buffer, idx, bufferLength, _payloadSize); 
+void ARP::Cache::markUnresolved(IPAddr addr, Event::Clock::time_point now)
+{
+    uint32_t time = stamp(now);
+
+    Entry *entry = find(addr);
+    if (entry != nullptr && entry->_state == State::RESOLVED && !expired(*entry, time)) {
+        return;
+    }
+
+    entry = slot(addr, time);
+    if (entry == nullptr) {
+        return;
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::Header::readFromBuffer: Failed reading ARP payload\n";
+
+    entry->_macAddr = MacAddr{};
+    entry->_state = State::NEGATIVE;
+    entry->_updated = time;
+}
+
+size_t ARP::Cache::sweep(Event::Clock::time_point now)
+{
+    uint32_t time = stamp(now);
+    size_t erased = 0;
+
+    // erase() pulls the next entry of the cluster into i, so i is looked at again
+    for (size_t i = 0; i <= _mask; ) {
+        if (_entries[i]._state != State::FREE && expired(_entries[i], time)) {
+            erase(i);
+            ++erased;
+        } else {
+            ++i;
+        }
     }
 
-    return _payloadSize;
+    return erased;
+}
+
+void ARP::Cache::debugPrint(void)
+{
+    std::cout << "ARP cache entries: " << _size << std::endl;
+
+    for (size_t i = 0; i <= _mask; ++i) {
+        Entry& entry = _entries[i];
+        if (entry._state == State::FREE) {
+            continue;
+        }
+
+        std::cout << "    IP addr: " << entry._ipAddr << " MAC addr: " << entry._macAddr 
+            << ((entry._state == State::NEGATIVE) ? " negative" : "") << " updated: " << entry._updated << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+bool ARP::Header::readFromBuffer(char* buffer, size_t bufferLength)
+{
+    _buffer = buffer;
+
+    if (!HeaderLayout::read(buffer, bufferLength, _hwType, _proType, _hwSize, _proSize, _opCode)) {
+        return false;
+    }
+
+    _payloadSize = bufferLength - HeaderLayout::SIZE;
+    _payload = buffer + HeaderLayout::SIZE;
+
+    return true;
 }
 
 void ARP::Header::debugPrint(void)
@@ -160,20 +456,11 @@ void ARP::Header::debugPrint(void)
     std::cout << std::setfill (' ') << std::setw(0) << std::dec << "\n" << std::endl;
 }
 
-void ARP::PayloadIPv4::readFromBuffer(char *buffer, size_t bufferLength)
+bool ARP::PayloadIPv4::readFromBuffer(char *buffer, size_t bufferLength)
 {
     _buffer = buffer;
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_srcMac, buffer, idx, bufferLength); 
-        Memory::consume(_srcIP, buffer, idx, bufferLength); 
-        Memory::consume(_dstMac, buffer, idx, bufferLength); 
-        Memory::consume(_dstIP, buffer, idx, bufferLength); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "arp.cpp: ARP::PayloadIPv4::readFromBuffer: Failed reading ARP IPv4 Payload\n";
-    }
+    return PayloadIPv4Layout::read(buffer, bufferLength, _srcMac, _srcIP, _dstMac, _dstIP);
 }
 
 void ARP::PayloadIPv4::debugPrint(void)
@@ -183,7 +470,7 @@ void ARP::PayloadIPv4::debugPrint(void)
 
     std::cout << "            Raw Packet:\n";
     std::cout << "            ";
-    for (size_t i = 0; i < sizeof(uint8_t) * 12 + sizeof(IPAddr) * 2; ++i) {
+    for (size_t i = 0; i < PayloadIPv4Layout::SIZE; ++i) {
         std::cout << std::setfill('0') << std::setw(2) << std::hex;
         std::cout << +(uint8_t)(_buffer[i]) << " "; 
     }
@@ -0,0 +1,206 @@
+#include <cstring>
+
+#include <arpa/inet.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define INET_HAVE_AVX2 1
+#endif
+
+#include "checksum.hpp"
+
+static constexpr size_t TTL_OFFSET      = 8;
+static constexpr size_t CHECKSUM_OFFSET = 10;
+
+/* add with end-around carry, the 64 bit accumulator only wraps when it is full */
+static inline Inet::Sum addCarry(Inet::Sum sum, Inet::Sum value)
+{
+    sum += value;
+    return sum + (sum < value);
+}
+
+Inet::Sum Inet::partialScalar(const void *buffer, size_t length, Sum sum)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(buffer);
+
+    while (length >= 32) {
+        uint64_t words[4];
+        std::memcpy(words, data, sizeof(words));
+
+        sum = addCarry(sum, words[0]);
+        sum = addCarry(sum, words[1]);
+        sum = addCarry(sum, words[2]);
+        sum = addCarry(sum, words[3]);
+
+        data += 32;
+        length -= 32;
+    }
+
+    while (length >= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        sum = addCarry(sum, word);
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length >= 2) {
+        uint16_t word;
+        std::memcpy(&word, data, sizeof(word));
+        sum = addCarry(sum, word);
+
+        data += 2;
+        length -= 2;
+    }
+
+    if (length > 0) {
+        // the odd byte is the high half of a network order word padded with zero.
+        unsigned char last[2] = { *data, 0 };
+        uint16_t word;
+        std::memcpy(&word, last, sizeof(word));
+        sum = addCarry(sum, word);
+    }
+
+    return sum;
+}
+
+#ifdef INET_HAVE_AVX2
+
+__attribute__((target("avx2")))
+Inet::Sum Inet::partialAvx2(const void *buffer, size_t length, Sum sum)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(buffer);
+
+    // 32 bit words are widened into 64 bit lanes, so the lanes can't overflow for any
+    // buffer shorter than 16 GiB.
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+
+    while (length >= 64) {
+        __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + 32));
+
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+
+        data += 64;
+        length -= 64;
+    }
+
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(acc0, acc1));
+
+    for (uint64_t lane : lanes) {
+        sum = addCarry(sum, lane);
+    }
+
+    return partialScalar(data, length, sum);
+}
+
+#else
+
+Inet::Sum Inet::partialAvx2(const void *buffer, size_t length, Sum sum)
+{
+    return partialScalar(buffer, length, sum);
+}
+
+#endif
+
+bool Inet::hasAvx2(void)
+{
+#ifdef INET_HAVE_AVX2
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+using Implementation = Inet::Sum (*)(const void*, size_t, Inet::Sum);
+
+static const Implementation implementation = Inet::hasAvx2() ? Inet::partialAvx2 : Inet::partialScalar;
+
+Inet::Sum Inet::partial(const void *buffer, size_t length, Sum sum)
+{
+    return implementation(buffer, length, sum);
+}
+
+uint16_t Inet::fold(Sum sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    return static_cast<uint16_t>(sum);
+}
+
+Inet::Sum Inet::pseudoHeader(IPAddr src, IPAddr dst, uint8_t protocol, uint16_t length)
+{
+    Sum sum = htonl(src);
+    sum += htonl(dst);
+    sum += htons(protocol);
+    sum += htons(length);
+
+    return sum;
+}
+
+uint16_t Inet::update16(uint16_t checksum, uint16_t oldWord, uint16_t newWord)
+{
+    uint32_t sum = static_cast<uint16_t>(~checksum) + static_cast<uint16_t>(~oldWord) + newWord;
+
+    return ~fold(sum);
+}
+
+uint16_t Inet::update32(uint16_t checksum, uint32_t oldWord, uint32_t newWord)
+{
+    Sum sum = static_cast<uint16_t>(~checksum);
+    sum += (~oldWord & 0xffff) + (~oldWord >> 16);
+    sum += (newWord & 0xffff) + (newWord >> 16);
+
+    return ~fold(sum);
+}
+
+void Inet::patch16(void *field, uint16_t newWord, void *checksum)
+{
+    uint16_t oldWord;
+    uint16_t oldChecksum;
+    std::memcpy(&oldWord, field, sizeof(oldWord));
+    std::memcpy(&oldChecksum, checksum, sizeof(oldChecksum));
+
+    uint16_t newChecksum = update16(oldChecksum, oldWord, newWord);
+    std::memcpy(field, &newWord, sizeof(newWord));
+    std::memcpy(checksum, &newChecksum, sizeof(newChecksum));
+}
+
+void Inet::patch32(void *field, uint32_t newWord, void *checksum)
+{
+    uint32_t oldWord;
+    uint16_t oldChecksum;
+    std::memcpy(&oldWord, field, sizeof(oldWord));
+    std::memcpy(&oldChecksum, checksum, sizeof(oldChecksum));
+
+    uint16_t newChecksum = update32(oldChecksum, oldWord, newWord);
+    std::memcpy(field, &newWord, sizeof(newWord));
+    std::memcpy(checksum, &newChecksum, sizeof(newChecksum));
+}
+
+bool Inet::decrementTTL(void *ipHeader)
+{
+    unsigned char *header = static_cast<unsigned char*>(ipHeader);
+
+    // an expired datagram is left alone rather than wrapped to 255
+    unsigned ttl = header[TTL_OFFSET];
+    if (ttl == 0) {
+        return false;
+    }
+
+    // TTL is the high byte of the TTL/protocol word.
+    uint16_t word = htons(static_cast<uint16_t>((ttl - 1u) << 8 | header[TTL_OFFSET + 1]));
+    patch16(header + TTL_OFFSET, word, header + CHECKSUM_OFFSET);
+    return true;
+}
@@ -0,0 +1,234 @@
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CRC_HAVE_PCLMUL 1
+#endif
+
+#include "crc32.hpp"
+
+static constexpr uint32_t POLYNOMIAL = 0xedb88320;
+
+using Table = std::array<std::array<uint32_t, 256>, 8>;
+
+static constexpr Table makeTables(void)
+{
+    Table tables{};
+
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (unsigned k = 0; k < 8; ++k) {
+            crc = crc & 1 ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+        }
+        tables[0][i] = crc;
+    }
+
+    // tables[n][i] is the CRC of byte i followed by n zero bytes.
+    for (uint32_t i = 0; i < 256; ++i) {
+        for (size_t n = 1; n < 8; ++n) {
+            uint32_t prev = tables[n - 1][i];
+            tables[n][i] = (prev >> 8) ^ tables[0][prev & 0xff];
+        }
+    }
+
+    return tables;
+}
+
+static constexpr Table tables = makeTables();
+
+/* the raw functions work on the inverted CRC register */
+
+static uint32_t slicing8Raw(uint32_t crc, const unsigned char *data, size_t length)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (length >= 8) {
+        uint32_t low;
+        uint32_t high;
+        std::memcpy(&low, data, sizeof(low));
+        std::memcpy(&high, data + 4, sizeof(high));
+        low ^= crc;
+
+        crc = tables[7][low & 0xff] ^ tables[6][(low >> 8) & 0xff] ^
+              tables[5][(low >> 16) & 0xff] ^ tables[4][low >> 24] ^
+              tables[3][high & 0xff] ^ tables[2][(high >> 8) & 0xff] ^
+              tables[1][(high >> 16) & 0xff] ^ tables[0][high >> 24];
+
+        data += 8;
+        length -= 8;
+    }
+#endif
+
+    while (length--) {
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xff];
+    }
+
+    return crc;
+}
+
+#ifdef CRC_HAVE_PCLMUL
+
+static constexpr size_t PCLMUL_MIN_LENGTH = 64;
+
+/*
+ * Folding by 4 x 128 bits, then Barrett reduction, from Intel's "Fast CRC Computation for
+ * Generic Polynomials Using PCLMULQDQ Instruction". Needs length >= 64 and a multiple of 16.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t pclmulRaw(uint32_t crc, const unsigned char *data, size_t length)
+{
+    alignas(16) static constexpr uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static constexpr uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static constexpr uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static constexpr uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+    data += 64;
+    length -= 64;
+
+    // fold 4 lanes in parallel.
+    while (length >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        length -= 64;
+    }
+
+    // fold the 4 lanes into one.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // fold the remaining 16 byte blocks.
+    while (length >= 16) {
+        x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 bits to 64 bits.
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits.
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+
+#endif
+
+CRC32 CRC::bitwise(CRC32 crc, const void *buffer, size_t bufferLength)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(buffer);
+    crc ^= 0xffffffff;
+    while (bufferLength--) {
+        crc ^= *data++;
+        for (unsigned k = 0; k < 8; ++k) {
+            crc = crc & 1 ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+        }
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+CRC32 CRC::slicing8(CRC32 crc, const void *buffer, size_t bufferLength)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(buffer);
+
+    return slicing8Raw(crc ^ 0xffffffff, data, bufferLength) ^ 0xffffffff;
+}
+
+CRC32 CRC::pclmul(CRC32 crc, const void *buffer, size_t bufferLength)
+{
+    const unsigned char *data = static_cast<const unsigned char*>(buffer);
+    crc ^= 0xffffffff;
+
+#ifdef CRC_HAVE_PCLMUL
+    if (bufferLength >= PCLMUL_MIN_LENGTH) {
+        size_t chunk = bufferLength & ~static_cast<size_t>(15);
+        crc = pclmulRaw(crc, data, chunk);
+
+        data += chunk;
+        bufferLength -= chunk;
+    }
+#endif
+
+    return slicing8Raw(crc, data, bufferLength) ^ 0xffffffff;
+}
+
+bool CRC::hasPclmul(void)
+{
+#ifdef CRC_HAVE_PCLMUL
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+}
+
+using Implementation = CRC32 (*)(CRC32, const void*, size_t);
+
+static const Implementation implementation = CRC::hasPclmul() ? CRC::pclmul : CRC::slicing8;
+
+CRC32 CRC::compute(CRC32 crc, const void *buffer, size_t bufferLength)
+{
+    return implementation(crc, buffer, bufferLength);
+}
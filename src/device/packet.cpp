@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+
+#include "packet.hpp"
+#include "tun.hpp"
+
+static_assert(PacketDevice::BLOCK_SIZE % PacketDevice::FRAME_SIZE == 0, "frames tile the blocks");
+static_assert(PacketDevice::TX_FRAMES * PacketDevice::FRAME_SIZE % PacketDevice::BLOCK_SIZE == 0,
+              "the TX ring is whole blocks");
+
+PacketDevice::PacketDevice(std::string_view interface, size_t headroom)
+    : _name{interface}
+{
+    _fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "packet.cpp: PacketDevice(): could not open socket");
+    }
+
+    auto fail = [this](const char* what) {
+        int error = errno;
+        if (_ring != nullptr) {
+            munmap(_ring, _ringSize);
+        }
+        close(_fd);
+        throw std::system_error(error, std::generic_category(), std::string{"packet.cpp: PacketDevice(): "} + what);
+    };
+
+    unsigned index = if_nametoindex(_name.c_str());
+    if (index == 0) {
+        fail("no such interface");
+    }
+
+    int version = TPACKET_V3;
+    int reserve = static_cast<int>(headroom);
+    int one = 1;
+    // a malformed TX frame is dropped (PACKET_LOSS) rather than left in its slot for good
+    if (setsockopt(_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 ||
+        setsockopt(_fd, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof(reserve)) < 0 ||
+        setsockopt(_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one)) < 0 ||
+        setsockopt(_fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one)) < 0 ||
+        setsockopt(_fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one)) < 0) {
+        fail("could not set up socket");
+    }
+
+    tpacket_req3 rx{};
+    rx.tp_block_size = BLOCK_SIZE;
+    rx.tp_block_nr = RX_BLOCKS;
+    rx.tp_frame_size = FRAME_SIZE;
+    rx.tp_frame_nr = BLOCK_SIZE / FRAME_SIZE * RX_BLOCKS;
+    rx.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+
+    tpacket_req3 tx{};
+    tx.tp_block_size = BLOCK_SIZE;
+    tx.tp_block_nr = TX_FRAMES * FRAME_SIZE / BLOCK_SIZE;
+    tx.tp_frame_size = FRAME_SIZE;
+    tx.tp_frame_nr = TX_FRAMES;
+
+    if (setsockopt(_fd, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) < 0 ||
+        setsockopt(_fd, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) < 0) {
+        fail("could not set up rings");
+    }
+
+    // one mapping, the RX ring first
+    size_t size = RX_BLOCKS * BLOCK_SIZE + TX_FRAMES * FRAME_SIZE;
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, 0);
+    if (ring == MAP_FAILED) {
+        fail("could not map rings");
+    }
+    _ring = static_cast<char*>(ring);
+    _ringSize = size;
+
+    sockaddr_ll addr{};
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = static_cast<int>(index);
+    if (bind(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        fail("could not bind socket");
+    }
+
+    struct ifreq ifr{};
+    _name.copy(ifr.ifr_name, IFNAMSIZ - 1, 0);
+    if (ioctl(_fd, SIOCGIFHWADDR, &ifr) < 0) {
+        fail("could not get hardware address");
+    }
+    for (int i = 0; i < 6; ++i) {
+        _addr.addr[i] = static_cast<uint8_t>(ifr.ifr_addr.sa_data[i]);
+    }
+    setDevMacAddr(_addr);
+}
+
+PacketDevice::~PacketDevice()
+{
+    munmap(_ring, _ringSize);
+    close(_fd);
+}
+
+bool PacketDevice::receive(Received& frame)
+{
+    while (_rxLeft == 0) {
+        if (_rxReading) {
+            _rxReading = false;
+            _rxBlock = (_rxBlock + 1) % RX_BLOCKS;
+            ++_rxHeld;
+        }
+
+        // every block is held by the burst, the next one is one of them
+        if (_rxHeld == RX_BLOCKS) {
+            return false;
+        }
+
+        tpacket_block_desc* desc = block(_rxBlock);
+        if ((__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0) {
+            return false;
+        }
+
+        _rxReading = true;
+        _rxLeft = desc->hdr.bh1.num_pkts;
+        _rxFrame = reinterpret_cast<tpacket3_hdr*>(reinterpret_cast<char*>(desc) + desc->hdr.bh1.offset_to_first_pkt);
+    }
+
+    // the frame may grow up to the next one, or the end of the block, but not past a slot: a
+    // copy taken by own() is as big as the room it had
+    tpacket3_hdr* header = _rxFrame;
+    char* start = reinterpret_cast<char*>(header);
+    char* end = header->tp_next_offset != 0 ? start + header->tp_next_offset
+                                            : reinterpret_cast<char*>(block(_rxBlock)) + BLOCK_SIZE;
+    char* limit = std::max(start + FRAME_SIZE, start + header->tp_mac + header->tp_snaplen);
+
+    frame._base = start + TPACKET3_HDRLEN;
+    frame._capacity = static_cast<size_t>(std::min(end, limit) - frame._base);
+    frame._headroom = header->tp_mac - TPACKET3_HDRLEN;
+    frame._length = header->tp_snaplen;
+    frame._status = header->tp_status;
+
+    _rxFrame = reinterpret_cast<tpacket3_hdr*>(end);
+    --_rxLeft;
+    return true;
+}
+
+void PacketDevice::release(void)
+{
+    for (size_t i = 1; i <= _rxHeld; ++i) {
+        tpacket_block_desc* desc = block((_rxBlock + RX_BLOCKS - i) % RX_BLOCKS);
+        __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    }
+    _rxHeld = 0;
+}
+
+char* PacketDevice::txSlot(void)
+{
+    tpacket3_hdr* header = slot(_txFrame);
+    if (__atomic_load_n(&header->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+        return nullptr;
+    }
+    return reinterpret_cast<char*>(header) + TX_DATA_OFFSET;
+}
+
+void PacketDevice::commit(size_t length)
+{
+    tpacket3_hdr* header = slot(_txFrame);
+    header->tp_len = static_cast<uint32_t>(length);
+    header->tp_snaplen = static_cast<uint32_t>(length);
+    header->tp_next_offset = 0;
+    __atomic_store_n(&header->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    _txFrame = (_txFrame + 1) % TX_FRAMES;
+}
+
+int PacketDevice::send(void)
+{
+    return static_cast<int>(::send(_fd, nullptr, 0, MSG_DONTWAIT));
+}
@@ -0,0 +1,363 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "pcap.hpp"
+
+static constexpr uint32_t PCAP_MAGIC       = 0xa1b2c3d4;    // microsecond timestamps
+static constexpr uint32_t PCAP_MAGIC_NS    = 0xa1b23c4d;
+static constexpr size_t   PCAP_HEADER_SIZE = 24;
+static constexpr size_t   PCAP_RECORD_SIZE = 16;
+
+static constexpr uint32_t BLOCK_SECTION    = 0x0a0d0d0a;    // the same in either byte order
+static constexpr uint32_t BLOCK_INTERFACE  = 1;
+static constexpr uint32_t BLOCK_SIMPLE     = 3;
+static constexpr uint32_t BLOCK_ENHANCED   = 6;
+static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+static constexpr uint16_t OPTION_END       = 0;
+static constexpr uint16_t OPTION_TSRESOL   = 9;
+static constexpr uint8_t  DEFAULT_TSRESOL  = 6;             // microseconds
+
+// the largest frame written to the output, a TCP segment the stack didn't cut up
+static constexpr uint32_t OUTPUT_SNAPLEN   = 65535 + 14;
+
+static constexpr uint64_t NS_PER_SECOND    = 1000000000;
+
+/* a timestamp of if_tsresol units in nanoseconds */
+static uint64_t toNanoseconds(uint64_t timestamp, uint8_t resolution)
+{
+    if (resolution & 0x80) {
+        unsigned shift = resolution & 0x7f;
+        if (shift >= 64) {
+            return 0;
+        }
+        uint64_t fraction = timestamp & ((uint64_t{1} << shift) - 1);
+        return (timestamp >> shift) * NS_PER_SECOND + static_cast<uint64_t>((static_cast<__uint128_t>(fraction) * NS_PER_SECOND) >> shift);
+    }
+
+    uint64_t scale = 1;
+    for (unsigned i = resolution; i < 9; ++i) {
+        scale *= 10;
+    }
+    for (unsigned i = 9; i < resolution; ++i) {
+        timestamp /= 10;
+    }
+    return timestamp * scale;
+}
+
+static size_t pad4(size_t length)
+{
+    return (length + 3) & ~size_t{3};
+}
+
+PcapDevice::PcapDevice(std::string_view input, std::string_view output, bool paced) : _paced{paced}
+{
+    std::string path{input};
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "pcap.cpp: PcapDevice(): could not open " + path);
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) < 0 || status.st_size < static_cast<off_t>(PCAP_HEADER_SIZE)) {
+        close(fd);
+        throw std::runtime_error("pcap.cpp: PcapDevice(): " + path + " is too short for a capture");
+    }
+
+    // the mapping outlives the fd
+    _fileSize = static_cast<size_t>(status.st_size);
+    void *file = mmap(nullptr, _fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    close(fd);
+    if (file == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), "pcap.cpp: PcapDevice(): could not map " + path);
+    }
+    _file = static_cast<const char*>(file);
+    madvise(file, _fileSize, MADV_SEQUENTIAL);
+
+    uint32_t magic;
+    std::memcpy(&magic, _file, sizeof(magic));
+    if (magic == BLOCK_SECTION) {
+        _ng = true;
+        _start = 0;
+        if (!section()) {
+            munmap(file, _fileSize);
+            throw std::runtime_error("pcap.cpp: PcapDevice(): " + path + " has a malformed section header");
+        }
+    } else if (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NS ||
+               __builtin_bswap32(magic) == PCAP_MAGIC || __builtin_bswap32(magic) == PCAP_MAGIC_NS) {
+        _swapped = magic != PCAP_MAGIC && magic != PCAP_MAGIC_NS;
+        _nanoseconds = magic == PCAP_MAGIC_NS || __builtin_bswap32(magic) == PCAP_MAGIC_NS;
+        _start = PCAP_HEADER_SIZE;
+        // the upper bits of the link type may describe the FCS
+        if ((load32(_file + 20) & 0xffff) != LINKTYPE_ETHERNET) {
+            munmap(file, _fileSize);
+            throw std::runtime_error("pcap.cpp: PcapDevice(): " + path + " isn't an ethernet capture");
+        }
+    } else {
+        munmap(file, _fileSize);
+        throw std::runtime_error("pcap.cpp: PcapDevice(): " + path + " is neither pcap nor pcapng");
+    }
+    rewind();
+
+    if (!output.empty()) {
+        _output.open(std::string{output}, std::ios::binary | std::ios::trunc);
+
+        // a nanosecond pcap in our byte order
+        uint32_t header[6] = {PCAP_MAGIC_NS, 2 | 4 << 16, 0, 0, OUTPUT_SNAPLEN, LINKTYPE_ETHERNET};
+        if (!_output.write(reinterpret_cast<const char*>(header), sizeof(header))) {
+            munmap(file, _fileSize);
+            throw std::runtime_error("pcap.cpp: PcapDevice(): could not write " + std::string{output});
+        }
+    }
+
+    _timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (_timerFd < 0) {
+        error = errno;
+        munmap(file, _fileSize);
+        throw std::system_error(error, std::generic_category(), "pcap.cpp: PcapDevice(): could not create timer");
+    }
+}
+
+PcapDevice::~PcapDevice()
+{
+    munmap(const_cast<char*>(_file), _fileSize);
+    close(_timerFd);
+}
+
+uint16_t PcapDevice::load16(const char *src) const
+{
+    uint16_t value;
+    std::memcpy(&value, src, sizeof(value));
+    return _swapped ? __builtin_bswap16(value) : value;
+}
+
+uint32_t PcapDevice::load32(const char *src) const
+{
+    uint32_t value;
+    std::memcpy(&value, src, sizeof(value));
+    return _swapped ? __builtin_bswap32(value) : value;
+}
+
+bool PcapDevice::section(void)
+{
+    constexpr size_t MIN_SIZE = 28;
+
+    if (_fileSize - _offset < MIN_SIZE) {
+        return false;
+    }
+
+    // every section sets its own byte order and interfaces
+    const char *block = _file + _offset;
+    uint32_t magic;
+    std::memcpy(&magic, block + 8, sizeof(magic));
+    if (magic != BYTE_ORDER_MAGIC && __builtin_bswap32(magic) != BYTE_ORDER_MAGIC) {
+        return false;
+    }
+    _swapped = magic != BYTE_ORDER_MAGIC;
+    _interfaces.clear();
+
+    uint32_t length = load32(block + 4);
+    if (length < MIN_SIZE || length % 4 != 0 || length > _fileSize - _offset) {
+        return false;
+    }
+
+    _offset += length;
+    return true;
+}
+
+bool PcapDevice::readPcap(Record& record)
+{
+    if (_fileSize - _offset < PCAP_RECORD_SIZE) {
+        return false;
+    }
+
+    const char *header = _file + _offset;
+    uint64_t seconds = load32(header);
+    uint64_t fraction = load32(header + 4);
+    uint32_t captured = load32(header + 8);
+
+    // a record cut short by the end of the file ends it
+    size_t data = _offset + PCAP_RECORD_SIZE;
+    if (captured > _fileSize - data) {
+        _offset = _fileSize;
+        return false;
+    }
+    _offset = data + captured;
+
+    record._data = _file + data;
+    record._length = captured;
+    record._timestamp = seconds * NS_PER_SECOND + (_nanoseconds ? fraction : fraction * 1000);
+    return true;
+}
+
+bool PcapDevice::readPcapng(Record& record)
+{
+    constexpr size_t MIN_SIZE = 12;
+
+    while (_fileSize - _offset >= MIN_SIZE) {
+        const char *block = _file + _offset;
+        uint32_t type = load32(block);
+        if (type == BLOCK_SECTION) {
+            if (!section()) {
+                _offset = _fileSize;
+                return false;
+            }
+            continue;
+        }
+
+        uint32_t length = load32(block + 4);
+        if (length < MIN_SIZE || length % 4 != 0 || length > _fileSize - _offset) {
+            _offset = _fileSize;
+            return false;
+        }
+        _offset += length;
+
+        // the options end with the block, before its trailing length
+        const char *end = block + length - 4;
+        if (type == BLOCK_INTERFACE && length >= 20) {
+            Interface interface{load16(block + 8), load32(block + 12), DEFAULT_TSRESOL};
+            for (const char *option = block + 16; end - option >= 4;) {
+                uint16_t code = load16(option);
+                uint16_t size = load16(option + 2);
+                if (code == OPTION_END || static_cast<size_t>(end - option - 4) < size) {
+                    break;
+                }
+                if (code == OPTION_TSRESOL && size >= 1) {
+                    interface._resolution = static_cast<uint8_t>(option[4]);
+                }
+                option += 4 + pad4(size);
+            }
+            _interfaces.push_back(interface);
+
+        } else if (type == BLOCK_ENHANCED && length >= 32) {
+            uint32_t id = load32(block + 8);
+            uint32_t captured = load32(block + 20);
+            if (id >= _interfaces.size() || _interfaces[id]._linkType != LINKTYPE_ETHERNET || captured > length - 32) {
+                continue;
+            }
+
+            uint64_t timestamp = static_cast<uint64_t>(load32(block + 12)) << 32 | load32(block + 16);
+            record._data = block + 28;
+            record._length = captured;
+            record._timestamp = toNanoseconds(timestamp, _interfaces[id]._resolution);
+            return true;
+
+        } else if (type == BLOCK_SIMPLE && length >= 16) {
+            if (_interfaces.empty() || _interfaces[0]._linkType != LINKTYPE_ETHERNET) {
+                continue;
+            }
+
+            // without a timestamp of its own the frame goes with the one before it
+            size_t captured = std::min<size_t>(load32(block + 8), length - 16);
+            if (_interfaces[0]._snapLength != 0) {
+                captured = std::min<size_t>(captured, _interfaces[0]._snapLength);
+            }
+            record._data = block + 12;
+            record._length = captured;
+            record._timestamp = _last;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PcapDevice::read(Record& record)
+{
+    if (!(_ng ? readPcapng(record) : readPcap(record))) {
+        return false;
+    }
+
+    _last = record._timestamp;
+    return true;
+}
+
+void PcapDevice::rewind(void)
+{
+    _offset = _start;
+    _interfaces.clear();
+    _started = false;
+    _pending = false;
+    _last = 0;
+    _now = 0;
+}
+
+bool PcapDevice::due(Record& record)
+{
+    if (!_pending && !(_pending = read(_next))) {
+        return false;
+    }
+
+    // the replay starts with the first frame, a frame recorded out of order is due at once
+    if (!_started) {
+        _started = true;
+        _first = _next._timestamp;
+        clock_gettime(CLOCK_MONOTONIC, &_epoch);
+    } else if (_paced && _next._timestamp > _first) {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t elapsed = static_cast<int64_t>(now.tv_sec - _epoch.tv_sec) * static_cast<int64_t>(NS_PER_SECOND) 
+                          + (now.tv_nsec - _epoch.tv_nsec);
+        if (_next._timestamp - _first > static_cast<uint64_t>(elapsed)) {
+            return false;
+        }
+    }
+
+    record = _next;
+    return true;
+}
+
+bool PcapDevice::done(void)
+{
+    if (!_pending) {
+        _pending = read(_next);
+    }
+    return !_pending;
+}
+
+void PcapDevice::arm(void)
+{
+    // an expiry in the past fires at once, a zero one disarms
+    itimerspec timer{};
+    int flags = 0;
+    if (!done()) {
+        if (!_paced || !_started || _next._timestamp <= _first) {
+            timer.it_value.tv_nsec = 1;
+        } else {
+            uint64_t due = static_cast<uint64_t>(_epoch.tv_nsec) + (_next._timestamp - _first);
+            timer.it_value.tv_sec = _epoch.tv_sec + static_cast<time_t>(due / NS_PER_SECOND);
+            timer.it_value.tv_nsec = static_cast<long>(due % NS_PER_SECOND);
+            flags = TFD_TIMER_ABSTIME;
+        }
+    }
+
+    // setting the timer also clears its expirations, it is never read
+    timerfd_settime(_timerFd, flags, &timer, nullptr);
+}
+
+void PcapDevice::write(const char *headers, size_t headerLength, const char *payload, size_t payloadSize)
+{
+    if (!_output.is_open()) {
+        return;
+    }
+
+    uint32_t length = static_cast<uint32_t>(headerLength + payloadSize);
+    uint32_t header[4] = {
+        static_cast<uint32_t>(_now / NS_PER_SECOND), static_cast<uint32_t>(_now % NS_PER_SECOND), length, length,
+    };
+    _output.write(reinterpret_cast<const char*>(header), sizeof(header));
+    _output.write(headers, static_cast<std::streamsize>(headerLength));
+    if (payloadSize > 0) {
+        _output.write(payload, static_cast<std::streamsize>(payloadSize));
+    }
+}
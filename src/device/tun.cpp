@@ -19,6 +19,11 @@ MacAddr getDevMacAddr(void)
     return deviceMacAddr;
 }
 
+void setDevMacAddr(MacAddr addr)
+{
+    deviceMacAddr = addr;
+}
+
 MacAddr TunDevice::getMacAddr(void)
 {
     MacAddr ret{};
@@ -34,7 +39,7 @@ MacAddr TunDevice::getMacAddr(void)
     return ret;
 }
 
-TunDevice::TunDevice(const std::optional<std::string_view> dev)
+TunDevice::TunDevice(const std::optional<std::string_view> dev, bool multiQueue, bool offload)
 {
     _fd = open(TAP_PATH, O_RDWR);
 
@@ -44,6 +49,12 @@ TunDevice::TunDevice(const std::optional<std::string_view> dev)
 
     struct ifreq ifr{};
     ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    if (multiQueue) {
+        ifr.ifr_flags |= IFF_MULTI_QUEUE;
+    }
+    if (offload) {
+        ifr.ifr_flags |= IFF_VNET_HDR;
+    }
     if (dev.has_value()) {
         dev.value().copy(ifr.ifr_name, IFNAMSIZ, 0);
     }
@@ -56,10 +67,37 @@ TunDevice::TunDevice(const std::optional<std::string_view> dev)
         throw std::system_error(std::error_code(), "tun.cpp: TunDevice(): could not ioctl TUN/TAP device");
     }
 
+    // the header is the legacy virtio_net_hdr, and we take checksums to finish and TCPv4 segments
+    if (offload) {
+        int headerSize = sizeof(VnetHeader);
+        if (ioctl(_fd, TUNSETVNETHDRSZ, &headerSize) < 0 || ioctl(_fd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4) < 0) {
+            int error = errno;
+            close(_fd);
+            throw std::system_error(error, std::generic_category(), "tun.cpp: TunDevice(): could not enable offloads");
+        }
+        _vnetHeader = true;
+    }
+
     _name = ifr.ifr_name;
     _addr = getMacAddr();
 }
 
+std::vector<TunDevice> TunDevice::openQueues(const std::optional<std::string_view> dev, size_t count, bool offload)
+{
+    std::vector<TunDevice> queues;
+    queues.reserve(count);
+
+    // the first queue resolves the name (e.g. "tun%d"), the others attach to it.
+    queues.emplace_back(dev, true, offload);
+
+    std::string name = queues.front().name();
+    for (size_t i = 1; i < count; ++i) {
+        queues.emplace_back(std::string_view{name}, true, offload);
+    }
+
+    return queues;
+}
+
 TunDevice::~TunDevice() 
 {
     if (_fd != -1) {
@@ -71,19 +109,34 @@ TunDevice::TunDevice(TunDevice&& other)
 {
     _fd = other._fd;
     _name = std::move(other._name);
+    _addr = other._addr;
+    _vnetHeader = other._vnetHeader;
     other._fd = -1;
 }
 
 TunDevice& TunDevice::operator=(TunDevice&& other)
 {
-    close(_fd);
+    if (_fd != -1) {
+        close(_fd);
+    }
 
     _fd = other._fd;
     _name = std::move(other._name);
+    _addr = other._addr;
+    _vnetHeader = other._vnetHeader;
     other._fd = -1;
     return *this;
 }
 
+void TunDevice::setNonBlocking(void)
+{
+    int flags = fcntl(_fd, F_GETFL, 0);
+
+    if (flags < 0 || fcntl(_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::system_error(errno, std::generic_category(), "tun.cpp: TunDevice::setNonBlocking(): could not set O_NONBLOCK");
+    }
+}
+
 int TunDevice::readBuf(char* buf, size_t count)
 {
     return read(_fd, buf, count);
@@ -93,3 +146,8 @@ int TunDevice::writeBuf(char* buf, size_t count)
 {
     return write(_fd, buf, count);
 }
+
+int TunDevice::writeVec(const struct iovec* iov, int count)
+{
+    return writev(_fd, iov, count);
+}
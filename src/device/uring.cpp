@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "uring.hpp"
+
+// IORING_OP_READ_MULTISHOT, Linux 6.7 is newer than <linux/io_uring.h> here
+static constexpr uint8_t OP_READ_MULTISHOT = 49;
+
+// how long the SQPOLL thread spins on an empty queue before it sleeps
+static constexpr unsigned SQ_THREAD_IDLE_MS = 50;
+
+static int uringSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uringEnter(int fd, unsigned submit, unsigned complete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, submit, complete, flags, nullptr, 0));
+}
+
+Uring::Uring(unsigned entries, unsigned cqEntries, bool sqPoll, int attach)
+    : _sqPoll{sqPoll}
+{
+    io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cqEntries;
+    if (sqPoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = SQ_THREAD_IDLE_MS;
+        if (attach >= 0) {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = static_cast<uint32_t>(attach);
+        }
+    }
+
+    _fd = uringSetup(entries, &params);
+    if (_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "uring.cpp: Uring(): io_uring_setup failed");
+    }
+
+    // since 5.4 both rings share one mapping
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+    _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    void *sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    _sqRing = (sqRing == MAP_FAILED) ? nullptr : sqRing;
+    void *cqRing = single ? sqRing : mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    _cqRing = (cqRing == MAP_FAILED) ? nullptr : cqRing;
+    void *sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    _sqes = (sqes == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe*>(sqes);
+
+    if (_sqRing == nullptr || _cqRing == nullptr || _sqes == nullptr) {
+        int error = errno;
+        unmap();
+        close(_fd);
+        throw std::system_error(error, std::generic_category(), "uring.cpp: Uring(): could not map the rings");
+    }
+
+    char *sq = static_cast<char*>(_sqRing);
+    _sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqFlags = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    _sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    _sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqEntries = params.sq_entries;
+    _sqLocalTail = *_sqTail;
+
+    char *cq = static_cast<char*>(_cqRing);
+    _cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    _cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+}
+
+Uring::~Uring()
+{
+    unmap();
+    if (_fd != -1) {
+        close(_fd);
+    }
+}
+
+void Uring::unmap(void)
+{
+    if (_sqes != nullptr) {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing != nullptr && _cqRing != _sqRing) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != nullptr) {
+        munmap(_sqRing, _sqRingSize);
+    }
+}
+
+io_uring_sqe* Uring::sqe(void)
+{
+    if (_sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) >= _sqEntries) {
+        return nullptr;
+    }
+
+    unsigned index = _sqLocalTail++ & _sqMask;
+    _sqArray[index] = index;
+
+    io_uring_sqe *sqe = &_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned Uring::submit(void)
+{
+    unsigned published = _sqLocalTail - *_sqTail;
+    __atomic_store_n(_sqTail, _sqLocalTail, __ATOMIC_RELEASE);
+
+    // the SQPOLL thread finds the entries by itself, unless it went to sleep
+    if (_sqPoll) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(_sqFlags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+            uringEnter(_fd, 0, 0, IORING_ENTER_SQ_WAKEUP);
+        }
+        return published;
+    }
+
+    // entries the kernel couldn't take last time go with these
+    unsigned pending = _sqLocalTail - __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+    if (pending > 0 && uringEnter(_fd, pending, 0, 0) < 0 && errno != EAGAIN && errno != EBUSY) {
+        throw std::system_error(errno, std::generic_category(), "uring.cpp: Uring::submit(): io_uring_enter failed");
+    }
+
+    return published;
+}
+
+bool Uring::peek(UringCompletion& completion)
+{
+    unsigned head = *_cqHead;
+    if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+
+    const io_uring_cqe& cqe = _cqes[head & _cqMask];
+    completion._result = cqe.res;
+    completion._flags = cqe.flags;
+    completion._data = cqe.user_data;
+    return true;
+}
+
+void Uring::advance(void)
+{
+    __atomic_store_n(_cqHead, *_cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool Uring::supports(uint8_t opcode)
+{
+    constexpr unsigned OPS = 256;
+
+    size_t size = sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op);
+    std::unique_ptr<char[]> memory{new char[size]()};
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe*>(memory.get());
+
+    if (enroll(IORING_REGISTER_PROBE, probe, OPS) < 0) {
+        return false;
+    }
+
+    return opcode < probe->ops_len && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+}
+
+int Uring::enroll(unsigned opcode, void* arg, unsigned count)
+{
+    int ret = static_cast<int>(syscall(__NR_io_uring_register, _fd, opcode, arg, count));
+    return (ret < 0) ? -errno : ret;
+}
+
+UringDevice::UringDevice(TunDevice&& tun, size_t frameSize, bool sqPoll)
+    : _tun{std::move(tun)},
+      _bufferRingSize{RX_BUFFERS * sizeof(io_uring_buf)},
+      _frameSize{frameSize},
+      _rx{SINGLE_READS, 2 * RX_BUFFERS, sqPoll},
+      _tx{TX_ENTRIES, 2 * TX_ENTRIES, sqPoll, _rx.fd()}
+{
+    for (Memory::PacketBuffer& buffer : _rxBuffers) {
+        buffer = Memory::PacketBuffer::allocate(frameSize);
+        if (!buffer) {
+            throw std::runtime_error("uring.cpp: UringDevice(): packet buffers exhausted");
+        }
+    }
+
+    // the ring is shared with the kernel and has to start on a page
+    void *ring = mmap(nullptr, _bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "uring.cpp: UringDevice(): could not map the buffer ring");
+    }
+    // under C++ the header's flexible array of entries starts 8 bytes in, they are indexed by hand
+    _bufferRing = static_cast<io_uring_buf*>(ring);
+    _bufferTail = &static_cast<io_uring_buf_ring*>(ring)->tail;
+
+    io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = RX_BUFFERS;
+    reg.bgid = BUFFER_GROUP;
+    int error = _rx.enroll(IORING_REGISTER_PBUF_RING, &reg, 1);
+    if (error < 0) {
+        munmap(ring, _bufferRingSize);
+        throw std::system_error(-error, std::generic_category(), "uring.cpp: UringDevice(): could not register the buffer ring");
+    }
+
+    for (uint16_t id = 0; id < RX_BUFFERS; ++id) {
+        provide(id);
+    }
+
+    // without the pool registered (RLIMIT_MEMLOCK) writes still work, they just pin every time
+    Memory::BuddyPool& pool = Memory::packetBufferPool();
+    struct iovec memory{pool.base(), pool.totalMemory()};
+    _fixed = _tx.enroll(IORING_REGISTER_BUFFERS, &memory, 1) == 0;
+
+    _multishot = _rx.supports(OP_READ_MULTISHOT);
+    arm();
+}
+
+UringDevice::~UringDevice()
+{
+    // the kernel keeps the ring's pages pinned until the RX ring is closed
+    if (_bufferRing != nullptr) {
+        munmap(_bufferRing, _bufferRingSize);
+    }
+}
+
+bool UringDevice::arm(void)
+{
+    unsigned reads = _multishot ? 1 : SINGLE_READS;
+    if (_reads >= reads) {
+        return true;
+    }
+
+    for (; _reads < reads; ++_reads) {
+        io_uring_sqe *sqe = _rx.sqe();
+        if (sqe == nullptr) {
+            break;
+        }
+
+        // the length comes from the buffer the kernel picks
+        sqe->opcode = _multishot ? OP_READ_MULTISHOT : static_cast<__u8>(IORING_OP_READ);
+        sqe->fd = _tun.fd();
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+    }
+    _rx.submit();
+
+    return _reads == reads;
+}
+
+bool UringDevice::peekRead(UringCompletion& completion, uint16_t& id)
+{
+    if (!_rx.peek(completion)) {
+        return false;
+    }
+
+    id = static_cast<uint16_t>(completion._flags >> IORING_CQE_BUFFER_SHIFT);
+    return true;
+}
+
+void UringDevice::nextRead(void)
+{
+    UringCompletion completion;
+    if (!_rx.peek(completion)) {
+        return;
+    }
+
+    // a read ends without IORING_CQE_F_MORE, e.g. a multishot one when the buffers ran out
+    if (!(completion._flags & IORING_CQE_F_MORE) && _reads > 0) {
+        --_reads;
+    }
+    _rx.advance();
+}
+
+void UringDevice::provide(uint16_t id)
+{
+    Memory::PacketBuffer& buffer = _rxBuffers[id];
+    buffer.reset();
+
+    uint16_t tail = *_bufferTail;
+    io_uring_buf& entry = _bufferRing[tail & (RX_BUFFERS - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(buffer.data());
+    entry.len = static_cast<uint32_t>(buffer.tailroom());
+    entry.bid = id;
+
+    __atomic_store_n(_bufferTail, static_cast<uint16_t>(tail + 1), __ATOMIC_RELEASE);
+}
+
+bool UringDevice::write(Memory::PacketBuffer& buffer, uint64_t data)
+{
+    io_uring_sqe *sqe = _tx.sqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = _tun.fd();
+    sqe->addr = reinterpret_cast<uint64_t>(buffer.data());
+    sqe->len = static_cast<uint32_t>(buffer.length());
+    sqe->user_data = data;
+
+    // big offload frames live on the heap, outside the registered pool
+    if (_fixed && Memory::packetBufferPool().contains(buffer.data(), buffer.length())) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+    }
+
+    return true;
+}
+
+bool UringDevice::reapWrite(UringCompletion& completion)
+{
+    if (!_tx.peek(completion)) {
+        return false;
+    }
+
+    _tx.advance();
+    return true;
+}
@@ -1,69 +1,596 @@
+#include <algorithm>
 #include <iostream>
+#include <cerrno>
+#include <cstring>
 
+#include "crc32.hpp"
 #include "ethernet.hpp"
+#include "gso.hpp"
+#include "trace.hpp"
 #include "tun.hpp"
 #include "memorypool.hpp"
 #include "types.hpp"
 
-static Memory::ObjectPool<Ethernet::Packet> packetsPool{};
-
 CRC32 Ethernet::calcCRC(CRC32 crc, void *buffer, size_t bufferLength) 
 {
-    unsigned char *data = static_cast<unsigned char*>(buffer);
-    crc ^= 0xffffffff;
-    while (bufferLength--) {
-        crc ^= *data++;
-        for (unsigned k = 0; k < 8; ++k) {
-            crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+    return CRC::compute(crc, buffer, bufferLength);
+}
+
+static constexpr size_t VNET_HEADER_SIZE = sizeof(VnetHeader);
+
+/* the largest frame a device may hand over, with its virtio-net header */
+static size_t receiveSize(bool vnetHeader)
+{
+    return vnetHeader ? VNET_HEADER_SIZE + Ethernet::MAX_OFFLOAD_FRAME_SIZE : Ethernet::MAX_FRAME_SIZE;
+}
+
+/* size bytes were read into the frame's buffer: strip the virtio-net header and parse, false for a runt */
+static bool receive(Ethernet::Frame& frame, size_t size, bool vnetHeader)
+{
+    Memory::PacketBuffer& buffer = frame.getBuffer();
+    Ethernet::Offload& offload = frame.offload();
+
+    buffer.setLength(size);
+    offload = Ethernet::Offload{};
+    frame.unchain();
+    if (vnetHeader) {
+        if (size < VNET_HEADER_SIZE) {
+            return false;
         }
+
+        VnetHeader header;
+        std::memcpy(&header, buffer.data(), VNET_HEADER_SIZE);
+        buffer.pull(VNET_HEADER_SIZE);
+
+        offload._flags = header._flags;
+        offload._gsoType = header._gsoType & ~VnetHeader::GSO_ECN;
+        offload._headerLength = header._headerLength;
+        offload._gsoSize = header._gsoSize;
+        offload._checksumStart = header._checksumStart;
+        offload._checksumOffset = header._checksumOffset;
     }
 
-    return crc ^ 0xffffffff;
+    if (!frame.parseBuffer()) {
+        return false;
+    }
+
+    Trace::debug(Trace::Event::FRAME_RX, size, frame.getType());
+    return true;
+}
+
+/* what the device should do with the frame, for a device with the virtio-net header */
+static VnetHeader toVnetHeader(const Ethernet::Offload& offload)
+{
+    VnetHeader header{};
+    header._flags = offload._flags & Ethernet::Offload::CHECKSUM_PARTIAL;
+    header._gsoType = offload._gsoType;
+    header._headerLength = offload._headerLength;
+    header._gsoSize = offload._gsoSize;
+    header._checksumStart = offload._checksumStart;
+    header._checksumOffset = offload._checksumOffset;
+    return header;
 }
 
-void* Ethernet::Packet::operator new(std::size_t size)
+/* not a GSO frame, or one the segmenter has nothing to cut from, e.g. a GSO frame without data */
+static bool uncut(Ethernet::Frame& frame, const GSO::Segmenter& segmenter)
 {
-    return packetsPool.allocate();
+    return frame.offload()._gsoType == Ethernet::Offload::GSO_NONE || segmenter.segments() == 0;
 }
 
-void Ethernet::Packet::operator delete(void *ptr)
+/* an uncut GSO frame goes out whole like any other frame, unless it is over the MTU */
+static bool oversized(Ethernet::Frame& frame)
 {
-    packetsPool.deallocate(ptr);
+    return frame.offload()._gsoType != Ethernet::Offload::GSO_NONE && 
+            frame.getBufferSize() > Ethernet::HeaderLayout::SIZE + Ethernet::MTU;
+}
+
+size_t Ethernet::Manager<TunDevice>::readBurst(Ethernet::Burst& burst)
+{
+    bool vnetHeader = _device.vnetHeader();
+    size_t frameSize = receiveSize(vnetHeader);
+
+    burst.count = 0;
+    burst.runts = 0;
+    while (burst.count < BURST_SIZE) {
+        Ethernet::Frame& frame = burst.frames[burst.count];
+        // out of buffers: leave the remaining frames queued in the kernel.
+        Memory::PacketBuffer& buffer = frame._buffer;
+        bool fits = buffer && buffer.capacity() >= Memory::PacketBuffer::DEFAULT_HEADROOM + frameSize;
+        if (!fits && !frame.tryAllocPacket(frameSize)) {
+            break;
+        }
+
+        buffer.reset();
+        int size = _device.readBuf(buffer.data(), buffer.tailroom());
+        if (size <= 0) {
+            if (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "ethernet.cpp: Ethernet::Manager<TunDevice>::readBurst: read failed: " << strerror(errno) << '\n';
+            }
+            break;
+        }
+
+        // a runt is dropped and its slot reused for the next frame.
+        if (receive(frame, size, vnetHeader)) {
+            ++burst.count;
+        } else {
+            ++burst.runts;
+        }
+    }
+
+    return burst.count;
 }
 
-void Ethernet::Frame::parseBuffer(void)
+bool Ethernet::Manager<TunDevice>::written(int result)
 {
-    size_t idx = 0;
-    try {
-        Memory::consume(_dstMac, _buffer->buf, idx, _bufferSize);
-        Memory::consume(_srcMac, _buffer->buf, idx, _bufferSize);
-        Memory::consume(_etherType, _buffer->buf, idx, _bufferSize);
+    if (result >= 0) {
+        return true;
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ethernet.cpp: Ethernet::Manager<TunDevice>::readDevice: Failed reading ethernet frame header\n";
+
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return false;
     }
 
-    _payloadSize = (_etherType < ETHERTYPE_MAX) ? _etherType : _bufferSize - HEADER_SIZE;
-    try {
-        Memory::consumePointer(_payload, _buffer->buf, idx, _bufferSize, _payloadSize);
+    // the frame is lost like on the wire
+    ++_txErrors;
+    return true;
+}
+
+bool Ethernet::Manager<TunDevice>::writeDevice(Ethernet::Frame& frame)
+{
+    // without the virtio-net header the device takes frames as they are, what it would have
+    // done to them is done here
+    if (!_device.vnetHeader()) {
+        GSO::Segmenter segmenter{frame};
+        if (uncut(frame, segmenter)) {
+            if (oversized(frame)) {
+                ++_txErrors;
+                return true;
+            }
+
+            GSO::completeChecksum(frame);
+            return written(_device.writeBuf(frame._buffer.data(), frame._buffer.length()));
+        }
+
+        // once the first segment is out the others follow, one the device drops is retransmitted
+        GSO::Segment segment;
+        for (bool first = true; segmenter.next(segment); first = false) {
+            struct iovec iov[2] = {
+                {segment._headers.data(), segment._headerLength},
+                {const_cast<char*>(segment._payload), segment._payloadSize},
+            };
+            if (!written(_device.writeVec(iov, 2)) && first) {
+                return false;
+            }
+        }
+        return true;
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ethernet.cpp: Ethernet::Manager<TunDevice>::readDevice: Failed reading ethernet frame payload\n";
+
+    VnetHeader header = toVnetHeader(frame._offload);
+    struct iovec iov[2] = {
+        {&header, sizeof(header)},
+        {frame._buffer.data(), frame._buffer.length()},
+    };
+    return written(_device.writeVec(iov, 2));
+}
+
+bool Ethernet::Manager<TunDevice>::enqueue(Ethernet::Frame& frame)
+{
+    if (_txCount == TX_RING_SIZE) {
+        flush();
+        if (_txCount == TX_RING_SIZE) {
+            return false;
+        }
     }
 
-    try {
-        Memory::consume<CRC32>(_frameCheckSequence, _buffer->buf, idx, _bufferSize);
-    } 
-    catch (const std::runtime_error& err) {
-        std::cerr << "ethernet.cpp: Ethernet::Manager<TunDevice>::readDevice: Failed reading ethernet frame check sequence\n";
+    _txRing[(_txHead + _txCount) % TX_RING_SIZE] = std::move(frame);
+    if (++_txCount >= TX_HIGH_WATER) {
+        flush();
     }
+
+    return true;
+}
+
+size_t Ethernet::Manager<TunDevice>::flush(void)
+{
+    size_t sent = 0;
+
+    while (_txCount > 0) {
+        Frame& frame = _txRing[_txHead];
+        if (!writeDevice(frame)) {
+            break;
+        }
+
+        // the write is done with the buffer, it goes back to the pool
+        frame = Frame{};
+        _txHead = (_txHead + 1) % TX_RING_SIZE;
+        --_txCount;
+        ++sent;
+    }
+
+    return sent;
+}
+
+size_t Ethernet::Manager<UringDevice>::frameSize(bool offload)
+{
+    return receiveSize(offload);
+}
+
+size_t Ethernet::Manager<UringDevice>::readBurst(Ethernet::Burst& burst)
+{
+    size_t frameSize = _device.frameSize();
+
+    burst.count = 0;
+    burst.runts = 0;
+    UringCompletion completion;
+    uint16_t id;
+    while (burst.count < BURST_SIZE && _device.peekRead(completion, id)) {
+        bool filled = completion._flags & IORING_CQE_F_BUFFER;
+        if (completion._result <= 0) {
+            // ENOBUFS ends a multishot read whose buffers ran out, it is posted again below
+            if (completion._result < 0 && completion._result != -ENOBUFS) {
+                std::cerr << "ethernet.cpp: Ethernet::Manager<UringDevice>::readBurst: read failed: " << strerror(-completion._result) << '\n';
+            }
+            if (filled) {
+                _device.provide(id);
+            }
+            _device.nextRead();
+            continue;
+        }
+
+        // the frame's buffer takes the filled one's place, out of buffers the read stays completed
+        Ethernet::Frame& frame = burst.frames[burst.count];
+        Memory::PacketBuffer& buffer = frame._buffer;
+        bool fits = buffer && buffer.capacity() >= Memory::PacketBuffer::DEFAULT_HEADROOM + frameSize;
+        if (!fits && !frame.tryAllocPacket(frameSize)) {
+            break;
+        }
+
+        std::swap(buffer, _device.buffer(id));
+        _device.provide(id);
+        _device.nextRead();
+
+        if (receive(frame, completion._result, _device.vnetHeader())) {
+            ++burst.count;
+        } else {
+            ++burst.runts;
+        }
+    }
+
+    _device.arm();
+    return burst.count;
+}
+
+bool Ethernet::Manager<UringDevice>::stage(Ethernet::Frame& frame)
+{
+    Frame& slot = _txRing[(_txHead + _txCount) % TX_RING_SIZE];
+    slot = std::move(frame);
+
+    if (!_device.vnetHeader()) {
+        GSO::completeChecksum(slot);
+    } else {
+        // the header goes in the headroom, the frame is written from one buffer
+        char *header = slot._buffer.push(VNET_HEADER_SIZE);
+        if (header == nullptr) {
+            slot = Frame{};
+            return false;
+        }
+
+        VnetHeader wire = toVnetHeader(slot._offload);
+        std::memcpy(header, &wire, VNET_HEADER_SIZE);
+    }
+
+    ++_txCount;
+    return true;
+}
+
+bool Ethernet::Manager<UringDevice>::enqueue(Ethernet::Frame& frame)
+{
+    // without the virtio-net header the device takes a GSO frame as the segments it would have cut
+    GSO::Segmenter segmenter{frame};
+    bool segment = !_device.vnetHeader() && !uncut(frame, segmenter);
+    if (!_device.vnetHeader() && !segment && oversized(frame)) {
+        ++_txErrors;
+        frame = Frame{};
+        return true;
+    }
+
+    size_t slots = segment ? segmenter.segments() : 1;
+
+    if (TX_RING_SIZE - _txCount < slots) {
+        flush();
+        if (TX_RING_SIZE - _txCount < slots) {
+            return false;
+        }
+    }
+
+    if (!segment) {
+        if (!stage(frame)) {
+            ++_txErrors;
+        }
+    } else {
+        // a write needs the segment in one buffer, so unlike the TAP's writev() it is copied out
+        size_t first = _txHead + _txCount;
+        GSO::Segment cut;
+        for (size_t i = 0; segmenter.next(cut); ++i) {
+            Frame& slot = _txRing[(first + i) % TX_RING_SIZE];
+            if (!slot.tryAllocPacket(cut._headerLength + cut._payloadSize)) {
+                for (size_t j = 0; j < i; ++j) {
+                    _txRing[(first + j) % TX_RING_SIZE] = Frame{};
+                }
+                return false;
+            }
+
+            std::memcpy(slot.getData(), cut._headers.data(), cut._headerLength);
+            std::memcpy(slot.getData() + cut._headerLength, cut._payload, cut._payloadSize);
+            slot.setBufferSize(cut._headerLength + cut._payloadSize);
+        }
+        _txCount += slots;
+        frame = Frame{};
+    }
+
+    if (txQueued() >= TX_HIGH_WATER) {
+        flush();
+    }
+
+    return true;
+}
+
+void Ethernet::Manager<UringDevice>::reap(void)
+{
+    UringCompletion completion;
+    while (_device.reapWrite(completion)) {
+        size_t slot = static_cast<size_t>(completion._data);
+        if (completion._result < 0) {
+            ++_txErrors;
+        }
+
+        // the write is done with the buffer, it goes back to the pool
+        _txRing[slot] = Frame{};
+        _txDone[slot] = true;
+    }
+
+    while (_txSubmitted > 0 && _txDone[_txHead]) {
+        _txDone[_txHead] = false;
+        _txHead = (_txHead + 1) % TX_RING_SIZE;
+        --_txCount;
+        --_txSubmitted;
+    }
+}
+
+size_t Ethernet::Manager<UringDevice>::flush(void)
+{
+    reap();
+
+    size_t submitted = 0;
+    while (_txSubmitted < _txCount) {
+        size_t slot = (_txHead + _txSubmitted) % TX_RING_SIZE;
+        if (!_device.write(_txRing[slot]._buffer, slot)) {
+            break;
+        }
+        ++_txSubmitted;
+        ++submitted;
+    }
+
+    if (submitted > 0) {
+        _device.submitWrites();
+    }
+
+    return submitted;
+}
+
+size_t Ethernet::Manager<PacketDevice>::readBurst(Ethernet::Burst& burst)
+{
+    // nothing holds on to the last burst's frames any more
+    _device.release();
+
+    burst.count = 0;
+    burst.runts = 0;
+    PacketDevice::Received received;
+    while (burst.count < BURST_SIZE && _device.receive(received)) {
+        Ethernet::Frame& frame = burst.frames[burst.count];
+        frame._buffer = Memory::PacketBuffer::borrow(received._base, received._capacity, received._headroom);
+        if (!receive(frame, received._length, false)) {
+            ++burst.runts;
+            continue;
+        }
+
+        // the host left the checksum to the device, or the device checked it
+        if (received._status & (TP_STATUS_CSUMNOTREADY | TP_STATUS_CSUM_VALID)) {
+            frame._offload._flags = Offload::CHECKSUM_VALID;
+        }
+        ++burst.count;
+    }
+
+    return burst.count;
+}
+
+bool Ethernet::Manager<PacketDevice>::put(const char* headers, size_t headerLength, const char* payload, size_t payloadSize)
+{
+    char *slot = _device.txSlot();
+    if (slot == nullptr) {
+        return false;
+    }
+
+    // too long for a slot, the frame is lost like on the wire
+    if (headerLength + payloadSize > PacketDevice::TX_ROOM) {
+        ++_txErrors;
+        return true;
+    }
+
+    std::memcpy(slot, headers, headerLength);
+    if (payloadSize > 0) {
+        std::memcpy(slot + headerLength, payload, payloadSize);
+    }
+    _device.commit(headerLength + payloadSize);
+    ++_txQueued;
+    return true;
+}
+
+bool Ethernet::Manager<PacketDevice>::enqueue(Ethernet::Frame& frame)
+{
+    if (_device.txFull()) {
+        flush();
+        if (_device.txFull()) {
+            return false;
+        }
+    }
+
+    GSO::Segmenter segmenter{frame};
+    if (uncut(frame, segmenter)) {
+        if (oversized(frame)) {
+            ++_txErrors;
+        } else {
+            GSO::completeChecksum(frame);
+            put(frame._buffer.data(), frame._buffer.length(), nullptr, 0);
+        }
+    } else {
+        // once the first segment is in the ring the others follow, one that finds it full is retransmitted
+        GSO::Segment segment;
+        while (segmenter.next(segment)) {
+            if (!put(segment._headers.data(), segment._headerLength, segment._payload, segment._payloadSize)) {
+                flush();
+                if (!put(segment._headers.data(), segment._headerLength, segment._payload, segment._payloadSize)) {
+                    ++_txErrors;
+                }
+            }
+        }
+    }
+
+    // the frame is in the ring, its buffer goes back to the pool or the RX ring
+    frame = Frame{};
+
+    if (_txQueued >= TX_HIGH_WATER) {
+        flush();
+    }
+
+    return true;
+}
+
+size_t Ethernet::Manager<PacketDevice>::flush(void)
+{
+    size_t sent = _txQueued;
+    if (sent == 0) {
+        return 0;
+    }
+
+    // the frames stay in their slots until the socket takes them, the next flush tries again
+    if (_device.send() < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            return 0;
+        }
+        ++_txErrors;
+    }
+
+    _txQueued = 0;
+    return sent;
+}
+
+size_t Ethernet::Manager<PcapDevice>::readBurst(Ethernet::Burst& burst)
+{
+    burst.count = 0;
+    burst.runts = 0;
+    PcapDevice::Record record;
+    while (burst.count < BURST_SIZE && _device.due(record)) {
+        // out of buffers: the frame stays due for the next burst
+        Ethernet::Frame& frame = burst.frames[burst.count];
+        Memory::PacketBuffer& buffer = frame._buffer;
+        size_t frameSize = std::max(record._length, MAX_FRAME_SIZE);
+        bool fits = buffer && buffer.capacity() >= Memory::PacketBuffer::DEFAULT_HEADROOM + frameSize;
+        if (!fits && !frame.tryAllocPacket(frameSize)) {
+            break;
+        }
+
+        buffer.reset();
+        std::memcpy(buffer.data(), record._data, record._length);
+        _device.take();
+        ++_rxFrames;
+
+        if (receive(frame, record._length, false)) {
+            ++burst.count;
+        } else {
+            ++burst.runts;
+        }
+    }
+
+    _device.arm();
+    return burst.count;
+}
+
+void Ethernet::Manager<PcapDevice>::write(const char* headers, size_t headerLength, const char* payload, size_t payloadSize)
+{
+    _device.write(headers, headerLength, payload, payloadSize);
+    ++_txQueued;
+    ++_txFrames;
+}
+
+bool Ethernet::Manager<PcapDevice>::enqueue(Ethernet::Frame& frame)
+{
+    GSO::Segmenter segmenter{frame};
+    if (uncut(frame, segmenter)) {
+        if (oversized(frame)) {
+            ++_txErrors;
+        } else {
+            GSO::completeChecksum(frame);
+            write(frame._buffer.data(), frame._buffer.length(), nullptr, 0);
+        }
+    } else {
+        GSO::Segment segment;
+        while (segmenter.next(segment)) {
+            write(segment._headers.data(), segment._headerLength, segment._payload, segment._payloadSize);
+        }
+    }
+
+    frame = Frame{};
+    return true;
+}
+
+size_t Ethernet::Manager<PcapDevice>::flush(void)
+{
+    size_t written = _txQueued;
+    _txQueued = 0;
+    return written;
+}
+
+void Ethernet::Frame::swapAddresses(const MacAddr& src)
+{
+    _dstMac = _srcMac;
+    _srcMac = src;
+
+    Memory::Codec<MacAddr>::store(_dstMac, _buffer.data() + HeaderLayout::offset<0>());
+    Memory::Codec<MacAddr>::store(_srcMac, _buffer.data() + HeaderLayout::offset<1>());
+}
+
+void Ethernet::Frame::setDst(const MacAddr& dst)
+{
+    _dstMac = dst;
+    Memory::Codec<MacAddr>::store(_dstMac, _buffer.data() + HeaderLayout::offset<0>());
+}
+
+bool Ethernet::Frame::parseBuffer(void)
+{
+    char *buffer = _buffer.data();
+    size_t length = _buffer.length();
+
+    if (!HeaderLayout::read(buffer, length, _dstMac, _srcMac, _etherType)) {
+        return false;
+    }
+
+    // TAP devices hand frames over without their FCS, everything after the header is payload.
+    _payloadSize = (_etherType < ETHERTYPE_MAX) ? _etherType : length - HeaderLayout::SIZE;
+    _payload = buffer + HeaderLayout::SIZE;
+
+    if (HeaderLayout::SIZE + _payloadSize > length) {
+        return false;
+    }
+
+    return true;
 }
 
 void Ethernet::Frame::debugPrint(void)
 {
     std::cout << "Ethernet Frame: dst: " << _dstMac << " src: " << _srcMac << std::endl;
     std::cout << std::setfill('0') << std::setw(2) << std::hex;
-    std::cout << "                ethertype: " << _etherType << " CRC: " << _frameCheckSequence << std::endl;
+    std::cout << "                ethertype: " << _etherType << std::endl;
     std::cout << "                payload addr: " << &_payload; 
     std::cout << std::setfill (' ') << std::setw(0) << std::dec;
     std::cout << " payload size: " << _payloadSize << std::endl;
@@ -71,9 +598,9 @@ void Ethernet::Frame::debugPrint(void)
     std::cout << "                Raw Packet:\n";
     std::cout << "                ";
     std::cout << std::setfill('0') << std::setw(2) << std::hex;
-    for (size_t i = 0; i < _bufferSize; ++i) {
+    for (size_t i = 0; i < _buffer.length(); ++i) {
         std::cout << std::setfill('0') << std::setw(2) << std::hex;
-        std::cout << +(uint8_t)(_buffer->buf[i]) << " "; 
+        std::cout << +(uint8_t)(_buffer.data()[i]) << " "; 
 
         if ((i + 1) % 20 == 0) {
             std::cout << "\n";
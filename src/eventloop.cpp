@@ -0,0 +1,89 @@
+#include <system_error>
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "eventloop.hpp"
+
+Event::Loop::Loop()
+{
+    _epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (_epollFd < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventloop.cpp: Event::Loop(): could not create epoll instance");
+    }
+}
+
+Event::Loop::~Loop()
+{
+    if (_epollFd != -1) {
+        close(_epollFd);
+    }
+}
+
+void Event::Loop::add(int fd, uint32_t events, Callback callback)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventloop.cpp: Event::Loop::add(): could not register fd");
+    }
+
+    _handlers[fd] = std::move(callback);
+}
+
+void Event::Loop::modify(int fd, uint32_t events)
+{
+    struct epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventloop.cpp: Event::Loop::modify(): could not modify fd");
+    }
+}
+
+void Event::Loop::remove(int fd)
+{
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    _handlers.erase(fd);
+}
+
+int Event::Loop::runOnce(int timeoutMs)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    int timerMs = _timers.timeoutMs(Clock::now());
+    if (timerMs >= 0 && (timeoutMs < 0 || timerMs < timeoutMs)) {
+        timeoutMs = timerMs;
+    }
+
+    int count = epoll_wait(_epollFd, events, MAX_EVENTS, timeoutMs);
+    if (count < 0) {
+        if (errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "eventloop.cpp: Event::Loop::runOnce(): epoll_wait failed");
+        }
+        count = 0;
+    }
+
+    _timers.advance(Clock::now());
+
+    for (int i = 0; i < count; ++i) {
+        auto it = _handlers.find(events[i].data.fd);
+        if (it != _handlers.end()) {
+            it->second(events[i].events);
+        }
+    }
+
+    return count;
+}
+
+void Event::Loop::run(void)
+{
+    _running = true;
+    while (_running) {
+        runOnce(-1);
+    }
+}
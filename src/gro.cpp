@@ -0,0 +1,215 @@
+#include <cstring>
+
+#include "checksum.hpp"
+#include "gro.hpp"
+#include "ip.hpp"
+
+// offsets from the start of the frame, only IP headers without options are coalesced
+static constexpr size_t IP_OFFSET  = Ethernet::HeaderLayout::SIZE;
+static constexpr size_t TCP_OFFSET = IP_OFFSET + IP::HEADER_SIZE;
+
+static constexpr size_t IP_TOS_OFFSET     = IP::HeaderLayout::offset<1>();
+static constexpr size_t IP_LENGTH_OFFSET  = IP::HeaderLayout::offset<2>();
+static constexpr size_t IP_FLAGS_OFFSET   = IP::HeaderLayout::offset<4>();
+static constexpr size_t TCP_ACK_OFFSET    = TCP::HeaderLayout::offset<3>();
+static constexpr size_t TCP_DATA_OFFSET   = TCP::HeaderLayout::offset<4>();
+static constexpr size_t TCP_FLAGS_OFFSET  = TCP_DATA_OFFSET + 1;
+static constexpr size_t TCP_WINDOW_OFFSET = TCP::HeaderLayout::offset<5>();
+
+struct GRO::Coalescer::Segment
+{
+    IPAddr   _srcAddr;
+    IPAddr   _dstAddr;
+    uint32_t _ports;
+    TCP::Seq _seq;
+    uint16_t _headerLength;     // TCP header with options
+    uint16_t _payloadSize;
+    uint8_t  _flags;
+    bool     _data;             // plain data with valid checksums, a candidate for merging
+};
+
+bool GRO::Coalescer::parse(Ethernet::Frame& frame, Segment& segment)
+{
+    if (frame.getType() != PRO_IPV4) {
+        return false;
+    }
+
+    const char *ip = frame.getPayload();
+    size_t available = frame.getPayloadSize();
+
+    IP::Fields1 f1;
+    IP::TOS tos;
+    IP::Length16 length;
+    IP::ID id;
+    IP::Fields2 f2;
+    IP::TTL ttl;
+    IP::Protocol proto;
+    IP::Checksum checksum;
+    if (!IP::HeaderLayout::read(ip, available, f1, tos, length, id, f2, ttl, proto, checksum, segment._srcAddr, segment._dstAddr)) {
+        return false;
+    }
+
+    size_t ipHeaderLength = f1._ihl * 4;
+    if (f1._version != IP::VER_IPV4 || proto != IP::PRO_TCP || ipHeaderLength < IP::HEADER_SIZE || length > available ||
+            ipHeaderLength + TCP::HEADER_SIZE > length) {
+        return false;
+    }
+
+    const char *tcp = ip + ipHeaderLength;
+    TCP::Port srcPort;
+    TCP::Port dstPort;
+    TCP::Seq ack;
+    TCP::OffsetFlags offsetFlags;
+    TCP::Window window;
+    TCP::Checksum tcpChecksum;
+    uint16_t urgent;
+    if (!TCP::HeaderLayout::read(tcp, length - ipHeaderLength, srcPort, dstPort, segment._seq, ack, offsetFlags, window, tcpChecksum, urgent)) {
+        return false;
+    }
+
+    segment._ports = static_cast<uint32_t>(srcPort) << 16 | dstPort;
+    segment._headerLength = static_cast<uint16_t>((offsetFlags >> 12) * 4);
+    segment._flags = offsetFlags & 0x3F;
+
+    // anything but data on an ACK, maybe pushed, goes up the stack by itself
+    segment._data = ipHeaderLength == IP::HEADER_SIZE && !(f2._flags & IP::FLAG_MORE) && f2._fragOffset == 0 &&
+                    frame.offload()._gsoType == Ethernet::Offload::GSO_NONE && segment._headerLength >= TCP::HEADER_SIZE &&
+                    IP::HEADER_SIZE + segment._headerLength < length && (segment._flags & ~TCP::FLAG_PSH) == TCP::FLAG_ACK;
+    if (!segment._data) {
+        return true;
+    }
+    segment._payloadSize = static_cast<uint16_t>(length - IP::HEADER_SIZE - segment._headerLength);
+
+    // a segment that fails is passed on as it is and dropped by IP or TCP with the right reason
+    uint16_t tcpLength = static_cast<uint16_t>(length - IP::HEADER_SIZE);
+    segment._data = Inet::checksum(ip, IP::HEADER_SIZE) == 0 && (frame.offload().checksumValid() ||
+                    Inet::checksum(tcp, tcpLength, Inet::pseudoHeader(segment._srcAddr, segment._dstAddr, IP::PRO_TCP, tcpLength)) == 0);
+
+    return true;
+}
+
+GRO::Coalescer::Flow* GRO::Coalescer::find(const Segment& segment)
+{
+    for (size_t i = 0; i < _count; ++i) {
+        Flow& flow = _flows[i];
+        if (flow._ports == segment._ports && flow._srcAddr == segment._srcAddr && flow._dstAddr == segment._dstAddr) {
+            return &flow;
+        }
+    }
+
+    return nullptr;
+}
+
+bool GRO::Coalescer::mergeable(const Flow& flow, Ethernet::Frame& frame, const Segment& segment)
+{
+    const char *head = flow._head->getPayload();
+    const char *ip = frame.getPayload();
+    size_t headerLength = IP::HEADER_SIZE + segment._headerLength;
+
+    if (segment._seq != flow._nextSeq || segment._payloadSize > flow._segmentSize ||
+            headerLength + flow._length + segment._payloadSize > UINT16_MAX) {
+        return false;
+    }
+
+    // the same TOS, DF and TTL, and the same ACK, header length and options
+    return head[IP_TOS_OFFSET] == ip[IP_TOS_OFFSET] && head[IP_FLAGS_OFFSET] == ip[IP_FLAGS_OFFSET] &&
+           head[IP::IP_TTL_OFFSET] == ip[IP::IP_TTL_OFFSET] &&
+           std::memcmp(head + IP::HEADER_SIZE + TCP_ACK_OFFSET, ip + IP::HEADER_SIZE + TCP_ACK_OFFSET, TCP_FLAGS_OFFSET - TCP_ACK_OFFSET) == 0 &&
+           std::memcmp(head + IP::HEADER_SIZE + TCP::HEADER_SIZE, ip + IP::HEADER_SIZE + TCP::HEADER_SIZE, segment._headerLength - TCP::HEADER_SIZE) == 0;
+}
+
+void GRO::Coalescer::merge(Flow& flow, Ethernet::Frame& frame, const Segment& segment)
+{
+    Ethernet::Frame& head = *flow._head;
+    char *tcp = head.getPayload() + IP::HEADER_SIZE;
+
+    // the padding of a short first frame would end up in the middle of the data
+    if (flow._segments == 1) {
+        head.setBufferSize(TCP_OFFSET + segment._headerLength + flow._length);
+        head.parseBuffer();
+    }
+
+    // the window is the latest one and a PSH anywhere is kept
+    const char *merged = frame.getPayload() + IP::HEADER_SIZE;
+    std::memcpy(tcp + TCP_WINDOW_OFFSET, merged + TCP_WINDOW_OFFSET, sizeof(TCP::Window));
+    tcp[TCP_FLAGS_OFFSET] |= segment._flags & TCP::FLAG_PSH;
+
+    // the merged frame keeps only its data
+    frame.getBuffer().pull(TCP_OFFSET + segment._headerLength);
+    frame.setBufferSize(segment._payloadSize);
+
+    flow._last->_next = &frame;
+    flow._last = &frame;
+    head._chainLength += segment._payloadSize;
+
+    flow._nextSeq += segment._payloadSize;
+    flow._length += segment._payloadSize;
+    ++flow._segments;
+    ++_merged;
+}
+
+void GRO::Coalescer::flush(Flow& flow)
+{
+    Ethernet::Frame& head = *flow._head;
+
+    if (flow._segments > 1) {
+        char *ip = head.getPayload();
+        size_t headerLength = IP::HEADER_SIZE + (static_cast<uint8_t>(ip[IP::HEADER_SIZE + TCP_DATA_OFFSET]) >> 4) * 4;
+        Inet::patch16(ip + IP_LENGTH_OFFSET, htons(static_cast<uint16_t>(headerLength + flow._length)), ip + IP::IP_CHECKSUM_OFFSET);
+
+        Ethernet::Offload& offload = head._offload;
+        offload._gsoType = Ethernet::Offload::GSO_TCPV4;
+        offload._gsoSize = flow._segmentSize;
+        offload._headerLength = static_cast<uint16_t>(IP_OFFSET + headerLength);
+    }
+
+    flow = _flows[--_count];
+}
+
+size_t GRO::Coalescer::coalesce(Ethernet::Burst& burst, Frames& frames)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < burst.count; ++i) {
+        Ethernet::Frame& frame = burst.frames[i];
+
+        Segment segment;
+        if (!parse(frame, segment)) {
+            frames[count++] = &frame;
+            continue;
+        }
+
+        Flow *flow = find(segment);
+        if (flow != nullptr && segment._data && mergeable(*flow, frame, segment)) {
+            merge(*flow, frame, segment);
+
+            // nothing longer may follow a short segment, and a PSH is delivered right away
+            if (segment._payloadSize < flow->_segmentSize || (segment._flags & TCP::FLAG_PSH)) {
+                flush(*flow);
+            }
+            continue;
+        }
+
+        // whatever else the flow sends comes after the data merged so far
+        if (flow != nullptr) {
+            flush(*flow);
+        }
+        frames[count++] = &frame;
+
+        if (!segment._data) {
+            continue;
+        }
+
+        frame._offload._flags |= Ethernet::Offload::CHECKSUM_VALID;
+        if (!(segment._flags & TCP::FLAG_PSH) && _count < MAX_FLOWS) {
+            _flows[_count++] = Flow{&frame, &frame, segment._srcAddr, segment._dstAddr, segment._ports,
+                                    segment._seq + segment._payloadSize, segment._payloadSize, segment._payloadSize, 1};
+        }
+    }
+
+    while (_count > 0) {
+        flush(_flows[_count - 1]);
+    }
+
+    return count;
+}
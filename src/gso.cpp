@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstring>
+
+#include "checksum.hpp"
+#include "gso.hpp"
+
+static constexpr size_t IP_LENGTH_OFFSET = IP::HeaderLayout::offset<2>();
+static constexpr size_t TCP_SEQ_OFFSET   = TCP::HeaderLayout::offset<2>();
+static constexpr size_t TCP_FLAGS_OFFSET = TCP::HeaderLayout::offset<4>() + 1;
+
+GSO::Segmenter::Segmenter(Ethernet::Frame& frame)
+    : _frame{frame.getData()}, _length{frame.getBufferSize()}
+{
+    const Ethernet::Offload& offload = frame.offload();
+    _ipOffset = Ethernet::HeaderLayout::SIZE;
+    _tcpOffset = _ipOffset + IP::HEADER_SIZE;
+
+    if (offload._gsoType != Ethernet::Offload::GSO_TCPV4 || offload._gsoSize == 0 || _length < _tcpOffset + TCP::HEADER_SIZE) {
+        return;
+    }
+
+    IP::Fields1 f1;
+    IP::TOS tos;
+    IP::Length16 length;
+    IP::Fields2 f2;
+    IP::TTL ttl;
+    IP::Protocol proto;
+    IP::Checksum checksum;
+    IP::HeaderLayout::read(_frame + _ipOffset, _length - _ipOffset, f1, tos, length, _id, f2, ttl, proto, checksum, _srcAddr, _dstAddr);
+    _tcpOffset = _ipOffset + f1._ihl * 4;
+    if (proto != IP::PRO_TCP || f1._ihl < 5 || _tcpOffset + TCP::HEADER_SIZE > _length) {
+        return;
+    }
+
+    Memory::Codec<TCP::Seq>::load(_seq, _frame + _tcpOffset + TCP_SEQ_OFFSET);
+    size_t headerLength = _tcpOffset + (static_cast<uint8_t>(_frame[_tcpOffset + TCP_FLAGS_OFFSET - 1]) >> 4) * 4;
+    if (headerLength < _tcpOffset + TCP::HEADER_SIZE || headerLength > MAX_HEADER_SIZE || headerLength > _length) {
+        return;
+    }
+
+    _headerLength = headerLength;
+    _gsoSize = offload._gsoSize;
+}
+
+bool GSO::Segmenter::next(Segment& segment)
+{
+    size_t dataLength = _length - _headerLength;
+    if (_gsoSize == 0 || _offset >= dataLength) {
+        return false;
+    }
+
+    size_t index = _offset / _gsoSize;
+    size_t size = std::min(_gsoSize, dataLength - _offset);
+    bool last = _offset + size == dataLength;
+
+    char *headers = segment._headers.data();
+    std::memcpy(headers, _frame, _headerLength);
+    segment._headerLength = _headerLength;
+    segment._payload = _frame + _headerLength + _offset;
+    segment._payloadSize = size;
+
+    // the IP header checksum follows its two changed fields
+    char *ip = headers + _ipOffset;
+    size_t tcpLength = _headerLength - _tcpOffset + size;
+    Inet::patch16(ip + IP_LENGTH_OFFSET, htons(static_cast<uint16_t>(_tcpOffset - _ipOffset + tcpLength)), ip + IP::IP_CHECKSUM_OFFSET);
+    Inet::patch16(ip + IP::IP_ID_OFFSET, htons(static_cast<IP::ID>(_id + index)), ip + IP::IP_CHECKSUM_OFFSET);
+
+    char *tcp = headers + _tcpOffset;
+    Memory::Codec<TCP::Seq>::store(static_cast<TCP::Seq>(_seq + _offset), tcp + TCP_SEQ_OFFSET);
+    if (!last) {
+        tcp[TCP_FLAGS_OFFSET] &= ~(TCP::FLAG_FIN | TCP::FLAG_PSH);
+    }
+    if (index != 0) {
+        tcp[TCP_FLAGS_OFFSET] &= ~TCP::FLAG_CWR;
+    }
+
+    // header lengths are multiples of 4, so the data's sum adds on to the header's
+    std::memset(tcp + TCP::CHECKSUM_OFFSET, 0, sizeof(TCP::Checksum));
+    Inet::Sum sum = Inet::partial(tcp, _headerLength - _tcpOffset,
+                                  Inet::pseudoHeader(_srcAddr, _dstAddr, IP::PRO_TCP, static_cast<uint16_t>(tcpLength)));
+    TCP::Checksum checksum = Inet::checksum(segment._payload, size, sum);
+    std::memcpy(tcp + TCP::CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    _offset += size;
+    return true;
+}
+
+void GSO::completeChecksum(Ethernet::Frame& frame)
+{
+    Ethernet::Offload& offload = frame.offload();
+    size_t start = offload._checksumStart;
+    size_t field = start + offload._checksumOffset;
+    if (!(offload._flags & Ethernet::Offload::CHECKSUM_PARTIAL) || field + sizeof(uint16_t) > frame.getBufferSize()) {
+        return;
+    }
+
+    char *data = frame.getData();
+    uint16_t checksum = Inet::checksum(data + start, frame.getBufferSize() - start);
+    std::memcpy(data + field, &checksum, sizeof(checksum));
+    offload._flags &= ~Ethernet::Offload::CHECKSUM_PARTIAL;
+}
@@ -1,10 +1,17 @@
 #ifndef ARP_HPP
 #define ARP_HPP
 
-#include <unordered_map>
+#include <array>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "types.hpp"
 #include "ethernet.hpp"
+#include "layout.hpp"
+#include "timerwheel.hpp"
+#include "verdict.hpp"
 
 namespace ARP
 {
@@ -16,6 +23,26 @@ namespace ARP
     using Size   = uint8_t;
     using OpCode = uint16_t;
 
+    // an entry is forgotten this long after the last ARP message from its host, a negative
+    // one (the host didn't answer) soon enough to try again. Expired entries are swept
+    // every SWEEP_INTERVAL.
+    constexpr std::chrono::seconds ENTRY_TIMEOUT{300};
+    constexpr std::chrono::seconds NEGATIVE_TIMEOUT{3};
+    constexpr std::chrono::seconds SWEEP_INTERVAL{30};
+
+    // an unresolved address holds up to PENDING_FRAMES frames while it is asked for at most
+    // MAX_REQUESTS times, one REQUEST_INTERVAL apart; MAX_RESOLVING addresses at a time.
+    constexpr size_t                PENDING_FRAMES = 8;
+    constexpr size_t                MAX_RESOLVING  = 64;
+    constexpr unsigned              MAX_REQUESTS   = 3;
+    constexpr std::chrono::seconds  REQUEST_INTERVAL{1};
+
+    /* send a frame on the device, false if it can't take it now and the frame was not sent */
+    using Transmit = std::function<bool(Ethernet::Frame& frame)>;
+
+    using HeaderLayout      = Memory::Layout<HwType, ProType, Size, Size, OpCode>;
+    using PayloadIPv4Layout = Memory::Layout<MacAddr, IPAddr, MacAddr, IPAddr>;
+
     class Header 
     {
         private:
@@ -30,8 +57,8 @@ namespace ARP
             char*   _payload;
 
         public:
-            /* return the payload size */
-            size_t readFromBuffer(char *buffer, size_t bufferLength);
+            /* false if the buffer is shorter than the header */
+            bool   readFromBuffer(char *buffer, size_t bufferLength);
 
             char* getPayload(void) { return _payload; }
 
@@ -53,7 +80,7 @@ namespace ARP
             IPAddr  _dstIP;
 
         public:
-            void readFromBuffer(char *buffer, size_t bufferLength);
+            bool readFromBuffer(char *buffer, size_t bufferLength);
    
             /* used for TESTS and DEBUG */
        
@@ -62,25 +89,157 @@ namespace ARP
             friend class CacheManager;
     };
 
-    struct Cache
+    enum class State : uint8_t {
+        FREE = 0,
+        RESOLVED,
+        NEGATIVE,   // asked and got no answer
+    };
+
+    struct Entry
     {
-        HwType  _hwType;
-        IPAddr  _ipAddr;
-        MacAddr _macAddr;
-        int     _state = false;
+        IPAddr   _ipAddr;
+        MacAddr  _macAddr;
+        State    _state = State::FREE;
+        uint8_t  _reserved;
+        uint32_t _updated;      // milliseconds since the cache's epoch, wraps after 49 days
+    };
+
+    static_assert(sizeof(Entry) == 16, "four entries should share a cache line");
+
+    /*
+     * Flat neighbour table: a power of two array of entries with linear probing and backward
+     * shift deletion, sized for capacity entries at half load. Entries age by their timestamp,
+     * lookup() treats an expired one as missing and sweep() clears them in bulk. When the
+     * table is full a new host takes the place of the stalest entry on its probe path.
+     */
+    class Cache
+    {
+        private:
+            static constexpr size_t EVICT_PROBES = 8;
+
+            std::unique_ptr<Entry[]> _entries;
+            size_t                   _mask;
+            size_t                   _size = 0;
+            size_t                   _maxSize;
+            Event::Clock::time_point _epoch;
+
+            size_t   home(IPAddr addr) const;
+
+            uint32_t stamp(Event::Clock::time_point now) const;
+
+            bool     expired(const Entry& entry, uint32_t now) const;
+
+            void     erase(size_t index);
+
+            Entry*   find(IPAddr addr);
+
+            /* the entry for addr, or a free or evicted one to overwrite; nullptr if nothing can be evicted */
+            Entry*   slot(IPAddr addr, uint32_t now);
+
+        public:
+            static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+            explicit Cache(size_t capacity = DEFAULT_CAPACITY, Event::Clock::time_point epoch = Event::Clock::now());
+
+            /* nullptr if addr is unknown or its entry expired, otherwise RESOLVED or NEGATIVE */
+            const Entry* lookup(IPAddr addr, Event::Clock::time_point now);
+
+            void   update(IPAddr addr, const MacAddr& macAddr, Event::Clock::time_point now);
+
+            /* a negative entry for addr, unless it was resolved in the meantime */
+            void   markUnresolved(IPAddr addr, Event::Clock::time_point now);
+
+            /* erase the expired entries, return how many */
+            size_t sweep(Event::Clock::time_point now);
+
+            size_t size(void)     const { return _size; }
+            size_t maxSize(void)  const { return _maxSize; }
+            size_t capacity(void) const { return _mask + 1; }
+
+            /* used for TESTS and DEBUG */
+
+            void debugPrint(void);
+    };
+
+    /* frames waiting for the MAC of _addr */
+    struct Pending
+    {
+        IPAddr                                      _addr = 0;
+        uint8_t                                     _count = 0;
+        uint8_t                                     _requests = 0;    // 0 marks a free slot
+        Event::TimerId                              _timer = 0;
+        std::array<Ethernet::Frame, PENDING_FRAMES> _frames;
     };
 
     class CacheManager
     {
         private:
-            std::unordered_map<IPAddr, Cache>    _cacheEntries;
+            Cache                  _cache;
+            Event::TimerWheel*     _timers = nullptr;
+            Transmit               _transmit;
+            Verdict::DropCounters* _drops = nullptr;
+            IPAddr                 _localAddr = 0;
+            std::vector<Pending>   _pending = std::vector<Pending>(MAX_RESOLVING);
+
+            /* the wheel's clock when attached, it is advanced before the packets of a wakeup */
+            Event::Clock::time_point now(void) { return _timers ? _timers->now() : Event::Clock::now(); }
+
+            void sweep(void);
+
+            /* overwrite the request in frame with its reply */
+            void replyMessage(Ethernet::Frame& frame, ARP::PayloadIPv4& data);
+
+            Pending* findPending(IPAddr addr);
+
+            /* broadcast a request for pending._addr and arm the retry */
+            void sendRequest(Pending& pending);
+
+            void retry(IPAddr addr);
 
-            Ethernet::Frame replyMessage(ARP::Header& header, ARP::PayloadIPv4& data, CRC32 oldCRC);
+            /* send the frames to the resolved MAC in one go */
+            void flush(Pending& pending, const MacAddr& macAddr);
+
+            /* give up on pending._addr: a negative entry, and its frames are dropped */
+            void fail(Pending& pending);
+
+            void release(Pending& pending);
         
         public:
-            Ethernet::Frame handleMessage(Ethernet::Frame& frame);
+            explicit CacheManager(size_t capacity = Cache::DEFAULT_CAPACITY) : _cache{capacity} {}
+
+            /*
+             * start the periodic sweep and request retries, without timers expired entries are only
+             * dropped by lookups and an address is asked for once. transmit sends the requests and
+             * the frames flushed on a reply, frames given up on are counted in drops.
+             */
+            void attach(Event::TimerWheel& timers, Transmit transmit = nullptr, Verdict::DropCounters* drops = nullptr);
+
+            /* sender address of our requests, 0 sends ARP probes */
+            void setLocalAddr(IPAddr addr) { _localAddr = addr; }
+
+            /*
+             * address frame to nextHop. REPLY: the destination MAC is filled in, send it. ACCEPT: the
+             * frame was moved to the pending queue of nextHop and is sent once it resolves. DROP: the
+             * address didn't resolve recently, or too many frames are waiting.
+             */
+            Verdict::Result output(Ethernet::Frame& frame, IPAddr nextHop);
+
+            /* on REPLY the frame holds the reply */
+            Verdict::Result handleMessage(Ethernet::Frame& frame);
+
+            /* for the transmit path, see Cache::lookup() */
+            const Entry* lookup(IPAddr addr) { return _cache.lookup(addr, now()); }
+
+            void markUnresolved(IPAddr addr) { _cache.markUnresolved(addr, now()); }
+
+            Cache& cache(void) { return _cache; }
+
             /* used for TESTS and DEBUG */
             
+            size_t size(void) { return _cache.size(); }
+
+            size_t pending(IPAddr addr) { Pending *queue = findPending(addr); return queue ? queue->_count : 0; }
+
             void debugPrint(void);
     };
 }
@@ -0,0 +1,54 @@
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "types.hpp"
+
+/*
+ * Internet checksum (RFC 1071). Words and checksums are handled as they are stored in the
+ * packet (network byte order), the one's complement sum doesn't depend on the byte order.
+ */
+namespace Inet
+{
+    /* unfolded one's complement sum, partial sums of even length chunks can be added */
+    using Sum = uint64_t;
+
+    Sum      partialScalar(const void *buffer, size_t length, Sum sum = 0);
+
+    /* only call it if hasAvx2() is true */
+    Sum      partialAvx2(const void *buffer, size_t length, Sum sum = 0);
+
+    bool     hasAvx2(void);
+
+    /* the fastest implementation supported by the CPU, selected once at startup */
+    Sum      partial(const void *buffer, size_t length, Sum sum = 0);
+
+    uint16_t fold(Sum sum);
+
+    /* the value to store in the checksum field, a buffer with a valid checksum returns 0 */
+    inline uint16_t checksum(const void *buffer, size_t length, Sum sum = 0)
+    {
+        return ~fold(partial(buffer, length, sum));
+    }
+
+    /* TCP/UDP pseudo header, addresses in host byte order as parsed by the headers */
+    Sum      pseudoHeader(IPAddr src, IPAddr dst, uint8_t protocol, uint16_t length);
+
+    /* RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m') */
+    uint16_t update16(uint16_t checksum, uint16_t oldWord, uint16_t newWord);
+
+    uint16_t update32(uint16_t checksum, uint32_t oldWord, uint32_t newWord);
+
+    /* store newWord in field (e.g. a port) and patch the checksum it is covered by */
+    void     patch16(void *field, uint16_t newWord, void *checksum);
+
+    /* store newWord in field (e.g. an address) and patch the checksum it is covered by */
+    void     patch32(void *field, uint32_t newWord, void *checksum);
+
+    /* decrement the TTL of an IPv4 header and patch its header checksum, false if the TTL is already 0 */
+    bool     decrementTTL(void *ipHeader);
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef CRC32_HPP
+#define CRC32_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "types.hpp"
+
+/*
+ * Ethernet CRC32 (reflected 0x04C11DB7). Every function takes the CRC of the previous chunk
+ * (0 for the first one) and returns the CRC including buffer, like Ethernet::calcCRC.
+ */
+namespace CRC
+{
+    /* reference implementation, one bit at a time */
+    CRC32 bitwise(CRC32 crc, const void *buffer, size_t bufferLength);
+
+    /* portable table driven implementation, 8 bytes per step */
+    CRC32 slicing8(CRC32 crc, const void *buffer, size_t bufferLength);
+
+    /* carry-less multiply folding, only call it if hasPclmul() is true */
+    CRC32 pclmul(CRC32 crc, const void *buffer, size_t bufferLength);
+
+    bool  hasPclmul(void);
+
+    /* the fastest implementation supported by the CPU, selected once at startup */
+    CRC32 compute(CRC32 crc, const void *buffer, size_t bufferLength);
+}
+
+#endif
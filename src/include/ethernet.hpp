@@ -1,11 +1,25 @@
 #ifndef ETHERNET_HPP
 #define ETHERNET_HPP
 
+#include <array>
+#include <optional>
+#include <string_view>
+
 #include <linux/if_ether.h>
 
+#include "layout.hpp"
 #include "memorypool.hpp"
+#include "packet.hpp"
+#include "packetbuffer.hpp"
+#include "pcap.hpp"
 #include "types.hpp"
 #include "tun.hpp"
+#include "uring.hpp"
+
+namespace GRO
+{
+    class Coalescer;
+}
 
 namespace Ethernet
 {
@@ -14,32 +28,66 @@ namespace Ethernet
     constexpr size_t HEADER_SIZE    = sizeof(char[6]) * 2 + sizeof(EtherType) + sizeof(CRC32);
     constexpr size_t MAX_FRAME_SIZE = MTU + HEADER_SIZE; 
     constexpr size_t MIN_FRAME_SIZE = 64;
+    constexpr size_t BURST_SIZE     = 32;
+
+    // frames waiting to be written, the ring is flushed early once TX_HIGH_WATER of them wait
+    constexpr size_t TX_RING_SIZE  = 256;
+    constexpr size_t TX_HIGH_WATER = 64;
+
+    // a TCP segment the kernel didn't cut up yet, on a device with offloads
+    constexpr size_t MAX_OFFLOAD_FRAME_SIZE = 65535 + MAX_FRAME_SIZE - MTU;
+
+    using HeaderLayout = Memory::Layout<MacAddr, MacAddr, EtherType>;
 
     CRC32 calcCRC(CRC32 crc, void *buffer, size_t bufferLength); 
 
-    struct Packet 
-    {
-        char buf[MAX_FRAME_SIZE];
-        
-        static void* operator new(std::size_t size);   
-        static void operator delete(void *ptr);
-    };
- 
     template <typename T>
     class Manager;
 
+    /*
+     * What the device did or should do for a frame, the virtio-net header of an IFF_VNET_HDR
+     * TAP (virtio 1.1, 5.1.6) field by field. Received: the TCP checksum was verified, or is
+     * partial and completed by whoever forwards the frame, either way it isn't checked again;
+     * a GSO frame is a run of TCP segments with one header. Sent: the device completes the
+     * checksum at checksumStart + checksumOffset and cuts a GSO frame into gsoSize segments.
+     */
+    struct Offload
+    {
+        enum : uint8_t {
+            CHECKSUM_PARTIAL = 1,   // VIRTIO_NET_HDR_F_NEEDS_CSUM
+            CHECKSUM_VALID   = 2,   // VIRTIO_NET_HDR_F_DATA_VALID
+        };
+
+        enum : uint8_t {
+            GSO_NONE  = 0,
+            GSO_TCPV4 = 1,
+        };
+
+        uint8_t  _flags = 0;
+        uint8_t  _gsoType = GSO_NONE;
+        uint16_t _headerLength = 0;       // ethernet, IP and TCP headers of a GSO frame
+        uint16_t _gsoSize = 0;            // payload bytes per segment
+        uint16_t _checksumStart = 0;      // from the start of the frame
+        uint16_t _checksumOffset = 0;     // of the checksum field, from checksumStart
+
+        bool checksumValid(void) const { return _flags & (CHECKSUM_PARTIAL | CHECKSUM_VALID); }
+    };
+
     class Frame
     {
         private:
-            std::unique_ptr<Packet> _buffer;
-            size_t                  _bufferSize;
+            Memory::PacketBuffer    _buffer;
             size_t                  _payloadSize;
 
             MacAddr                 _dstMac;
             MacAddr                 _srcMac;
             EtherType               _etherType;
             char*                   _payload;
-            CRC32                   _frameCheckSequence;    
+            Offload                 _offload;
+
+            // data that follows the frame's own, in frames of the same burst (see GRO::Coalescer)
+            Frame*                  _next = nullptr;
+            size_t                  _chainLength = 0;
 
         public:
             MacAddr   getDst(void)         { return _dstMac; }
@@ -47,18 +95,58 @@ namespace Ethernet
             EtherType getType(void)        { return _etherType; }
             char*     getPayload(void)     { return _payload; }
             size_t    getPayloadSize(void) { return _payloadSize; }
-            Packet*   getPacket(void)      { return _buffer.get(); }
-            CRC32     getCRC(void)         { return _frameCheckSequence; }
 
-            void      setBufferSize(size_t size) { _bufferSize = size; }
+            Memory::PacketBuffer& getBuffer(void) { return _buffer; }
+            char*     getData(void)        { return _buffer.data(); }
+            size_t    getBufferSize(void)  { return _buffer.length(); }
+            bool      hasBuffer(void)      { return static_cast<bool>(_buffer); }
+            Offload&  offload(void)        { return _offload; }
+            Frame*    getNext(void)        { return _next; }
+            size_t    getChainLength(void) { return _chainLength; }
+
+            void      setBufferSize(size_t size) { _buffer.setLength(size); }
+
+            /* forget the chained frames, the frame is back to its own buffer */
+            void      unchain(void)        { _next = nullptr; _chainLength = 0; }
+
+            /* address the frame back to its sender, from src */
+            void      swapAddresses(const MacAddr& src);
 
-            size_t    allocPacket(void)    
+            void      setDst(const MacAddr& dst);
+
+            /* buffer for a frame of up to size bytes, with headroom in front of it */
+            size_t    allocPacket(size_t size = MAX_FRAME_SIZE)    
             { 
-                _buffer = std::unique_ptr<Ethernet::Packet>(new Ethernet::Packet()); 
-                return MAX_FRAME_SIZE; 
+                if (!tryAllocPacket(size)) {
+                    throw std::runtime_error("ethernet.hpp: Ethernet::Frame::allocPacket(): packet buffers exhausted");
+                }
+                return size; 
+            }
+
+            /* like allocPacket() but returns false when the packet buffers are exhausted */
+            bool      tryAllocPacket(size_t size = MAX_FRAME_SIZE)
+            {
+                _buffer = Memory::PacketBuffer::allocate(size);
+                return static_cast<bool>(_buffer);
+            }
+
+            /* copy a buffer borrowed from a device ring, so the frame can be kept past its burst; false if out of buffers */
+            bool      own(void)
+            {
+                if (!_buffer.borrowed()) {
+                    return true;
+                }
+
+                char *data = _buffer.data();
+                if (!_buffer.own()) {
+                    return false;
+                }
+                _payload = _buffer.data() + (_payload - data);
+                return true;
             }
 
-            void       parseBuffer(void);
+            /* false if the buffer is too short for the header and payload */
+            bool      parseBuffer(void);
 
             /* used for TESTS and DEBUG */
 
@@ -66,6 +154,7 @@ namespace Ethernet
  
             template <typename T>
             friend class Ethernet::Manager;
+            friend class GRO::Coalescer;
     };
 
     template <typename T>
@@ -77,30 +166,241 @@ namespace Ethernet
         public:
     };
 
+    /* frames drained from a device in one wakeup, buffers stay allocated between bursts */
+    struct Burst
+    {
+        std::array<Frame, BURST_SIZE> frames;
+        size_t                        count = 0;
+        size_t                        runts = 0;    // frames dropped because they failed to parse
+    };
+
+    /*
+     * The TAP takes one frame per write(), so batching can't save syscalls here: the ring moves
+     * the writes out of the protocol handlers to the end of the burst, where they run back to
+     * back, and holds a frame's buffer until its write is done.
+     */
     template<>
     class Manager<TunDevice>
     {
         private:
-            TunDevice _device;
+            TunDevice                        _device;
+            std::array<Frame, TX_RING_SIZE>  _txRing;
+            size_t                           _txHead = 0;
+            size_t                           _txCount = 0;
+            uint64_t                         _txErrors = 0;
+
+            /* false if the write would block, any other error loses the frame */
+            bool written(int result);
         
         public:
-            Manager(const char *name) : _device{name} {}
-
-            Ethernet::Frame readDevice(void)
+            Manager(const std::optional<std::string_view> name, bool offload = false) : _device{name, false, offload} 
             {
-                Ethernet::Frame frame;
-                frame._buffer = std::unique_ptr<Ethernet::Packet>(new Ethernet::Packet());
-                frame._bufferSize = _device.readBuf(frame._buffer->buf, MAX_FRAME_SIZE);
+                _device.setNonBlocking();
+            }
 
-                frame.parseBuffer();
-                    
-                return frame;
+            Manager(TunDevice&& device) : _device{std::move(device)} 
+            {
+                _device.setNonBlocking();
             }
 
-            void writeDevice(Ethernet::Frame& frame) 
+            int fd(void) const { return _device.fd(); }
+
+            /* frames carry Offload information both ways */
+            bool offload(void) const { return _device.vnetHeader(); }
+
+            /* read up to BURST_SIZE frames without blocking, return how many were read */
+            size_t readBurst(Ethernet::Burst& burst);
+
+            /* write the frame now, false if the device would block and nothing was written */
+            bool   writeDevice(Ethernet::Frame& frame);
+
+            /*
+             * queue the frame for the next flush(), taking its buffer. false if the ring is still
+             * full after a flush: the frame is left as it was and the caller drops it.
+             */
+            bool   enqueue(Ethernet::Frame& frame);
+
+            /* write the queued frames in order, those the device won't take yet stay queued; return how many went */
+            size_t flush(void);
+
+            /* producers with more to send should hold it back until there is room */
+            bool   txFull(void)   const { return _txCount == TX_RING_SIZE; }
+
+            size_t txQueued(void) const { return _txCount; }
+
+            /* used for TESTS and DEBUG */
+
+            uint64_t txErrors(void) const { return _txErrors; }
+    };
+
+    /*
+     * Frames read and written through io_uring, see UringDevice. A received frame takes the
+     * buffer the kernel filled and leaves its own in the buffer ring in exchange. The queued
+     * frames are submitted in one batch per flush and keep their buffers until their writes
+     * complete, which may be out of order; a slot is reused once every write before it is done.
+     */
+    template<>
+    class Manager<UringDevice>
+    {
+        private:
+            static_assert(UringDevice::TX_ENTRIES >= TX_RING_SIZE, "a flush prepares a write per slot");
+
+            // declared first, so the device is gone before the buffers of its writes
+            std::array<Frame, TX_RING_SIZE>  _txRing;
+            std::array<bool, TX_RING_SIZE>   _txDone{};
+            size_t                           _txHead = 0;
+            size_t                           _txCount = 0;
+            size_t                           _txSubmitted = 0;     // the first of the queued frames
+            uint64_t                         _txErrors = 0;
+            UringDevice                      _device;
+
+            static size_t frameSize(bool offload);
+
+            /* take the completed writes, free their buffers and the slots at the head */
+            void reap(void);
+
+            /* move the frame to the next slot as the device takes it, false if it was lost for want of headroom */
+            bool stage(Frame& frame);
+
+        public:
+            Manager(const std::optional<std::string_view> name, bool offload = false, bool sqPoll = false)
+                : _device{TunDevice{name, false, offload}, frameSize(offload), sqPoll} {}
+
+            Manager(TunDevice&& device, bool sqPoll = false)
+                : _device{std::move(device), frameSize(device.vnetHeader()), sqPoll} {}
+
+            int fd(void) const { return _device.fd(); }
+
+            bool offload(void) const { return _device.vnetHeader(); }
+
+            /* take up to BURST_SIZE completed reads, return how many frames they made */
+            size_t readBurst(Ethernet::Burst& burst);
+
+            /*
+             * queue the frame for the next flush(), taking its buffer. false if the ring is still
+             * full after a flush: the frame is left as it was and the caller drops it.
+             */
+            bool   enqueue(Ethernet::Frame& frame);
+
+            /* submit the queued frames with one syscall, return how many were submitted */
+            size_t flush(void);
+
+            bool   txFull(void)     const { return _txCount == TX_RING_SIZE; }
+
+            size_t txQueued(void)   const { return _txCount - _txSubmitted; }
+
+            /* used for TESTS and DEBUG */
+
+            size_t txInFlight(void) const { return _txSubmitted; }
+
+            uint64_t txErrors(void) const { return _txErrors; }
+
+            UringDevice& device(void) { return _device; }
+    };
+
+    /*
+     * Frames straight from an AF_PACKET socket's rings, see PacketDevice. A received frame
+     * borrows its place in the RX ring and is gone with the next burst, whatever keeps one
+     * longer copies it first (Frame::own()). There is no virtio-net header: checksums and
+     * segmentation are done before a frame is copied into a TX slot by enqueue(), and a flush
+     * sends every slot filled since the last one with a single send().
+     */
+    template<>
+    class Manager<PacketDevice>
+    {
+        private:
+            PacketDevice _device;
+            size_t       _txQueued = 0;
+            uint64_t     _txErrors = 0;
+
+            /* copy the pieces into the next TX slot, false if the ring is full */
+            bool put(const char* headers, size_t headerLength, const char* payload, size_t payloadSize);
+
+        public:
+            Manager(std::string_view interface) : _device{interface, Memory::PacketBuffer::DEFAULT_HEADROOM} {}
+
+            int fd(void) const { return _device.fd(); }
+
+            bool offload(void) const { return false; }
+
+            /* hand the last burst's frames back to the kernel and take up to BURST_SIZE new ones */
+            size_t readBurst(Ethernet::Burst& burst);
+
+            /*
+             * copy the frame to the TX ring for the next flush(), releasing its buffer. false if
+             * the ring is still full after a flush: the frame is left as it was and the caller drops it.
+             */
+            bool   enqueue(Ethernet::Frame& frame);
+
+            /* send the queued frames, return how many there were */
+            size_t flush(void);
+
+            bool   txFull(void)         { return _device.txFull(); }
+
+            size_t txQueued(void) const { return _txQueued; }
+
+            /* used for TESTS and DEBUG */
+
+            uint64_t txErrors(void) const { return _txErrors; }
+
+            PacketDevice& device(void) { return _device; }
+    };
+
+    /*
+     * Frames replayed from a capture, see PcapDevice. A frame is copied from the mapped file
+     * into a pool buffer as a TAP read would copy it, so a replay costs the stack what live
+     * traffic does without the syscalls per frame. Frames sent are checksummed and segmented
+     * as for a TAP without offloads and appended to the output capture by enqueue().
+     */
+    template<>
+    class Manager<PcapDevice>
+    {
+        private:
+            PcapDevice _device;
+            size_t     _txQueued = 0;       // written since the last flush
+            uint64_t   _rxFrames = 0;
+            uint64_t   _txFrames = 0;
+            uint64_t   _txErrors = 0;
+
+            void write(const char* headers, size_t headerLength, const char* payload, size_t payloadSize);
+
+        public:
+            /* an empty output discards the frames sent, paced replays the capture at its recorded pace */
+            Manager(std::string_view input, std::string_view output = {}, bool paced = false) 
+                : _device{input, output, paced}
             {
-                _device.writeBuf(frame._buffer->buf, frame._bufferSize);
+                _device.arm();
             }
+
+            int fd(void) const { return _device.fd(); }
+
+            bool offload(void) const { return false; }
+
+            /* take up to BURST_SIZE frames that are due, return how many */
+            size_t readBurst(Ethernet::Burst& burst);
+
+            /* write the frame to the output capture, releasing its buffer; always true */
+            bool   enqueue(Ethernet::Frame& frame);
+
+            /* return how many frames were written since the last flush */
+            size_t flush(void);
+
+            bool   txFull(void)   const { return false; }
+
+            size_t txQueued(void) const { return _txQueued; }
+
+            /* every frame of the capture was read */
+            bool   done(void) { return _device.done(); }
+
+            uint64_t rxFrames(void) const { return _rxFrames; }
+
+            uint64_t txFrames(void) const { return _txFrames; }
+
+            uint64_t txErrors(void) const { return _txErrors; }
+
+            /* used for TESTS and DEBUG */
+
+            PcapDevice& device(void) { return _device; }
     };
 }
 #endif
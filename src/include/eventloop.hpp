@@ -0,0 +1,55 @@
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include <sys/epoll.h>
+
+#include "timerwheel.hpp"
+
+namespace Event
+{
+    using Callback = std::function<void(uint32_t events)>;
+
+    class Loop
+    {
+        private:
+            static constexpr int MAX_EVENTS = 64;
+
+            int                               _epollFd = -1;
+            bool                              _running = false;
+            std::unordered_map<int, Callback> _handlers;
+            TimerWheel                        _timers;
+
+        public:
+            Loop();
+
+            ~Loop();
+
+            Loop(const Loop&) = delete;
+
+            Loop& operator=(const Loop&) = delete;
+
+            /* the callback is invoked once per wakeup, it should drain the fd */
+            void add(int fd, uint32_t events, Callback callback);
+
+            /* change the events fd is watched for, its callback stays */
+            void modify(int fd, uint32_t events);
+
+            void remove(int fd);
+
+            /* wait at most timeoutMs (-1 blocks) or until the next timer, return the number of fds served */
+            int  runOnce(int timeoutMs);
+
+            void run(void);
+
+            void stop(void) { _running = false; }
+
+            /* advanced on every wakeup by the monotonic clock, before the fd callbacks run */
+            TimerWheel& timers(void) { return _timers; }
+    };
+}
+
+#endif
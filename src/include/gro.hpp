@@ -0,0 +1,76 @@
+#ifndef GRO_HPP
+#define GRO_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "types.hpp"
+#include "ethernet.hpp"
+#include "tcp.hpp"
+
+namespace GRO
+{
+    using Frames = std::array<Ethernet::Frame*, Ethernet::BURST_SIZE>;
+
+    /*
+     * Receive side coalescing of TCP over IPv4, after Linux's GRO. Consecutive in order data
+     * segments of a flow in one burst are merged into the first one: their frames are chained
+     * to it instead of copied and its IP total length grows to cover them, so IP and TCP parse
+     * it, look up its connection and acknowledge it once. Every segment's checksums are checked
+     * here on the way in. A segment that is more than plain data (SYN, FIN, RST, URG, IP options
+     * or fragments), out of order, longer than the first one or whose ACK, TTL or TCP options
+     * differ ends its flow and passes on by itself; a shorter one or a PSH is merged and ends it
+     * too. Flows are flushed at the end of the burst, GRO never holds a segment back.
+     */
+    class Coalescer
+    {
+        private:
+            static constexpr size_t MAX_FLOWS = 8;
+
+            struct Flow
+            {
+                Ethernet::Frame* _head;
+                Ethernet::Frame* _last;
+                IPAddr           _srcAddr;
+                IPAddr           _dstAddr;
+                uint32_t         _ports;
+                TCP::Seq         _nextSeq;
+                uint16_t         _segmentSize;    // payload of the first segment, no later one is longer
+                uint16_t         _length;         // payload of all segments
+                uint16_t         _segments;
+            };
+
+            struct Segment;
+
+            std::array<Flow, MAX_FLOWS> _flows;
+            size_t                      _count = 0;
+
+            uint64_t                    _merged = 0;
+
+            /* false if frame isn't TCP over IPv4, segment._data tells if it may be merged */
+            static bool parse(Ethernet::Frame& frame, Segment& segment);
+
+            Flow* find(const Segment& segment);
+
+            bool  mergeable(const Flow& flow, Ethernet::Frame& frame, const Segment& segment);
+
+            void  merge(Flow& flow, Ethernet::Frame& frame, const Segment& segment);
+
+            /* rewrite the head's IP header for the whole run and stop tracking the flow */
+            void  flush(Flow& flow);
+
+        public:
+            /*
+             * coalesce the frames of burst, frames is filled in their order with those left to
+             * process, the merged ones are skipped. Returns how many there are.
+             */
+            size_t coalesce(Ethernet::Burst& burst, Frames& frames);
+
+            /* used for TESTS and DEBUG */
+
+            uint64_t merged(void) const { return _merged; }
+    };
+}
+
+#endif
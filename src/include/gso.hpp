@@ -0,0 +1,65 @@
+#ifndef GSO_HPP
+#define GSO_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "types.hpp"
+#include "ethernet.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+
+namespace GSO
+{
+    // ethernet, IP and TCP headers, options included
+    constexpr size_t MAX_HEADER_SIZE = Ethernet::HeaderLayout::SIZE + 60 + 60;
+
+    /* one frame cut from a GSO frame: its own headers and a slice of the GSO frame's data */
+    struct Segment
+    {
+        std::array<char, MAX_HEADER_SIZE> _headers;
+        size_t                            _headerLength = 0;
+        const char*                       _payload = nullptr;
+        size_t                            _payloadSize = 0;
+    };
+
+    /*
+     * Software segmentation for devices without TSO, what the kernel does with the virtio-net
+     * header otherwise. The headers of the GSO frame are copied in front of every gsoSize bytes
+     * of its data and fixed up: IP total length and ID with the header checksum patched
+     * (RFC 1624), TCP sequence number, FIN and PSH on the last segment only, CWR on the first.
+     * The data is never copied, a segment points into the GSO frame, and its TCP checksum is
+     * the sum of its header and data on top of the pseudo header. A frame that is not a valid
+     * GSO_TCPV4 frame yields no segments.
+     */
+    class Segmenter
+    {
+        private:
+            const char* _frame;
+            size_t      _length;
+            size_t      _headerLength = 0;
+            size_t      _ipOffset;
+            size_t      _tcpOffset;
+            size_t      _gsoSize = 0;
+            size_t      _offset = 0;
+
+            IPAddr      _srcAddr;
+            IPAddr      _dstAddr;
+            IP::ID      _id;
+            TCP::Seq    _seq;
+
+        public:
+            explicit Segmenter(Ethernet::Frame& frame);
+
+            /* the next segment, false after the last one */
+            bool next(Segment& segment);
+
+            size_t segments(void) const { return _gsoSize ? (_length - _headerLength + _gsoSize - 1) / _gsoSize : 0; }
+    };
+
+    /* fill in a CHECKSUM_PARTIAL frame's checksum, whose field holds the pseudo header sum */
+    void completeChecksum(Ethernet::Frame& frame);
+}
+
+#endif
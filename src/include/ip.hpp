@@ -2,7 +2,13 @@
 #define IPV4_HPP
 
 #include "types.hpp"
+#include "arp.hpp"
 #include "ethernet.hpp"
+#include "layout.hpp"
+#include "reassembly.hpp"
+#include "route.hpp"
+#include "tcp.hpp"
+#include "verdict.hpp"
 
 namespace IP {
     enum {
@@ -15,6 +21,7 @@ namespace IP {
     };
 
     enum {
+        FLAG_MORE   = 0x1,
         FLAG_NOFRAG = 0x2,
     };
 
@@ -36,10 +43,25 @@ namespace IP {
     using Length8  = uint8_t;
     using Var      = uint16_t;
  
-    constexpr size_t HEADER_SIZE = sizeof(Fields1) + sizeof(TOS) + sizeof(Length16) + sizeof(ID) + 
-                                sizeof(Fields2) + sizeof(TTL) + sizeof(Protocol) + sizeof(Checksum) + 2 * sizeof(IPAddr);
+    using HeaderLayout = Memory::Layout<Fields1, TOS, Length16, ID, Fields2, TTL, Protocol, Checksum, IPAddr, IPAddr>;
 
-    constexpr size_t ICMP_HEADER_SIZE = sizeof(Type) + sizeof(Code) + sizeof(Checksum);
+    using ICMPHeaderLayout      = Memory::Layout<Type, Code, Checksum>;
+    using ICMPEchoLayout        = Memory::Layout<ID, Sequence>;
+    using ICMPUnreachableLayout = Memory::Layout<uint8_t, Length8, Var>;
+
+    constexpr size_t HEADER_SIZE = HeaderLayout::SIZE;
+
+    constexpr size_t ICMP_HEADER_SIZE = ICMPHeaderLayout::SIZE;
+
+    constexpr TTL DEFAULT_TTL = 64;
+
+    // byte offsets of the fields rewritten in place when turning a request into a reply
+    constexpr size_t IP_ID_OFFSET         = HeaderLayout::offset<3>();
+    constexpr size_t IP_TTL_OFFSET        = HeaderLayout::offset<5>();
+    constexpr size_t IP_CHECKSUM_OFFSET   = HeaderLayout::offset<7>();
+    constexpr size_t IP_SRC_OFFSET        = HeaderLayout::offset<8>();
+    constexpr size_t IP_DST_OFFSET        = HeaderLayout::offset<9>();
+    constexpr size_t ICMP_CHECKSUM_OFFSET = ICMPHeaderLayout::offset<2>();
 
     class Header {
         private:
@@ -62,7 +84,11 @@ namespace IP {
             size_t getPayloadSize(void) { return _payloadSize; }
             char*  getPayload(void)     { return _payload; }
 
-            size_t readFromBuffer(char *buffer, size_t bufferLength);      
+            /* header size including options */
+            size_t headerLength(void)   { return _f1._ihl * 4; }
+
+            /* false if the buffer is shorter than the header */
+            bool   readFromBuffer(char *buffer, size_t bufferLength);
  
             Checksum calculateChecksum(void);
 
@@ -71,6 +97,7 @@ namespace IP {
             void debugPrint(void);
 
             friend class Manager;
+            friend class Reassembler;
     };
 
     class PayloadICMPv4Header {
@@ -87,7 +114,7 @@ namespace IP {
             size_t getPayloadSize(void) { return _payloadSize; }
             char*  getPayload(void)     { return _payload; }
 
-            size_t readFromBuffer(char* buffer, size_t bufferLength);
+            bool   readFromBuffer(char* buffer, size_t bufferLength);
 
             /* used for TESTS and DEBUG */
         
@@ -106,7 +133,7 @@ namespace IP {
             char*    _payload;
 
         public:
-            size_t readFromBuffer(char* buffer, size_t bufferLength);
+            bool   readFromBuffer(char* buffer, size_t bufferLength);
 
             /* used for TESTS and DEBUG */
         
@@ -126,7 +153,7 @@ namespace IP {
             char*    _payload;
 
         public:
-            size_t readFromBuffer(char* buffer, size_t bufferLength);
+            bool   readFromBuffer(char* buffer, size_t bufferLength);
 
             /* used for TESTS and DEBUG */
         
@@ -137,19 +164,53 @@ namespace IP {
 
     class Manager {
         private:  
-            Ethernet::Frame replyMessage(IP::Header& header);
-            
-            Ethernet::Frame handleICMPRequest(Ethernet::Frame& frame, IP::Header& header, 
-                    IP::PayloadICMPv4Header& icmpHeader, IP::PayloadICMPv4Echo& icmpEcho);
+            ID                 _idNum = 1;
+            ARP::CacheManager& _arp;
+            RouteTable         _routes;
+            ARP::Transmit      _transmit;
+            TCP::Manager       _tcp;
+            Reassembler        _reassembly;
+
+            /* put the IP and ethernet headers in front of the payload in frame and address it to nextHop */
+            Verdict::Result send(Ethernet::Frame& frame, IPAddr src, IPAddr dst, Protocol proto, ID id, 
+                    Fields2 fields2, IPAddr nextHop);
+
+            /* turn the echo request into its reply, in its own buffer */
+            Verdict::Result handleICMPRequest(Ethernet::Frame& frame, IP::Header& header, 
+                    IP::PayloadICMPv4Header& icmpHeader);
             
-            Ethernet::Frame handleICMPMessage(Ethernet::Frame& frame, IP::Header& header);
+            Verdict::Result handleICMPMessage(Ethernet::Frame& frame, IP::Header& header);
 
-            Checksum calculateChecksum(void *buffer, size_t count);
+            /* the TCP reply is written over the segment */
+            Verdict::Result handleTCPMessage(Ethernet::Frame& frame, IP::Header& header);
  
         public:
-            Manager() = default;
+            /* next hops are resolved by arp */
+            explicit Manager(ARP::CacheManager& arp, size_t maxConnections = TCP::Manager::DEFAULT_CONNECTIONS) 
+                : _arp{arp}, _tcp{maxConnections} {}
+
+            /* 
+             * timers for reassembly and TCP, expired fragments are counted into drops. transmit sends
+             * all but the last fragment of a datagram that output() splits.
+             */
+            void attach(Event::TimerWheel& timers, ARP::Transmit transmit = nullptr, Verdict::DropCounters* drops = nullptr);
+
+            /*
+             * send the payload in frame, which starts at the transport header, from src to dst. The
+             * headers go into the headroom. A TCP payload over the MTU goes as one GSO frame, see
+             * Ethernet::Offload, any other is split into fragments unless dontFragment.
+             * Returns like ARP::CacheManager::output(): on REPLY frame is ready to go.
+             */
+            Verdict::Result output(Ethernet::Frame& frame, IPAddr src, IPAddr dst, Protocol proto, bool dontFragment = false);
+
+            /* on REPLY the frame holds the reply, fragments are held until their datagram is whole */
+            Verdict::Result handleMessage(Ethernet::Frame& frame);
+
+            RouteTable&   routes(void) { return _routes; }
+
+            TCP::Manager& tcp(void) { return _tcp; }
 
-            Ethernet::Frame handleMessage(Ethernet::Frame& frame);
+            Reassembler&  reassembly(void) { return _reassembly; }
     };
 }
 
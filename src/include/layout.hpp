@@ -0,0 +1,177 @@
+#ifndef LAYOUT_HPP
+#define LAYOUT_HPP
+
+#include <arpa/inet.h>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "types.hpp"
+
+namespace Memory
+{
+    /* wire format of a field: its size and how it moves between the buffer and host order */
+    template <typename T, typename Enable = void>
+    struct Codec;
+
+    template <typename T>
+    struct Codec<T, std::enable_if_t<std::is_integral_v<T>>>
+    {
+        static_assert(sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4, "no network order for this size");
+
+        static constexpr std::size_t SIZE = sizeof(T);
+
+        static void load(T& dest, const char *src)
+        {
+            T value;
+            std::memcpy(&value, src, SIZE);
+
+            if constexpr (SIZE == 2) {
+                value = ntohs(value);
+            } else if constexpr (SIZE == 4) {
+                value = ntohl(value);
+            }
+            dest = value;
+        }
+
+        static void store(const T& src, char *dest)
+        {
+            T value = src;
+
+            if constexpr (SIZE == 2) {
+                value = htons(value);
+            } else if constexpr (SIZE == 4) {
+                value = htonl(value);
+            }
+            std::memcpy(dest, &value, SIZE);
+        }
+    };
+
+    template <>
+    struct Codec<MacAddr>
+    {
+        static constexpr std::size_t SIZE = 6;
+
+        static void load(MacAddr& dest, const char *src) { std::memcpy(dest.addr.data(), src, SIZE); }
+
+        static void store(const MacAddr& src, char *dest) { std::memcpy(dest, src.addr.data(), SIZE); }
+    };
+
+    template <>
+    struct Codec<IP::Fields1>
+    {
+        static constexpr std::size_t SIZE = 1;
+
+        static void load(IP::Fields1& dest, const char *src)
+        {
+            uint8_t value = static_cast<uint8_t>(*src);
+
+            dest._version = value >> 4;
+            dest._ihl     = value & 0xF;
+        }
+
+        static void store(const IP::Fields1& src, char *dest)
+        {
+            *dest = static_cast<char>(src._version << 4 | (src._ihl & 0xF));
+        }
+    };
+
+    template <>
+    struct Codec<IP::Fields2>
+    {
+        static constexpr std::size_t SIZE = 2;
+
+        static void load(IP::Fields2& dest, const char *src)
+        {
+            uint16_t value;
+            Codec<uint16_t>::load(value, src);
+
+            dest._flags      = value >> 13;
+            dest._fragOffset = value & 0x1FFF;
+        }
+
+        static void store(const IP::Fields2& src, char *dest)
+        {
+            Codec<uint16_t>::store(static_cast<uint16_t>(src._flags << 13 | (src._fragOffset & 0x1FFF)), dest);
+        }
+    };
+
+    /*
+     * A header declared once as the list of its field types in wire order. Offsets, the total
+     * size and byte swaps are resolved at compile time, so parsing or serializing a header is
+     * one bounds check followed by straight loads or stores.
+     */
+    template <typename... Fields>
+    class Layout
+    {
+        private:
+            static constexpr std::array<std::size_t, sizeof...(Fields)> makeOffsets(void)
+            {
+                std::array<std::size_t, sizeof...(Fields)> offsets{};
+                constexpr std::size_t sizes[] = { Codec<Fields>::SIZE... };
+
+                std::size_t offset = 0;
+                for (std::size_t i = 0; i < sizeof...(Fields); ++i) {
+                    offsets[i] = offset;
+                    offset += sizes[i];
+                }
+                return offsets;
+            }
+
+            static constexpr std::array<std::size_t, sizeof...(Fields)> OFFSETS = makeOffsets();
+
+            template <std::size_t... I>
+            static void loadAll(const char *buffer, std::index_sequence<I...>, Fields&... fields)
+            {
+                (Codec<Fields>::load(fields, buffer + OFFSETS[I]), ...);
+            }
+
+            template <std::size_t... I>
+            static void storeAll(char *buffer, std::index_sequence<I...>, const Fields&... fields)
+            {
+                (Codec<Fields>::store(fields, buffer + OFFSETS[I]), ...);
+            }
+
+        public:
+            static constexpr std::size_t SIZE = (Codec<Fields>::SIZE + ... + 0);
+
+            template <std::size_t I>
+            static constexpr std::size_t offset(void) { return OFFSETS[I]; }
+
+            /* no bounds check, the caller made sure SIZE bytes are there */
+            static void load(const char *buffer, Fields&... fields)
+            {
+                loadAll(buffer, std::index_sequence_for<Fields...>{}, fields...);
+            }
+
+            static void store(char *buffer, const Fields&... fields)
+            {
+                storeAll(buffer, std::index_sequence_for<Fields...>{}, fields...);
+            }
+
+            /* false, leaving the fields untouched, if the buffer is shorter than the header */
+            static bool read(const char *buffer, std::size_t bufferLength, Fields&... fields)
+            {
+                if (bufferLength < SIZE) {
+                    return false;
+                }
+
+                load(buffer, fields...);
+                return true;
+            }
+
+            static bool write(char *buffer, std::size_t bufferLength, const Fields&... fields)
+            {
+                if (bufferLength < SIZE) {
+                    return false;
+                }
+
+                store(buffer, fields...);
+                return true;
+            }
+    };
+}
+
+#endif
@@ -2,49 +2,128 @@
 #define MEMORYPOOL_HPP
 
 #include <arpa/inet.h>
+#include <atomic>
 #include <cstdint>
 #include <cstring>
 #include <stack>
 #include <vector>
 #include <list>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <stdexcept>
 
 #include "types.hpp"
 
 namespace Memory 
 {
+    /*
+     * Fixed size blocks carved from slabs of totalBlocks objects. The pool starts with one slab
+     * and grows by one slab at a time while it stays within maxBlocks. Block indices are global
+     * (slab * slab size + offset), so they stay valid as slabs come and go.
+     */
     template <typename T>
     class ObjectPool 
     {
         private:
-    static constexpr std::size_t DEFAULT_TOTAL_BLOCKS = 1000;
-    
-            std::vector<T>     _memory;
-            std::size_t        _totalBlocks;
-            std::stack<std::size_t> _freeBlocks;
+            static constexpr std::size_t DEFAULT_TOTAL_BLOCKS = 1000;
+
+            std::vector<std::unique_ptr<T[]>> _slabs;
+            std::vector<std::size_t>          _slabUsed;
+            std::size_t                       _slabBlocks;
+            std::size_t                       _maxSlabs;
+            std::size_t                       _totalBlocks = 0;
+            std::stack<std::size_t>           _freeBlocks;
+
+            /* add a slab, false if the pool is at its cap or out of memory */
+            bool grow() noexcept
+            {
+                std::size_t slab = 0;
+                while (slab < _slabs.size() && _slabs[slab]) {
+                    ++slab;
+                }
+
+                if (slab == _maxSlabs) {
+                    return false;
+                }
+
+                // the free list allocates as it grows, a failure takes the slab back out
+                std::size_t pushed = 0;
+                try {
+                    if (slab == _slabs.size()) {
+                        _slabs.emplace_back();
+                        _slabUsed.push_back(0);
+                    }
+                    _slabs[slab] = std::unique_ptr<T[]>(new T[_slabBlocks]);
+
+                    // pushed backwards so the slab is handed out from its first block.
+                    for (std::size_t i = _slabBlocks; i > 0; --i, ++pushed) {
+                        _freeBlocks.push(slab * _slabBlocks + i - 1);
+                    }
+                } catch (...) {
+                    for (; pushed > 0; --pushed) {
+                        _freeBlocks.pop();
+                    }
+                    if (slab < _slabs.size()) {
+                        _slabs[slab].reset();
+                    }
+                    return false;
+                }
+
+                _totalBlocks += _slabBlocks;
+                return true;
+            }
+
+            std::size_t slabOf(T* block)
+            {
+                for (std::size_t slab = 0; slab < _slabs.size(); ++slab) {
+                    T* base = _slabs[slab].get();
+                    if (base != nullptr && block >= base && block < base + _slabBlocks) {
+                        return slab;
+                    }
+                }
+
+                throw std::runtime_error("memorypool.hpp: Memory::ObjectPool<T>::deallocate(): block doesn't belong to the pool");
+            }
         
         public:
-            ObjectPool(std::size_t totalBlocks = DEFAULT_TOTAL_BLOCKS)
-                : _memory(totalBlocks),
-                  _totalBlocks{totalBlocks},
+            /* maxBlocks == 0 keeps the pool at its initial size */
+            ObjectPool(std::size_t totalBlocks = DEFAULT_TOTAL_BLOCKS, std::size_t maxBlocks = 0)
+                : _slabBlocks{totalBlocks},
+                  _maxSlabs{totalBlocks != 0 && maxBlocks > totalBlocks ? maxBlocks / totalBlocks : 1},
                   _freeBlocks{}
             {
-                for (std::size_t i = 0; i < totalBlocks; ++i) {
-                    _freeBlocks.push(i);
+                if (totalBlocks == 0) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ObjectPool<T>(): a slab needs at least one block");
                 }
+
+                _slabs.reserve(_maxSlabs);
+                _slabUsed.reserve(_maxSlabs);
+                grow();
             }
-  
-            T* allocate()
+
+            /* return nullptr instead of throwing when the pool can't grow anymore */
+            T* tryAllocate() noexcept
             {
-                if (_freeBlocks.empty()) {
-                    throw std::runtime_error("memorypool.hpp: Memory::ObjectPool<T>::allocate(): there aren't any free blocks");
+                if (_freeBlocks.empty() && !grow()) {
+                    return nullptr;
                 }
             
                 std::size_t blockIndex = _freeBlocks.top();
                 _freeBlocks.pop();
+                ++_slabUsed[blockIndex / _slabBlocks];
+            
+                return block(blockIndex);
+            }
+  
+            T* allocate()
+            {
+                T* ptr = tryAllocate();
+                if (ptr == nullptr) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ObjectPool<T>::allocate(): there aren't any free blocks");
+                }
             
-                return &(_memory[blockIndex]);
+                return ptr;
             }
             
             void deallocate(void* ptr)
@@ -54,46 +133,471 @@ namespace Memory
                     throw std::runtime_error("memorypool.hpp: Memory::ObjectPool<T>::deallocate(): block is nullptr");
                 }
             
-                std::size_t blockIndex = block - &(_memory[0]);
+                std::size_t slab = slabOf(block);
+                std::size_t blockIndex = slab * _slabBlocks + (block - _slabs[slab].get());
+                --_slabUsed[slab];
                 _freeBlocks.push(blockIndex);
             }
 
+            /* give the memory of idle slabs back to the OS, the first slab is always kept */
+            void shrink()
+            {
+                std::vector<bool> release(_slabs.size(), false);
+                bool any = false;
+                for (std::size_t slab = 1; slab < _slabs.size(); ++slab) {
+                    if (_slabs[slab] && _slabUsed[slab] == 0) {
+                        release[slab] = any = true;
+                    }
+                }
+
+                if (!any) {
+                    return;
+                }
+
+                std::stack<std::size_t> kept;
+                while (!_freeBlocks.empty()) {
+                    std::size_t blockIndex = _freeBlocks.top();
+                    _freeBlocks.pop();
+                    if (!release[blockIndex / _slabBlocks]) {
+                        kept.push(blockIndex);
+                    }
+                }
+                while (!kept.empty()) {
+                    _freeBlocks.push(kept.top());
+                    kept.pop();
+                }
+
+                for (std::size_t slab = 0; slab < _slabs.size(); ++slab) {
+                    if (release[slab]) {
+                        _slabs[slab].reset();
+                        _totalBlocks -= _slabBlocks;
+                    }
+                }
+            }
+
             /* used for TESTS and DEBUG */
 
-            std::vector<T>* memory() { return &_memory; }
+            T* block(std::size_t blockIndex) { return &(_slabs[blockIndex / _slabBlocks][blockIndex % _slabBlocks]); }
+
+            std::size_t totalBlocks() { return _totalBlocks; }
  
             std::stack<std::size_t>* freeBlocks() { return &_freeBlocks; }
     };
  
-    class Block 
+    /* 
+     * concurrent pools cache blocks per thread, in the slot of the calling thread. A thread takes
+     * the lowest free slot on first use and gives it back when it exits, after every pool took its
+     * cached blocks back, so slots are reused by later threads. NO_SLOT once MAX_THREADS threads
+     * hold one, or after the calling thread's slot was given back.
+     */
+    constexpr std::size_t MAX_THREADS = 64;
+    constexpr std::size_t NO_SLOT = MAX_THREADS;
+
+    std::size_t threadSlot(void);
+
+    /* a pool with per-thread caches, told when a thread gives its slot back */
+    class ThreadCaches
     {
         public:
-            unsigned char* _addr;
-        
-        Block() = default;
+            /* return slot's cached blocks to the pool, called by the exiting thread */
+            virtual void reclaim(std::size_t slot) = 0;
+
+        protected:
+            ~ThreadCaches() = default;
+    };
+
+    /* a pool is reclaimed from while registered, it registers once built and leaves before it is torn down */
+    void registerCaches(ThreadCaches* caches);
+
+    void unregisterCaches(ThreadCaches* caches);
+
+    /*
+     * Thread safe ObjectPool. The shared free list is a Treiber stack of block indices whose head
+     * carries an ABA tag, and every thread keeps a magazine of blocks that is refilled from and
+     * flushed to it in batches. A block remembers the thread it was allocated by: freed by
+     * another thread it is pushed on its owner's remote list, which the owner takes back whole
+     * once its magazine runs dry. An exiting thread hands its magazine and remote list back to
+     * the shared list. Like ObjectPool it grows by slabs of totalBlocks up to maxBlocks; slabs
+     * are never released while the pool is alive.
+     */
+    template <typename T>
+    class ConcurrentObjectPool : public ThreadCaches
+    {
+        private:
+            static constexpr std::size_t DEFAULT_TOTAL_BLOCKS = 1000;
+            static constexpr std::size_t MAGAZINE_SIZE = 32;
+            static constexpr std::size_t BATCH_SIZE = MAGAZINE_SIZE / 2;
+            static constexpr uint32_t    NIL = UINT32_MAX;
+
+            struct alignas(64) Magazine
+            {
+                std::size_t                       _count = 0;
+                uint32_t                          _blocks[MAGAZINE_SIZE];
+                alignas(64) std::atomic<uint32_t> _remote{NIL};     // pushed by other threads
+            };
+
+            struct Slab
+            {
+                std::unique_ptr<T[]>                     _memory;
+                std::unique_ptr<std::atomic<uint32_t>[]> _next;
+                std::unique_ptr<std::atomic<uint8_t>[]>  _owner;    // slot of the allocating thread
+            };
+
+            std::size_t                       _slabBlocks;
+            std::size_t                       _maxSlabs;
+            std::unique_ptr<Slab[]>           _slabs;
+            std::atomic<std::size_t>          _slabCount{0};
+            std::mutex                        _growLock;
+            std::unique_ptr<Magazine[]>       _magazines;
+            alignas(64) std::atomic<uint64_t> _head;
+
+            static uint32_t index(uint64_t head) { return static_cast<uint32_t>(head); }
+
+            static uint64_t tagged(uint64_t head, uint32_t index) { return ((head >> 32) + 1) << 32 | index; }
+
+            std::atomic<uint32_t>& next(uint32_t blockIndex) 
+            { 
+                return _slabs[blockIndex / _slabBlocks]._next[blockIndex % _slabBlocks]; 
+            }
+
+            std::atomic<uint8_t>& owner(uint32_t blockIndex) 
+            { 
+                return _slabs[blockIndex / _slabBlocks]._owner[blockIndex % _slabBlocks]; 
+            }
+
+            uint32_t pop(void)
+            {
+                uint64_t head = _head.load(std::memory_order_acquire);
+                while (index(head) != NIL) {
+                    uint32_t nextIndex = next(index(head)).load(std::memory_order_relaxed);
+                    if (_head.compare_exchange_weak(head, tagged(head, nextIndex), 
+                                std::memory_order_acq_rel, std::memory_order_acquire)) {
+                        return index(head);
+                    }
+                }
+
+                return NIL;
+            }
 
-        Block(unsigned char* addr) : _addr{addr} {} 
+            /* push the chain first -> ... -> last, already linked through next() */
+            void push(uint32_t first, uint32_t last)
+            {
+                uint64_t head = _head.load(std::memory_order_relaxed);
+                do {
+                    next(last).store(index(head), std::memory_order_relaxed);
+                } while (!_head.compare_exchange_weak(head, tagged(head, first), 
+                            std::memory_order_release, std::memory_order_relaxed));
+            }
 
-        static void* operator new(std::size_t size);
-        static void operator delete(void *ptr);
+            /* push a NIL terminated chain */
+            void pushChain(uint32_t first)
+            {
+                uint32_t last = first;
+                for (uint32_t i = next(first).load(std::memory_order_relaxed); i != NIL; i = next(i).load(std::memory_order_relaxed)) {
+                    last = i;
+                }
+                push(first, last);
+            }
+
+            /* 
+             * a remote list is only ever taken whole, so unlike the shared list it needs no tag:
+             * the block pushed can't be popped from under the CAS
+             */
+            void pushRemote(std::size_t slot, uint32_t blockIndex)
+            {
+                std::atomic<uint32_t>& remote = _magazines[slot]._remote;
+                uint32_t first = remote.load(std::memory_order_relaxed);
+                do {
+                    next(blockIndex).store(first, std::memory_order_relaxed);
+                } while (!remote.compare_exchange_weak(first, blockIndex, std::memory_order_release, std::memory_order_relaxed));
+            }
+
+            uint32_t takeRemote(std::size_t slot) { return _magazines[slot]._remote.exchange(NIL, std::memory_order_acquire); }
+
+            /* pop a block, adding a slab when the shared list is empty */
+            uint32_t popOrGrow(void)
+            {
+                uint32_t blockIndex = pop();
+                if (blockIndex != NIL) {
+                    return blockIndex;
+                }
+
+                std::lock_guard<std::mutex> guard{_growLock};
+
+                // another thread may have grown the pool while we waited, and blocks freed to
+                // threads that exited or don't allocate wait on remote lists.
+                blockIndex = pop();
+                if (blockIndex != NIL) {
+                    return blockIndex;
+                }
+                for (std::size_t slot = 0; slot < MAX_THREADS; ++slot) {
+                    uint32_t chain = takeRemote(slot);
+                    if (chain != NIL) {
+                        pushChain(chain);
+                    }
+                }
+
+                blockIndex = pop();
+                std::size_t slab = _slabCount.load(std::memory_order_relaxed);
+                if (blockIndex != NIL || slab == _maxSlabs) {
+                    return blockIndex;
+                }
+
+                Slab& newSlab = _slabs[slab];
+                newSlab._memory = std::unique_ptr<T[]>(new (std::nothrow) T[_slabBlocks]);
+                newSlab._next = std::unique_ptr<std::atomic<uint32_t>[]>(new (std::nothrow) std::atomic<uint32_t>[_slabBlocks]);
+                newSlab._owner = std::unique_ptr<std::atomic<uint8_t>[]>(new (std::nothrow) std::atomic<uint8_t>[_slabBlocks]);
+                if (!newSlab._memory || !newSlab._next || !newSlab._owner) {
+                    newSlab._memory.reset();
+                    newSlab._next.reset();
+                    newSlab._owner.reset();
+                    return NIL;
+                }
+
+                uint32_t first = static_cast<uint32_t>(slab * _slabBlocks);
+                for (std::size_t i = 0; i + 1 < _slabBlocks; ++i) {
+                    newSlab._next[i].store(static_cast<uint32_t>(first + i + 1), std::memory_order_relaxed);
+                }
+                _slabCount.store(slab + 1, std::memory_order_release);
+
+                // keep the first block, publish the rest.
+                if (_slabBlocks > 1) {
+                    push(first + 1, static_cast<uint32_t>(first + _slabBlocks - 1));
+                }
+                return first;
+            }
+
+            /* an empty magazine takes back what other threads freed first, then a batch of the shared list */
+            void refill(std::size_t slot)
+            {
+                Magazine& mag = _magazines[slot];
+
+                uint32_t chain = takeRemote(slot);
+                while (chain != NIL && mag._count < MAGAZINE_SIZE) {
+                    mag._blocks[mag._count++] = chain;
+                    chain = next(chain).load(std::memory_order_relaxed);
+                }
+                if (chain != NIL) {
+                    pushChain(chain);
+                }
+
+                uint32_t blockIndex;
+                while (mag._count < BATCH_SIZE && (blockIndex = popOrGrow()) != NIL) {
+                    mag._blocks[mag._count++] = blockIndex;
+                }
+            }
+
+        public:
+            /* maxBlocks == 0 keeps the pool at its initial size */
+            ConcurrentObjectPool(std::size_t totalBlocks = DEFAULT_TOTAL_BLOCKS, std::size_t maxBlocks = 0)
+                : _slabBlocks{totalBlocks},
+                  _maxSlabs{totalBlocks != 0 && maxBlocks > totalBlocks ? maxBlocks / totalBlocks : 1},
+                  _slabs{new Slab[_maxSlabs]},
+                  _magazines{new Magazine[MAX_THREADS]},
+                  _head{NIL}
+            {
+                if (totalBlocks == 0 || _maxSlabs * totalBlocks >= NIL) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ConcurrentObjectPool<T>(): invalid number of blocks");
+                }
+
+                uint32_t first = popOrGrow();
+                if (first == NIL) {
+                    throw std::bad_alloc();
+                }
+                push(first, first);
+
+                registerCaches(this);
+            }
+
+            ~ConcurrentObjectPool() { unregisterCaches(this); }
+
+            ConcurrentObjectPool(const ConcurrentObjectPool&) = delete;
+
+            ConcurrentObjectPool& operator=(const ConcurrentObjectPool&) = delete;
+
+            /* return nullptr instead of throwing when the pool can't grow anymore */
+            T* tryAllocate() noexcept
+            {
+                std::size_t slot = threadSlot();
+                uint32_t blockIndex;
+
+                if (slot == NO_SLOT) {
+                    blockIndex = popOrGrow();
+                    if (blockIndex == NIL) {
+                        return nullptr;
+                    }
+                } else {
+                    Magazine& mag = _magazines[slot];
+                    if (mag._count == 0) {
+                        refill(slot);
+                        if (mag._count == 0) {
+                            return nullptr;
+                        }
+                    }
+                    blockIndex = mag._blocks[--mag._count];
+                }
+
+                owner(blockIndex).store(static_cast<uint8_t>(slot), std::memory_order_relaxed);
+                return block(blockIndex);
+            }
+
+            T* allocate()
+            {
+                T* ptr = tryAllocate();
+                if (ptr == nullptr) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ConcurrentObjectPool<T>::allocate(): there aren't any free blocks");
+                }
+
+                return ptr;
+            }
+
+            void deallocate(void* ptr)
+            {
+                T* block = static_cast<T*>(ptr); 
+                if (block == nullptr) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ConcurrentObjectPool<T>::deallocate(): block is nullptr");
+                }
+
+                uint32_t blockIndex = NIL;
+                std::size_t slabs = _slabCount.load(std::memory_order_acquire);
+                for (std::size_t slab = 0; slab < slabs; ++slab) {
+                    T* base = _slabs[slab]._memory.get();
+                    if (block >= base && block < base + _slabBlocks) {
+                        blockIndex = static_cast<uint32_t>(slab * _slabBlocks + (block - base));
+                        break;
+                    }
+                }
+
+                if (blockIndex == NIL) {
+                    throw std::runtime_error("memorypool.hpp: Memory::ConcurrentObjectPool<T>::deallocate(): block doesn't belong to the pool");
+                }
+
+                std::size_t slot = threadSlot();
+                if (slot == NO_SLOT) {
+                    push(blockIndex, blockIndex);
+                    return;
+                }
+
+                // the block goes back to the magazine it came from
+                std::size_t blockOwner = owner(blockIndex).load(std::memory_order_relaxed);
+                if (blockOwner != slot && blockOwner != NO_SLOT) {
+                    pushRemote(blockOwner, blockIndex);
+                    return;
+                }
+
+                Magazine& mag = _magazines[slot];
+                if (mag._count == MAGAZINE_SIZE) {
+                    // hand the older half back to the shared list with a single CAS.
+                    for (std::size_t i = 0; i < BATCH_SIZE - 1; ++i) {
+                        next(mag._blocks[i]).store(mag._blocks[i + 1], std::memory_order_relaxed);
+                    }
+                    push(mag._blocks[0], mag._blocks[BATCH_SIZE - 1]);
+
+                    std::memmove(mag._blocks, mag._blocks + BATCH_SIZE, (MAGAZINE_SIZE - BATCH_SIZE) * sizeof(uint32_t));
+                    mag._count -= BATCH_SIZE;
+                }
+
+                mag._blocks[mag._count++] = blockIndex;
+            }
+
+            void reclaim(std::size_t slot) override
+            {
+                Magazine& mag = _magazines[slot];
+                if (mag._count > 0) {
+                    for (std::size_t i = 0; i + 1 < mag._count; ++i) {
+                        next(mag._blocks[i]).store(mag._blocks[i + 1], std::memory_order_relaxed);
+                    }
+                    push(mag._blocks[0], mag._blocks[mag._count - 1]);
+                    mag._count = 0;
+                }
+
+                uint32_t chain = takeRemote(slot);
+                if (chain != NIL) {
+                    pushChain(chain);
+                }
+            }
+
+            /* used for TESTS and DEBUG */
+
+            T* block(std::size_t blockIndex) { return &(_slabs[blockIndex / _slabBlocks]._memory[blockIndex % _slabBlocks]); }
+
+            std::size_t totalBlocks() { return _slabCount.load() * _slabBlocks; }
+
+            /* blocks in the shared list, the magazines and the remote lists, only exact when no thread is using the pool */
+            std::size_t freeBlocks()
+            {
+                std::size_t count = 0;
+                for (uint32_t i = index(_head.load()); i != NIL; i = next(i).load()) {
+                    ++count;
+                }
+                for (std::size_t slot = 0; slot < MAX_THREADS; ++slot) {
+                    count += _magazines[slot]._count;
+                    for (uint32_t i = _magazines[slot]._remote.load(); i != NIL; i = next(i).load()) {
+                        ++count;
+                    }
+                }
+                return count;
+            }
+    };
+ 
+    /* links kept inside every free block, the free lists cost no memory of their own */
+    struct FreeBlock
+    {
+        FreeBlock* _prev;
+        FreeBlock* _next;
     };
  
     class OrderBlocks
     {
         public:
-            std::list<std::unique_ptr<Block>> _blockList;
-            std::vector<bool>                 _bitMap;
-            std::size_t                       _order;
-            std::size_t                       _sizeShift;
+            FreeBlock*        _head = nullptr;
+            std::vector<bool> _bitMap;
+            std::size_t       _order;
+            std::size_t       _sizeShift;
 
+        /* one bit per buddy pair, flipped on every allocation and free of either buddy */
         void markAllocated(std::uintptr_t addr);
     
         bool get(std::uintptr_t addr);
         
         void add(unsigned char* addr) 
         {
-            _blockList.push_front(std::make_unique<Block>(addr));
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(addr);
+            block->_prev = nullptr;
+            block->_next = _head;
+            if (_head != nullptr) {
+                _head->_prev = block;
+            }
+            _head = block;
+        }
+
+        void remove(unsigned char* addr)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(addr);
+            if (block->_prev != nullptr) {
+                block->_prev->_next = block->_next;
+            } else {
+                _head = block->_next;
+            }
+            if (block->_next != nullptr) {
+                block->_next->_prev = block->_prev;
+            }
         }
+
+        unsigned char* pop(void)
+        {
+            unsigned char* addr = front();
+            remove(addr);
+            return addr;
+        }
+
+        unsigned char* front(void) { return reinterpret_cast<unsigned char*>(_head); }
+
+        bool empty(void) { return _head == nullptr; }
+
+        /* used for TESTS and DEBUG */
+
+        std::size_t size(void);
     };
 
     class BuddyPool
@@ -111,9 +615,20 @@ namespace Memory
             std::vector<unsigned char>     _memory;
             std::vector<OrderBlocks>       _orderBlocksList;
 
-            void splitBlock(std::size_t order);
-    
-            void mergeBlock(unsigned char* addr, std::size_t order);
+            /* links kept inside a block released by another thread until the owner takes it back */
+            struct RemoteBlock
+            {
+                RemoteBlock* _next;
+                std::size_t  _size;
+            };
+
+            std::atomic<RemoteBlock*>      _remote{nullptr};
+
+            /* take a block of at least sizeOrder, splitting a bigger one if needed */
+            unsigned char* takeBlock(std::size_t sizeOrder);
+
+            /* free every block other threads released, the whole list is taken at once */
+            void drainRemote(void);
 
         public:
             BuddyPool(std::size_t size = DEFAULT_SIZE, std::size_t order = DEFAULT_ORDER) 
@@ -122,6 +637,7 @@ namespace Memory
                   _memory(_totalMemory),
                   _orderBlocksList(order) 
             {
+                // one bit per pair of buddies, an odd number of top order blocks leaves the last one unpaired.
                 std::size_t nbits = _totalMemory / 128;
                 std::size_t i = 0;
                 for (auto& orderBlocks : _orderBlocksList) {
@@ -129,40 +645,77 @@ namespace Memory
                     orderBlocks._order = i++;    
                     orderBlocks._sizeShift = SMALLEST_SIZE_SHIFT;
 
-                    nbits >>= 1;
+                    nbits = (nbits + 1) / 2;
                 }
 
-                unsigned char* addr = static_cast<unsigned char*>(&_memory[0]);
-                _orderBlocksList[order - 1].add(addr);
+                // every top order block starts free, lowest address at the front.
+                std::size_t blockSize = SMALLEST_SIZE << (order - 1);
+                for (std::size_t block = size; block > 0; --block) {
+                    _orderBlocksList[order - 1].add(_memory.data() + (block - 1) * blockSize);
+                }
             }
 
             static std::size_t getOrder(std::size_t size);
 
+            /* size of the block handed out for a request of size bytes */
+            static std::size_t blockSize(std::size_t size) { return SMALLEST_SIZE << getOrder(size); }
+
+            /* return nullptr when no block big enough is free */
+            template <typename T>
+            T tryAllocate(std::size_t size)
+            {
+                static_assert(std::is_pointer<T>::value, "Expected pointer");
+
+                std::size_t sizeOrder = getOrder(size);
+                if (sizeOrder >= _totalOrder) {
+                    return nullptr;
+                }
+
+                if (_remote.load(std::memory_order_relaxed) != nullptr) {
+                    drainRemote();
+                }
+
+                return reinterpret_cast<T>(takeBlock(sizeOrder));
+            }
+
             template <typename T>
             T allocate(std::size_t size)
             {
                 static_assert(std::is_pointer<T>::value, "Expected pointer");
 
-                if (size > _totalMemory) {
+                if (getOrder(size) >= _totalOrder) {
                     throw std::runtime_error("memorypool.hpp: Memory::BuddyPool::allocate(): asking for more memory than available");
                 }
 
-                std::size_t sizeOrder = getOrder(size);
-    
-                if (_orderBlocksList[sizeOrder]._blockList.empty()) {
-                    splitBlock(sizeOrder + 1);  
+                T ptr = tryAllocate<T>(size);
+                if (ptr == nullptr) {
+                    throw std::runtime_error("memorypool.hpp: Memory::BuddyPool::allocate(): the buddyPool is full");
                 }
 
-                std::unique_ptr<Block> block = std::move(_orderBlocksList[sizeOrder]._blockList.front());
-                _orderBlocksList[sizeOrder]._blockList.pop_front();
-    
-                _orderBlocksList[sizeOrder].markAllocated(block->_addr - _memory.data());
-    
-                return block->_addr;
+                return ptr;
             }
             
             void deallocate(void* ptr, std::size_t size);
-    
+
+            /* 
+             * the pool is unlocked and only the thread owning it may allocate and deallocate, any other
+             * thread releases a block here. The owner frees it on its next allocation.
+             */
+            void deallocateRemote(void* ptr, std::size_t size);
+
+            /* largest block the pool can hand out */
+            std::size_t maxBlockSize() { return SMALLEST_SIZE << (_totalOrder - 1); }
+
+            /* the memory every block is carved from, e.g. to register it with a device once */
+            unsigned char* base() { return _memory.data(); }
+
+            bool contains(const void* ptr, std::size_t size)
+            {
+                auto addr = reinterpret_cast<std::uintptr_t>(ptr);
+                auto start = reinterpret_cast<std::uintptr_t>(_memory.data());
+                return addr >= start && addr + size <= start + _totalMemory;
+            }
+
             /* used for TESTS and DEBUG */
             
             std::vector<unsigned char>* memory() { return &_memory; }
@@ -173,96 +726,5 @@ namespace Memory
             
             std::size_t totalMemory() { return _totalMemory; }
     };
-    
-    template<typename T>
-    void consume(T& dest, char *buffer, std::size_t& idx, std::size_t bufferSize)
-    {
-        if (idx + sizeof(T) > bufferSize) {
-            throw std::runtime_error("memorypool.hpp: Memory::consume(): the requested memory would overflow the buffer\n");
-        }
-
-        T* ptr = reinterpret_cast<T*>(buffer + idx);
-        switch (sizeof(T)) {
-        case 1:
-            dest = *ptr;
-            break;
-
-        case 2:
-            dest = ntohs(*ptr);
-            break;
-
-        case 4:
-            dest = ntohl(*ptr);
-            break;
-
-        default:
-            throw std::runtime_error("memorypool.hpp: Memory::consume(): size of object bigger than what ntoh can convert\n");
-        }
-        idx += sizeof(T);
-    }
-
-    void consume(IP::Fields1& dest, char *buffer, std::size_t& idx, std::size_t bufferSize);
-    
-    void consume(IP::Fields2& dest, char *buffer, std::size_t& idx, std::size_t bufferSize);
-
-    void consume(MacAddr& dest, char *buffer, std::size_t& idx, std::size_t bufferSize);
-    
-    template<typename T>
-    void consumePointer(T*& dest, char *buffer, std::size_t& idx, std::size_t bufferSize, std::size_t size)
-    {
-        if (idx + sizeof(T) * size > bufferSize) {
-            throw std::runtime_error("memorypool.hpp: Memory::consumePointer(): the requested memory would overflow the buffer\n");
-        }
-
-        dest = static_cast<T*>(buffer + idx);
-        idx += sizeof(T) * size;
-    }
-
-    template<typename T>
-    void write(const T& src, char *buffer, std::size_t& idx, std::size_t bufferSize)
-    {
-        if (idx + sizeof(T) > bufferSize) {
-            throw std::runtime_error("memorypool.hpp: Memory::write(): writing the memory would overflow the buffer\n");
-        }
-
-        T* ptr = reinterpret_cast<T*>(buffer + idx);
-        switch (sizeof(T)) {
-        case 1:
-            *ptr = src;
-            break;
-
-        case 2:
-            *ptr = htons(src);
-            break;
-
-        case 4:
-            *ptr = htonl(src);
-            break;
-
-        default:
-            throw std::runtime_error("memorypool.hpp: Memory::write(): size of object bigger than what ntoh can convert\n");
-        }
-        idx += sizeof(T);
-    }
-
-    void write(const IP::Fields1& src, char *buffer, std::size_t& idx, std::size_t bufferSize);
-    
-    void write(const IP::Fields2& src, char *buffer, std::size_t& idx, std::size_t bufferSize);
-    
-    void write(const MacAddr& src, char *buffer, std::size_t& idx, std::size_t bufferSize);
-
-    template<typename T>
-    void writePointer(T*& src, char *buffer, std::size_t& idx, std::size_t bufferSize, std::size_t size)
-    {
-        if (idx + sizeof(T) * size > bufferSize) {
-            throw std::runtime_error("memorypool.hpp: Memory::writePointer(): writing the memory would overflow the buffer\n");
-        }
-
-        T* ptr = reinterpret_cast<T*>(buffer + idx);
-        for (size_t i = 0; i < size; ++i) {
-            ptr[i] = src[i];
-        }
-        idx += sizeof(T) * size;
-    }
 }
 #endif
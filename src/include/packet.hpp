@@ -0,0 +1,98 @@
+#ifndef DEVICE_PACKET_HPP
+#define DEVICE_PACKET_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <linux/if_packet.h>
+
+#include "types.hpp"
+
+/*
+ * An AF_PACKET socket bound to an interface, with TPACKET_V3 RX and TX rings mapped into the
+ * process. The kernel fills the RX ring a block at a time and hands a block over once it is
+ * full or BLOCK_TIMEOUT_MS after its first frame. Frames are used where they lie in the block,
+ * and a block goes back to the kernel when the burst after the one that finished it starts.
+ * To send, frames are copied into fixed size TX slots and one send() transmits all of them.
+ * The socket doesn't receive its own frames, and its interface's address becomes the stack's.
+ */
+class PacketDevice
+{
+    public:
+        static constexpr size_t   BLOCK_SIZE       = 1 << 18;
+        static constexpr size_t   RX_BLOCKS        = 16;
+        static constexpr size_t   FRAME_SIZE       = 2048;
+        static constexpr size_t   TX_FRAMES        = 512;
+        static constexpr unsigned BLOCK_TIMEOUT_MS = 1;
+
+        // TX data follows the frame header, the sockaddr_ll of a received frame isn't there
+        static constexpr size_t   TX_DATA_OFFSET   = TPACKET_ALIGN(sizeof(tpacket3_hdr));
+        static constexpr size_t   TX_ROOM          = FRAME_SIZE - TX_DATA_OFFSET;
+
+        /* a frame in the RX ring: length bytes after headroom, which it may grow to capacity */
+        struct Received
+        {
+            char*    _base;
+            size_t   _capacity;
+            size_t   _headroom;
+            size_t   _length;
+            uint32_t _status;       // TP_STATUS_*, e.g. the checksum was left to the device
+        };
+
+    private:
+        int            _fd = -1;
+        std::string    _name;
+        MacAddr        _addr;
+        char*          _ring = nullptr;
+        size_t         _ringSize = 0;
+
+        size_t         _rxBlock = 0;        // the block being read, or the next one to be
+        bool           _rxReading = false;
+        uint32_t       _rxLeft = 0;         // frames of the block not read yet
+        tpacket3_hdr*  _rxFrame = nullptr;  // the first of them
+        size_t         _rxHeld = 0;         // blocks before _rxBlock, read but not handed back
+
+        size_t         _txFrame = 0;        // the next slot to fill
+
+        tpacket_block_desc* block(size_t index) { return reinterpret_cast<tpacket_block_desc*>(_ring + index * BLOCK_SIZE); }
+
+        tpacket3_hdr*       slot(size_t index)
+        {
+            return reinterpret_cast<tpacket3_hdr*>(_ring + RX_BLOCKS * BLOCK_SIZE + index * FRAME_SIZE);
+        }
+
+    public:
+        /* headroom is left free in front of every received frame */
+        PacketDevice(std::string_view interface, size_t headroom);
+
+        ~PacketDevice();
+
+        PacketDevice(const PacketDevice&) = delete;
+
+        PacketDevice& operator=(const PacketDevice&) = delete;
+
+        std::string name() const { return _name; }
+        MacAddr     addr() const { return _addr; }
+        int         fd()   const { return _fd;   }
+
+        /* the next received frame, false if there is none yet */
+        bool receive(Received& frame);
+
+        /* hand the blocks the last burst read back to the kernel, their frames are gone */
+        void release(void);
+
+        /* TX_ROOM bytes for the next frame, nullptr if the ring is full */
+        char* txSlot(void);
+
+        /* the frame written to txSlot() is length bytes long and goes with the next send() */
+        void  commit(size_t length);
+
+        bool  txFull(void) { return txSlot() == nullptr; }
+
+        /* transmit every committed frame, send(2)'s result */
+        int   send(void);
+};
+
+#endif
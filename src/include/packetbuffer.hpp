@@ -0,0 +1,129 @@
+#ifndef PACKETBUFFER_HPP
+#define PACKETBUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "memorypool.hpp"
+
+namespace Memory
+{
+    /* the calling thread's pool, every packet buffer it allocates is carved from it. An exiting thread leaves it to a later one */
+    BuddyPool& packetBufferPool(void);
+
+    /*
+     * Packet data in a BuddyPool block of the smallest size class that fits, placed after a
+     * headroom so lower layers can push their headers in front of it in place (like an mbuf).
+     * Requests bigger than the pool's largest block, like offloaded segments, get a LARGE_SIZE
+     * block that is kept for reuse once released, only bigger ones fall back to the heap. Any
+     * thread may release a buffer, the allocating thread's pool takes it back on its next
+     * allocation. A borrowed buffer is memory owned by someone else, e.g. a device's ring, and
+     * is only valid until the owner takes it back.
+     */
+    class PacketBuffer
+    {
+        private:
+            unsigned char* _base     = nullptr;
+            BuddyPool*     _pool     = nullptr;
+            uint32_t       _capacity = 0;
+            uint32_t       _head     = 0;
+            uint32_t       _length   = 0;
+            bool           _borrowed = false;
+
+            void release(void);
+
+        public:
+            static constexpr std::size_t DEFAULT_HEADROOM = 64;
+
+            // holds a 64 KiB segment with its headers and headroom
+            static constexpr std::size_t LARGE_SIZE = 72 * 1024;
+
+            PacketBuffer() = default;
+
+            ~PacketBuffer() { release(); }
+
+            PacketBuffer(const PacketBuffer&) = delete;
+
+            PacketBuffer& operator=(const PacketBuffer&) = delete;
+
+            PacketBuffer(PacketBuffer&& other) noexcept;
+
+            PacketBuffer& operator=(PacketBuffer&& other) noexcept;
+
+            /* room for size bytes of data after headroom bytes, an empty buffer if memory is exhausted */
+            static PacketBuffer allocate(std::size_t size, std::size_t headroom = DEFAULT_HEADROOM);
+
+            /* capacity bytes at base, never freed, with the data after headroom bytes */
+            static PacketBuffer borrow(char* base, std::size_t capacity, std::size_t headroom);
+
+            /* copy a borrowed buffer's data into one of its own, false if memory is exhausted */
+            bool own(void);
+
+            explicit operator bool() const { return _base != nullptr; }
+
+            bool        borrowed(void) const { return _borrowed; }
+
+            char*       data(void)     { return reinterpret_cast<char*>(_base + _head); }
+            std::size_t length(void)   const { return _length; }
+            std::size_t headroom(void) const { return _head; }
+            std::size_t tailroom(void) const { return _capacity - _head - _length; }
+            std::size_t capacity(void) const { return _capacity; }
+
+            /* grow the data at the front by count bytes, nullptr if the headroom is too small */
+            char* push(std::size_t count)
+            {
+                if (count > _head) {
+                    return nullptr;
+                }
+
+                _head -= count;
+                _length += count;
+                return data();
+            }
+
+            /* strip count bytes from the front, nullptr if there aren't enough */
+            char* pull(std::size_t count)
+            {
+                if (count > _length) {
+                    return nullptr;
+                }
+
+                _head += count;
+                _length -= count;
+                return data();
+            }
+
+            /* grow the data at the back by count bytes, return the added area */
+            char* put(std::size_t count)
+            {
+                if (count > tailroom()) {
+                    return nullptr;
+                }
+
+                char* tail = data() + _length;
+                _length += count;
+                return tail;
+            }
+
+            /* cut count bytes from the back */
+            void trim(std::size_t count) { _length -= (count > _length) ? _length : count; }
+
+            /* empty the buffer and put the data back after headroom bytes */
+            void reset(std::size_t headroom = DEFAULT_HEADROOM)
+            {
+                _head = static_cast<uint32_t>(headroom < _capacity ? headroom : _capacity);
+                _length = 0;
+            }
+
+            void setLength(std::size_t length)
+            {
+                if (length > _capacity - _head) {
+                    throw std::runtime_error("packetbuffer.hpp: Memory::PacketBuffer::setLength(): length exceeds the buffer");
+                }
+
+                _length = static_cast<uint32_t>(length);
+            }
+    };
+}
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef DEVICE_PCAP_HPP
+#define DEVICE_PCAP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+/*
+ * Frames replayed from a capture file instead of a live interface, for benchmarks that need
+ * neither root nor a peer and see the same input every run. The file is mapped and parsed in
+ * place: classic pcap in either byte order with micro or nanosecond timestamps, or pcapng,
+ * whose enhanced and simple packet blocks are taken from its ethernet interfaces. Frames are
+ * due at once, or paced to the spacing they were recorded with; fd() polls readable while one
+ * is due. Frames sent to the device are appended to an optional pcap, stamped with the time
+ * of the frame replayed last, so two runs over the same capture write the same file.
+ */
+class PcapDevice
+{
+    public:
+        static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+        /* a frame of the capture, only length bytes of it may have been recorded */
+        struct Record
+        {
+            const char* _data;
+            size_t      _length;
+            uint64_t    _timestamp;     // nanoseconds since the epoch
+        };
+
+    private:
+        /* an interface of the current pcapng section */
+        struct Interface
+        {
+            uint16_t _linkType;
+            uint32_t _snapLength;
+            uint8_t  _resolution;       // if_tsresol: a power of ten, or of two with the top bit set
+        };
+
+        int                    _timerFd = -1;
+        const char*            _file = nullptr;
+        size_t                 _fileSize = 0;
+        size_t                 _start = 0;          // the first record or block
+        size_t                 _offset = 0;         // the next one
+        bool                   _ng = false;
+        bool                   _swapped = false;    // the file's byte order isn't ours
+        bool                   _nanoseconds = false;
+        std::vector<Interface> _interfaces;
+
+        bool                   _paced;
+        bool                   _started = false;
+        bool                   _pending = false;    // _next was read and not taken yet
+        Record                 _next;
+        uint64_t               _first = 0;          // recorded time of the first frame taken
+        timespec               _epoch;              // and the monotonic time it was taken at
+        uint64_t               _last = 0;           // recorded time of the last frame read
+        uint64_t               _now = 0;            // and of the last one taken
+
+        std::ofstream          _output;
+
+        uint16_t load16(const char *src) const;
+        uint32_t load32(const char *src) const;
+
+        /* parse the section header block at _offset and move past it, false if it is malformed */
+        bool     section(void);
+
+        bool     readPcap(Record& record);
+        bool     readPcapng(Record& record);
+
+    public:
+        /* an empty output discards the frames sent */
+        PcapDevice(std::string_view input, std::string_view output, bool paced);
+
+        ~PcapDevice();
+
+        PcapDevice(const PcapDevice&) = delete;
+
+        PcapDevice& operator=(const PcapDevice&) = delete;
+
+        int  fd(void) const { return _timerFd; }
+
+        bool paced(void) const { return _paced; }
+
+        /* the next frame of the file, pacing aside; false at its end */
+        bool read(Record& record);
+
+        /* back to the first frame */
+        void rewind(void);
+
+        /* the next frame if it is due, without taking it */
+        bool due(Record& record);
+
+        /* take the frame due() returned */
+        void take(void) { _pending = false; _now = _next._timestamp; }
+
+        /* every frame was taken */
+        bool done(void);
+
+        /* poll readable once the next frame is due, never after the last one */
+        void arm(void);
+
+        /* append a frame to the output, from two pieces */
+        void write(const char *headers, size_t headerLength, const char *payload, size_t payloadSize);
+};
+
+#endif
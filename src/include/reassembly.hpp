@@ -0,0 +1,122 @@
+#ifndef REASSEMBLY_HPP
+#define REASSEMBLY_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+#include "ethernet.hpp"
+#include "memorypool.hpp"
+#include "timerwheel.hpp"
+#include "verdict.hpp"
+
+namespace IP
+{
+    class Header;
+
+    // RFC 791 leaves the timeout to the implementation, Linux waits 30 seconds as well
+    constexpr std::chrono::seconds REASSEMBLY_TIMEOUT{30};
+
+    /*
+     * IPv4 reassembly. Fragments stay in the buffers they were received in until the last
+     * hole is filled, then they are copied once into a buffer for the whole datagram. Holes
+     * and overlaps are tracked in a bitmap of 8 byte blocks, so every fragment costs work in
+     * proportion to its size. Memory is bounded three ways: at most maxDatagrams in progress,
+     * MAX_FRAGMENTS per datagram and memoryBudget bytes of fragment buffers; the least
+     * recently extended datagram is evicted first. Overlapping fragments drop the datagram.
+     */
+    class Reassembler
+    {
+        private:
+            static constexpr size_t   MAX_FRAGMENTS = 64;
+            static constexpr size_t   BLOCKS        = 65536 / 8;
+            static constexpr size_t   BUCKETS       = 256;
+            static constexpr uint16_t NIL           = UINT16_MAX;
+
+            struct Fragment
+            {
+                Ethernet::Frame _frame;
+                const char*     _data = nullptr;
+                uint16_t        _offset = 0;
+                uint16_t        _length = 0;
+                Fragment*       _next = nullptr;
+            };
+
+            struct Datagram
+            {
+                IPAddr         _srcAddr;
+                IPAddr         _dstAddr;
+                uint16_t       _id;
+                uint8_t        _proto;
+                bool           _active = false;
+                bool           _lastSeen = false;
+                uint8_t        _count = 0;
+                uint16_t       _bucketNext = NIL;   // the free list while inactive
+                uint16_t       _lruPrev = NIL;
+                uint16_t       _lruNext = NIL;
+                uint32_t       _total = 0;          // payload bytes, known once the last fragment is in
+                uint32_t       _end = 0;            // furthest byte received
+                uint32_t       _received = 0;
+                size_t         _memory = 0;
+                Fragment*      _first = nullptr;    // offset 0, its headers are the datagram's
+                Fragment*      _fragments = nullptr;
+                Event::TimerId _timer = 0;
+                std::array<uint64_t, BLOCKS / 64> _blocks;
+            };
+
+            std::vector<Datagram>              _datagrams;
+            std::array<uint16_t, BUCKETS>      _buckets;
+            Memory::ObjectPool<Fragment>       _fragmentPool;
+            uint16_t                           _free = NIL;
+            uint16_t                           _lruHead = NIL;     // least recently extended
+            uint16_t                           _lruTail = NIL;
+            size_t                             _memory = 0;
+            size_t                             _memoryBudget;
+            size_t                             _active = 0;
+            Event::TimerWheel*                 _timers = nullptr;
+            Verdict::DropCounters*             _drops = nullptr;
+
+            static size_t bucket(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto);
+
+            Datagram* find(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto);
+
+            /* a new datagram, evicting the least recently extended one if all are in use */
+            Datagram* create(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto);
+
+            void      touch(Datagram& datagram);
+
+            void      unlinkLRU(Datagram& datagram);
+
+            /* free the datagram, its fragments are counted as dropped for reason */
+            void      release(Datagram& datagram, Verdict::Reason reason);
+
+            /* copy the fragments into frame, false if no buffer could be had */
+            bool      assemble(Datagram& datagram, Ethernet::Frame& frame);
+
+        public:
+            static constexpr size_t DEFAULT_DATAGRAMS     = 64;
+            static constexpr size_t DEFAULT_MEMORY_BUDGET = 4 << 20;
+
+            explicit Reassembler(size_t maxDatagrams = DEFAULT_DATAGRAMS, size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+
+            /* without timers incomplete datagrams only go when evicted */
+            void attach(Event::TimerWheel& timers, Verdict::DropCounters* drops = nullptr);
+
+            /*
+             * take the fragment in frame. true: it completed its datagram, which frame now holds.
+             * false: verdict is ACCEPT when the fragment was kept (the frame is left empty) or a drop.
+             */
+            bool add(Ethernet::Frame& frame, Header& header, Verdict::Result& verdict);
+
+            /* used for TESTS and DEBUG */
+
+            size_t datagrams(void) const { return _active; }
+
+            size_t memory(void)    const { return _memory; }
+    };
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef ROUTE_HPP
+#define ROUTE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.hpp"
+
+namespace IP
+{
+    /* where a route leads: the gateway to hand the datagram to, 0 if the destination is on link */
+    struct NextHop
+    {
+        IPAddr   _gateway = 0;
+        uint16_t _device = 0;
+
+        bool operator==(const NextHop& other) const { return _gateway == other._gateway && _device == other._device; }
+    };
+
+    /*
+     * Longest prefix match in the DIR-24-8 style (Gupta, Lin & McKeown), with a 16 bit root and
+     * two 8 bit levels so a worker's table stays small: the root is indexed by the top 16 bits
+     * of the address and an entry either holds the next hop or points to a group of 256 entries
+     * for the next 8 bits. A lookup is at most three dependent loads and no compares. Prefixes
+     * are expanded into every entry they cover, each entry remembers the length of the prefix
+     * that wrote it so longer prefixes are never overwritten by shorter ones.
+     */
+    class RouteTable
+    {
+        private:
+            using Entry = uint32_t;
+
+            static constexpr unsigned ROOT_BITS  = 16;
+            static constexpr unsigned GROUP_BITS = 8;
+            static constexpr size_t   GROUP_SIZE = 1 << GROUP_BITS;
+
+            // valid, points to a group, length of the prefix, next hop or group index
+            static constexpr Entry    VALID       = Entry{1} << 31;
+            static constexpr Entry    GROUP       = Entry{1} << 30;
+            static constexpr unsigned DEPTH_SHIFT = 24;
+            static constexpr Entry    INDEX_MASK  = (Entry{1} << DEPTH_SHIFT) - 1;
+
+            struct Rule
+            {
+                IPAddr   _prefix;
+                uint8_t  _depth;
+                uint32_t _nextHop;
+            };
+
+            std::vector<Entry>    _root;
+            std::vector<Entry>    _groups;
+            std::vector<uint32_t> _freeGroups;
+            std::vector<NextHop>  _nextHops;
+            std::vector<Rule>     _rules;
+
+            static unsigned depth(Entry entry) { return (entry >> DEPTH_SHIFT) & 0x3f; }
+
+            Entry* group(Entry entry) { return &_groups[(entry & INDEX_MASK) * GROUP_SIZE]; }
+
+            /* overwrite the entries whose prefix length is within [minDepth, maxDepth], groups included */
+            void paint(Entry *entries, size_t count, unsigned minDepth, unsigned maxDepth, Entry entry);
+
+            /* write entry for prefix into the level ending at bit levelEnd, splitting entries into groups */
+            void insert(Entry *table, unsigned levelEnd, IPAddr prefix, unsigned depth, Entry entry);
+
+            /* put replacement where the entries of prefix were, and fold groups that became uniform */
+            void replace(Entry *table, unsigned levelEnd, IPAddr prefix, unsigned depth, Entry replacement);
+
+        public:
+            static constexpr size_t DEFAULT_GROUPS = 256;
+
+            /* room for maxGroups groups, every prefix longer than 16 bits takes one or two */
+            explicit RouteTable(size_t maxGroups = DEFAULT_GROUPS);
+
+            /* add or replace the route for prefix/depth, false if depth is over 32 or no group is free */
+            bool add(IPAddr prefix, unsigned depth, const NextHop& nextHop);
+
+            /* false if there is no route for prefix/depth */
+            bool remove(IPAddr prefix, unsigned depth);
+
+            /* nullptr if no route matches addr */
+            const NextHop* lookup(IPAddr addr) const
+            {
+                Entry entry = _root[addr >> (32 - ROOT_BITS)];
+                if (entry & GROUP) {
+                    entry = _groups[(entry & INDEX_MASK) * GROUP_SIZE + ((addr >> GROUP_BITS) & (GROUP_SIZE - 1))];
+                    if (entry & GROUP) {
+                        entry = _groups[(entry & INDEX_MASK) * GROUP_SIZE + (addr & (GROUP_SIZE - 1))];
+                    }
+                }
+
+                return (entry & VALID) ? &_nextHops[entry & INDEX_MASK] : nullptr;
+            }
+
+            size_t size(void) const { return _rules.size(); }
+
+            /* used for TESTS and DEBUG */
+
+            size_t freeGroups(void) const { return _freeGroups.size(); }
+    };
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef STACK_HPP
+#define STACK_HPP
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "types.hpp"
+#include "ethernet.hpp"
+#include "arp.hpp"
+#include "gro.hpp"
+#include "ip.hpp"
+#include "eventloop.hpp"
+#include "trace.hpp"
+#include "verdict.hpp"
+
+namespace Stack
+{
+    /* one device plus the protocol state that serves it, driven by an Event::Loop */
+    template <typename T>
+    class Worker
+    {
+        private:
+            Ethernet::Manager<T>  _manager;
+            ARP::CacheManager     _arp;
+            IP::Manager           _ip;
+            Ethernet::Burst       _burst;
+            GRO::Coalescer        _gro;
+            GRO::Frames           _frames;
+            Verdict::DropCounters _drops;
+            bool                  _polling = false;
+            Event::Loop*          _loop = nullptr;
+            bool                  _writable = false;    // the device is watched for EPOLLOUT
+
+            Verdict::Result dispatch(Ethernet::Frame& frame)
+            {
+                switch (frame.getType()) {
+                    case PRO_ARP:
+                        return _arp.handleMessage(frame);
+
+                    case PRO_IPV4:
+                        return _ip.handleMessage(frame);
+
+                    default:
+                        return Verdict::drop(Verdict::Reason::ETHERTYPE);
+                }
+            }
+
+            void handleFrame(Ethernet::Frame& frame)
+            {
+                Verdict::Result verdict = dispatch(frame);
+
+                // a reply is queued for the end of the burst, when the ring is full it is dropped
+                if (verdict._action == Verdict::Action::REPLY && !_manager.enqueue(frame)) {
+                    verdict = Verdict::drop(Verdict::Reason::TX_QUEUE_FULL);
+                }
+
+                if (verdict._action == Verdict::Action::DROP) {
+                    _drops.count(verdict._reason);
+                    Trace::packet(Trace::Event::DROP, static_cast<uint32_t>(verdict._reason), frame.getType());
+                }
+            }
+
+            /* while frames are left queued, e.g. the device said EAGAIN, flush again once it is writable */
+            void watchWritable(void)
+            {
+                bool queued = _manager.txQueued() > 0;
+                if (queued != _writable) {
+                    _writable = queued;
+                    _loop->modify(_manager.fd(), queued ? EPOLLIN | EPOLLOUT : EPOLLIN);
+                }
+            }
+
+        public:
+            template <typename... Args>
+            Worker(Args&&... args) : _manager{std::forward<Args>(args)...}, _ip{_arp} 
+            {
+                // until routes are configured every destination is on link, through the only device
+                _ip.routes().add(0, 0, IP::NextHop{});
+            }
+
+            Ethernet::Manager<T>& manager(void) { return _manager; }
+
+            IP::Manager&          ip(void)      { return _ip; }
+
+            ARP::CacheManager&    arp(void)     { return _arp; }
+
+            /* the address the stack answers for, its ARP requests are sent from it */
+            void setAddr(IPAddr addr) { _arp.setLocalAddr(addr); }
+
+            const Verdict::DropCounters& drops(void) const { return _drops; }
+
+            /* 
+             * drain one burst from the device, coalesce it and hand every frame to the protocol layers,
+             * then write what they sent
+             */
+            size_t poll(void)
+            {
+                size_t count = _manager.readBurst(_burst);
+                _drops.count(Verdict::Reason::RUNT, _burst.runts);
+
+                _polling = true;
+                size_t segments = _gro.coalesce(_burst, _frames);
+                for (size_t i = 0; i < segments; ++i) {
+                    handleFrame(*_frames[i]);
+                }
+                _polling = false;
+
+                _manager.flush();
+
+                return count;
+            }
+
+            void attach(Event::Loop& loop)
+            {
+                // frames sent from timers go out at once, within a burst they wait for its end
+                ARP::Transmit transmit = [this](Ethernet::Frame& frame) {
+                    bool queued = _manager.enqueue(frame);
+                    if (!_polling) {
+                        _manager.flush();
+                        watchWritable();
+                    }
+                    return queued;
+                };
+                _arp.attach(loop.timers(), transmit, &_drops);
+                _ip.attach(loop.timers(), transmit, &_drops);
+
+                _loop = &loop;
+                loop.add(_manager.fd(), EPOLLIN, [this](uint32_t events) { 
+                    if (events & ~EPOLLOUT) {
+                        poll();
+                    } else {
+                        _manager.flush();
+                    }
+                    watchWritable();
+                });
+            }
+    };
+
+    /* 
+     * listen on ports as addr and run the worker on an event loop of its own, until the loop
+     * stops. Without an address ARP requests go out as probes, from 0.0.0.0.
+     */
+    template <typename T>
+    void serve(Worker<T>& worker, const std::vector<TCP::Port>& ports, IPAddr addr = 0)
+    {
+        Event::Loop loop;
+
+        worker.setAddr(addr);
+
+        for (TCP::Port port : ports) {
+            worker.ip().tcp().listen(port);
+        }
+
+        worker.attach(loop);
+        loop.run();
+    }
+
+    /* how a worker reads and writes its TAP queue */
+    enum class Backend
+    {
+        READ_WRITE,       // a syscall per frame
+        URING,            // batched through io_uring, see UringDevice
+        URING_SQPOLL,     // the same with a kernel thread polling the submissions
+    };
+
+    /* 
+     * open count IFF_MULTI_QUEUE queues on the interface and run one worker thread per queue,
+     * every worker owns its packet pool, ARP cache, IP and TCP state and listens on ports as addr.
+     * offload opens the queues with the virtio-net header, see TunDevice.
+     * Blocks until all workers exit.
+     */
+    void runQueues(const std::optional<std::string_view> name, size_t count, const std::vector<TCP::Port>& ports, 
+                   IPAddr addr = 0, bool offload = false, Backend backend = Backend::READ_WRITE);
+
+    /* what a replay took and gave */
+    struct ReplayStats
+    {
+        uint64_t                 _frames;
+        uint64_t                 _replies;
+        std::chrono::nanoseconds _elapsed;
+    };
+
+    /*
+     * listen on ports and feed the worker its capture until the end. The capture's peers won't
+     * answer ARP, so the cache starts out with the address every IPv4 sender in it used. TCP
+     * is seeded, see TCP::Manager::seed(), so every run writes the same replies.
+     */
+    ReplayStats replay(Worker<PcapDevice>& worker, const std::vector<TCP::Port>& ports);
+}
+
+#endif
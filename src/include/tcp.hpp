@@ -0,0 +1,286 @@
+#ifndef TCP_HPP
+#define TCP_HPP
+
+#include <bitset>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "types.hpp"
+#include "layout.hpp"
+#include "timerwheel.hpp"
+#include "verdict.hpp"
+
+namespace TCP
+{
+    enum {
+        FLAG_FIN = 0x01,
+        FLAG_SYN = 0x02,
+        FLAG_RST = 0x04,
+        FLAG_PSH = 0x08,
+        FLAG_ACK = 0x10,
+        FLAG_URG = 0x20,
+        FLAG_ECE = 0x40,
+        FLAG_CWR = 0x80,
+    };
+
+    enum {
+        OPTION_END = 0,
+        OPTION_NOP = 1,
+        OPTION_MSS = 2,
+    };
+
+    using Port     = uint16_t;
+    using Seq      = uint32_t;
+    using Window   = uint16_t;
+    using Checksum = uint16_t;
+
+    // data offset (4 bits), reserved (6 bits) and flags (6 bits) share one word
+    using OffsetFlags = uint16_t;
+
+    using HeaderLayout = Memory::Layout<Port, Port, Seq, Seq, OffsetFlags, Window, Checksum, uint16_t>;
+
+    constexpr size_t HEADER_SIZE     = HeaderLayout::SIZE;
+    constexpr size_t MSS_OPTION_SIZE = 4;
+    constexpr size_t MAX_REPLY_SIZE  = HEADER_SIZE + MSS_OPTION_SIZE;
+
+    constexpr uint16_t DEFAULT_MSS    = 536;
+    constexpr uint16_t LOCAL_MSS      = 1460;
+    constexpr Window   DEFAULT_WINDOW = 65535;
+
+    constexpr size_t CHECKSUM_OFFSET = HeaderLayout::offset<6>();
+
+    // TIME_WAIT lasts 2 MSL; a handshake or close that stalls that long is given up
+    constexpr std::chrono::seconds MSL{30};
+    constexpr std::chrono::seconds TIME_WAIT_TIMEOUT = 2 * MSL;
+    constexpr std::chrono::seconds HANDSHAKE_TIMEOUT{75};
+    constexpr std::chrono::seconds CLOSE_TIMEOUT{60};
+
+    /* sequence number comparisons modulo 2^32 */
+    inline bool seqLT(Seq a, Seq b)  { return static_cast<int32_t>(a - b) < 0; }
+    inline bool seqLEQ(Seq a, Seq b) { return static_cast<int32_t>(a - b) <= 0; }
+    inline bool seqGT(Seq a, Seq b)  { return static_cast<int32_t>(a - b) > 0; }
+    inline bool seqGEQ(Seq a, Seq b) { return static_cast<int32_t>(a - b) >= 0; }
+
+    enum class State : uint8_t {
+        CLOSED = 0,
+        LISTEN,
+        SYN_SENT,
+        SYN_RECEIVED,
+        ESTABLISHED,
+        FIN_WAIT_1,
+        FIN_WAIT_2,
+        CLOSE_WAIT,
+        CLOSING,
+        LAST_ACK,
+        TIME_WAIT,
+    };
+
+    const char* stateName(State state);
+
+    class Header
+    {
+        private:
+            const char* _buffer;
+            size_t      _payloadSize;
+
+            Port        _srcPort;
+            Port        _dstPort;
+            Seq         _seq;
+            Seq         _ack;
+            OffsetFlags _offsetFlags;
+            Window      _window;
+            Checksum    _checksum;
+            uint16_t    _urgent;
+            uint16_t    _mss;
+            const char* _payload;
+
+        public:
+            size_t      getPayloadSize(void) { return _payloadSize; }
+            const char* getPayload(void)     { return _payload; }
+            Seq         getSeq(void)         { return _seq; }
+            Seq         getAck(void)         { return _ack; }
+
+            size_t  headerLength(void) const { return (_offsetFlags >> 12) * 4; }
+            uint8_t flags(void)        const { return _offsetFlags & 0x3F; }
+
+            /* sequence space the segment occupies: data plus one for SYN and FIN each */
+            uint32_t sequenceLength(void) const
+            {
+                return static_cast<uint32_t>(_payloadSize) + !!(flags() & FLAG_SYN) + !!(flags() & FLAG_FIN);
+            }
+
+            /* false if the buffer is shorter than the header or the data offset is invalid */
+            bool readFromBuffer(const char *buffer, size_t bufferLength);
+
+            /* used for TESTS and DEBUG */
+
+            void debugPrint(void);
+
+            friend class Manager;
+    };
+
+    /* a connection as seen from this host */
+    struct Key
+    {
+        IPAddr _localAddr;
+        IPAddr _remoteAddr;
+        Port   _localPort;
+        Port   _remotePort;
+
+        bool operator==(const Key& other) const
+        {
+            return _localAddr == other._localAddr && _remoteAddr == other._remoteAddr &&
+                   _localPort == other._localPort && _remotePort == other._remotePort;
+        }
+    };
+
+    /*
+     * Transmission control block. Everything the per-segment path touches sits in this one
+     * cache line, the rest lives in Stats at the same index of a parallel array.
+     */
+    struct alignas(64) Connection
+    {
+        Key      _key;
+        uint32_t _hash;
+        State    _state = State::CLOSED;     // CLOSED marks a free slot
+        uint8_t  _reserved;
+        uint16_t _mss;
+
+        Seq      _iss;
+        Seq      _sndUna;
+        Seq      _sndNxt;
+        uint32_t _sndWnd;
+
+        Seq      _irs;
+        Seq      _rcvNxt;
+        uint32_t _rcvWnd;
+
+        Event::TimerId _timer = 0;
+    };
+
+    static_assert(sizeof(Connection) == 64, "a connection's hot fields should fill one cache line");
+
+    struct Stats
+    {
+        uint64_t _segmentsIn  = 0;
+        uint64_t _segmentsOut = 0;
+        uint64_t _bytesIn     = 0;
+    };
+
+    /*
+     * Fixed capacity open addressing table keyed by the 4-tuple: linear probing and
+     * backward shift deletion, so there are no tombstones and all memory is allocated up
+     * front. Erasing moves entries, pointers are only valid until the next erase.
+     */
+    class ConnectionTable
+    {
+        private:
+            std::unique_ptr<Connection[]> _connections;
+            std::unique_ptr<Stats[]>      _stats;
+            size_t                        _mask;
+            size_t                        _size = 0;
+            size_t                        _maxSize;
+
+            uint64_t                      _seed;
+
+            uint32_t hash(const Key& key) const;
+
+        public:
+            /* room for maxSize connections, kept at most half full */
+            explicit ConnectionTable(size_t maxSize);
+
+            Connection* find(const Key& key);
+
+            /* a connection for key in state, nullptr if the table is full or key is already there */
+            Connection* insert(const Key& key, State state);
+
+            void        erase(Connection* connection);
+
+            /* key the hash with seed instead of a random value, only while the table is empty */
+            void        seed(uint64_t seed) { _seed = seed; }
+
+            Stats&      stats(const Connection* connection) { return _stats[connection - _connections.get()]; }
+
+            size_t      size(void)     const { return _size; }
+            size_t      maxSize(void)  const { return _maxSize; }
+            size_t      capacity(void) const { return _mask + 1; }
+    };
+
+    /*
+     * TCP state machine (RFC 793 with the RFC 5961 challenge ACKs). Replies are written as
+     * whole segments, checksum included, into a caller supplied buffer of MAX_REPLY_SIZE
+     * bytes; the IP layer puts its header in front. Only in order data is accepted, anything
+     * else is answered with a duplicate ACK. There is no application yet: data is counted and
+     * acknowledged, and a FIN from the peer is answered with our own FIN right away.
+     */
+    class Manager
+    {
+        private:
+            ConnectionTable      _table;
+            std::bitset<1 << 16> _listening;
+            uint32_t             _secret;
+            bool                 _clocked = true;   // the ISS follows the clock, see seed()
+            Event::TimerWheel*   _timers = nullptr;
+
+            Seq    initialSequence(const Key& key);
+
+            size_t writeSegment(char *out, const Key& key, Seq seq, Seq ack, uint8_t flags, Window window, uint16_t mss = 0);
+
+            size_t writeAck(char *out, Connection& connection);
+
+            /* every state change rearms the connection's one timer, see armTimer() */
+            void   setState(Connection& connection, State state);
+
+            void   armTimer(Connection& connection);
+
+            void   expire(const Key& key);
+
+            void   erase(Connection& connection);
+
+            Verdict::Result handleNoConnection(const Key& key, Header& segment, char *reply, size_t& replyLength);
+
+            Verdict::Result handleSynSent(Connection& connection, Header& segment, char *reply, size_t& replyLength);
+
+        public:
+            static constexpr size_t DEFAULT_CONNECTIONS = 1 << 14;
+
+            explicit Manager(size_t maxConnections = DEFAULT_CONNECTIONS);
+
+            /* without timers TIME_WAIT lasts until the 4-tuple is reused and stalled connections stay */
+            void attach(Event::TimerWheel& timers) { _timers = &timers; }
+
+            /*
+             * derive the hash and ISS keys from seed instead of random values and leave the clock out
+             * of the ISS, so runs over the same input, like replays, send the same segments. Only
+             * before the first connection.
+             */
+            void seed(uint64_t seed);
+
+            void listen(Port port)   { _listening.set(port); }
+            void unlisten(Port port) { _listening.reset(port); }
+
+            /* 
+             * segment of length bytes from src to dst, on REPLY replyLength bytes were written to reply.
+             * checksumValid: the device or GRO verified the checksum already. The data of a coalesced
+             * segment may go on past the buffer, only the header has to be in it.
+             */
+            Verdict::Result handleSegment(IPAddr src, IPAddr dst, const char *segment, size_t length,
+                                          char *reply, size_t& replyLength, bool checksumValid = false);
+
+            /* active open, write the SYN to out and return its length, 0 if key is in use or the table is full */
+            size_t connect(const Key& key, char *out);
+
+            /* send our FIN, return its length, 0 if the connection can't be closed from its state */
+            size_t close(const Key& key, char *out);
+
+            /* used for TESTS and DEBUG */
+
+            Connection*      find(const Key& key) { return _table.find(key); }
+
+            ConnectionTable& table(void)          { return _table; }
+    };
+}
+
+#endif
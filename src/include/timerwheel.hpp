@@ -0,0 +1,139 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace Event
+{
+    using Clock = std::chrono::steady_clock;
+
+    /*
+     * What a timer runs, stored inline so scheduling never allocates. std::function only holds
+     * 16 bytes in place, a lambda capturing this and a TCP key already goes to the heap. The
+     * callable must be trivially copyable and fit CAPACITY bytes, anything bigger is captured by
+     * reference.
+     */
+    class TimerCallback
+    {
+        private:
+            static constexpr std::size_t CAPACITY = 24;
+
+            alignas(void*) unsigned char _storage[CAPACITY];
+            void                         (*_invoke)(void* storage) = nullptr;
+
+        public:
+            TimerCallback() = default;
+
+            TimerCallback(std::nullptr_t) {}
+
+            template <typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, TimerCallback>::value>>
+            TimerCallback(F callable)
+            {
+                static_assert(sizeof(F) <= CAPACITY && alignof(F) <= alignof(void*), "the callback doesn't fit inline");
+                static_assert(std::is_trivially_copyable<F>::value, "the callback is copied as plain bytes");
+
+                new (_storage) F(callable);
+                _invoke = [](void* storage) { (*static_cast<F*>(storage))(); };
+            }
+
+            void operator()(void) { _invoke(_storage); }
+
+            explicit operator bool() const { return _invoke != nullptr; }
+    };
+
+    // node index in the low half, generation in the high half; 0 is never a timer
+    using TimerId = uint64_t;
+
+    /*
+     * Hierarchical timing wheel (Varghese & Lauck): LEVELS wheels of SLOTS slots, each level
+     * turning SLOTS times slower than the one below it. Timers are nodes of one array, linked
+     * into per slot lists by index, so schedule, reschedule and cancel are O(1) and a timer
+     * moves down at most LEVELS - 1 times before it fires. The granularity is one tick and
+     * timers beyond the top level are parked in it until they come into range.
+     * Not thread safe, every Event::Loop has its own.
+     */
+    class TimerWheel
+    {
+        private:
+            static constexpr unsigned LEVEL_BITS = 6;
+            static constexpr unsigned SLOTS      = 1 << LEVEL_BITS;
+            static constexpr unsigned LEVELS     = 6;
+            static constexpr uint64_t MAX_DELTA  = (uint64_t{1} << (LEVEL_BITS * LEVELS)) - 1;
+            static constexpr uint32_t NIL        = UINT32_MAX;
+
+            struct Node
+            {
+                uint64_t      _expires;             // tick
+                uint32_t      _next = NIL;
+                uint32_t      _prev = NIL;
+                uint32_t      _generation = 1;
+                uint16_t      _slot = 0;            // level * SLOTS + slot
+                bool          _pending = false;
+                TimerCallback _callback;
+            };
+
+            Clock::duration                       _tick;
+            Clock::time_point                     _start;
+            uint64_t                              _now = 0;
+            std::size_t                           _size = 0;
+
+            std::vector<Node>                     _nodes;
+            uint32_t                              _free = NIL;
+            std::array<uint32_t, LEVELS * SLOTS>  _heads;
+            std::array<uint64_t, LEVELS>          _occupied{};
+
+            Node*    node(TimerId id);
+
+            uint64_t ticks(Clock::duration delay) const;
+
+            /* link the node into the slot its expiry falls in, relative to _now */
+            void     place(uint32_t index);
+
+            void     unlink(uint32_t index);
+
+            /* move every timer of the slot down, they are all due within one turn of the level below */
+            void     cascade(unsigned level);
+
+            std::size_t fire(void);
+
+            /* ticks until the next tick that has a slot to cascade or fire */
+            uint64_t ticksUntilWork(void) const;
+
+        public:
+            explicit TimerWheel(Clock::duration tick = std::chrono::milliseconds{1}, Clock::time_point start = Clock::now());
+
+            TimerWheel(const TimerWheel&) = delete;
+
+            TimerWheel& operator=(const TimerWheel&) = delete;
+
+            /* run callback once delay has passed, at the first advance() after it */
+            TimerId schedule(Clock::duration delay, TimerCallback callback);
+
+            /* move a pending timer to delay from now, false if it already fired or was cancelled */
+            bool    reschedule(TimerId id, Clock::duration delay);
+
+            /* false if the timer already fired or was cancelled */
+            bool    cancel(TimerId id);
+
+            bool    pending(TimerId id);
+
+            /* run every timer due by now, return how many fired */
+            std::size_t advance(Clock::time_point now);
+
+            /* how long an epoll_wait may sleep before advance() has work, -1 if there are no timers */
+            int     timeoutMs(Clock::time_point now) const;
+
+            std::size_t size(void) const { return _size; }
+
+            /* time of the last tick advance() reached, a cheap clock for the callbacks and the fd handlers */
+            Clock::time_point now(void) const { return _start + _tick * _now; }
+    };
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* compile-time trace level, events above it compile to nothing */
+#ifndef CHARMTCP_TRACE_LEVEL
+#define CHARMTCP_TRACE_LEVEL 3
+#endif
+
+/*
+ * Packet path tracing. Events are stored as fixed size binary records in a per-thread ring,
+ * written without locks or syscalls, dumped to a file on demand and decoded offline.
+ */
+namespace Trace
+{
+    enum Level : uint8_t {
+        LEVEL_OFF    = 0,
+        LEVEL_ERROR  = 1,
+        LEVEL_INFO   = 2,
+        LEVEL_PACKET = 3,
+        LEVEL_DEBUG  = 4,
+    };
+
+    constexpr int LEVEL = CHARMTCP_TRACE_LEVEL;
+
+    // the arguments every event carries: arg0, arg1, arg2
+    enum class Event : uint16_t {
+        FRAME_RX = 1,   // frame length, ethertype
+        ARP_RX,         // opcode, sender IP, target IP
+        ARP_REPLY,      // -, target IP, target MAC
+        IP_RX,          // protocol << 16 | total length, src IP, dst IP
+        ICMP_RX,        // type << 8 | code, payload size
+        ICMP_REPLY,     // id << 16 | sequence, payload size
+        DROP,           // Verdict::Reason, ethertype
+        TCP_RX,         // flags << 16 | payload size, src port << 16 | dst port, seq << 32 | ack
+        TCP_STATE,      // old state << 8 | new state, local port << 16 | remote port, remote IP
+        ARP_REQUEST,    // attempt, -, target IP
+    };
+
+    struct Record
+    {
+        uint64_t _timestamp;    // steady clock, nanoseconds
+        uint16_t _event;
+        uint8_t  _level;
+        uint8_t  _reserved;
+        uint32_t _arg0;
+        uint64_t _arg1;
+        uint64_t _arg2;
+    };
+
+    static_assert(sizeof(Record) == 32, "a trace record should stay half a cache line");
+
+    /*
+     * Single producer ring that overwrites its oldest records. Only the owning thread pushes,
+     * any thread can take a snapshot: it copies the records and then drops the ones the
+     * producer may have overwritten meanwhile (like a seqlock reader).
+     */
+    class Ring
+    {
+        private:
+            std::unique_ptr<Record[]> _records;
+            uint32_t                  _thread;
+
+            alignas(64) std::atomic<uint64_t> _head{0};
+
+        public:
+            static constexpr std::size_t SIZE = 1 << 14;
+
+            explicit Ring(uint32_t thread) : _records{new Record[SIZE]}, _thread{thread} {}
+
+            void push(const Record& record) noexcept
+            {
+                uint64_t head = _head.load(std::memory_order_relaxed);
+
+                _records[head & (SIZE - 1)] = record;
+                _head.store(head + 1, std::memory_order_release);
+            }
+
+            /* the records still in the ring, oldest first, at most SIZE - 1 of them */
+            std::vector<Record> snapshot(void) const;
+
+            uint32_t thread(void) const { return _thread; }
+
+            /* records pushed since the ring was created, including overwritten ones */
+            uint64_t pushed(void) const { return _head.load(std::memory_order_acquire); }
+    };
+
+    /* the calling thread's ring, registered on first use */
+    Ring& localRing(void);
+
+    void record(Level level, Event event, uint32_t arg0, uint64_t arg1, uint64_t arg2) noexcept;
+
+    template <Level L>
+    inline void emit(Event event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0)
+    {
+        if constexpr (L != LEVEL_OFF && L <= LEVEL) {
+            record(L, event, arg0, arg1, arg2);
+        }
+    }
+
+    inline void error(Event event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0)  { emit<LEVEL_ERROR>(event, arg0, arg1, arg2); }
+    inline void info(Event event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0)   { emit<LEVEL_INFO>(event, arg0, arg1, arg2); }
+    inline void packet(Event event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0) { emit<LEVEL_PACKET>(event, arg0, arg1, arg2); }
+    inline void debug(Event event, uint32_t arg0 = 0, uint64_t arg1 = 0, uint64_t arg2 = 0)  { emit<LEVEL_DEBUG>(event, arg0, arg1, arg2); }
+
+    /* write every thread's ring to path, false on I/O errors */
+    bool dump(const std::string& path);
+
+    /* print a dump as text, all threads merged by timestamp, false if it isn't a valid dump */
+    bool decode(const std::string& path, std::ostream& os);
+
+    /*
+     * dump to path on SIGUSR1 and exit after dumping on SIGINT or SIGTERM. Call it before
+     * starting other threads: the signals are blocked in the caller and waited for by a
+     * background thread.
+     */
+    void dumpOnSignal(const std::string& path);
+}
+
+#endif
@@ -4,11 +4,32 @@
 #include <optional>
 #include <string_view>
 #include <memory>
+#include <vector>
+
+#include <sys/uio.h>
 
 #include "types.hpp"
 
 MacAddr getDevMacAddr(void); 
 
+/* the address the stack sends from, for devices that aren't a TAP */
+void setDevMacAddr(MacAddr addr);
+
+/* struct virtio_net_hdr in front of every frame of an IFF_VNET_HDR device, <linux/virtio_net.h> isn't C++ */
+struct VnetHeader
+{
+    static constexpr uint8_t GSO_ECN = 0x80;
+
+    uint8_t  _flags;
+    uint8_t  _gsoType;
+    uint16_t _headerLength;
+    uint16_t _gsoSize;
+    uint16_t _checksumStart;
+    uint16_t _checksumOffset;
+};
+
+static_assert(sizeof(VnetHeader) == 10, "the legacy virtio-net header is 10 bytes");
+
 class TunDevice
 {
     private:
@@ -17,6 +38,7 @@ class TunDevice
         int         _fd = -1;
         std::string _name;
         MacAddr     _addr;
+        bool        _vnetHeader = false;
 
         MacAddr getMacAddr();
 
@@ -24,7 +46,14 @@ class TunDevice
 
         static constexpr char TUN_NAME[] = "tun%d";
 
-        TunDevice(const std::optional<std::string_view> dev);
+        /* 
+         * with offload every frame carries a virtio-net header (IFF_VNET_HDR), and the kernel may
+         * hand over frames with partial TCP checksums and TCP segments of up to 64 KiB
+         */
+        TunDevice(const std::optional<std::string_view> dev, bool multiQueue = false, bool offload = false);
+
+        /* open count IFF_MULTI_QUEUE fds attached to the same interface */
+        static std::vector<TunDevice> openQueues(const std::optional<std::string_view> dev, size_t count, bool offload = false);
 
         ~TunDevice();
  
@@ -41,10 +70,16 @@ class TunDevice
         std::string name() const { return _name; }
         MacAddr     addr() const { return _addr; }
         int         fd()   const { return _fd;   }
+        bool        vnetHeader() const { return _vnetHeader; }
+
+        void setNonBlocking(void);
     
         int readBuf(char* buf, size_t count);
 
         int writeBuf(char* buf, size_t count);
+
+        /* one frame gathered from count pieces, e.g. the virtio-net header and the frame */
+        int writeVec(const struct iovec* iov, int count);
 };
 
 #endif
@@ -1,6 +1,7 @@
 #ifndef TYPES_HPP 
 #define TYPES_HPP
 
+#include <array>
 #include <iostream>
 #include <iomanip>
 
@@ -0,0 +1,168 @@
+#ifndef DEVICE_URING_HPP
+#define DEVICE_URING_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+#include "packetbuffer.hpp"
+#include "tun.hpp"
+
+/* the completion of a request: its result, flags and user data */
+struct UringCompletion
+{
+    int32_t  _result;
+    uint32_t _flags;
+    uint64_t _data;
+};
+
+/*
+ * An io_uring set up with raw syscalls (there is no liburing here): the submission queue, its
+ * entries and the completion queue are mapped from the kernel and shared with it, heads and
+ * tails move with acquire/release ordering. With sqPoll a kernel thread picks the submissions
+ * up and the process only enters the kernel to wake it after it went idle.
+ */
+class Uring
+{
+    private:
+        int            _fd = -1;
+        bool           _sqPoll;
+
+        void*          _sqRing = nullptr;
+        size_t         _sqRingSize = 0;
+        void*          _cqRing = nullptr;
+        size_t         _cqRingSize = 0;
+        io_uring_sqe*  _sqes = nullptr;
+        size_t         _sqesSize = 0;
+
+        unsigned*      _sqHead;
+        unsigned*      _sqTail;
+        unsigned*      _sqFlags;
+        unsigned*      _sqArray;
+        unsigned       _sqMask;
+        unsigned       _sqEntries;
+        unsigned       _sqLocalTail = 0;    // entries handed out by sqe(), published by submit()
+
+        unsigned*      _cqHead;
+        unsigned*      _cqTail;
+        io_uring_cqe*  _cqes;
+        unsigned       _cqMask;
+
+        void unmap(void);
+
+    public:
+        /* attach shares the SQPOLL thread of another ring */
+        Uring(unsigned entries, unsigned cqEntries, bool sqPoll, int attach = -1);
+
+        ~Uring();
+
+        Uring(const Uring&) = delete;
+
+        Uring& operator=(const Uring&) = delete;
+
+        int  fd(void) const { return _fd; }
+
+        /* a cleared submission entry, nullptr if the queue is full until the next submit() */
+        io_uring_sqe* sqe(void);
+
+        /* hand the entries to the kernel, return how many were published */
+        unsigned submit(void);
+
+        /* the oldest completion without consuming it, false if there is none */
+        bool peek(UringCompletion& completion);
+
+        /* consume the completion peek() returned */
+        void advance(void);
+
+        /* whether the running kernel knows the opcode */
+        bool supports(uint8_t opcode);
+
+        /* io_uring_register(2), -errno on failure */
+        int enroll(unsigned opcode, void* arg, unsigned count);
+};
+
+/*
+ * A TAP driven through io_uring instead of a read() and a write() per frame. Reads complete
+ * into a provided buffer ring of RX_BUFFERS packet buffers, every completion names the buffer
+ * it filled. One multishot read keeps completing until the ring runs dry; on kernels without
+ * IORING_OP_READ_MULTISHOT (before 6.7) SINGLE_READS plain reads are kept posted instead.
+ * Writes are batched on a second ring and submitted with one syscall, or none with SQPOLL.
+ * The thread's packet pool is registered as a fixed buffer, so writing a pool buffer doesn't
+ * pin its pages for every request. Reads and writes have a ring each because they are reaped
+ * at different times: reads in bursts when the RX ring polls readable, writes on every flush.
+ * The TAP stays blocking, io_uring polls it, and like its packet buffers the device belongs to
+ * the thread that created it.
+ */
+class UringDevice
+{
+    public:
+        static constexpr size_t   RX_BUFFERS   = 64;     // a power of two, for the buffer ring
+        static constexpr size_t   TX_ENTRIES   = 256;    // writes prepared between two submits
+        static constexpr unsigned SINGLE_READS = 16;
+        static constexpr uint16_t BUFFER_GROUP = 0;
+
+    private:
+        // the buffers outlive the rings, the kernel may still be reading into them
+        TunDevice                                    _tun;
+        std::array<Memory::PacketBuffer, RX_BUFFERS> _rxBuffers;
+        io_uring_buf*                                _bufferRing = nullptr;
+        uint16_t*                                    _bufferTail;
+        size_t                                       _bufferRingSize;
+        size_t                                       _frameSize;
+        Uring                                        _rx;
+        Uring                                        _tx;
+
+        bool                                         _multishot;
+        bool                                         _fixed;       // the packet pool is registered
+        unsigned                                     _reads = 0;   // posted and not ended
+
+    public:
+        /* every receive buffer holds frameSize bytes after its headroom */
+        UringDevice(TunDevice&& tun, size_t frameSize, bool sqPoll = false);
+
+        ~UringDevice();
+
+        UringDevice(const UringDevice&) = delete;
+
+        UringDevice& operator=(const UringDevice&) = delete;
+
+        std::string name() const { return _tun.name(); }
+        MacAddr     addr() const { return _tun.addr(); }
+        bool        vnetHeader() const { return _tun.vnetHeader(); }
+        size_t      frameSize() const { return _frameSize; }
+        bool        multishot() const { return _multishot; }
+        bool        fixedBuffers() const { return _fixed; }
+
+        /* polls readable when reads completed */
+        int         fd() const { return _rx.fd(); }
+
+        /* post the reads that ended again, false if the queue had no room for all of them */
+        bool arm(void);
+
+        /* 
+         * the oldest completed read, false if there is none. With IORING_CQE_F_BUFFER in its
+         * flags the read filled buffer(id), which has to be provided again
+         */
+        bool peekRead(UringCompletion& completion, uint16_t& id);
+
+        /* consume the read peekRead() returned */
+        void nextRead(void);
+
+        Memory::PacketBuffer& buffer(uint16_t id) { return _rxBuffers[id]; }
+
+        /* hand buffer(id) back to the kernel to read into, emptied */
+        void provide(uint16_t id);
+
+        /* prepare a write of the buffer's data tagged with data, false if the queue is full */
+        bool write(Memory::PacketBuffer& buffer, uint64_t data);
+
+        /* start the prepared writes */
+        void submitWrites(void) { _tx.submit(); }
+
+        /* the next finished write, false if there is none */
+        bool reapWrite(UringCompletion& completion);
+};
+
+#endif
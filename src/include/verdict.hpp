@@ -0,0 +1,90 @@
+#ifndef VERDICT_HPP
+#define VERDICT_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+/*
+ * What the packet path decided about a frame. Malformed or unsupported traffic is an
+ * ordinary outcome, it is returned and counted instead of thrown.
+ */
+namespace Verdict
+{
+    enum class Action : uint8_t {
+        ACCEPT,     // consumed, nothing to send
+        REPLY,      // the frame was rewritten into a reply, send it back
+        DROP,
+    };
+
+    /* traces record reasons by value, new ones go at the end */
+    enum class Reason : uint8_t {
+        NONE = 0,
+        RUNT,               // shorter than the ethernet header
+        ETHERTYPE,
+        TRUNCATED,          // a header runs past the end of the packet
+        ARP_HW_TYPE,
+        ARP_PRO_TYPE,
+        ARP_OPCODE,
+        IPV4_VERSION,
+        IPV4_HEADER_LENGTH,
+        IPV4_TTL,
+        IPV4_CHECKSUM,
+        IPV4_PROTOCOL,
+        ICMP_UNREACHABLE,
+        ICMP_TYPE,
+        TCP_CHECKSUM,
+        TCP_NO_CONNECTION,  // RST for a connection we don't have
+        TCP_TABLE_FULL,
+        TCP_SEQUENCE,       // RST outside the receive window
+        TCP_UNEXPECTED,     // not valid in the connection's state, e.g. no ACK once synchronized
+        NO_BUFFER,          // no room for the reply
+        ARP_UNRESOLVED,     // the next hop didn't answer
+        ARP_QUEUE_FULL,     // too many frames waiting for resolution
+        IPV4_FRAGMENT_INVALID,      // bad size or offset, or it contradicts the datagram's end
+        IPV4_FRAGMENT_OVERLAP,      // the whole datagram is dropped
+        IPV4_FRAGMENT_DUPLICATE,
+        IPV4_REASSEMBLY_TIMEOUT,
+        IPV4_REASSEMBLY_EVICTED,    // reassembly out of contexts, fragments or memory
+        IPV4_NO_ROUTE,
+        IPV4_TOO_BIG,               // over the MTU and not to be fragmented
+        TX_QUEUE_FULL,      // the device's transmit ring is full
+        COUNT,
+    };
+
+    struct Result
+    {
+        Action _action;
+        Reason _reason;
+
+        bool operator==(const Result& other) const { return _action == other._action && _reason == other._reason; }
+        bool operator!=(const Result& other) const { return !(*this == other); }
+    };
+
+    constexpr Result accept(void)        { return {Action::ACCEPT, Reason::NONE}; }
+    constexpr Result reply(void)         { return {Action::REPLY, Reason::NONE}; }
+    constexpr Result drop(Reason reason) { return {Action::DROP, reason}; }
+
+    const char* reasonName(Reason reason);
+
+    /* drops per reason, every worker keeps its own so plain counters are enough */
+    class DropCounters
+    {
+        private:
+            std::array<uint64_t, static_cast<std::size_t>(Reason::COUNT)> _counts{};
+
+        public:
+            void count(Reason reason, uint64_t n = 1) { _counts[static_cast<std::size_t>(reason)] += n; }
+
+            uint64_t get(Reason reason) const { return _counts[static_cast<std::size_t>(reason)]; }
+
+            uint64_t total(void) const;
+
+            /* used for TESTS and DEBUG */
+
+            void debugPrint(std::ostream& os) const;
+    };
+}
+
+#endif
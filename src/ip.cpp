@@ -1,58 +1,26 @@
+#include "checksum.hpp"
 #include "ip.hpp"
-#include "memorypool.hpp"
 #include "ethernet.hpp"
+#include "trace.hpp"
 
-IP::Checksum IP::Manager::calculateChecksum(void *buffer, size_t count)
-{
-    uint32_t sum = 0;
-    uint16_t *ptr = reinterpret_cast<uint16_t*>(buffer);
-
-    while (count > 1) {
-        sum += *ptr++;
-        count -= 2;
-    }
-
-    if (count > 0) {
-        sum += *reinterpret_cast<uint8_t*>(ptr);
-    }
-
-    while (sum >> 16) {
-        sum = (sum & 0xffff) + (sum >> 16);
-    }
-
-    return ~sum;
-}
-
-size_t IP::Header::readFromBuffer(char *buffer, size_t bufferLength)
+bool IP::Header::readFromBuffer(char *buffer, size_t bufferLength)
 {
     _buffer = buffer;
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_f1, buffer, idx, bufferLength); 
-        Memory::consume(_tos, buffer, idx, bufferLength); 
-        Memory::consume(_length, buffer, idx, bufferLength); 
-        Memory::consume(_id, buffer, idx, bufferLength); 
-        Memory::consume(_f2, buffer, idx, bufferLength); 
-        Memory::consume(_ttl, buffer, idx, bufferLength); 
-        Memory::consume(_proto, buffer, idx, bufferLength); 
-        Memory::consume(_checksum, buffer, idx, bufferLength); 
-        Memory::consume(_srcAddr, buffer, idx, bufferLength); 
-        Memory::consume(_dstAddr, buffer, idx, bufferLength); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Header::readFromBuffer: Failed reading IP header\n";
+    if (!HeaderLayout::read(buffer, bufferLength, _f1, _tos, _length, _id, _f2, _ttl, _proto, _checksum, _srcAddr, _dstAddr)) {
+        return false;
     }
 
-    _payloadSize = bufferLength - idx;
-    try {
-        Memory::consumePointer(_payload, buffer, idx, bufferLength, _payloadSize); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Header::readFromBuffer: Failed reading IP payload\n";
+    // the payload ends at the total length, frames shorter than 64 bytes are padded. A bad
+    // header or total length leaves an empty payload, Manager::handleMessage drops it.
+    _payload = buffer + HeaderLayout::SIZE;
+    _payloadSize = 0;
+    if (headerLength() >= HEADER_SIZE && headerLength() <= _length && _length <= bufferLength) {
+        _payload = buffer + headerLength();
+        _payloadSize = _length - headerLength();
     }
 
-    return _payloadSize;
+    return true;
 }
 
 void IP::Header::debugPrint(void)
@@ -75,29 +43,18 @@ void IP::Header::debugPrint(void)
     std::cout << std::setfill (' ') << std::setw(0) << std::dec << "\n" << std::endl;
 }
 
-size_t IP::PayloadICMPv4Header::readFromBuffer(char *buffer, size_t bufferLength)
+bool IP::PayloadICMPv4Header::readFromBuffer(char *buffer, size_t bufferLength)
 {
     _buffer = buffer;
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_type, buffer, idx, bufferLength); 
-        Memory::consume(_code, buffer, idx, bufferLength); 
-        Memory::consume(_checksum, buffer, idx, bufferLength); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4::readFromBuffer: Failed reading ICMPv4 header\n";
+    if (!ICMPHeaderLayout::read(buffer, bufferLength, _type, _code, _checksum)) {
+        return false;
     }
 
-    _payloadSize = bufferLength - idx;
-    try {
-        Memory::consumePointer(_payload, buffer, idx, bufferLength, _payloadSize); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4::readFromBuffer: Failed reading ICMPv4 payload\n";
-    }
+    _payloadSize = bufferLength - ICMPHeaderLayout::SIZE;
+    _payload = buffer + ICMPHeaderLayout::SIZE;
 
-    return _payloadSize;
+    return true;
 }
 
 void IP::PayloadICMPv4Header::debugPrint(void)
@@ -116,29 +73,18 @@ void IP::PayloadICMPv4Header::debugPrint(void)
     std::cout << std::setfill (' ') << std::setw(0) << std::dec << "\n" << std::endl;
 }
 
-size_t IP::PayloadICMPv4Echo::readFromBuffer(char *buffer, size_t bufferLength)
+bool IP::PayloadICMPv4Echo::readFromBuffer(char *buffer, size_t bufferLength)
 {
     _buffer = buffer;
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_id, buffer, idx, bufferLength); 
-        Memory::consume(_sequence, buffer, idx, bufferLength); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4Echo::readFromBuffer: Failed reading ICMPv4 echo header\n";
+    if (!ICMPEchoLayout::read(buffer, bufferLength, _id, _sequence)) {
+        return false;
     }
 
-    _payloadSize = bufferLength - idx;
-    std::cout << "DATA SIZE: " << _payloadSize << '\n';
-    try {
-        Memory::consumePointer(_payload, buffer, idx, bufferLength, _payloadSize); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4Echo::readFromBuffer: Failed reading ICMPv4 echo payload\n";
-    }
+    _payloadSize = bufferLength - ICMPEchoLayout::SIZE;
+    _payload = buffer + ICMPEchoLayout::SIZE;
 
-    return _payloadSize;
+    return true;
 }
 
 void IP::PayloadICMPv4Echo::debugPrint(void)
@@ -156,29 +102,18 @@ void IP::PayloadICMPv4Echo::debugPrint(void)
     std::cout << std::setfill (' ') << std::setw(0) << std::dec << "\n" << std::endl;
 }
 
-size_t IP::PayloadICMPv4Unreachable::readFromBuffer(char *buffer, size_t bufferLength)
+bool IP::PayloadICMPv4Unreachable::readFromBuffer(char *buffer, size_t bufferLength)
 {
     _buffer = buffer;
 
-    size_t idx = 0;
-    try {
-        Memory::consume(_unused, buffer, idx, bufferLength); 
-        Memory::consume(_length, buffer, idx, bufferLength); 
-        Memory::consume(_var, buffer, idx, bufferLength); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4Unreachable::readFromBuffer: Failed reading ICMPv4 unreachable header\n";
+    if (!ICMPUnreachableLayout::read(buffer, bufferLength, _unused, _length, _var)) {
+        return false;
     }
 
-    _payloadSize = bufferLength - idx;
-    try {
-        Memory::consumePointer(_payload, buffer, idx, bufferLength, _payloadSize); 
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::PayloadICMPv4Unreachable::readFromBuffer: Failed reading ICMPv4 unreachable payload\n";
-    }
+    _payloadSize = bufferLength - ICMPUnreachableLayout::SIZE;
+    _payload = buffer + ICMPUnreachableLayout::SIZE;
 
-    return _payloadSize;
+    return true;
 }
 
 void IP::PayloadICMPv4Unreachable::debugPrint(void)
@@ -196,156 +131,218 @@ void IP::PayloadICMPv4Unreachable::debugPrint(void)
     std::cout << std::setfill (' ') << std::setw(0) << std::dec << "\n" << std::endl;
 }
 
-Ethernet::Frame IP::Manager::handleICMPRequest(Ethernet::Frame& frame, IP::Header& header, 
-                                            IP::PayloadICMPv4Header& icmpHeader, IP::PayloadICMPv4Echo& icmpEcho)
+Verdict::Result IP::Manager::send(Ethernet::Frame& frame, IPAddr src, IPAddr dst, Protocol proto, ID id, 
+                                  Fields2 fields2, IPAddr nextHop)
 {
-    static uint32_t id_num = 1;
+    constexpr size_t HEADERS_SIZE = Ethernet::HeaderLayout::SIZE + HEADER_SIZE;
 
-    Ethernet::Frame reply;
-    size_t bufferLength = reply.allocPacket();
-    Ethernet::Packet *buffer = reply.getPacket();
-    MacAddr addr = getDevMacAddr();
-    
-    size_t idx = 0;
-    try {
-        Memory::write(frame.getSrc(), buffer->buf, idx, bufferLength);
-        Memory::write(addr, buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<EtherType>(PRO_IPV4), buffer->buf, idx, bufferLength);
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Manager::handleICMPRequest: Failed writing ethernet frame header\n";
+    Memory::PacketBuffer& buffer = frame.getBuffer();
+    if (buffer.headroom() < HEADERS_SIZE) {
+        return Verdict::drop(Verdict::Reason::NO_BUFFER);
     }
 
-    size_t ipStart = idx;
-    size_t ipLenStart; 
-    size_t ipChecksumStart;
-    try {
-        Memory::write(IP::Fields1(VER_IPV4, 5), buffer->buf, idx, bufferLength);
-        Memory::write(header._tos, buffer->buf, idx, bufferLength);
-        ipLenStart = idx;
-        Memory::write(static_cast<Length16>(0), buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<ID>(id_num++), buffer->buf, idx, bufferLength);
-        Memory::write(IP::Fields2(0, 0), buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<TTL>(64), buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<Protocol>(IP::PRO_ICMP), buffer->buf, idx, bufferLength);
-        ipChecksumStart = idx;
-        Memory::write(static_cast<Checksum>(0), buffer->buf, idx, bufferLength);
-        Memory::write(header._dstAddr, buffer->buf, idx, bufferLength);
-        Memory::write(header._srcAddr, buffer->buf, idx, bufferLength);
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Manager::handleICMPRequest: Failed writing IP header\n";
-    }
+    size_t length = buffer.length();
+    char *ip = buffer.push(HEADER_SIZE);
+    HeaderLayout::store(ip, Fields1(VER_IPV4, HEADER_SIZE / 4), 0, static_cast<Length16>(HEADER_SIZE + length), 
+            id, fields2, DEFAULT_TTL, proto, 0, src, dst);
+    Checksum checksum = Inet::checksum(ip, HEADER_SIZE);
+    std::memcpy(ip + IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
 
-    size_t icmpStart = idx;
-    size_t icmpChecksumStart;
-    try {
-        Memory::write(static_cast<Type>(TYPE_REPLY), buffer->buf, idx, bufferLength);
-        Memory::write(static_cast<Code>(0), buffer->buf, idx, bufferLength);
-        icmpChecksumStart = idx;
-        Memory::write(static_cast<Checksum>(0), buffer->buf, idx, bufferLength);
-    }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Manager::handleICMPRequest: Failed writing ICMP header\n";
-    }
+    // the destination MAC is filled in once the next hop is resolved
+    Ethernet::HeaderLayout::store(buffer.push(Ethernet::HeaderLayout::SIZE), MacAddr{}, getDevMacAddr(), 
+            static_cast<EtherType>(PRO_IPV4));
+    frame.parseBuffer();
+
+    return _arp.output(frame, nextHop);
+}
 
-    try {
-        Memory::write(icmpEcho._id, buffer->buf, idx, bufferLength);
-        Memory::write(icmpEcho._sequence, buffer->buf, idx, bufferLength);
-        Memory::writePointer(icmpEcho._payload, buffer->buf, idx, bufferLength, icmpEcho._payloadSize);
-        Memory::write(frame.getCRC(), buffer->buf, idx, bufferLength);
+Verdict::Result IP::Manager::output(Ethernet::Frame& frame, IPAddr src, IPAddr dst, Protocol proto, bool dontFragment)
+{
+    // every fragment but the last carries a multiple of 8 bytes
+    constexpr size_t FRAGMENT_SIZE = (Ethernet::MTU - HEADER_SIZE) & ~size_t{7};
+
+    const NextHop *route = _routes.lookup(dst);
+    if (route == nullptr) {
+        return Verdict::drop(Verdict::Reason::IPV4_NO_ROUTE);
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Manager::handleICMPRequest: Failed writing ICMP reply\n";
+
+    IPAddr nextHop = (route->_gateway != 0) ? route->_gateway : dst;
+    size_t length = frame.getBufferSize();
+    ID id = _idNum++;
+
+    // a reply written over a coalesced segment leaves the chained data behind
+    frame.offload() = Ethernet::Offload{};
+    frame.unchain();
+    if (HEADER_SIZE + length <= Ethernet::MTU) {
+        return send(frame, src, dst, proto, id, Fields2(dontFragment ? FLAG_NOFRAG : 0, 0), nextHop);
     }
 
-    try {
-        Memory::write(static_cast<Length16>(idx - ipStart), buffer->buf, ipLenStart, bufferLength);
-        
-        Checksum icmpChecksum = htons(calculateChecksum(buffer->buf + icmpStart, idx - icmpStart));
-        Memory::write(static_cast<Checksum>(icmpChecksum), buffer->buf, icmpChecksumStart, bufferLength);
+    // one header for the whole run of segments, cut up and checksummed by the device or by
+    // GSO::Segmenter on the way to it. Their checksums start from the pseudo header sum.
+    if (proto == PRO_TCP && HEADER_SIZE + length <= UINT16_MAX && length >= TCP::HEADER_SIZE) {
+        char *segment = frame.getData();
+        size_t tcpHeaderLength = (static_cast<uint8_t>(segment[12]) >> 4) * 4;
+        Checksum pseudo = Inet::fold(Inet::pseudoHeader(src, dst, PRO_TCP, static_cast<uint16_t>(length)));
+        std::memcpy(segment + TCP::CHECKSUM_OFFSET, &pseudo, sizeof(pseudo));
+
+        Ethernet::Offload& offload = frame.offload();
+        offload._flags = Ethernet::Offload::CHECKSUM_PARTIAL;
+        offload._gsoType = Ethernet::Offload::GSO_TCPV4;
+        offload._headerLength = static_cast<uint16_t>(Ethernet::HeaderLayout::SIZE + HEADER_SIZE + tcpHeaderLength);
+        offload._gsoSize = static_cast<uint16_t>(Ethernet::MTU - HEADER_SIZE - tcpHeaderLength);
+        offload._checksumStart = static_cast<uint16_t>(Ethernet::HeaderLayout::SIZE + HEADER_SIZE);
+        offload._checksumOffset = static_cast<uint16_t>(TCP::CHECKSUM_OFFSET);
 
-        Checksum checksum = htons(calculateChecksum(buffer->buf + ipStart, idx - ipStart));
-        Memory::write(static_cast<Checksum>(checksum), buffer->buf, ipChecksumStart, bufferLength);
+        return send(frame, src, dst, proto, id, Fields2(FLAG_NOFRAG, 0), nextHop);
+    }
 
-        CRC32 newCRC = htonl(Ethernet::calcCRC(0, buffer->buf, idx));
-        Memory::write(newCRC, buffer->buf, idx, bufferLength);
+    // without transmit only the last fragment could go out
+    if (dontFragment || HEADER_SIZE + length > UINT16_MAX || !_transmit) {
+        return Verdict::drop(Verdict::Reason::IPV4_TOO_BIG);
     }
-    catch (const std::runtime_error& err) {
-        std::cerr << "ip.cpp: IP::Manager::handleICMPRequest: Failed writing checksums\n";
+
+    // the leading fragments are copied out and sent as they are cut, the last one stays in frame
+    size_t offset = 0;
+    for (; length - offset > FRAGMENT_SIZE; offset += FRAGMENT_SIZE) {
+        Ethernet::Frame fragment;
+        if (!fragment.tryAllocPacket(FRAGMENT_SIZE)) {
+            return Verdict::drop(Verdict::Reason::NO_BUFFER);
+        }
+        std::memcpy(fragment.getData(), frame.getData() + offset, FRAGMENT_SIZE);
+        fragment.setBufferSize(FRAGMENT_SIZE);
+
+        Verdict::Result result = send(fragment, src, dst, proto, id, Fields2(FLAG_MORE, offset / 8), nextHop);
+        if (result == Verdict::reply()) {
+            if (!_transmit(fragment)) {
+                return Verdict::drop(Verdict::Reason::TX_QUEUE_FULL);
+            }
+        } else if (result != Verdict::accept()) {
+            return result;
+        }
     }
 
-    reply.setBufferSize(idx);
-    reply.parseBuffer();
-    std::cout << "RESPONSE:\n";
-    reply.debugPrint();
-    return reply;
+    frame.getBuffer().pull(offset);
+    return send(frame, src, dst, proto, id, Fields2(0, offset / 8), nextHop);
 }
 
-Ethernet::Frame IP::Manager::handleICMPMessage(Ethernet::Frame& frame, IP::Header& header)
+Verdict::Result IP::Manager::handleICMPRequest(Ethernet::Frame& frame, IP::Header& header, 
+                                              IP::PayloadICMPv4Header& icmpHeader)
 {
-    char *buffer = header.getPayload();   
-    size_t bufferLength = header.getPayloadSize();
+    // only the ICMP type changes and its checksum is patched instead of recomputed. The reply
+    // keeps the request's buffer, without the trailing bytes of a padded frame, and output()
+    // writes fresh headers in front of it.
+    char *icmp = icmpHeader._buffer;
+    Inet::patch16(icmp, htons(static_cast<uint16_t>(TYPE_REPLY << 8)), icmp + ICMP_CHECKSUM_OFFSET);
 
-    IP::PayloadICMPv4Header icmpHeader;
-    icmpHeader.readFromBuffer(buffer, bufferLength);
-    icmpHeader.debugPrint();
+    frame.getBuffer().pull(icmp - frame.getData());
+    frame.setBufferSize(header.getPayloadSize());
+
+    return output(frame, header._dstAddr, header._srcAddr, PRO_ICMP);
+}
 
+Verdict::Result IP::Manager::handleICMPMessage(Ethernet::Frame& frame, IP::Header& header)
+{
+    IP::PayloadICMPv4Header icmpHeader;
+    if (!icmpHeader.readFromBuffer(header.getPayload(), header.getPayloadSize())) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
+    }
+    Trace::packet(Trace::Event::ICMP_RX, icmpHeader._type << 8 | icmpHeader._code, icmpHeader._payloadSize);
 
     switch (icmpHeader._type) {
         case TYPE_REQUEST: {
-            buffer = icmpHeader.getPayload();
-            bufferLength = icmpHeader.getPayloadSize();
-
             IP::PayloadICMPv4Echo icmpEcho;
-            icmpEcho.readFromBuffer(buffer, bufferLength);
-            return handleICMPRequest(frame, header, icmpHeader, icmpEcho);
+            if (!icmpEcho.readFromBuffer(icmpHeader.getPayload(), icmpHeader.getPayloadSize())) {
+                return Verdict::drop(Verdict::Reason::TRUNCATED);
+            }
+
+            Trace::packet(Trace::Event::ICMP_REPLY, icmpEcho._id << 16 | icmpEcho._sequence, icmpEcho._payloadSize);
+            return handleICMPRequest(frame, header, icmpHeader);
         }
             
         case TYPE_UNREACHABLE:
-            throw std::runtime_error("ip.cpp: IP::Manager::HandleICMPMessage(): unreachable\n");
+            return Verdict::drop(Verdict::Reason::ICMP_UNREACHABLE);
         
         default:
-            throw std::runtime_error("ip.cpp: IP::Manager::HandleICMPMessage(): not supported version type\n");
+            return Verdict::drop(Verdict::Reason::ICMP_TYPE);
+    }
+}
+
+Verdict::Result IP::Manager::handleTCPMessage(Ethernet::Frame& frame, IP::Header& header)
+{
+    char *segment = header.getPayload();
+    size_t offset = segment - frame.getData();
+    if (frame.getBuffer().capacity() - frame.getBuffer().headroom() < offset + TCP::MAX_REPLY_SIZE) {
+        return Verdict::drop(Verdict::Reason::NO_BUFFER);
+    }
+
+    size_t replyLength = 0;
+    Verdict::Result result = _tcp.handleSegment(header._srcAddr, header._dstAddr, segment, header.getPayloadSize(), 
+                                                segment, replyLength, frame.offload().checksumValid());
+    if (result != Verdict::reply()) {
+        return result;
     }
+
+    frame.getBuffer().pull(offset);
+    frame.setBufferSize(replyLength);
+
+    return output(frame, header._dstAddr, header._srcAddr, PRO_TCP, true);
+}
+
+void IP::Manager::attach(Event::TimerWheel& timers, ARP::Transmit transmit, Verdict::DropCounters* drops)
+{
+    _transmit = std::move(transmit);
+    _reassembly.attach(timers, drops);
+    _tcp.attach(timers);
 }
 
-Ethernet::Frame IP::Manager::handleMessage(Ethernet::Frame& frame)
+Verdict::Result IP::Manager::handleMessage(Ethernet::Frame& frame)
 {
-    char *buffer = frame.getPayload();
-    size_t bufferLength = frame.getPayloadSize();
+    // a coalesced segment continues in the frames chained to it, only its headers are in frame
+    size_t length = frame.getPayloadSize() + frame.getChainLength();
 
     IP::Header header;
-    header.readFromBuffer(buffer, bufferLength);   
-    header.debugPrint();
+    if (!header.readFromBuffer(frame.getPayload(), length)) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
+    }
+    Trace::packet(Trace::Event::IP_RX, header._proto << 16 | header._length, header._srcAddr, header._dstAddr);
 
     if (header._f1._version != VER_IPV4) {
-        throw std::runtime_error("ip.cpp: IP::Manager::HandleMessage(): not supported version type\n");
+        return Verdict::drop(Verdict::Reason::IPV4_VERSION);
     }
     
     if (header._f1._ihl < 5) {
-        throw std::runtime_error("ip.cpp: IP::Manager::HandleMessage(): IPv4 header length must be at least 5\n");
+        return Verdict::drop(Verdict::Reason::IPV4_HEADER_LENGTH);
+    }
+
+    if (header._length < header.headerLength() || header._length > length) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
     }
 
     if (header._ttl == 0) {
-        throw std::runtime_error("ip.cpp: IP::Manager::HandleMessage(): Time to live == 0\n");
+        return Verdict::drop(Verdict::Reason::IPV4_TTL);
     }
 
-    Checksum checksum = calculateChecksum(header._buffer, IP::HEADER_SIZE);
+    if (Inet::checksum(header._buffer, header.headerLength()) != 0) {
+        return Verdict::drop(Verdict::Reason::IPV4_CHECKSUM);
+    }
 
-    if (checksum != 0) {
-        throw std::runtime_error("ip.cpp: IP::Manager::HandleMessage(): checksum not correct\n");
+    // a fragment is taken over by the reassembler, the last one comes back as the whole datagram
+    if ((header._f2._flags & FLAG_MORE) || header._f2._fragOffset != 0) {
+        Verdict::Result verdict;
+        if (!_reassembly.add(frame, header, verdict)) {
+            return verdict;
+        }
+        header.readFromBuffer(frame.getPayload(), frame.getPayloadSize());
     }
 
     switch (header._proto) {
         case PRO_ICMP:
             return handleICMPMessage(frame, header);        
-            break;
+
+        case PRO_TCP:
+            return handleTCPMessage(frame, header);
 
         default:
-            throw std::runtime_error("ip.cpp: IP::Manager::HandleMessage(): not supported protocol type\n");
-            break;
+            return Verdict::drop(Verdict::Reason::IPV4_PROTOCOL);
     }
-
-    return {};
 }
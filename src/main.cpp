@@ -0,0 +1,146 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "eventloop.hpp"
+#include "packet.hpp"
+#include "pcap.hpp"
+#include "stack.hpp"
+#include "trace.hpp"
+#include "tun.hpp"
+#include "uring.hpp"
+
+/* 
+ * usage: charmTCP [--addr <IPv4 address>] [--offload] [--uring | --sqpoll] [device name] [number of queues]
+ *                 [TCP port to listen on]...
+ *        charmTCP [--addr <IPv4 address>] --packet <interface> [1] [TCP port to listen on]...
+ *        charmTCP --pcap [--paced] <capture> [reply capture | -] [TCP port to listen on]...
+ *        charmTCP --decode <trace file>
+ *
+ * --offload exchanges frames with the TAP through the virtio-net header, so the kernel skips
+ * checksums and segmentation for us. --uring reads and writes the TAP through io_uring,
+ * --sqpoll too with a kernel thread that polls the submissions. --packet attaches to an
+ * existing interface (one end of a veth pair, say) through AF_PACKET rings instead of a TAP.
+ * --pcap replays a pcap or pcapng capture as fast as the stack takes it, or as it was recorded
+ * with --paced, writes what the stack sends to the reply capture and prints the packet rate.
+ * --addr is the stack's own address, which it resolves next hops from; without it ARP requests
+ * are sent as probes.
+ *
+ * with CHARMTCP_TRACE=<trace file> set, the trace rings are dumped there on SIGUSR1 and
+ * before exiting on SIGINT/SIGTERM.
+ */
+int main(int argc, char *argv[])
+{
+    if (argc > 2 && std::strcmp(argv[1], "--decode") == 0) {
+        return Trace::decode(argv[2], std::cout) ? 0 : 1;
+    }
+
+    if (const char *tracePath = std::getenv("CHARMTCP_TRACE")) {
+        Trace::dumpOnSignal(tracePath);
+    }
+
+    bool offload = false;
+    bool packet = false;
+    bool pcap = false;
+    bool paced = false;
+    IPAddr addr = 0;
+    Stack::Backend backend = Stack::Backend::READ_WRITE;
+    for (; argc > 1 && std::strncmp(argv[1], "--", 2) == 0; --argc, ++argv) {
+        if (std::strcmp(argv[1], "--offload") == 0) {
+            offload = true;
+        } else if (std::strcmp(argv[1], "--uring") == 0) {
+            backend = Stack::Backend::URING;
+        } else if (std::strcmp(argv[1], "--sqpoll") == 0) {
+            backend = Stack::Backend::URING_SQPOLL;
+        } else if (std::strcmp(argv[1], "--packet") == 0) {
+            packet = true;
+        } else if (std::strcmp(argv[1], "--pcap") == 0) {
+            pcap = true;
+        } else if (std::strcmp(argv[1], "--paced") == 0) {
+            paced = true;
+        } else if (std::strcmp(argv[1], "--addr") == 0) {
+            in_addr parsed;
+            if (argc < 3 || inet_pton(AF_INET, argv[2], &parsed) != 1) {
+                std::cerr << "--addr takes an IPv4 address\n";
+                return 1;
+            }
+            addr = ntohl(parsed.s_addr);
+            --argc;
+            ++argv;
+        } else {
+            std::cerr << "unknown option " << argv[1] << '\n';
+            return 1;
+        }
+    }
+
+    std::optional<std::string_view> name;
+    if (argc > 1) {
+        name = argv[1];
+    }
+
+    // a replay takes its reply capture where the number of queues would go
+    size_t queues = (argc > 2 && !pcap) ? std::strtoul(argv[2], nullptr, 10) : 1;
+
+    std::vector<TCP::Port> ports;
+    for (int i = 3; i < argc; ++i) {
+        ports.push_back(static_cast<TCP::Port>(std::strtoul(argv[i], nullptr, 10)));
+    }
+
+    if (pcap) {
+        if (!name.has_value()) {
+            std::cerr << "--pcap takes a capture to replay\n";
+            return 1;
+        }
+
+        if (packet || offload || backend != Stack::Backend::READ_WRITE) {
+            std::cerr << "--pcap can't be combined with --packet, --offload, --uring or --sqpoll\n";
+            return 1;
+        }
+
+        std::string_view output = (argc > 2 && std::strcmp(argv[2], "-") != 0) ? argv[2] : "";
+        Stack::Worker<PcapDevice> worker{name.value(), output, paced};
+        Stack::ReplayStats stats = Stack::replay(worker, ports);
+
+        double seconds = std::chrono::duration<double>(stats._elapsed).count();
+        std::cout << stats._frames << " frames in " << seconds << " s, " << (seconds > 0 ? stats._frames / seconds : 0) 
+                  << " pps, " << stats._replies << " replies, " << worker.drops().total() << " drops\n";
+        return 0;
+    }
+
+    if (packet) {
+        if (!name.has_value() || queues != 1) {
+            std::cerr << "--packet takes an interface and a single queue\n";
+            return 1;
+        }
+
+        if (offload || backend != Stack::Backend::READ_WRITE) {
+            std::cerr << "--packet can't be combined with --offload, --uring or --sqpoll\n";
+            return 1;
+        }
+
+        Stack::Worker<PacketDevice> worker{name.value()};
+        Stack::serve(worker, ports, addr);
+        return 0;
+    }
+
+    if (queues > 1) {
+        Stack::runQueues(name, queues, ports, addr, offload, backend);
+        return 0;
+    }
+
+    if (backend == Stack::Backend::READ_WRITE) {
+        Stack::Worker<TunDevice> worker{name, offload};
+        Stack::serve(worker, ports, addr);
+    } else {
+        Stack::Worker<UringDevice> worker{name, offload, backend == Stack::Backend::URING_SQPOLL};
+        Stack::serve(worker, ports, addr);
+    }
+
+    return 0;
+}
@@ -1,17 +1,85 @@
 #include "memorypool.hpp"
 
+#include <algorithm>
+#include <bitset>
 #include <iostream>
 
-static Memory::ObjectPool<Memory::Block> blocksPool{};
+/* the live concurrent pools and the thread slots taken */
+struct SlotRegistry
+{
+    std::mutex                          _lock;
+    std::vector<Memory::ThreadCaches*>  _caches;
+    std::bitset<Memory::MAX_THREADS>    _taken;
+};
 
-void* Memory::Block::operator new(std::size_t size)
+static SlotRegistry& registry(void)
 {
-    return blocksPool.allocate();
+    static SlotRegistry registry;
+
+    return registry;
 }
 
-void Memory::Block::operator delete(void *ptr)
+static constexpr std::size_t UNASSIGNED = SIZE_MAX;
+
+// plain data, still readable while the thread's other thread_locals are destroyed
+static thread_local std::size_t currentSlot = UNASSIGNED;
+
+/* gives the thread's slot back when it exits */
+struct SlotHolder
 {
-    blocksPool.deallocate(ptr);
+    ~SlotHolder()
+    {
+        std::size_t slot = currentSlot;
+        currentSlot = Memory::NO_SLOT;
+        if (slot == Memory::NO_SLOT) {
+            return;
+        }
+
+        SlotRegistry& slots = registry();
+        std::lock_guard<std::mutex> guard{slots._lock};
+        for (Memory::ThreadCaches* caches : slots._caches) {
+            caches->reclaim(slot);
+        }
+        slots._taken.reset(slot);
+    }
+};
+
+std::size_t Memory::threadSlot(void)
+{
+    if (currentSlot != UNASSIGNED) {
+        return currentSlot;
+    }
+
+    thread_local SlotHolder holder;
+    SlotRegistry& slots = registry();
+    std::lock_guard<std::mutex> guard{slots._lock};
+
+    currentSlot = NO_SLOT;
+    for (std::size_t slot = 0; slot < MAX_THREADS; ++slot) {
+        if (!slots._taken[slot]) {
+            slots._taken.set(slot);
+            currentSlot = slot;
+            break;
+        }
+    }
+
+    return currentSlot;
+}
+
+void Memory::registerCaches(ThreadCaches* caches)
+{
+    SlotRegistry& slots = registry();
+    std::lock_guard<std::mutex> guard{slots._lock};
+
+    slots._caches.push_back(caches);
+}
+
+void Memory::unregisterCaches(ThreadCaches* caches)
+{
+    SlotRegistry& slots = registry();
+    std::lock_guard<std::mutex> guard{slots._lock};
+
+    slots._caches.erase(std::remove(slots._caches.begin(), slots._caches.end(), caches), slots._caches.end());
 }
 
 void Memory::OrderBlocks::markAllocated(std::uintptr_t addr)
@@ -28,50 +96,38 @@ bool Memory::OrderBlocks::get(std::uintptr_t addr)
     return _bitMap[bit];
 }
 
-void Memory::BuddyPool::splitBlock(std::size_t order)
+std::size_t Memory::OrderBlocks::size(void)
 {
-    if (order == _totalOrder - 1 && _orderBlocksList[order]._blockList.empty()) {
-        throw std::runtime_error("memorypool.cpp: Memory::BuddyPool::splitBlock(): the buddyPool is full");
-    }
-
-    if (_orderBlocksList[order]._blockList.empty()) {
-        splitBlock(order + 1);
+    std::size_t count = 0;
+    for (FreeBlock* block = _head; block != nullptr; block = block->_next) {
+        ++count;
     }
 
-    if (order != 0) { 
-        std::unique_ptr<Block> block = std::move(_orderBlocksList[order]._blockList.front());
-        _orderBlocksList[order]._blockList.pop_front();
-        
-        _orderBlocksList[order].markAllocated(block->_addr - _memory.data());
-     
-        // cutting the block in two smaller halves.
-        _orderBlocksList[order - 1].add(block->_addr + (SMALLEST_SIZE << order) / 2);
-        _orderBlocksList[order - 1].add(block->_addr);
-    } else {
-        throw std::runtime_error("memorypool.cpp: Memory::BuddyPool::splitBlock(): can't split order 0 blocks");
-    }
+    return count;
 }
 
-void Memory::BuddyPool::mergeBlock(unsigned char* addr, std::size_t order)
+unsigned char* Memory::BuddyPool::takeBlock(std::size_t sizeOrder)
 {
-    _orderBlocksList[order].markAllocated(addr - _memory.data());
+    std::size_t order = sizeOrder;
+    while (order < _totalOrder && _orderBlocksList[order].empty()) {
+        ++order;
+    }
 
-    if (order != _totalOrder - 1 && !_orderBlocksList[order].get(addr - _memory.data())) {
-        unsigned char* high_addr = ((addr - _memory.data()) & ~(1 << (order + SMALLEST_SIZE_SHIFT))) + _memory.data(); 
-        unsigned char* low_addr = ((addr - _memory.data()) | (1 << (order + SMALLEST_SIZE_SHIFT))) + _memory.data(); 
+    if (order == _totalOrder) {
+        return nullptr;
+    }
 
-        std::list<std::unique_ptr<Block>>& list = _orderBlocksList[order]._blockList;
-        for (auto it = list.begin(); it != list.end(); ++it) {
-            if (it->get()->_addr == high_addr || it->get()->_addr == low_addr) {
-                list.erase(it);
-                break;
-            }
-        }
+    unsigned char* addr = _orderBlocksList[order].pop();
+    _orderBlocksList[order].markAllocated(addr - _memory.data());
 
-        mergeBlock(high_addr, order + 1);
-    } else {
-        _orderBlocksList[order].add(addr);
+    // cutting the block in halves down to the requested order, the upper halves stay free.
+    while (order > sizeOrder) {
+        --order;
+        _orderBlocksList[order].add(addr + (SMALLEST_SIZE << order));
+        _orderBlocksList[order].markAllocated(addr - _memory.data());
     }
+
+    return addr;
 }
 
 std::size_t Memory::BuddyPool::getOrder(std::size_t size) 
@@ -87,96 +143,53 @@ std::size_t Memory::BuddyPool::getOrder(std::size_t size)
     return sizeOrder;
 }
 
-void Memory::BuddyPool::deallocate(void *ptr, std::size_t size)
-{
-    if (ptr == nullptr) {
-        throw std::runtime_error("memorypool.cpp: Memory::BuddyPool::deallocate(): ptr is already freed");
-    }
-
-    std::size_t sizeOrder = getOrder(size);
-    mergeBlock(static_cast<unsigned char*>(ptr), sizeOrder);
-    ptr = nullptr;
-}
-
-void Memory::consume(IP::Fields1& dest, char *buffer, std::size_t& idx, std::size_t bufferSize)
+void Memory::BuddyPool::drainRemote(void)
 {
-    if (idx + sizeof(uint8_t) > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::consume(): the requested memory would overflow the buffer\n");
+    RemoteBlock* block = _remote.exchange(nullptr, std::memory_order_acquire);
+    while (block != nullptr) {
+        RemoteBlock* next = block->_next;
+        deallocate(block, block->_size);
+        block = next;
     }
-
-    uint8_t val = static_cast<uint8_t>(buffer[idx]);
-
-    dest._version = val >> 4;
-    dest._ihl     = val & 0xF; 
-
-    idx += sizeof(uint8_t);
 }
 
-void Memory::consume(IP::Fields2& dest, char *buffer, std::size_t& idx, std::size_t bufferSize)
+void Memory::BuddyPool::deallocate(void *ptr, std::size_t size)
 {
-    if (idx + sizeof(uint16_t) > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::consume(): the requested memory would overflow the buffer\n");
+    if (ptr == nullptr) {
+        throw std::runtime_error("memorypool.cpp: Memory::BuddyPool::deallocate(): ptr is already freed");
     }
 
-    uint16_t val = ntohs(*reinterpret_cast<uint16_t*>(buffer + idx));
-
-    dest._flags      = val >> 13;
-    dest._fragOffset = val & 0x1FFF; 
-
-    idx += sizeof(uint16_t);
-}
+    std::size_t order = getOrder(size);
+    std::uintptr_t offset = static_cast<unsigned char*>(ptr) - _memory.data();
 
-void Memory::consume(MacAddr& dest, char *buffer, std::size_t& idx, std::size_t bufferSize)
-{
-    if (idx + sizeof(uint8_t) * 6 > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::consume(): the requested memory would overflow the buffer\n");
-    } 
+    // merging with the buddy while it is free too, the bitmap tells it without a search.
+    while (true) {
+        OrderBlocks& orderBlocks = _orderBlocksList[order];
+        orderBlocks.markAllocated(offset);
 
-    for (uint8_t& byte : dest.addr) {
-        byte = static_cast<uint8_t>(buffer[idx]);
-        idx += sizeof(uint8_t);
-    }
-}
+        if (order == _totalOrder - 1 || orderBlocks.get(offset)) {
+            orderBlocks.add(_memory.data() + offset);
+            return;
+        }
 
-void Memory::write(const IP::Fields1& src, char *buffer, std::size_t& idx, std::size_t bufferSize)
-{
-    if (idx + sizeof(uint8_t) > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::write(): writing the memory would overflow the buffer\n");
+        std::uintptr_t blockSize = SMALLEST_SIZE << order;
+        orderBlocks.remove(_memory.data() + (offset ^ blockSize));
+        offset &= ~blockSize;
+        ++order;
     }
-
-    uint8_t *ptr = reinterpret_cast<uint8_t*>(buffer + idx);
-
-    *ptr = src._version << 4;
-    *ptr |= src._ihl & 0xF; 
-
-    idx += sizeof(uint8_t);
 }
 
-void Memory::write(const IP::Fields2& src, char *buffer, std::size_t& idx, std::size_t bufferSize)
+void Memory::BuddyPool::deallocateRemote(void* ptr, std::size_t size)
 {
-    if (idx + sizeof(uint16_t) > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::write(): writing the memory would overflow the buffer\n");
+    if (ptr == nullptr) {
+        throw std::runtime_error("memorypool.cpp: Memory::BuddyPool::deallocateRemote(): ptr is already freed");
     }
 
-    uint16_t *ptr = reinterpret_cast<uint16_t*>(buffer + idx);
-
-    uint16_t val = src._flags << 13;
-    val |= src._fragOffset & 0x1FFF;
-
-    *ptr = ntohs(val);
+    RemoteBlock* block = static_cast<RemoteBlock*>(ptr);
+    block->_size = size;
 
-    idx += sizeof(uint16_t);
-}
-
-void Memory::write(const MacAddr& src, char *buffer, std::size_t& idx, std::size_t bufferSize)
-{
-    if (idx + sizeof(uint8_t) * 6 > bufferSize) {
-        throw std::runtime_error("memorypool.hpp: Memory::write(): writing the memory would overflow the buffer\n");
-    } 
-
-    uint8_t *ptr = reinterpret_cast<uint8_t*>(buffer + idx);
-    for (const uint8_t byte : src.addr) {
-        *(ptr++) = byte;
-        idx += sizeof(uint8_t);
-    }
+    RemoteBlock* head = _remote.load(std::memory_order_relaxed);
+    do {
+        block->_next = head;
+    } while (!_remote.compare_exchange_weak(head, block, std::memory_order_release, std::memory_order_relaxed));
 }
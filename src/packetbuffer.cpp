@@ -0,0 +1,222 @@
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "packetbuffer.hpp"
+
+// 2048 blocks of 2 KiB per thread, enough for a few full bursts of MTU sized frames.
+static constexpr std::size_t POOL_BLOCKS = 2048;
+
+// released LARGE_SIZE blocks kept per thread, enough for a burst and a full TX ring.
+static constexpr std::size_t LARGE_CACHED = 288;
+
+/* pools of exited threads, their buffers may still be held by others, so a new thread takes one over */
+class IdlePools
+{
+    private:
+        std::mutex                      _lock;
+        std::vector<Memory::BuddyPool*> _pools;
+
+    public:
+        Memory::BuddyPool* take(void)
+        {
+            std::lock_guard<std::mutex> guard{_lock};
+            if (_pools.empty()) {
+                return new Memory::BuddyPool{POOL_BLOCKS};
+            }
+
+            Memory::BuddyPool* pool = _pools.back();
+            _pools.pop_back();
+            return pool;
+        }
+
+        void put(Memory::BuddyPool* pool)
+        {
+            std::lock_guard<std::mutex> guard{_lock};
+            _pools.push_back(pool);
+        }
+};
+
+static IdlePools& idlePools(void)
+{
+    // never destroyed, threads still give their pools back after static destructors ran
+    static IdlePools* pools = new IdlePools;
+
+    return *pools;
+}
+
+// nullptr before the thread's first packet buffer and once it gave its pool back
+static thread_local Memory::BuddyPool* currentPool = nullptr;
+
+/* the calling thread's pool, given back when the thread exits */
+class PoolHolder
+{
+    public:
+        Memory::BuddyPool* _pool;
+
+        PoolHolder() : _pool{idlePools().take()} { currentPool = _pool; }
+
+        ~PoolHolder()
+        {
+            currentPool = nullptr;
+            idlePools().put(_pool);
+        }
+};
+
+Memory::BuddyPool& Memory::packetBufferPool(void)
+{
+    thread_local PoolHolder holder;
+
+    return *holder._pool;
+}
+
+/* the calling thread's released LARGE_SIZE blocks */
+class LargeBlocks
+{
+    private:
+        std::vector<unsigned char*> _blocks;
+
+    public:
+        // releasing a buffer never allocates
+        LargeBlocks() { _blocks.reserve(LARGE_CACHED); }
+
+        ~LargeBlocks()
+        {
+            for (unsigned char* block : _blocks) {
+                delete[] block;
+            }
+        }
+
+        unsigned char* get(void)
+        {
+            if (_blocks.empty()) {
+                return new (std::nothrow) unsigned char[Memory::PacketBuffer::LARGE_SIZE];
+            }
+
+            unsigned char* block = _blocks.back();
+            _blocks.pop_back();
+            return block;
+        }
+
+        void put(unsigned char* block)
+        {
+            if (_blocks.size() == LARGE_CACHED) {
+                delete[] block;
+                return;
+            }
+
+            _blocks.push_back(block);
+        }
+};
+
+static LargeBlocks& largeBlocks(void)
+{
+    thread_local LargeBlocks blocks;
+
+    return blocks;
+}
+
+Memory::PacketBuffer::PacketBuffer(PacketBuffer&& other) noexcept
+    : _base{other._base},
+      _pool{other._pool},
+      _capacity{other._capacity},
+      _head{other._head},
+      _length{other._length},
+      _borrowed{other._borrowed}
+{
+    other._base = nullptr;
+}
+
+Memory::PacketBuffer& Memory::PacketBuffer::operator=(PacketBuffer&& other) noexcept
+{
+    if (this != &other) {
+        release();
+
+        _base = other._base;
+        _pool = other._pool;
+        _capacity = other._capacity;
+        _head = other._head;
+        _length = other._length;
+        _borrowed = other._borrowed;
+        other._base = nullptr;
+    }
+
+    return *this;
+}
+
+Memory::PacketBuffer Memory::PacketBuffer::allocate(std::size_t size, std::size_t headroom)
+{
+    PacketBuffer buffer;
+    std::size_t capacity = size + headroom;
+    BuddyPool& pool = packetBufferPool();
+
+    if (capacity <= pool.maxBlockSize()) {
+        // the whole size class is usable, the extra space becomes tailroom.
+        buffer._base = pool.tryAllocate<unsigned char*>(capacity);
+        buffer._pool = &pool;
+        capacity = BuddyPool::blockSize(capacity);
+    } else if (capacity <= LARGE_SIZE) {
+        buffer._base = largeBlocks().get();
+        capacity = LARGE_SIZE;
+    } else {
+        buffer._base = new (std::nothrow) unsigned char[capacity];
+    }
+
+    if (buffer._base != nullptr) {
+        buffer._capacity = static_cast<uint32_t>(capacity);
+        buffer._head = static_cast<uint32_t>(headroom);
+    }
+
+    return buffer;
+}
+
+Memory::PacketBuffer Memory::PacketBuffer::borrow(char* base, std::size_t capacity, std::size_t headroom)
+{
+    PacketBuffer buffer;
+    buffer._base = reinterpret_cast<unsigned char*>(base);
+    buffer._capacity = static_cast<uint32_t>(capacity);
+    buffer._head = static_cast<uint32_t>(headroom < capacity ? headroom : capacity);
+    buffer._borrowed = true;
+    return buffer;
+}
+
+bool Memory::PacketBuffer::own(void)
+{
+    if (!_borrowed) {
+        return true;
+    }
+
+    // the same headroom and tailroom, whoever keeps the data may still grow it
+    PacketBuffer copy = allocate(_capacity - _head, _head);
+    if (!copy) {
+        return false;
+    }
+
+    std::memcpy(copy.data(), data(), _length);
+    copy._length = _length;
+    *this = std::move(copy);
+    return true;
+}
+
+void Memory::PacketBuffer::release(void)
+{
+    if (_base == nullptr || _borrowed) {
+        _base = nullptr;
+        return;
+    }
+
+    if (_pool == currentPool && _pool != nullptr) {
+        _pool->deallocate(_base, _capacity);
+    } else if (_pool != nullptr) {
+        // the pools are per thread and unlocked, the owner frees it on its next allocation.
+        _pool->deallocateRemote(_base, _capacity);
+    } else if (_capacity == LARGE_SIZE) {
+        largeBlocks().put(_base);
+    } else {
+        delete[] _base;
+    }
+
+    _base = nullptr;
+}
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cstring>
+
+#include "checksum.hpp"
+#include "ip.hpp"
+#include "reassembly.hpp"
+#include "trace.hpp"
+
+// blocks [first, last) of the map that are already received, a word at a time
+static size_t countBlocks(const uint64_t *map, size_t first, size_t last)
+{
+    size_t count = 0;
+    while (first < last) {
+        size_t bit = first % 64;
+        size_t bits = std::min<size_t>(64 - bit, last - first);
+        uint64_t mask = (bits == 64) ? ~uint64_t{0} : ((uint64_t{1} << bits) - 1) << bit;
+
+        count += __builtin_popcountll(map[first / 64] & mask);
+        first += bits;
+    }
+
+    return count;
+}
+
+static void markBlocks(uint64_t *map, size_t first, size_t last)
+{
+    while (first < last) {
+        size_t bit = first % 64;
+        size_t bits = std::min<size_t>(64 - bit, last - first);
+        uint64_t mask = (bits == 64) ? ~uint64_t{0} : ((uint64_t{1} << bits) - 1) << bit;
+
+        map[first / 64] |= mask;
+        first += bits;
+    }
+}
+
+IP::Reassembler::Reassembler(size_t maxDatagrams, size_t memoryBudget)
+    : _datagrams(std::clamp<size_t>(maxDatagrams, 1, NIL)),
+      _fragmentPool{_datagrams.size(), _datagrams.size() * MAX_FRAGMENTS},
+      _memoryBudget{memoryBudget}
+{
+    _buckets.fill(NIL);
+
+    for (size_t i = _datagrams.size(); i > 0; --i) {
+        _datagrams[i - 1]._bucketNext = _free;
+        _free = static_cast<uint16_t>(i - 1);
+    }
+}
+
+void IP::Reassembler::attach(Event::TimerWheel& timers, Verdict::DropCounters* drops)
+{
+    _timers = &timers;
+    _drops = drops;
+}
+
+size_t IP::Reassembler::bucket(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto)
+{
+    uint64_t key = (uint64_t{srcAddr} << 32 | dstAddr) ^ (uint64_t{id} << 8 | proto) * 0x9E3779B97F4A7C15ull;
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+
+    return key % BUCKETS;
+}
+
+IP::Reassembler::Datagram* IP::Reassembler::find(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto)
+{
+    for (uint16_t index = _buckets[bucket(srcAddr, dstAddr, id, proto)]; index != NIL; index = _datagrams[index]._bucketNext) {
+        Datagram& datagram = _datagrams[index];
+        if (datagram._id == id && datagram._srcAddr == srcAddr && datagram._dstAddr == dstAddr && datagram._proto == proto) {
+            return &datagram;
+        }
+    }
+
+    return nullptr;
+}
+
+IP::Reassembler::Datagram* IP::Reassembler::create(IPAddr srcAddr, IPAddr dstAddr, uint16_t id, uint8_t proto)
+{
+    if (_active == _datagrams.size()) {
+        release(_datagrams[_lruHead], Verdict::Reason::IPV4_REASSEMBLY_EVICTED);
+    }
+
+    uint16_t index = _free;
+    Datagram& datagram = _datagrams[index];
+    _free = datagram._bucketNext;
+
+    datagram._srcAddr = srcAddr;
+    datagram._dstAddr = dstAddr;
+    datagram._id = id;
+    datagram._proto = proto;
+    datagram._active = true;
+    datagram._lastSeen = false;
+    datagram._count = 0;
+    datagram._total = 0;
+    datagram._end = 0;
+    datagram._received = 0;
+    datagram._memory = 0;
+    datagram._first = nullptr;
+    datagram._fragments = nullptr;
+    datagram._blocks.fill(0);
+
+    size_t head = bucket(srcAddr, dstAddr, id, proto);
+    datagram._bucketNext = _buckets[head];
+    _buckets[head] = index;
+
+    datagram._lruPrev = _lruTail;
+    datagram._lruNext = NIL;
+    if (_lruTail != NIL) {
+        _datagrams[_lruTail]._lruNext = index;
+    } else {
+        _lruHead = index;
+    }
+    _lruTail = index;
+    ++_active;
+
+    // the timeout runs from the first fragment, later ones don't extend it
+    datagram._timer = 0;
+    if (_timers != nullptr) {
+        datagram._timer = _timers->schedule(REASSEMBLY_TIMEOUT, [this, index]() {
+            _datagrams[index]._timer = 0;
+            release(_datagrams[index], Verdict::Reason::IPV4_REASSEMBLY_TIMEOUT);
+        });
+    }
+
+    return &datagram;
+}
+
+void IP::Reassembler::unlinkLRU(Datagram& datagram)
+{
+    if (datagram._lruPrev != NIL) {
+        _datagrams[datagram._lruPrev]._lruNext = datagram._lruNext;
+    } else {
+        _lruHead = datagram._lruNext;
+    }
+
+    if (datagram._lruNext != NIL) {
+        _datagrams[datagram._lruNext]._lruPrev = datagram._lruPrev;
+    } else {
+        _lruTail = datagram._lruPrev;
+    }
+}
+
+void IP::Reassembler::touch(Datagram& datagram)
+{
+    uint16_t index = static_cast<uint16_t>(&datagram - _datagrams.data());
+    if (_lruTail == index) {
+        return;
+    }
+
+    unlinkLRU(datagram);
+    datagram._lruPrev = _lruTail;
+    datagram._lruNext = NIL;
+    _datagrams[_lruTail]._lruNext = index;
+    _lruTail = index;
+}
+
+void IP::Reassembler::release(Datagram& datagram, Verdict::Reason reason)
+{
+    uint16_t index = static_cast<uint16_t>(&datagram - _datagrams.data());
+
+    if (_timers != nullptr && datagram._timer != 0) {
+        _timers->cancel(datagram._timer);
+    }
+
+    uint16_t *link = &_buckets[bucket(datagram._srcAddr, datagram._dstAddr, datagram._id, datagram._proto)];
+    while (*link != index) {
+        link = &_datagrams[*link]._bucketNext;
+    }
+    *link = datagram._bucketNext;
+    unlinkLRU(datagram);
+
+    if (reason != Verdict::Reason::NONE) {
+        if (_drops != nullptr) {
+            _drops->count(reason, datagram._count);
+        }
+        for (size_t i = 0; i < datagram._count; ++i) {
+            Trace::packet(Trace::Event::DROP, static_cast<uint32_t>(reason), PRO_IPV4);
+        }
+    }
+
+    // the buffers go back to the pool
+    Fragment *fragment = datagram._fragments;
+    while (fragment != nullptr) {
+        Fragment *next = fragment->_next;
+        fragment->_frame = Ethernet::Frame{};
+        fragment->_next = nullptr;
+        _fragmentPool.deallocate(fragment);
+        fragment = next;
+    }
+
+    _memory -= datagram._memory;
+    datagram._fragments = nullptr;
+    datagram._first = nullptr;
+    datagram._active = false;
+    datagram._timer = 0;
+    datagram._bucketNext = _free;
+    _free = index;
+    --_active;
+}
+
+bool IP::Reassembler::assemble(Datagram& datagram, Ethernet::Frame& frame)
+{
+    constexpr size_t IP_OFFSET = Ethernet::HeaderLayout::SIZE;
+
+    Fragment& first = *datagram._first;
+    char *firstIP = first._frame.getPayload();
+    size_t headerLength = first._data - firstIP;
+    if (headerLength + datagram._total > UINT16_MAX) {
+        return false;
+    }
+
+    Ethernet::Frame whole;
+    size_t size = IP_OFFSET + headerLength + datagram._total;
+    if (!whole.tryAllocPacket(size)) {
+        return false;
+    }
+
+    // ethernet and IP header of the first fragment, then every payload at its offset
+    char *data = whole.getData();
+    std::memcpy(data, first._frame.getData(), IP_OFFSET + headerLength);
+    for (Fragment *fragment = datagram._fragments; fragment != nullptr; fragment = fragment->_next) {
+        std::memcpy(data + IP_OFFSET + headerLength + fragment->_offset, fragment->_data, fragment->_length);
+    }
+
+    char *ip = data + IP_OFFSET;
+    Fields2 fields2;
+    Memory::Codec<Fields2>::load(fields2, ip + HeaderLayout::offset<4>());
+    Memory::Codec<Length16>::store(static_cast<Length16>(headerLength + datagram._total), ip + HeaderLayout::offset<2>());
+    Memory::Codec<Fields2>::store(Fields2(static_cast<uint16_t>(fields2._flags & ~FLAG_MORE), 0), ip + HeaderLayout::offset<4>());
+    std::memset(ip + IP_CHECKSUM_OFFSET, 0, sizeof(Checksum));
+    Checksum checksum = Inet::checksum(ip, headerLength);
+    std::memcpy(ip + IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    whole.setBufferSize(size);
+    if (!whole.parseBuffer()) {
+        return false;
+    }
+
+    frame = std::move(whole);
+    return true;
+}
+
+bool IP::Reassembler::add(Ethernet::Frame& frame, Header& header, Verdict::Result& verdict)
+{
+    size_t offset = header._f2._fragOffset * 8;
+    size_t length = header.getPayloadSize();
+    size_t end = offset + length;
+    bool more = header._f2._flags & FLAG_MORE;
+
+    // every fragment but the last carries a multiple of 8 bytes, and none ends past 64 KiB
+    if (end + header.headerLength() > UINT16_MAX || (more && (length == 0 || length % 8 != 0))) {
+        verdict = Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_INVALID);
+        return false;
+    }
+
+    Datagram *datagram = find(header._srcAddr, header._dstAddr, header._id, header._proto);
+    if (datagram == nullptr) {
+        datagram = create(header._srcAddr, header._dstAddr, header._id, header._proto);
+    }
+
+    // a fragment that moves the end of the datagram makes all of it suspect
+    bool inconsistent = more ? (datagram->_lastSeen && end > datagram->_total)
+                             : (datagram->_lastSeen ? end != datagram->_total : end < datagram->_end);
+    if (inconsistent) {
+        release(*datagram, Verdict::Reason::IPV4_FRAGMENT_INVALID);
+        verdict = Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_INVALID);
+        return false;
+    }
+
+    size_t firstBlock = offset / 8;
+    size_t lastBlock = (end + 7) / 8;
+    size_t received = countBlocks(datagram->_blocks.data(), firstBlock, lastBlock);
+    if (received != 0) {
+        // a retransmitted copy is harmless, anything else could smuggle different bytes in
+        if (received == lastBlock - firstBlock) {
+            for (Fragment *fragment = datagram->_fragments; fragment != nullptr; fragment = fragment->_next) {
+                if (fragment->_offset == offset && fragment->_length == length) {
+                    verdict = Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_DUPLICATE);
+                    return false;
+                }
+            }
+        }
+
+        release(*datagram, Verdict::Reason::IPV4_FRAGMENT_OVERLAP);
+        verdict = Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_OVERLAP);
+        return false;
+    }
+
+    if (datagram->_count == MAX_FRAGMENTS) {
+        release(*datagram, Verdict::Reason::IPV4_REASSEMBLY_EVICTED);
+        verdict = Verdict::drop(Verdict::Reason::IPV4_REASSEMBLY_EVICTED);
+        return false;
+    }
+
+    // the fragment outlives its burst, its payload is found again in the copy
+    size_t payloadOffset = header.getPayload() - frame.getData();
+    if (!frame.own()) {
+        verdict = Verdict::drop(Verdict::Reason::NO_BUFFER);
+        return false;
+    }
+
+    // make room by evicting the least recently extended datagrams, this one last
+    size_t charge = frame.getBuffer().capacity();
+    touch(*datagram);
+    while (_memory + charge > _memoryBudget && _lruHead != NIL) {
+        bool self = &_datagrams[_lruHead] == datagram;
+        release(_datagrams[_lruHead], Verdict::Reason::IPV4_REASSEMBLY_EVICTED);
+        if (self) {
+            verdict = Verdict::drop(Verdict::Reason::IPV4_REASSEMBLY_EVICTED);
+            return false;
+        }
+    }
+
+    Fragment *fragment = _fragmentPool.tryAllocate();
+    if (fragment == nullptr) {
+        verdict = Verdict::drop(Verdict::Reason::NO_BUFFER);
+        return false;
+    }
+
+    // the frame keeps its buffer, so the payload pointer stays valid after the move
+    fragment->_data = frame.getData() + payloadOffset;
+    fragment->_offset = static_cast<uint16_t>(offset);
+    fragment->_length = static_cast<uint16_t>(length);
+    fragment->_frame = std::move(frame);
+    fragment->_next = datagram->_fragments;
+    datagram->_fragments = fragment;
+
+    markBlocks(datagram->_blocks.data(), firstBlock, lastBlock);
+    datagram->_received += length;
+    datagram->_end = std::max<uint32_t>(datagram->_end, end);
+    datagram->_memory += charge;
+    _memory += charge;
+    ++datagram->_count;
+
+    if (offset == 0) {
+        datagram->_first = fragment;
+    }
+    if (!more) {
+        datagram->_lastSeen = true;
+        datagram->_total = end;
+    }
+
+    verdict = Verdict::accept();
+    if (!datagram->_lastSeen || datagram->_first == nullptr || datagram->_received != datagram->_total) {
+        return false;
+    }
+
+    // without a buffer for the whole datagram its fragments, this one included, are dropped
+    bool complete = assemble(*datagram, frame);
+    release(*datagram, complete ? Verdict::Reason::NONE : Verdict::Reason::NO_BUFFER);
+
+    return complete;
+}
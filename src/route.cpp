@@ -0,0 +1,144 @@
+#include <algorithm>
+
+#include "route.hpp"
+
+static IPAddr mask(unsigned depth)
+{
+    return (depth == 0) ? 0 : ~IPAddr{0} << (32 - depth);
+}
+
+IP::RouteTable::RouteTable(size_t maxGroups)
+    : _root(size_t{1} << ROOT_BITS, 0),
+      _groups(maxGroups * GROUP_SIZE, 0)
+{
+    // handed out from group 0 up
+    for (size_t i = maxGroups; i > 0; --i) {
+        _freeGroups.push_back(static_cast<uint32_t>(i - 1));
+    }
+}
+
+void IP::RouteTable::paint(Entry *entries, size_t count, unsigned minDepth, unsigned maxDepth, Entry entry)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (entries[i] & GROUP) {
+            paint(group(entries[i]), GROUP_SIZE, minDepth, maxDepth, entry);
+        } else if (depth(entries[i]) >= minDepth && depth(entries[i]) <= maxDepth) {
+            entries[i] = entry;
+        }
+    }
+}
+
+void IP::RouteTable::insert(Entry *table, unsigned levelEnd, IPAddr prefix, unsigned depth, Entry entry)
+{
+    unsigned bits = (levelEnd == ROOT_BITS) ? ROOT_BITS : GROUP_BITS;
+    size_t index = (prefix >> (32 - levelEnd)) & ((size_t{1} << bits) - 1);
+
+    if (depth <= levelEnd) {
+        paint(table + index, size_t{1} << (levelEnd - depth), 0, depth, entry);
+        return;
+    }
+
+    // the entry is split into a group that starts out with its value everywhere
+    Entry& slot = table[index];
+    if (!(slot & GROUP)) {
+        uint32_t free = _freeGroups.back();
+        _freeGroups.pop_back();
+        std::fill_n(&_groups[free * GROUP_SIZE], GROUP_SIZE, slot);
+        slot = GROUP | free;
+    }
+
+    insert(group(slot), levelEnd + GROUP_BITS, prefix, depth, entry);
+}
+
+void IP::RouteTable::replace(Entry *table, unsigned levelEnd, IPAddr prefix, unsigned depth, Entry replacement)
+{
+    unsigned bits = (levelEnd == ROOT_BITS) ? ROOT_BITS : GROUP_BITS;
+    size_t index = (prefix >> (32 - levelEnd)) & ((size_t{1} << bits) - 1);
+
+    if (depth <= levelEnd || !(table[index] & GROUP)) {
+        size_t count = (depth <= levelEnd) ? size_t{1} << (levelEnd - depth) : 1;
+        paint(table + index, count, depth, depth, replacement);
+        return;
+    }
+
+    Entry& slot = table[index];
+    Entry *entries = group(slot);
+    replace(entries, levelEnd + GROUP_BITS, prefix, depth, replacement);
+
+    // a group whose entries all came from one prefix is folded back into its parent entry, unless
+    // the prefix is longer than the parent's level: two such prefixes can share a next hop
+    if (!(entries[0] & GROUP) && RouteTable::depth(entries[0]) <= levelEnd &&
+            std::all_of(entries, entries + GROUP_SIZE, [&](Entry entry) { return entry == entries[0]; })) {
+        _freeGroups.push_back(slot & INDEX_MASK);
+        slot = entries[0];
+    }
+}
+
+bool IP::RouteTable::add(IPAddr prefix, unsigned depth, const NextHop& nextHop)
+{
+    if (depth > 32) {
+        return false;
+    }
+    prefix &= mask(depth);
+
+    // a prefix can split an entry at both levels below the root
+    size_t groups = 0;
+    if (depth > ROOT_BITS) {
+        Entry entry = _root[prefix >> (32 - ROOT_BITS)];
+        if (!(entry & GROUP)) {
+            groups = (depth > ROOT_BITS + GROUP_BITS) ? 2 : 1;
+        } else if (depth > ROOT_BITS + GROUP_BITS && !(group(entry)[(prefix >> GROUP_BITS) & (GROUP_SIZE - 1)] & GROUP)) {
+            groups = 1;
+        }
+    }
+    if (_freeGroups.size() < groups) {
+        return false;
+    }
+
+    auto hop = std::find(_nextHops.begin(), _nextHops.end(), nextHop);
+    uint32_t index = static_cast<uint32_t>(hop - _nextHops.begin());
+    if (hop == _nextHops.end()) {
+        _nextHops.push_back(nextHop);
+    }
+
+    auto rule = std::find_if(_rules.begin(), _rules.end(), [&](const Rule& rule) {
+        return rule._prefix == prefix && rule._depth == depth;
+    });
+    if (rule != _rules.end()) {
+        rule->_nextHop = index;
+    } else {
+        _rules.push_back({prefix, static_cast<uint8_t>(depth), index});
+    }
+
+    insert(_root.data(), ROOT_BITS, prefix, depth, VALID | Entry{depth} << DEPTH_SHIFT | index);
+    return true;
+}
+
+bool IP::RouteTable::remove(IPAddr prefix, unsigned depth)
+{
+    if (depth > 32) {
+        return false;
+    }
+    prefix &= mask(depth);
+
+    auto rule = std::find_if(_rules.begin(), _rules.end(), [&](const Rule& rule) {
+        return rule._prefix == prefix && rule._depth == depth;
+    });
+    if (rule == _rules.end()) {
+        return false;
+    }
+    _rules.erase(rule);
+
+    // the addresses of the prefix fall back to the longest shorter prefix covering them
+    Entry replacement = 0;
+    unsigned best = 0;
+    for (const Rule& cover : _rules) {
+        if (cover._depth < depth && (prefix & mask(cover._depth)) == cover._prefix && (replacement == 0 || cover._depth >= best)) {
+            replacement = VALID | Entry{cover._depth} << DEPTH_SHIFT | cover._nextHop;
+            best = cover._depth;
+        }
+    }
+
+    replace(_root.data(), ROOT_BITS, prefix, depth, replacement);
+    return true;
+}
@@ -0,0 +1,71 @@
+#include <thread>
+#include <vector>
+
+#include "layout.hpp"
+#include "pcap.hpp"
+#include "stack.hpp"
+#include "tun.hpp"
+#include "uring.hpp"
+
+void Stack::runQueues(const std::optional<std::string_view> name, size_t count, const std::vector<TCP::Port>& ports, 
+                      IPAddr addr, bool offload, Backend backend)
+{
+    std::vector<TunDevice> queues = TunDevice::openQueues(name, count, offload);
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+
+    for (TunDevice& queue : queues) {
+        threads.emplace_back([device = std::move(queue), &ports, addr, backend]() mutable {
+            // the worker is built on its thread, its rings register that thread's packet pool
+            if (backend == Backend::READ_WRITE) {
+                Stack::Worker<TunDevice> worker{std::move(device)};
+                serve(worker, ports, addr);
+            } else {
+                Stack::Worker<UringDevice> worker{std::move(device), backend == Backend::URING_SQPOLL};
+                serve(worker, ports, addr);
+            }
+        });
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// the same capture always gets the same connections and sequence numbers
+static constexpr uint64_t REPLAY_SEED = 0x63686172;
+
+Stack::ReplayStats Stack::replay(Worker<PcapDevice>& worker, const std::vector<TCP::Port>& ports)
+{
+    constexpr size_t SRC_ADDR_OFFSET = Ethernet::HeaderLayout::SIZE + IP::HeaderLayout::offset<8>();
+
+    PcapDevice& device = worker.manager().device();
+    PcapDevice::Record record;
+    while (device.read(record)) {
+        MacAddr srcMac;
+        MacAddr dstMac;
+        EtherType type;
+        IPAddr srcAddr;
+        if (Ethernet::HeaderLayout::read(record._data, record._length, dstMac, srcMac, type) && type == PRO_IPV4 && 
+                record._length >= SRC_ADDR_OFFSET + sizeof(IPAddr)) {
+            Memory::Codec<IPAddr>::load(srcAddr, record._data + SRC_ADDR_OFFSET);
+            worker.arp().cache().update(srcAddr, srcMac, Event::Clock::now());
+        }
+    }
+    device.rewind();
+    device.arm();
+
+    Event::Loop loop;
+    worker.ip().tcp().seed(REPLAY_SEED);
+    for (TCP::Port port : ports) {
+        worker.ip().tcp().listen(port);
+    }
+    worker.attach(loop);
+
+    Event::Clock::time_point start = Event::Clock::now();
+    while (!worker.manager().done()) {
+        loop.runOnce(-1);
+    }
+
+    return ReplayStats{worker.manager().rxFrames(), worker.manager().txFrames(), Event::Clock::now() - start};
+}
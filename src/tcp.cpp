@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+#include "checksum.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+#include "trace.hpp"
+
+/* 64 bit finalizer from MurmurHash3 */
+static uint64_t mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+
+    return value;
+}
+
+static uint64_t keyWord(const TCP::Key& key, uint64_t seed)
+{
+    uint64_t addresses = static_cast<uint64_t>(key._localAddr) << 32 | key._remoteAddr;
+    uint64_t ports = static_cast<uint64_t>(key._localPort) << 16 | key._remotePort;
+
+    return addresses ^ (ports + seed) * 0x9e3779b97f4a7c15ULL;
+}
+
+const char* TCP::stateName(State state)
+{
+    switch (state) {
+        case State::CLOSED:       return "CLOSED";
+        case State::LISTEN:       return "LISTEN";
+        case State::SYN_SENT:     return "SYN_SENT";
+        case State::SYN_RECEIVED: return "SYN_RECEIVED";
+        case State::ESTABLISHED:  return "ESTABLISHED";
+        case State::FIN_WAIT_1:   return "FIN_WAIT_1";
+        case State::FIN_WAIT_2:   return "FIN_WAIT_2";
+        case State::CLOSE_WAIT:   return "CLOSE_WAIT";
+        case State::CLOSING:      return "CLOSING";
+        case State::LAST_ACK:     return "LAST_ACK";
+        case State::TIME_WAIT:    return "TIME_WAIT";
+        default:                  return "?";
+    }
+}
+
+bool TCP::Header::readFromBuffer(const char *buffer, size_t bufferLength)
+{
+    _buffer = buffer;
+
+    if (!HeaderLayout::read(buffer, bufferLength, _srcPort, _dstPort, _seq, _ack, _offsetFlags, _window, _checksum, _urgent)) {
+        return false;
+    }
+
+    size_t length = headerLength();
+    if (length < HEADER_SIZE || length > bufferLength) {
+        return false;
+    }
+
+    // only MSS is used, the other options are skipped
+    _mss = 0;
+    for (size_t i = HEADER_SIZE; i < length; ) {
+        uint8_t kind = static_cast<uint8_t>(buffer[i]);
+
+        if (kind == OPTION_END) {
+            break;
+        }
+
+        if (kind == OPTION_NOP) {
+            ++i;
+            continue;
+        }
+
+        if (i + 1 >= length) {
+            break;
+        }
+
+        uint8_t optionLength = static_cast<uint8_t>(buffer[i + 1]);
+        if (optionLength < 2 || i + optionLength > length) {
+            break;
+        }
+
+        if (kind == OPTION_MSS && optionLength == MSS_OPTION_SIZE) {
+            Memory::Codec<uint16_t>::load(_mss, buffer + i + 2);
+        }
+        i += optionLength;
+    }
+
+    _payload = buffer + length;
+    _payloadSize = bufferLength - length;
+
+    return true;
+}
+
+void TCP::Header::debugPrint(void)
+{
+    std::cout << "TCP Header: src port: " << _srcPort << " dst port: " << _dstPort << std::endl;
+    std::cout << "            seq: " << _seq << " ack: " << _ack << std::endl;
+    std::cout << std::setfill('0') << std::setw(2) << std::hex;
+    std::cout << "            flags: " << +flags() << std::setfill(' ') << std::setw(0) << std::dec;
+    std::cout << " window: " << _window << " mss: " << _mss << std::endl;
+    std::cout << "            payload addr: " << &_payload << " payload size: " << _payloadSize << '\n' << std::endl;
+}
+
+TCP::ConnectionTable::ConnectionTable(size_t maxSize)
+    : _maxSize{maxSize}
+{
+    size_t capacity = 16;
+    while (capacity < 2 * maxSize) {
+        capacity <<= 1;
+    }
+
+    _connections.reset(new Connection[capacity]);
+    _stats.reset(new Stats[capacity]);
+    _mask = capacity - 1;
+
+    // keeps remote peers from choosing 4-tuples that collide
+    std::random_device random;
+    _seed = static_cast<uint64_t>(random()) << 32 | random();
+}
+
+uint32_t TCP::ConnectionTable::hash(const Key& key) const
+{
+    return static_cast<uint32_t>(mix(keyWord(key, _seed)));
+}
+
+TCP::Connection* TCP::ConnectionTable::find(const Key& key)
+{
+    uint32_t keyHash = hash(key);
+
+    // at most half full, the probe always reaches a free slot.
+    for (size_t i = keyHash & _mask; ; i = (i + 1) & _mask) {
+        Connection& connection = _connections[i];
+
+        if (connection._state == State::CLOSED) {
+            return nullptr;
+        }
+
+        if (connection._hash == keyHash && connection._key == key) {
+            return &connection;
+        }
+    }
+}
+
+TCP::Connection* TCP::ConnectionTable::insert(const Key& key, State state)
+{
+    if (_size >= _maxSize) {
+        return nullptr;
+    }
+
+    uint32_t keyHash = hash(key);
+
+    for (size_t i = keyHash & _mask; ; i = (i + 1) & _mask) {
+        Connection& connection = _connections[i];
+
+        if (connection._state == State::CLOSED) {
+            connection = Connection{};
+            connection._key = key;
+            connection._hash = keyHash;
+            connection._state = state;
+            _stats[i] = Stats{};
+            ++_size;
+            return &connection;
+        }
+
+        if (connection._hash == keyHash && connection._key == key) {
+            return nullptr;
+        }
+    }
+}
+
+void TCP::ConnectionTable::erase(Connection* connection)
+{
+    size_t hole = connection - _connections.get();
+
+    // backward shift: pull every later entry of the cluster that may live in the hole into it
+    for (size_t i = (hole + 1) & _mask; _connections[i]._state != State::CLOSED; i = (i + 1) & _mask) {
+        size_t home = _connections[i]._hash & _mask;
+
+        bool between = (hole <= i) ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!between) {
+            _connections[hole] = _connections[i];
+            _stats[hole] = _stats[i];
+            hole = i;
+        }
+    }
+
+    _connections[hole]._state = State::CLOSED;
+    --_size;
+}
+
+TCP::Manager::Manager(size_t maxConnections)
+    : _table{maxConnections}
+{
+    std::random_device random;
+    _secret = random();
+}
+
+void TCP::Manager::seed(uint64_t seed)
+{
+    if (_table.size() != 0) {
+        throw std::runtime_error("tcp.cpp: TCP::Manager::seed(): the connections are keyed already");
+    }
+
+    _table.seed(mix(seed));
+    _secret = static_cast<uint32_t>(mix(~seed));
+    _clocked = false;
+}
+
+TCP::Seq TCP::Manager::initialSequence(const Key& key)
+{
+    // RFC 6528: a 4 microsecond clock plus a keyed hash of the connection
+    uint64_t micros = !_clocked ? 0 : std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    return static_cast<Seq>(micros / 4) + static_cast<Seq>(mix(keyWord(key, _secret)));
+}
+
+size_t TCP::Manager::writeSegment(char *out, const Key& key, Seq seq, Seq ack, uint8_t flags, Window window, uint16_t mss)
+{
+    size_t length = HEADER_SIZE + (mss != 0 ? MSS_OPTION_SIZE : 0);
+    OffsetFlags offsetFlags = static_cast<OffsetFlags>((length / 4) << 12 | flags);
+
+    HeaderLayout::store(out, key._localPort, key._remotePort, seq, ack, offsetFlags, window, 0, 0);
+
+    if (mss != 0) {
+        out[HEADER_SIZE] = OPTION_MSS;
+        out[HEADER_SIZE + 1] = MSS_OPTION_SIZE;
+        Memory::Codec<uint16_t>::store(mss, out + HEADER_SIZE + 2);
+    }
+
+    Checksum checksum = Inet::checksum(out, length, Inet::pseudoHeader(key._localAddr, key._remoteAddr, IP::PRO_TCP, length));
+    std::memcpy(out + CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    return length;
+}
+
+size_t TCP::Manager::writeAck(char *out, Connection& connection)
+{
+    ++_table.stats(&connection)._segmentsOut;
+
+    Window window = static_cast<Window>(std::min<uint32_t>(connection._rcvWnd, DEFAULT_WINDOW));
+    return writeSegment(out, connection._key, connection._sndNxt, connection._rcvNxt, FLAG_ACK, window);
+}
+
+void TCP::Manager::setState(Connection& connection, State state)
+{
+    const Key& key = connection._key;
+    Trace::packet(Trace::Event::TCP_STATE, static_cast<uint32_t>(connection._state) << 8 | static_cast<uint32_t>(state),
+                  key._localPort << 16 | key._remotePort, key._remoteAddr);
+
+    connection._state = state;
+    armTimer(connection);
+}
+
+void TCP::Manager::armTimer(Connection& connection)
+{
+    if (_timers == nullptr) {
+        return;
+    }
+
+    std::chrono::seconds timeout{0};
+    switch (connection._state) {
+        case State::SYN_SENT:
+        case State::SYN_RECEIVED:
+            timeout = HANDSHAKE_TIMEOUT;
+            break;
+
+        case State::FIN_WAIT_1:
+        case State::FIN_WAIT_2:
+        case State::CLOSING:
+        case State::LAST_ACK:
+            timeout = CLOSE_TIMEOUT;
+            break;
+
+        case State::TIME_WAIT:
+            timeout = TIME_WAIT_TIMEOUT;
+            break;
+
+        default:
+            _timers->cancel(connection._timer);
+            connection._timer = 0;
+            return;
+    }
+
+    // the callback only holds the key, connections move inside the table
+    if (!_timers->reschedule(connection._timer, timeout)) {
+        Key key = connection._key;
+        connection._timer = _timers->schedule(timeout, [this, key]() { expire(key); });
+    }
+}
+
+void TCP::Manager::expire(const Key& key)
+{
+    Connection *connection = _table.find(key);
+    if (connection != nullptr) {
+        setState(*connection, State::CLOSED);
+        erase(*connection);
+    }
+}
+
+void TCP::Manager::erase(Connection& connection)
+{
+    if (_timers != nullptr) {
+        _timers->cancel(connection._timer);
+    }
+
+    _table.erase(&connection);
+}
+
+/* RFC 793 segment acceptability test */
+static bool acceptable(const TCP::Connection& connection, TCP::Seq seq, uint32_t length)
+{
+    TCP::Seq begin = connection._rcvNxt;
+    TCP::Seq end = connection._rcvNxt + connection._rcvWnd;
+
+    if (length == 0) {
+        return (connection._rcvWnd == 0) ? seq == begin : TCP::seqLEQ(begin, seq) && TCP::seqLT(seq, end);
+    }
+
+    if (connection._rcvWnd == 0) {
+        return false;
+    }
+
+    TCP::Seq last = seq + length - 1;
+    return (TCP::seqLEQ(begin, seq) && TCP::seqLT(seq, end)) || (TCP::seqLEQ(begin, last) && TCP::seqLT(last, end));
+}
+
+Verdict::Result TCP::Manager::handleNoConnection(const Key& key, Header& segment, char *reply, size_t& replyLength)
+{
+    uint8_t flags = segment.flags();
+
+    if (flags & FLAG_RST) {
+        return Verdict::drop(Verdict::Reason::TCP_NO_CONNECTION);
+    }
+
+    if (flags & FLAG_ACK) {
+        replyLength = writeSegment(reply, key, segment._ack, 0, FLAG_RST, 0);
+        return Verdict::reply();
+    }
+
+    if (!(flags & FLAG_SYN) || !_listening.test(key._localPort)) {
+        replyLength = writeSegment(reply, key, 0, segment._seq + segment.sequenceLength(), FLAG_RST | FLAG_ACK, 0);
+        return Verdict::reply();
+    }
+
+    Connection *connection = _table.insert(key, State::LISTEN);
+    if (connection == nullptr) {
+        return Verdict::drop(Verdict::Reason::TCP_TABLE_FULL);
+    }
+
+    connection->_irs = segment._seq;
+    connection->_rcvNxt = segment._seq + 1;
+    connection->_rcvWnd = DEFAULT_WINDOW;
+    connection->_iss = initialSequence(key);
+    connection->_sndUna = connection->_iss;
+    connection->_sndNxt = connection->_iss + 1;
+    connection->_sndWnd = segment._window;
+    connection->_mss = segment._mss ? segment._mss : DEFAULT_MSS;
+    setState(*connection, State::SYN_RECEIVED);
+
+    Stats& stats = _table.stats(connection);
+    ++stats._segmentsIn;
+    ++stats._segmentsOut;
+
+    replyLength = writeSegment(reply, key, connection->_iss, connection->_rcvNxt, FLAG_SYN | FLAG_ACK, DEFAULT_WINDOW, LOCAL_MSS);
+    return Verdict::reply();
+}
+
+Verdict::Result TCP::Manager::handleSynSent(Connection& connection, Header& segment, char *reply, size_t& replyLength)
+{
+    uint8_t flags = segment.flags();
+
+    if ((flags & FLAG_ACK) && (seqLEQ(segment._ack, connection._iss) || seqGT(segment._ack, connection._sndNxt))) {
+        if (flags & FLAG_RST) {
+            return Verdict::drop(Verdict::Reason::TCP_SEQUENCE);
+        }
+
+        replyLength = writeSegment(reply, connection._key, segment._ack, 0, FLAG_RST, 0);
+        return Verdict::reply();
+    }
+
+    if (flags & FLAG_RST) {
+        if (!(flags & FLAG_ACK)) {
+            return Verdict::drop(Verdict::Reason::TCP_SEQUENCE);
+        }
+
+        // connection refused
+        setState(connection, State::CLOSED);
+        erase(connection);
+        return Verdict::accept();
+    }
+
+    if (!(flags & FLAG_SYN)) {
+        return Verdict::drop(Verdict::Reason::TCP_UNEXPECTED);
+    }
+
+    connection._irs = segment._seq;
+    connection._rcvNxt = segment._seq + 1;
+    connection._sndWnd = segment._window;
+    connection._mss = segment._mss ? segment._mss : DEFAULT_MSS;
+
+    if (flags & FLAG_ACK) {
+        connection._sndUna = segment._ack;
+        setState(connection, State::ESTABLISHED);
+        replyLength = writeAck(reply, connection);
+        return Verdict::reply();
+    }
+
+    // simultaneous open
+    setState(connection, State::SYN_RECEIVED);
+    ++_table.stats(&connection)._segmentsOut;
+    replyLength = writeSegment(reply, connection._key, connection._iss, connection._rcvNxt, FLAG_SYN | FLAG_ACK, DEFAULT_WINDOW, LOCAL_MSS);
+    return Verdict::reply();
+}
+
+Verdict::Result TCP::Manager::handleSegment(IPAddr src, IPAddr dst, const char *buffer, size_t length,
+                                            char *reply, size_t& replyLength, bool checksumValid)
+{
+    Header segment;
+    if (!segment.readFromBuffer(buffer, length)) {
+        return Verdict::drop(Verdict::Reason::TRUNCATED);
+    }
+
+    if (!checksumValid && Inet::checksum(buffer, length, Inet::pseudoHeader(src, dst, IP::PRO_TCP, static_cast<uint16_t>(length))) != 0) {
+        return Verdict::drop(Verdict::Reason::TCP_CHECKSUM);
+    }
+
+    uint8_t flags = segment.flags();
+    Key key{dst, src, segment._dstPort, segment._srcPort};
+    Trace::packet(Trace::Event::TCP_RX, flags << 16 | static_cast<uint32_t>(segment._payloadSize),
+                  segment._srcPort << 16 | segment._dstPort, static_cast<uint64_t>(segment._seq) << 32 | segment._ack);
+
+    Connection *found = _table.find(key);
+    if (found == nullptr) {
+        return handleNoConnection(key, segment, reply, replyLength);
+    }
+
+    Connection& connection = *found;
+    Stats& stats = _table.stats(found);
+    ++stats._segmentsIn;
+
+    if (connection._state == State::SYN_SENT) {
+        return handleSynSent(connection, segment, reply, replyLength);
+    }
+
+    // RFC 1122 4.2.2.13: a new SYN above the old sequence space reopens a TIME_WAIT connection
+    if (connection._state == State::TIME_WAIT && (flags & (FLAG_SYN | FLAG_ACK | FLAG_RST)) == FLAG_SYN &&
+            seqGT(segment._seq, connection._rcvNxt)) {
+        erase(connection);
+        return handleNoConnection(key, segment, reply, replyLength);
+    }
+
+    // our SYN-ACK was lost and the peer retransmitted its SYN
+    if (connection._state == State::SYN_RECEIVED && (flags & (FLAG_SYN | FLAG_ACK)) == FLAG_SYN &&
+            segment._seq == connection._irs) {
+        ++stats._segmentsOut;
+        replyLength = writeSegment(reply, key, connection._iss, connection._rcvNxt, FLAG_SYN | FLAG_ACK, DEFAULT_WINDOW, LOCAL_MSS);
+        return Verdict::reply();
+    }
+
+    if (!acceptable(connection, segment._seq, segment.sequenceLength())) {
+        if (flags & FLAG_RST) {
+            return Verdict::drop(Verdict::Reason::TCP_SEQUENCE);
+        }
+
+        replyLength = writeAck(reply, connection);
+        return Verdict::reply();
+    }
+
+    // RFC 5961: only an exact RST resets, a SYN or an RST elsewhere in the window gets a challenge ACK
+    if (flags & FLAG_RST) {
+        if (segment._seq != connection._rcvNxt) {
+            replyLength = writeAck(reply, connection);
+            return Verdict::reply();
+        }
+
+        setState(connection, State::CLOSED);
+        erase(connection);
+        return Verdict::accept();
+    }
+
+    if (flags & FLAG_SYN) {
+        replyLength = writeAck(reply, connection);
+        return Verdict::reply();
+    }
+
+    if (!(flags & FLAG_ACK)) {
+        return Verdict::drop(Verdict::Reason::TCP_UNEXPECTED);
+    }
+
+    Seq ack = segment._ack;
+    switch (connection._state) {
+        case State::SYN_RECEIVED:
+            if (!seqLT(connection._sndUna, ack) || !seqLEQ(ack, connection._sndNxt)) {
+                replyLength = writeSegment(reply, key, ack, 0, FLAG_RST, 0);
+                return Verdict::reply();
+            }
+
+            connection._sndUna = ack;
+            connection._sndWnd = segment._window;
+            setState(connection, State::ESTABLISHED);
+            break;
+
+        case State::LAST_ACK:
+            if (ack == connection._sndNxt) {
+                setState(connection, State::CLOSED);
+                erase(connection);
+                return Verdict::accept();
+            }
+            break;
+
+        case State::TIME_WAIT:
+            break;
+
+        default:
+            if (seqGT(ack, connection._sndNxt)) {
+                replyLength = writeAck(reply, connection);
+                return Verdict::reply();
+            }
+
+            if (seqLT(connection._sndUna, ack)) {
+                connection._sndUna = ack;
+            }
+            connection._sndWnd = segment._window;
+
+            if (ack == connection._sndNxt) {
+                if (connection._state == State::FIN_WAIT_1) {
+                    setState(connection, State::FIN_WAIT_2);
+                } else if (connection._state == State::CLOSING) {
+                    setState(connection, State::TIME_WAIT);
+                }
+            }
+            break;
+    }
+
+    bool receiving = connection._state == State::ESTABLISHED || connection._state == State::FIN_WAIT_1 ||
+                     connection._state == State::FIN_WAIT_2;
+
+    // the segment is acceptable, so a retransmission overlaps rcvNxt by less than its length.
+    if (seqGT(segment._seq, connection._rcvNxt)) {
+        // out of order, not queued: a duplicate ACK asks for what is missing
+        replyLength = writeAck(reply, connection);
+        return Verdict::reply();
+    }
+
+    uint32_t duplicate = connection._rcvNxt - segment._seq;
+    bool needAck = false;
+
+    if (segment._payloadSize > duplicate && receiving) {
+        uint32_t received = static_cast<uint32_t>(segment._payloadSize) - duplicate;
+
+        connection._rcvNxt += received;
+        stats._bytesIn += received;
+        needAck = true;
+    } else if (segment._payloadSize > 0) {
+        needAck = true;
+    }
+
+    if ((flags & FLAG_FIN) && seqLEQ(segment._seq + segment._payloadSize, connection._rcvNxt)) {
+        switch (connection._state) {
+            case State::ESTABLISHED:
+                // no application to wait for: close our side in the same segment.
+                connection._rcvNxt += 1;
+                setState(connection, State::CLOSE_WAIT);
+                setState(connection, State::LAST_ACK);
+
+                ++stats._segmentsOut;
+                replyLength = writeSegment(reply, key, connection._sndNxt, connection._rcvNxt, FLAG_FIN | FLAG_ACK, DEFAULT_WINDOW);
+                connection._sndNxt += 1;
+                return Verdict::reply();
+
+            case State::FIN_WAIT_1:
+                connection._rcvNxt += 1;
+                setState(connection, State::CLOSING);
+                break;
+
+            case State::FIN_WAIT_2:
+                connection._rcvNxt += 1;
+                setState(connection, State::TIME_WAIT);
+                break;
+
+            default:
+                break;
+        }
+        needAck = true;
+    }
+
+    if (needAck) {
+        replyLength = writeAck(reply, connection);
+        return Verdict::reply();
+    }
+
+    return Verdict::accept();
+}
+
+size_t TCP::Manager::connect(const Key& key, char *out)
+{
+    Connection *connection = _table.insert(key, State::CLOSED);
+    if (connection == nullptr) {
+        return 0;
+    }
+
+    connection->_rcvWnd = DEFAULT_WINDOW;
+    connection->_iss = initialSequence(key);
+    connection->_sndUna = connection->_iss;
+    connection->_sndNxt = connection->_iss + 1;
+    connection->_mss = DEFAULT_MSS;
+    setState(*connection, State::SYN_SENT);
+
+    ++_table.stats(connection)._segmentsOut;
+    return writeSegment(out, key, connection->_iss, 0, FLAG_SYN, DEFAULT_WINDOW, LOCAL_MSS);
+}
+
+size_t TCP::Manager::close(const Key& key, char *out)
+{
+    Connection *connection = _table.find(key);
+    if (connection == nullptr) {
+        return 0;
+    }
+
+    switch (connection->_state) {
+        case State::SYN_SENT:
+            setState(*connection, State::CLOSED);
+            erase(*connection);
+            return 0;
+
+        case State::SYN_RECEIVED:
+        case State::ESTABLISHED:
+            setState(*connection, State::FIN_WAIT_1);
+            break;
+
+        case State::CLOSE_WAIT:
+            setState(*connection, State::LAST_ACK);
+            break;
+
+        default:
+            return 0;
+    }
+
+    ++_table.stats(connection)._segmentsOut;
+    size_t length = writeSegment(out, key, connection->_sndNxt, connection->_rcvNxt, FLAG_FIN | FLAG_ACK, DEFAULT_WINDOW);
+    connection->_sndNxt += 1;
+    return length;
+}
@@ -0,0 +1,240 @@
+#include <algorithm>
+#include <climits>
+
+#include "timerwheel.hpp"
+
+Event::TimerWheel::TimerWheel(Clock::duration tick, Clock::time_point start)
+    : _tick{tick}, _start{start}
+{
+    _heads.fill(NIL);
+}
+
+Event::TimerWheel::Node* Event::TimerWheel::node(TimerId id)
+{
+    uint32_t index = static_cast<uint32_t>(id);
+    if (index >= _nodes.size()) {
+        return nullptr;
+    }
+
+    Node& timer = _nodes[index];
+    if (!timer._pending || timer._generation != static_cast<uint32_t>(id >> 32)) {
+        return nullptr;
+    }
+
+    return &timer;
+}
+
+uint64_t Event::TimerWheel::ticks(Clock::duration delay) const
+{
+    // rounded up, and at least the next tick
+    if (delay <= Clock::duration::zero()) {
+        return 1;
+    }
+
+    return std::max<uint64_t>(1, (delay + _tick - Clock::duration{1}) / _tick);
+}
+
+void Event::TimerWheel::place(uint32_t index)
+{
+    Node& timer = _nodes[index];
+
+    uint64_t delta = std::min(timer._expires - std::min(timer._expires, _now), MAX_DELTA);
+    uint64_t at = _now + delta;
+
+    unsigned level = (delta == 0) ? 0 : (63 - __builtin_clzll(delta)) / LEVEL_BITS;
+    unsigned slot = (at >> (level * LEVEL_BITS)) & (SLOTS - 1);
+
+    timer._slot = static_cast<uint16_t>(level * SLOTS + slot);
+    timer._prev = NIL;
+    timer._next = _heads[timer._slot];
+    if (timer._next != NIL) {
+        _nodes[timer._next]._prev = index;
+    }
+
+    _heads[timer._slot] = index;
+    _occupied[level] |= uint64_t{1} << slot;
+}
+
+void Event::TimerWheel::unlink(uint32_t index)
+{
+    Node& timer = _nodes[index];
+
+    if (timer._prev != NIL) {
+        _nodes[timer._prev]._next = timer._next;
+    } else {
+        _heads[timer._slot] = timer._next;
+    }
+
+    if (timer._next != NIL) {
+        _nodes[timer._next]._prev = timer._prev;
+    }
+
+    if (_heads[timer._slot] == NIL) {
+        _occupied[timer._slot / SLOTS] &= ~(uint64_t{1} << (timer._slot % SLOTS));
+    }
+}
+
+Event::TimerId Event::TimerWheel::schedule(Clock::duration delay, TimerCallback callback)
+{
+    uint32_t index = _free;
+    if (index != NIL) {
+        _free = _nodes[index]._next;
+    } else {
+        index = static_cast<uint32_t>(_nodes.size());
+        _nodes.emplace_back();
+    }
+
+    Node& timer = _nodes[index];
+    timer._expires = _now + ticks(delay);
+    timer._pending = true;
+    timer._callback = std::move(callback);
+    place(index);
+    ++_size;
+
+    return static_cast<TimerId>(timer._generation) << 32 | index;
+}
+
+bool Event::TimerWheel::reschedule(TimerId id, Clock::duration delay)
+{
+    Node* timer = node(id);
+    if (timer == nullptr) {
+        return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(id);
+    unlink(index);
+    timer->_expires = _now + ticks(delay);
+    place(index);
+
+    return true;
+}
+
+bool Event::TimerWheel::cancel(TimerId id)
+{
+    Node* timer = node(id);
+    if (timer == nullptr) {
+        return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(id);
+    unlink(index);
+
+    // a new generation makes every copy of id stale
+    timer->_pending = false;
+    timer->_generation = (timer->_generation == UINT32_MAX) ? 1 : timer->_generation + 1;
+    timer->_callback = nullptr;
+    timer->_next = _free;
+    _free = index;
+    --_size;
+
+    return true;
+}
+
+bool Event::TimerWheel::pending(TimerId id)
+{
+    return node(id) != nullptr;
+}
+
+void Event::TimerWheel::cascade(unsigned level)
+{
+    unsigned slot = (_now >> (level * LEVEL_BITS)) & (SLOTS - 1);
+    uint32_t& head = _heads[level * SLOTS + slot];
+
+    uint32_t index = head;
+    head = NIL;
+    _occupied[level] &= ~(uint64_t{1} << slot);
+
+    while (index != NIL) {
+        uint32_t next = _nodes[index]._next;
+        place(index);
+        index = next;
+    }
+}
+
+std::size_t Event::TimerWheel::fire(void)
+{
+    std::size_t fired = 0;
+    uint32_t& head = _heads[_now & (SLOTS - 1)];
+
+    // callbacks may schedule or cancel timers, but nothing new can land in this slot
+    while (head != NIL) {
+        uint32_t index = head;
+        TimerCallback callback = std::move(_nodes[index]._callback);
+
+        cancel(static_cast<TimerId>(_nodes[index]._generation) << 32 | index);
+        ++fired;
+        callback();
+    }
+
+    return fired;
+}
+
+uint64_t Event::TimerWheel::ticksUntilWork(void) const
+{
+    uint64_t best = UINT64_MAX;
+
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        uint64_t occupied = _occupied[level];
+        if (occupied == 0) {
+            continue;
+        }
+
+        // nearest occupied slot after the current one, a full turn if only the current one is
+        uint64_t current = _now >> (level * LEVEL_BITS);
+        unsigned shift = (current + 1) & (SLOTS - 1);
+        uint64_t rotated = (occupied >> shift) | (shift ? occupied << (SLOTS - shift) : 0);
+        uint64_t distance = __builtin_ctzll(rotated) + 1;
+
+        uint64_t tick = (current + distance) << (level * LEVEL_BITS);
+        best = std::min(best, tick - _now);
+    }
+
+    return best;
+}
+
+std::size_t Event::TimerWheel::advance(Clock::time_point now)
+{
+    if (now < _start) {
+        return 0;
+    }
+
+    uint64_t target = (now - _start) / _tick;
+    std::size_t fired = 0;
+
+    while (_now < target) {
+        // ticks without a slot to cascade or fire are skipped at once
+        uint64_t work = ticksUntilWork();
+        if (work == UINT64_MAX || work > target - _now) {
+            _now = target;
+            break;
+        }
+        _now += work;
+
+        for (unsigned level = LEVELS - 1; level > 0; --level) {
+            if ((_now & ((uint64_t{1} << (level * LEVEL_BITS)) - 1)) == 0) {
+                cascade(level);
+            }
+        }
+
+        fired += fire();
+    }
+
+    return fired;
+}
+
+int Event::TimerWheel::timeoutMs(Clock::time_point now) const
+{
+    uint64_t work = ticksUntilWork();
+    if (work == UINT64_MAX) {
+        return -1;
+    }
+
+    Clock::time_point deadline = _start + _tick * (_now + work);
+    if (deadline <= now) {
+        return 0;
+    }
+
+    // rounded up, waking before the tick would only spin
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+    return static_cast<int>(std::min<decltype(remaining)>(remaining, INT_MAX));
+}
@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <pthread.h>
+
+#include "tcp.hpp"
+#include "trace.hpp"
+#include "verdict.hpp"
+
+static constexpr char     MAGIC[8] = {'C', 'H', 'T', 'R', 'A', 'C', 'E', '\0'};
+static constexpr uint32_t VERSION  = 1;
+
+struct FileHeader
+{
+    char     _magic[8];
+    uint32_t _version;
+    uint32_t _rings;
+};
+
+struct RingHeader
+{
+    uint32_t _thread;
+    uint32_t _reserved;
+    uint64_t _count;
+};
+
+static std::mutex& registryLock(void)
+{
+    static std::mutex lock;
+    return lock;
+}
+
+// rings outlive their threads, so a dump still shows what exited workers did.
+static std::vector<std::shared_ptr<Trace::Ring>>& registry(void)
+{
+    static std::vector<std::shared_ptr<Trace::Ring>> rings;
+    return rings;
+}
+
+std::vector<Trace::Record> Trace::Ring::snapshot(void) const
+{
+    uint64_t end = _head.load(std::memory_order_acquire);
+    uint64_t begin = (end > SIZE) ? end - SIZE : 0;
+
+    std::vector<Record> records;
+    records.reserve(end - begin);
+    for (uint64_t i = begin; i < end; ++i) {
+        records.push_back(_records[i & (SIZE - 1)]);
+    }
+
+    // the producer is about to overwrite the slot of index head - SIZE, so everything
+    // older than head + 1 - SIZE may have been torn while it was copied.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t head = _head.load(std::memory_order_relaxed);
+    uint64_t valid = (head + 1 > SIZE) ? head + 1 - SIZE : 0;
+
+    if (valid > begin) {
+        records.erase(records.begin(), records.begin() + std::min(valid - begin, end - begin));
+    }
+
+    return records;
+}
+
+Trace::Ring& Trace::localRing(void)
+{
+    thread_local Ring *ring = [] {
+        std::lock_guard<std::mutex> guard{registryLock()};
+        auto& rings = registry();
+
+        rings.push_back(std::make_shared<Ring>(static_cast<uint32_t>(rings.size())));
+        return rings.back().get();
+    }();
+
+    return *ring;
+}
+
+void Trace::record(Level level, Event event, uint32_t arg0, uint64_t arg1, uint64_t arg2) noexcept
+{
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    localRing().push({now, static_cast<uint16_t>(event), level, 0, arg0, arg1, arg2});
+}
+
+bool Trace::dump(const std::string& path)
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> guard{registryLock()};
+        rings = registry();
+    }
+
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+
+    FileHeader header{};
+    std::memcpy(header._magic, MAGIC, sizeof(MAGIC));
+    header._version = VERSION;
+    header._rings = static_cast<uint32_t>(rings.size());
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (const auto& ring : rings) {
+        std::vector<Record> records = ring->snapshot();
+
+        RingHeader ringHeader{ring->thread(), 0, records.size()};
+        file.write(reinterpret_cast<const char*>(&ringHeader), sizeof(ringHeader));
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(Record));
+    }
+
+    return static_cast<bool>(file);
+}
+
+static const char* levelName(uint8_t level)
+{
+    switch (level) {
+        case Trace::LEVEL_ERROR:  return "ERROR";
+        case Trace::LEVEL_INFO:   return "INFO";
+        case Trace::LEVEL_PACKET: return "PACKET";
+        case Trace::LEVEL_DEBUG:  return "DEBUG";
+        default:                  return "?";
+    }
+}
+
+static void printIP(std::ostream& os, uint64_t addr)
+{
+    os << (addr >> 24 & 0xff) << '.' << (addr >> 16 & 0xff) << '.' << (addr >> 8 & 0xff) << '.' << (addr & 0xff);
+}
+
+static void printRecord(std::ostream& os, uint32_t thread, const Trace::Record& record)
+{
+    os << record._timestamp / 1000000000 << '.' << std::setfill('0') << std::setw(9)
+       << record._timestamp % 1000000000 << std::setfill(' ') << std::setw(0)
+       << " t" << thread << ' ' << levelName(record._level) << ' ';
+
+    switch (static_cast<Trace::Event>(record._event)) {
+        case Trace::Event::FRAME_RX:
+            os << "FRAME_RX length: " << record._arg0 << " ethertype: 0x" << std::hex << record._arg1 << std::dec;
+            break;
+
+        case Trace::Event::ARP_RX:
+            os << "ARP_RX opcode: " << record._arg0 << " sender: ";
+            printIP(os, record._arg1);
+            os << " target: ";
+            printIP(os, record._arg2);
+            break;
+
+        case Trace::Event::ARP_REPLY:
+            os << "ARP_REPLY target: ";
+            printIP(os, record._arg1);
+            os << " MAC: " << std::hex << std::setfill('0') << std::setw(12) << record._arg2
+               << std::setfill(' ') << std::setw(0) << std::dec;
+            break;
+
+        case Trace::Event::IP_RX:
+            os << "IP_RX protocol: " << (record._arg0 >> 16) << " length: " << (record._arg0 & 0xffff) << " src: ";
+            printIP(os, record._arg1);
+            os << " dst: ";
+            printIP(os, record._arg2);
+            break;
+
+        case Trace::Event::ICMP_RX:
+            os << "ICMP_RX type: " << (record._arg0 >> 8) << " code: " << (record._arg0 & 0xff)
+               << " payload size: " << record._arg1;
+            break;
+
+        case Trace::Event::ICMP_REPLY:
+            os << "ICMP_REPLY id: " << (record._arg0 >> 16) << " sequence: " << (record._arg0 & 0xffff)
+               << " payload size: " << record._arg1;
+            break;
+
+        case Trace::Event::DROP:
+            os << "DROP reason: " << Verdict::reasonName(static_cast<Verdict::Reason>(record._arg0))
+               << " ethertype: 0x" << std::hex << record._arg1 << std::dec;
+            break;
+
+        case Trace::Event::TCP_RX:
+            os << "TCP_RX flags: 0x" << std::hex << (record._arg0 >> 16) << std::dec << " payload size: " 
+               << (record._arg0 & 0xffff) << " ports: " << (record._arg1 >> 16) << " -> " << (record._arg1 & 0xffff)
+               << " seq: " << (record._arg2 >> 32) << " ack: " << (record._arg2 & 0xffffffff);
+            break;
+
+        case Trace::Event::ARP_REQUEST:
+            os << "ARP_REQUEST attempt: " << record._arg0 << " target: ";
+            printIP(os, record._arg2);
+            break;
+
+        case Trace::Event::TCP_STATE:
+            os << "TCP_STATE " << TCP::stateName(static_cast<TCP::State>(record._arg0 >> 8)) << " -> " 
+               << TCP::stateName(static_cast<TCP::State>(record._arg0 & 0xff)) << " ports: " << (record._arg1 >> 16) 
+               << " <- " << (record._arg1 & 0xffff) << " remote: ";
+            printIP(os, record._arg2);
+            break;
+
+        default:
+            os << "event " << record._event << ' ' << record._arg0 << ' ' << record._arg1 << ' ' << record._arg2;
+            break;
+    }
+
+    os << '\n';
+}
+
+bool Trace::decode(const std::string& path, std::ostream& os)
+{
+    std::ifstream file{path, std::ios::binary};
+
+    FileHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header._magic, MAGIC, sizeof(MAGIC)) != 0 || header._version != VERSION) {
+        return false;
+    }
+
+    std::vector<std::pair<uint32_t, Record>> records;
+    for (uint32_t i = 0; i < header._rings; ++i) {
+        RingHeader ringHeader;
+        if (!file.read(reinterpret_cast<char*>(&ringHeader), sizeof(ringHeader)) || ringHeader._count > Ring::SIZE) {
+            return false;
+        }
+
+        for (uint64_t j = 0; j < ringHeader._count; ++j) {
+            Record record;
+            if (!file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+                return false;
+            }
+            records.emplace_back(ringHeader._thread, record);
+        }
+    }
+
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+        return a.second._timestamp < b.second._timestamp;
+    });
+
+    for (const auto& [thread, record] : records) {
+        printRecord(os, thread, record);
+    }
+
+    return true;
+}
+
+void Trace::dumpOnSignal(const std::string& path)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    std::thread([path, signals] {
+        while (true) {
+            int signal;
+            if (sigwait(&signals, &signal) != 0) {
+                continue;
+            }
+
+            if (!dump(path)) {
+                std::cerr << "trace.cpp: Trace::dumpOnSignal: failed writing " << path << '\n';
+            }
+
+            if (signal != SIGUSR1) {
+                std::_Exit(0);
+            }
+        }
+    }).detach();
+}
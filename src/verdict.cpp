@@ -0,0 +1,59 @@
+#include "verdict.hpp"
+
+const char* Verdict::reasonName(Reason reason)
+{
+    switch (reason) {
+        case Reason::NONE:                    return "none";
+        case Reason::RUNT:                    return "runt";
+        case Reason::ETHERTYPE:               return "unsupported ethertype";
+        case Reason::TRUNCATED:               return "truncated header";
+        case Reason::ARP_HW_TYPE:             return "unsupported ARP hardware type";
+        case Reason::ARP_PRO_TYPE:            return "unsupported ARP protocol type";
+        case Reason::ARP_OPCODE:              return "unsupported ARP opcode";
+        case Reason::IPV4_VERSION:            return "unsupported IP version";
+        case Reason::IPV4_HEADER_LENGTH:      return "bad IP header length";
+        case Reason::IPV4_TTL:                return "TTL expired";
+        case Reason::IPV4_CHECKSUM:           return "bad IP checksum";
+        case Reason::IPV4_PROTOCOL:           return "unsupported IP protocol";
+        case Reason::ICMP_UNREACHABLE:        return "ICMP unreachable";
+        case Reason::ICMP_TYPE:               return "unsupported ICMP type";
+        case Reason::TCP_CHECKSUM:            return "bad TCP checksum";
+        case Reason::TCP_NO_CONNECTION:       return "TCP reset without connection";
+        case Reason::TCP_TABLE_FULL:          return "TCP connection table full";
+        case Reason::TCP_SEQUENCE:            return "TCP reset out of window";
+        case Reason::TCP_UNEXPECTED:          return "unexpected TCP segment";
+        case Reason::NO_BUFFER:               return "no room for the reply";
+        case Reason::ARP_UNRESOLVED:          return "ARP resolution failed";
+        case Reason::ARP_QUEUE_FULL:          return "ARP pending queue full";
+        case Reason::IPV4_FRAGMENT_INVALID:   return "invalid IP fragment";
+        case Reason::IPV4_FRAGMENT_OVERLAP:   return "overlapping IP fragments";
+        case Reason::IPV4_FRAGMENT_DUPLICATE: return "duplicate IP fragment";
+        case Reason::IPV4_REASSEMBLY_TIMEOUT: return "IP reassembly timed out";
+        case Reason::IPV4_REASSEMBLY_EVICTED: return "IP reassembly evicted";
+        case Reason::IPV4_NO_ROUTE:           return "no route to host";
+        case Reason::IPV4_TOO_BIG:            return "datagram too big to send";
+        case Reason::TX_QUEUE_FULL:           return "transmit queue full";
+        default:                              return "unknown";
+    }
+}
+
+uint64_t Verdict::DropCounters::total(void) const
+{
+    uint64_t sum = 0;
+    for (uint64_t count : _counts) {
+        sum += count;
+    }
+
+    return sum;
+}
+
+void Verdict::DropCounters::debugPrint(std::ostream& os) const
+{
+    os << "drops: " << total() << '\n';
+
+    for (std::size_t i = 1; i < _counts.size(); ++i) {
+        if (_counts[i] != 0) {
+            os << "    " << reasonName(static_cast<Reason>(i)) << ": " << _counts[i] << '\n';
+        }
+    }
+}
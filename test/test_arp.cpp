@@ -0,0 +1,227 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "arp.hpp"
+#include "ethernet.hpp"
+#include "verdict.hpp"
+
+class ArpCacheTest : public testing::Test
+{
+    protected:
+        Event::Clock::time_point _epoch = Event::Clock::now();
+        ARP::Cache               _cache{64, _epoch};
+
+        static MacAddr mac(uint8_t last)
+        {
+            MacAddr addr;
+            addr.addr = {0x02, 0, 0, 0, 0, last};
+            return addr;
+        }
+};
+
+TEST_F(ArpCacheTest, lookup)
+{
+    ASSERT_EQ(_cache.lookup(0x0a000001, _epoch), nullptr);
+
+    for (uint8_t host = 1; host <= 50; ++host) {
+        _cache.update(0x0a000000 | host, mac(host), _epoch);
+    }
+    ASSERT_EQ(_cache.size(), 50u);
+
+    for (uint8_t host = 1; host <= 50; ++host) {
+        const ARP::Entry *entry = _cache.lookup(0x0a000000 | host, _epoch);
+        ASSERT_NE(entry, nullptr);
+        ASSERT_EQ(entry->_state, ARP::State::RESOLVED);
+        ASSERT_EQ(entry->_macAddr.addr, mac(host).addr);
+    }
+
+    // a new MAC replaces the old one
+    _cache.update(0x0a000001, mac(99), _epoch);
+    ASSERT_EQ(_cache.lookup(0x0a000001, _epoch)->_macAddr.addr, mac(99).addr);
+    ASSERT_EQ(_cache.size(), 50u);
+}
+
+TEST_F(ArpCacheTest, aging)
+{
+    _cache.update(0x0a000001, mac(1), _epoch);
+    _cache.update(0x0a000002, mac(2), _epoch + ARP::ENTRY_TIMEOUT / 2);
+
+    ASSERT_NE(_cache.lookup(0x0a000001, _epoch + ARP::ENTRY_TIMEOUT), nullptr);
+    ASSERT_EQ(_cache.lookup(0x0a000001, _epoch + ARP::ENTRY_TIMEOUT + std::chrono::seconds{1}), nullptr);
+    ASSERT_EQ(_cache.size(), 1u);
+
+    ASSERT_EQ(_cache.sweep(_epoch + ARP::ENTRY_TIMEOUT), 0u);
+    ASSERT_EQ(_cache.sweep(_epoch + ARP::ENTRY_TIMEOUT * 2), 1u);
+    ASSERT_EQ(_cache.size(), 0u);
+}
+
+TEST_F(ArpCacheTest, negative)
+{
+    _cache.markUnresolved(0x0a000001, _epoch);
+    const ARP::Entry *entry = _cache.lookup(0x0a000001, _epoch);
+    ASSERT_NE(entry, nullptr);
+    ASSERT_EQ(entry->_state, ARP::State::NEGATIVE);
+
+    ASSERT_EQ(_cache.lookup(0x0a000001, _epoch + ARP::NEGATIVE_TIMEOUT + std::chrono::seconds{1}), nullptr);
+
+    // an answer overrides a negative entry, but not the other way round
+    _cache.markUnresolved(0x0a000002, _epoch);
+    _cache.update(0x0a000002, mac(2), _epoch);
+    _cache.markUnresolved(0x0a000002, _epoch);
+    ASSERT_EQ(_cache.lookup(0x0a000002, _epoch)->_state, ARP::State::RESOLVED);
+}
+
+TEST_F(ArpCacheTest, eviction)
+{
+    // full: new hosts replace the stalest entries on their probe path, the rest stays reachable
+    for (uint32_t host = 0; host < 64; ++host) {
+        _cache.update(0x0a000000 | host, mac(host), _epoch + std::chrono::milliseconds{host});
+    }
+    ASSERT_EQ(_cache.size(), 64u);
+
+    size_t cached = 0;
+    for (uint32_t host = 64; host < 128; ++host) {
+        _cache.update(0x0a000000 | host, mac(host), _epoch + std::chrono::seconds{1});
+        cached += _cache.lookup(0x0a000000 | host, _epoch + std::chrono::seconds{1}) != nullptr;
+    }
+    ASSERT_EQ(_cache.size(), 64u);
+    ASSERT_GT(cached, 0u);
+
+    size_t reachable = 0;
+    for (uint32_t host = 0; host < 128; ++host) {
+        const ARP::Entry *entry = _cache.lookup(0x0a000000 | host, _epoch + std::chrono::seconds{1});
+        if (entry != nullptr) {
+            ASSERT_EQ(entry->_macAddr.addr[5], host);
+            ++reachable;
+        }
+    }
+    ASSERT_EQ(reachable, 64u);
+}
+
+class ArpResolveTest : public testing::Test
+{
+    protected:
+        Event::Clock::time_point         _start = Event::Clock::now();
+        Event::TimerWheel                _timers{std::chrono::milliseconds{1}, _start};
+        ARP::CacheManager                _arp;
+        Verdict::DropCounters            _drops;
+        std::vector<std::vector<char>>   _sent;
+
+        static constexpr IPAddr LOCAL_ADDR = 0x0a090002;
+        static constexpr IPAddr PEER_ADDR  = 0x0a090001;
+        static constexpr size_t ARP_OFFSET = Ethernet::HeaderLayout::SIZE;
+
+        void SetUp() override
+        {
+            _arp.setLocalAddr(LOCAL_ADDR);
+            _arp.attach(_timers, [this](Ethernet::Frame& frame) {
+                _sent.emplace_back(frame.getData(), frame.getData() + frame.getBufferSize());
+                return true;
+            }, &_drops);
+        }
+
+        /* an IPv4 frame whose last byte tells it apart */
+        static Ethernet::Frame ipFrame(uint8_t mark)
+        {
+            Ethernet::Frame frame;
+            frame.allocPacket();
+            char *data = frame.getData();
+            std::memset(data, 0, 60);
+            data[12] = 0x08;
+            data[59] = static_cast<char>(mark);
+            frame.setBufferSize(60);
+            frame.parseBuffer();
+            return frame;
+        }
+
+        Ethernet::Frame arpReply(IPAddr from, const MacAddr& mac)
+        {
+            std::vector<unsigned char> reply = {
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0, 0, 0, 0, 0, 0, 0x08, 0x06,
+                0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x02,
+                0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x0a, 0x09, 0x00, 0x02
+            };
+            Ethernet::Frame frame;
+            frame.allocPacket();
+            std::memcpy(frame.getData(), reply.data(), reply.size());
+            Memory::Codec<MacAddr>::store(mac, frame.getData() + 6);
+            Memory::Codec<MacAddr>::store(mac, frame.getData() + ARP_OFFSET + 8);
+            Memory::Codec<IPAddr>::store(from, frame.getData() + ARP_OFFSET + 14);
+            frame.setBufferSize(reply.size());
+            frame.parseBuffer();
+            return frame;
+        }
+};
+
+TEST_F(ArpResolveTest, queueAndFlush)
+{
+    MacAddr peer;
+    peer.addr = {0x02, 0, 0, 0, 0, 0x01};
+
+    Ethernet::Frame first = ipFrame(1);
+    Ethernet::Frame second = ipFrame(2);
+    ASSERT_EQ(_arp.output(first, PEER_ADDR), Verdict::accept());
+    ASSERT_EQ(_arp.output(second, PEER_ADDR), Verdict::accept());
+    ASSERT_EQ(_arp.pending(PEER_ADDR), 2u);
+    ASSERT_FALSE(first.hasBuffer());
+
+    // one broadcast request for both
+    ASSERT_EQ(_sent.size(), 1u);
+    const char *request = _sent[0].data();
+    ASSERT_EQ(static_cast<uint8_t>(request[0]), 0xff);
+    ASSERT_EQ(static_cast<uint8_t>(request[ARP_OFFSET + 7]), ARP::OP_REQUEST);
+    IPAddr sender, target;
+    Memory::Codec<IPAddr>::load(sender, request + ARP_OFFSET + 14);
+    Memory::Codec<IPAddr>::load(target, request + ARP_OFFSET + 24);
+    ASSERT_EQ(sender, LOCAL_ADDR);
+    ASSERT_EQ(target, PEER_ADDR);
+
+    // the reply sends the queued frames in order, addressed to the peer
+    Ethernet::Frame reply = arpReply(PEER_ADDR, peer);
+    ASSERT_EQ(_arp.handleMessage(reply), Verdict::accept());
+    ASSERT_EQ(_sent.size(), 3u);
+    ASSERT_EQ(_sent[1][59], 1);
+    ASSERT_EQ(_sent[2][59], 2);
+    ASSERT_EQ(std::memcmp(_sent[1].data(), peer.addr.data(), 6), 0);
+    ASSERT_EQ(_arp.pending(PEER_ADDR), 0u);
+    ASSERT_EQ(_timers.size(), 1u);
+
+    // later frames go out directly
+    Ethernet::Frame third = ipFrame(3);
+    ASSERT_EQ(_arp.output(third, PEER_ADDR), Verdict::reply());
+    ASSERT_EQ(std::memcmp(third.getData(), peer.addr.data(), 6), 0);
+}
+
+TEST_F(ArpResolveTest, retriesAndFails)
+{
+    Ethernet::Frame frame = ipFrame(1);
+    ASSERT_EQ(_arp.output(frame, PEER_ADDR), Verdict::accept());
+
+    // a full queue drops instead of asking again
+    for (size_t i = 1; i < ARP::PENDING_FRAMES; ++i) {
+        Ethernet::Frame more = ipFrame(1);
+        ASSERT_EQ(_arp.output(more, PEER_ADDR), Verdict::accept());
+    }
+    Ethernet::Frame overflow = ipFrame(1);
+    ASSERT_EQ(_arp.output(overflow, PEER_ADDR), Verdict::drop(Verdict::Reason::ARP_QUEUE_FULL));
+    ASSERT_EQ(_sent.size(), 1u);
+
+    _timers.advance(_start + ARP::REQUEST_INTERVAL);
+    ASSERT_EQ(_sent.size(), 2u);
+    _timers.advance(_start + ARP::REQUEST_INTERVAL * 2);
+    ASSERT_EQ(_sent.size(), 3u);
+
+    // no more requests, the frames are dropped and the address is negative for a while
+    _timers.advance(_start + ARP::REQUEST_INTERVAL * 3);
+    ASSERT_EQ(_sent.size(), 3u);
+    ASSERT_EQ(_arp.pending(PEER_ADDR), 0u);
+    ASSERT_EQ(_drops.get(Verdict::Reason::ARP_UNRESOLVED), ARP::PENDING_FRAMES);
+
+    frame = ipFrame(1);
+    ASSERT_EQ(_arp.output(frame, PEER_ADDR), Verdict::drop(Verdict::Reason::ARP_UNRESOLVED));
+    ASSERT_EQ(_sent.size(), 3u);
+}
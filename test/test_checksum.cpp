@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include <arpa/inet.h>
+
+#include "checksum.hpp"
+
+/* RFC 1071 reference, one 16 bit word at a time */
+static uint16_t referenceChecksum(const unsigned char *data, std::size_t length)
+{
+    uint32_t sum = 0;
+    for (std::size_t i = 0; i + 1 < length; i += 2) {
+        sum += data[i] << 8 | data[i + 1];
+    }
+    if (length & 1) {
+        sum += data[length - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return htons(static_cast<uint16_t>(~sum));
+}
+
+class ChecksumTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t _size = 4096;
+        std::vector<unsigned char> _buffer;
+
+        // 20 bytes IPv4 header with a valid checksum.
+        unsigned char _ipHeader[20] = {
+            0x45, 0x00, 0x00, 0x54, 0x12, 0x34, 0x40, 0x00, 0x40, 0x01, 
+            0x00, 0x00, 0x0a, 0x09, 0x00, 0x01, 0x0a, 0x09, 0x00, 0x02
+        };
+
+        ChecksumTest() : _buffer(_size) 
+        {
+            std::mt19937 gen{7};
+            for (auto& byte : _buffer) {
+                byte = static_cast<unsigned char>(gen());
+            }
+
+            uint16_t checksum = Inet::checksum(_ipHeader, sizeof(_ipHeader));
+            std::memcpy(_ipHeader + 10, &checksum, sizeof(checksum));
+        }
+};
+
+TEST_F(ChecksumTest, ScalarMatchesReference)
+{
+    for (std::size_t offset = 0; offset < 8; ++offset) {
+        for (std::size_t length = 0; length < 600; ++length) {
+            const unsigned char *data = _buffer.data() + offset;
+            ASSERT_EQ(static_cast<uint16_t>(~Inet::fold(Inet::partialScalar(data, length))), 
+                      referenceChecksum(data, length)) << "length: " << length;
+        }
+    }
+}
+
+TEST_F(ChecksumTest, Avx2MatchesReference)
+{
+    if (!Inet::hasAvx2()) {
+        GTEST_SKIP() << "CPU without AVX2";
+    }
+
+    for (std::size_t offset = 0; offset < 8; ++offset) {
+        for (std::size_t length = 0; length < 3000; length += 5) {
+            const unsigned char *data = _buffer.data() + offset;
+            ASSERT_EQ(static_cast<uint16_t>(~Inet::fold(Inet::partialAvx2(data, length))), 
+                      referenceChecksum(data, length)) << "length: " << length;
+        }
+    }
+}
+
+TEST_F(ChecksumTest, ValidHeaderSumsToZero)
+{
+    ASSERT_EQ(Inet::checksum(_ipHeader, sizeof(_ipHeader)), 0);
+}
+
+TEST_F(ChecksumTest, DecrementTTL)
+{
+    ASSERT_TRUE(Inet::decrementTTL(_ipHeader));
+
+    ASSERT_EQ(_ipHeader[8], 0x3f);
+    ASSERT_EQ(Inet::checksum(_ipHeader, sizeof(_ipHeader)), 0);
+
+    // TTL 0 doesn't wrap around
+    _ipHeader[8] = 0;
+    _ipHeader[10] = 0;
+    _ipHeader[11] = 0;
+    uint16_t checksum = Inet::checksum(_ipHeader, sizeof(_ipHeader));
+    std::memcpy(_ipHeader + 10, &checksum, sizeof(checksum));
+    ASSERT_FALSE(Inet::decrementTTL(_ipHeader));
+    ASSERT_EQ(_ipHeader[8], 0);
+    ASSERT_EQ(Inet::checksum(_ipHeader, sizeof(_ipHeader)), 0);
+}
+
+TEST_F(ChecksumTest, AddressRewrite)
+{
+    Inet::patch32(_ipHeader + 12, htonl(0xc0a80101), _ipHeader + 10);
+
+    ASSERT_EQ(_ipHeader[12], 0xc0);
+    ASSERT_EQ(Inet::checksum(_ipHeader, sizeof(_ipHeader)), 0);
+}
+
+TEST_F(ChecksumTest, PortRewrite)
+{
+    // UDP datagram: ports, length, checksum and payload covered by the pseudo header.
+    unsigned char segment[64] = {};
+    std::memcpy(segment + 8, _buffer.data(), sizeof(segment) - 8);
+    segment[0] = 0x13; segment[1] = 0x88; segment[2] = 0x00; segment[3] = 0x35;
+    segment[5] = sizeof(segment);
+
+    Inet::Sum pseudo = Inet::pseudoHeader(0x0a090001, 0x0a090002, 17, sizeof(segment));
+    uint16_t checksum = Inet::checksum(segment, sizeof(segment), pseudo);
+    std::memcpy(segment + 6, &checksum, sizeof(checksum));
+    ASSERT_EQ(Inet::checksum(segment, sizeof(segment), pseudo), 0);
+
+    Inet::patch16(segment, htons(40000), segment + 6);
+    ASSERT_EQ(Inet::checksum(segment, sizeof(segment), pseudo), 0);
+}
+
+TEST_F(ChecksumTest, ChainedPartialSums)
+{
+    Inet::Sum sum = Inet::partial(_buffer.data(), 1000);
+    sum = Inet::partial(_buffer.data() + 1000, 514, sum);
+
+    ASSERT_EQ(static_cast<uint16_t>(~Inet::fold(sum)), referenceChecksum(_buffer.data(), 1514));
+}
+
+#define PERFORMANCE_TESTS   100000
+
+TEST_F(ChecksumTest, ReferencePerformance)
+{
+    uint32_t acc = 0;
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        acc += referenceChecksum(_buffer.data(), 1500);
+    }
+    ASSERT_NE(acc, 1);
+}
+
+TEST_F(ChecksumTest, PartialPerformance)
+{
+    uint32_t acc = 0;
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        acc += Inet::checksum(_buffer.data(), 1500);
+    }
+    ASSERT_NE(acc, 1);
+}
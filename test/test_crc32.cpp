@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "crc32.hpp"
+#include "ethernet.hpp"
+
+class CRC32Test : public testing::Test
+{
+    protected:
+        static constexpr std::size_t _size = 4096;
+        std::vector<unsigned char> _buffer;
+
+        CRC32Test() : _buffer(_size) 
+        {
+            std::mt19937 gen{42};
+            for (auto& byte : _buffer) {
+                byte = static_cast<unsigned char>(gen());
+            }
+        }
+};
+
+TEST_F(CRC32Test, KnownVector)
+{
+    const char data[] = "123456789";
+
+    ASSERT_EQ(CRC::bitwise(0, data, 9), 0xcbf43926);
+    ASSERT_EQ(CRC::slicing8(0, data, 9), 0xcbf43926);
+    ASSERT_EQ(CRC::compute(0, data, 9), 0xcbf43926);
+    ASSERT_EQ(Ethernet::calcCRC(0, const_cast<char*>(data), 9), 0xcbf43926);
+}
+
+TEST_F(CRC32Test, Slicing8MatchesBitwise)
+{
+    for (std::size_t offset = 0; offset < 8; ++offset) {
+        for (std::size_t length = 0; length < 300; ++length) {
+            ASSERT_EQ(CRC::slicing8(0, _buffer.data() + offset, length), 
+                      CRC::bitwise(0, _buffer.data() + offset, length)) << "length: " << length;
+        }
+    }
+
+    ASSERT_EQ(CRC::slicing8(0, _buffer.data(), _size), CRC::bitwise(0, _buffer.data(), _size));
+}
+
+TEST_F(CRC32Test, PclmulMatchesBitwise)
+{
+    if (!CRC::hasPclmul()) {
+        GTEST_SKIP() << "CPU without PCLMULQDQ";
+    }
+
+    for (std::size_t offset = 0; offset < 16; offset += 3) {
+        for (std::size_t length = 0; length < 2100; length += 7) {
+            ASSERT_EQ(CRC::pclmul(0, _buffer.data() + offset, length), 
+                      CRC::bitwise(0, _buffer.data() + offset, length)) << "length: " << length;
+        }
+    }
+}
+
+TEST_F(CRC32Test, Chaining)
+{
+    CRC32 whole = CRC::bitwise(0, _buffer.data(), 1518);
+    CRC32 first = CRC::compute(0, _buffer.data(), 700);
+
+    ASSERT_EQ(CRC::compute(first, _buffer.data() + 700, 1518 - 700), whole);
+    ASSERT_EQ(CRC::slicing8(CRC::slicing8(0, _buffer.data(), 13), _buffer.data() + 13, 1505), whole);
+}
+
+#define PERFORMANCE_TESTS   10000
+
+TEST_F(CRC32Test, BitwisePerformance)
+{
+    CRC32 crc = 0;
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        crc = CRC::bitwise(crc, _buffer.data(), Ethernet::MAX_FRAME_SIZE);
+    }
+    ASSERT_NE(crc, 0);
+}
+
+TEST_F(CRC32Test, Slicing8Performance)
+{
+    CRC32 crc = 0;
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        crc = CRC::slicing8(crc, _buffer.data(), Ethernet::MAX_FRAME_SIZE);
+    }
+    ASSERT_NE(crc, 0);
+}
+
+TEST_F(CRC32Test, ComputePerformance)
+{
+    CRC32 crc = 0;
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        crc = CRC::compute(crc, _buffer.data(), Ethernet::MAX_FRAME_SIZE);
+    }
+    ASSERT_NE(crc, 0);
+}
@@ -1,5 +1,19 @@
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "ethernet.hpp"
+#include "packet.hpp"
+#include "pcap.hpp"
 #include "tun.hpp"
 
 TEST(TunDeviceTest, TunDeviceCreation) 
@@ -12,3 +26,353 @@ TEST(TunDeviceTest, TunDeviceCreation)
     EXPECT_STREQ(tunDev.name().c_str(), name) << "TUN/TAP device's name is different from the one requested.";
     ASSERT_GT(tunDev.fd(), -1) << "TUN/TAP device failed to obtain a file descriptor.";
 }
+
+TEST(TunDeviceTest, TunDeviceMultiQueue) 
+{
+    constexpr char name[] = "TESTMQ";
+    constexpr size_t queues = 4;
+
+    std::vector<TunDevice> tunDevs = TunDevice::openQueues(name, queues);
+
+    ASSERT_EQ(tunDevs.size(), queues);
+    for (TunDevice& tunDev : tunDevs) {
+        EXPECT_STREQ(tunDev.name().c_str(), name) << "TUN/TAP queue is attached to a different device.";
+        ASSERT_GT(tunDev.fd(), -1) << "TUN/TAP queue failed to obtain a file descriptor.";
+    }
+}
+
+TEST(TunDeviceTest, TunDeviceOffload) 
+{
+    constexpr char name[] = "TESTVNET";
+
+    TunDevice tunDev{name, false, true};
+
+    ASSERT_GT(tunDev.fd(), -1) << "TUN/TAP device failed to obtain a file descriptor.";
+    ASSERT_TRUE(tunDev.vnetHeader()) << "TUN/TAP device didn't enable the virtio-net header.";
+}
+
+TEST(TunDeviceTest, ManagerTxRing) 
+{
+    constexpr char name[] = "TESTTX";
+    constexpr size_t frames = 10;
+
+    Ethernet::Manager<TunDevice> manager{name};
+
+    auto frame = []() {
+        Ethernet::Frame frame;
+        frame.allocPacket();
+        std::memset(frame.getData(), 0xff, Ethernet::MIN_FRAME_SIZE);
+        frame.setBufferSize(Ethernet::MIN_FRAME_SIZE);
+        frame.parseBuffer();
+        return frame;
+    };
+
+    // queued frames own their buffers until they are written
+    for (size_t i = 0; i < frames; ++i) {
+        Ethernet::Frame queued = frame();
+        ASSERT_TRUE(manager.enqueue(queued));
+        ASSERT_FALSE(queued.hasBuffer());
+    }
+    ASSERT_EQ(manager.txQueued(), frames);
+    ASSERT_EQ(manager.flush(), frames);
+    ASSERT_EQ(manager.txQueued(), 0u);
+
+    // the high water mark flushes without waiting for the end of the burst
+    for (size_t i = 0; i < Ethernet::TX_HIGH_WATER - 1; ++i) {
+        Ethernet::Frame queued = frame();
+        ASSERT_TRUE(manager.enqueue(queued));
+    }
+    ASSERT_EQ(manager.txQueued(), Ethernet::TX_HIGH_WATER - 1);
+
+    Ethernet::Frame last = frame();
+    ASSERT_TRUE(manager.enqueue(last));
+    ASSERT_EQ(manager.txQueued(), 0u);
+    ASSERT_FALSE(manager.txFull());
+}
+
+TEST(TunDeviceTest, ManagerUring) 
+{
+    constexpr char name[] = "TESTURING";
+    constexpr size_t frames = 10;
+
+    Ethernet::Manager<UringDevice> manager{name};
+    ASSERT_GT(manager.fd(), -1) << "io_uring failed to obtain a file descriptor.";
+
+    Ethernet::Burst burst;
+    ASSERT_EQ(manager.readBurst(burst), 0u);
+
+    for (size_t i = 0; i < frames; ++i) {
+        Ethernet::Frame queued;
+        queued.allocPacket();
+        std::memset(queued.getData(), 0xff, Ethernet::MIN_FRAME_SIZE);
+        queued.setBufferSize(Ethernet::MIN_FRAME_SIZE);
+        queued.parseBuffer();
+
+        ASSERT_TRUE(manager.enqueue(queued));
+        ASSERT_FALSE(queued.hasBuffer());
+    }
+    ASSERT_EQ(manager.txQueued(), frames);
+
+    // one submission for the batch, the frames keep their slots until their writes complete
+    ASSERT_EQ(manager.flush(), frames);
+    ASSERT_EQ(manager.txQueued(), 0u);
+    for (int i = 0; i < 100 && manager.txInFlight() > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        manager.flush();
+    }
+    ASSERT_EQ(manager.txInFlight(), 0u);
+    ASSERT_FALSE(manager.txFull());
+}
+
+TEST(PacketDeviceTest, ManagerVethPair) 
+{
+    constexpr size_t frames = 10;
+    constexpr EtherType type = 0x88b5;     // local experimental
+
+    ASSERT_EQ(std::system("ip link add TESTPKT0 type veth peer name TESTPKT1 && "
+                          "ip link set TESTPKT0 up && ip link set TESTPKT1 up"), 0) << "could not create the veth pair.";
+
+    // the pair goes away even if an assertion fails
+    struct Cleanup { ~Cleanup() { std::system("ip link del TESTPKT0"); } } cleanup;
+
+    size_t received = 0;
+    {
+        Ethernet::Manager<PacketDevice> sender{"TESTPKT0"};
+        Ethernet::Manager<PacketDevice> receiver{"TESTPKT1"};
+        ASSERT_GT(receiver.fd(), -1);
+
+        for (size_t i = 0; i < frames; ++i) {
+            Ethernet::Frame queued;
+            queued.allocPacket();
+            std::memset(queued.getData(), 0xff, Ethernet::MIN_FRAME_SIZE);
+            Ethernet::HeaderLayout::store(queued.getData(), MacAddr{}, MacAddr{}, type);
+            queued.setBufferSize(Ethernet::MIN_FRAME_SIZE);
+            queued.parseBuffer();
+
+            ASSERT_TRUE(sender.enqueue(queued));
+            ASSERT_FALSE(queued.hasBuffer());
+        }
+        ASSERT_EQ(sender.txQueued(), frames);
+        ASSERT_EQ(sender.flush(), frames);
+        ASSERT_EQ(sender.txQueued(), 0u);
+
+        // received frames are read in place from the ring, among whatever else the kernel sends
+        Ethernet::Burst burst;
+        Ethernet::Frame kept;
+        for (int i = 0; i < 100 && received < frames; ++i) {
+            receiver.readBurst(burst);
+            for (size_t j = 0; j < burst.count; ++j) {
+                Ethernet::Frame& frame = burst.frames[j];
+                if (frame.getType() == type) {
+                    EXPECT_TRUE(frame.getBuffer().borrowed());
+                    EXPECT_EQ(frame.getBufferSize(), Ethernet::MIN_FRAME_SIZE);
+                    EXPECT_LE(frame.getBuffer().capacity(), PacketDevice::FRAME_SIZE);
+                    ++received;
+
+                    // kept past its burst, a frame is copied out of the ring
+                    if (!kept.hasBuffer()) {
+                        ASSERT_TRUE(frame.own());
+                        EXPECT_FALSE(frame.getBuffer().borrowed());
+                        kept = std::move(frame);
+                    }
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        // the ring moved on, the copy didn't
+        ASSERT_TRUE(kept.hasBuffer());
+        EXPECT_LE(kept.getBuffer().capacity(), PacketDevice::FRAME_SIZE);
+        EXPECT_EQ(kept.getType(), type);
+        EXPECT_EQ(kept.getBufferSize(), Ethernet::MIN_FRAME_SIZE);
+        EXPECT_EQ(static_cast<unsigned char>(kept.getData()[Ethernet::MIN_FRAME_SIZE - 1]), 0xff);
+    }
+    ASSERT_EQ(received, frames);
+}
+
+/* a minimum size frame of the local experimental ethertype */
+static std::string pcapFrame(void)
+{
+    std::string frame(Ethernet::MIN_FRAME_SIZE, '\xff');
+    frame[12] = '\x88';
+    frame[13] = '\xb5';
+    return frame;
+}
+
+/* a file of its own for a test, removed with it */
+struct TempFile
+{
+    std::string _path = "/tmp/charmtcp_test_XXXXXX";
+
+    TempFile()
+    {
+        int fd = mkstemp(_path.data());
+        if (fd < 0) {
+            throw std::runtime_error("test_device.cpp: TempFile(): could not create a temporary file");
+        }
+        close(fd);
+    }
+
+    ~TempFile() { std::remove(_path.c_str()); }
+};
+
+static void appendInt(std::string& file, uint64_t value, size_t size, bool bigEndian = false)
+{
+    for (size_t i = 0; i < size; ++i) {
+        size_t shift = bigEndian ? (size - 1 - i) * 8 : i * 8;
+        file.push_back(static_cast<char>(value >> shift));
+    }
+}
+
+TEST(PcapDeviceTest, ManagerReplay) 
+{
+    constexpr size_t frames = 3;
+    TempFile input;
+    TempFile output;
+
+    // big endian with microsecond timestamps
+    std::string file;
+    appendInt(file, 0xa1b2c3d4, 4, true);
+    appendInt(file, 2, 2, true);
+    appendInt(file, 4, 2, true);
+    for (uint32_t field : {0u, 0u, 65535u, 1u}) {
+        appendInt(file, field, 4, true);
+    }
+    for (size_t i = 0; i < frames; ++i) {
+        for (uint32_t field : {1700000000u, static_cast<uint32_t>(i), 64u, 64u}) {
+            appendInt(file, field, 4, true);
+        }
+        file += pcapFrame();
+    }
+    std::ofstream{input._path, std::ios::binary} << file;
+
+    {
+        Ethernet::Manager<PcapDevice> manager{input._path, output._path};
+        ASSERT_GT(manager.fd(), -1);
+        ASSERT_FALSE(manager.done());
+
+        Ethernet::Burst burst;
+        ASSERT_EQ(manager.readBurst(burst), frames);
+        ASSERT_TRUE(manager.done());
+        ASSERT_EQ(manager.readBurst(burst), 0u);
+
+        // the frames were copied out of the mapped file, and go to the output
+        for (size_t i = 0; i < frames; ++i) {
+            Ethernet::Frame& frame = burst.frames[i];
+            EXPECT_EQ(frame.getType(), 0x88b5);
+            EXPECT_FALSE(frame.getBuffer().borrowed());
+            ASSERT_TRUE(manager.enqueue(frame));
+        }
+        ASSERT_EQ(manager.txQueued(), frames);
+        ASSERT_EQ(manager.flush(), frames);
+        ASSERT_EQ(manager.txFrames(), frames);
+    }
+
+    std::ifstream written{output._path, std::ios::binary | std::ios::ate};
+    EXPECT_EQ(static_cast<size_t>(written.tellg()), 24 + frames * (16 + Ethernet::MIN_FRAME_SIZE));
+}
+
+TEST(PcapDeviceTest, UncutGsoFrames)
+{
+    TempFile input;
+    TempFile output;
+
+    // a capture without frames
+    std::string file;
+    appendInt(file, 0xa1b2c3d4, 4, true);
+    appendInt(file, 2, 2, true);
+    appendInt(file, 4, 2, true);
+    for (uint32_t field : {0u, 0u, 65535u, 1u}) {
+        appendInt(file, field, 4, true);
+    }
+    std::ofstream{input._path, std::ios::binary} << file;
+
+    {
+        Ethernet::Manager<PcapDevice> manager{input._path, output._path};
+
+        // not TCP, the segmenter cuts nothing: the small frame goes out whole, the big one is lost
+        for (size_t size : {Ethernet::MIN_FRAME_SIZE, size_t{4000}}) {
+            Ethernet::Frame frame;
+            frame.allocPacket(size);
+            std::memset(frame.getData(), 0xff, size);
+            frame.setBufferSize(size);
+            frame.offload()._gsoType = Ethernet::Offload::GSO_TCPV4;
+            frame.offload()._gsoSize = 1448;
+            ASSERT_TRUE(manager.enqueue(frame));
+        }
+        ASSERT_EQ(manager.flush(), 1u);
+        ASSERT_EQ(manager.txFrames(), 1u);
+        ASSERT_EQ(manager.txErrors(), 1u);
+    }
+
+    std::ifstream written{output._path, std::ios::binary | std::ios::ate};
+    EXPECT_EQ(static_cast<size_t>(written.tellg()), 24 + 16 + Ethernet::MIN_FRAME_SIZE);
+}
+
+TEST(PcapDeviceTest, ReadPcapng) 
+{
+    TempFile input;
+    constexpr uint64_t timestamp = 1500000000123456789;
+
+    auto block = [](std::string& file, uint32_t type, const std::string& body) {
+        appendInt(file, type, 4);
+        appendInt(file, 12 + body.size(), 4);
+        file += body;
+        appendInt(file, 12 + body.size(), 4);
+    };
+
+    std::string file;
+    std::string body;
+    appendInt(body, 0x1a2b3c4d, 4);
+    appendInt(body, 1, 2);
+    appendInt(body, 0, 2);
+    appendInt(body, ~uint64_t{0}, 8);
+    block(file, 0x0a0d0d0a, body);
+
+    // an ethernet interface with nanosecond timestamps, then one of another link type
+    body.clear();
+    appendInt(body, PcapDevice::LINKTYPE_ETHERNET, 2);
+    appendInt(body, 0, 2);
+    appendInt(body, 0, 4);
+    appendInt(body, 9 | 1 << 16, 4);
+    appendInt(body, 9, 4);
+    appendInt(body, 0, 4);
+    block(file, 1, body);
+
+    body.clear();
+    appendInt(body, 101, 2);
+    appendInt(body, 0, 2);
+    appendInt(body, 0, 4);
+    block(file, 1, body);
+
+    for (uint32_t interface : {1u, 0u}) {
+        body.clear();
+        appendInt(body, interface, 4);
+        appendInt(body, timestamp >> 32, 4);
+        appendInt(body, timestamp & 0xffffffff, 4);
+        appendInt(body, Ethernet::MIN_FRAME_SIZE, 4);
+        appendInt(body, Ethernet::MIN_FRAME_SIZE, 4);
+        body += pcapFrame();
+        block(file, 6, body);
+    }
+
+    // a simple packet block has no timestamp of its own
+    body.clear();
+    appendInt(body, Ethernet::MIN_FRAME_SIZE, 4);
+    body += pcapFrame();
+    block(file, 3, body);
+    std::ofstream{input._path, std::ios::binary} << file;
+
+    PcapDevice device{input._path, "", false};
+    PcapDevice::Record record;
+    for (int i = 0; i < 2; ++i) {
+        ASSERT_TRUE(device.read(record));
+        EXPECT_EQ(record._length, Ethernet::MIN_FRAME_SIZE);
+        EXPECT_EQ(record._timestamp, timestamp);
+        EXPECT_EQ(std::string(record._data, record._length), pcapFrame());
+    }
+    ASSERT_FALSE(device.read(record));
+
+    device.rewind();
+    ASSERT_TRUE(device.read(record));
+}
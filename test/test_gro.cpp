@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "arp.hpp"
+#include "checksum.hpp"
+#include "ethernet.hpp"
+#include "gro.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+#include "verdict.hpp"
+
+class GROTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t IP_OFFSET  = Ethernet::HeaderLayout::SIZE;
+        static constexpr std::size_t TCP_OFFSET = IP_OFFSET + IP::HEADER_SIZE;
+        static constexpr IPAddr      CLIENT     = 0x0a090001;
+        static constexpr IPAddr      SERVER     = 0x0a090002;
+        static constexpr TCP::Port   PORT       = 7;
+
+        ARP::CacheManager _arp;
+        IP::Manager       _ip{_arp};
+        Ethernet::Burst   _burst;
+        GRO::Frames       _frames;
+        GRO::Coalescer    _gro;
+
+        void SetUp() override
+        {
+            MacAddr sender;
+            sender.addr = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+            _arp.cache().update(CLIENT, sender, Event::Clock::now());
+            _ip.routes().add(0, 0, IP::NextHop{});
+        }
+
+        /* a TCP segment from the client's port to PORT with data, checksums filled in */
+        void segment(Ethernet::Frame& frame, TCP::Port port, TCP::Seq seq, TCP::Seq ack, uint8_t flags,
+                     const std::string& data = "")
+        {
+            std::vector<char> packet = {
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00
+            };
+            size_t length = IP::HEADER_SIZE + TCP::HEADER_SIZE + data.size();
+            packet.resize(TCP_OFFSET + TCP::HEADER_SIZE);
+
+            IP::HeaderLayout::store(packet.data() + IP_OFFSET, IP::Fields1(IP::VER_IPV4, 5), 0, static_cast<IP::Length16>(length),
+                    1, IP::Fields2(IP::FLAG_NOFRAG, 0), IP::DEFAULT_TTL, static_cast<IP::Protocol>(IP::PRO_TCP), 0, CLIENT, SERVER);
+            uint16_t checksum = Inet::checksum(packet.data() + IP_OFFSET, IP::HEADER_SIZE);
+            std::memcpy(packet.data() + IP_OFFSET + IP::IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+            TCP::HeaderLayout::store(packet.data() + TCP_OFFSET, port, PORT, seq, ack,
+                    static_cast<TCP::OffsetFlags>(5 << 12 | flags), TCP::DEFAULT_WINDOW, 0, 0);
+            packet.insert(packet.end(), data.begin(), data.end());
+            uint16_t tcpLength = static_cast<uint16_t>(length - IP::HEADER_SIZE);
+            checksum = Inet::checksum(packet.data() + TCP_OFFSET, tcpLength, Inet::pseudoHeader(CLIENT, SERVER, IP::PRO_TCP, tcpLength));
+            std::memcpy(packet.data() + TCP_OFFSET + TCP::CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+            // padded to the minimum frame size, like a short segment off the wire
+            packet.resize(std::max<size_t>(packet.size(), 60));
+
+            frame.allocPacket();
+            std::memcpy(frame.getData(), packet.data(), packet.size());
+            frame.setBufferSize(packet.size());
+            frame.parseBuffer();
+        }
+
+        /* append a segment to the burst */
+        Ethernet::Frame& add(TCP::Port port, TCP::Seq seq, uint8_t flags, const std::string& data)
+        {
+            Ethernet::Frame& frame = _burst.frames[_burst.count++];
+            segment(frame, port, seq, 1, flags, data);
+            return frame;
+        }
+
+        /* the data of a coalesced segment, its own and that of the frames chained to it */
+        std::string data(Ethernet::Frame& frame)
+        {
+            IP::Length16 length;
+            Memory::Codec<IP::Length16>::load(length, frame.getPayload() + 2);
+
+            std::string data(frame.getData() + TCP_OFFSET + TCP::HEADER_SIZE, frame.getData() + IP_OFFSET + length - frame.getChainLength());
+            for (Ethernet::Frame *next = frame.getNext(); next != nullptr; next = next->getNext()) {
+                data.append(next->getData(), next->getBufferSize());
+            }
+            return data;
+        }
+};
+
+TEST_F(GROTest, mergesInOrderRuns)
+{
+    add(40000, 1000, TCP::FLAG_ACK, std::string(100, 'a'));
+    add(40001, 5000, TCP::FLAG_ACK, "x");
+    add(40000, 1100, TCP::FLAG_ACK, std::string(100, 'b'));
+    add(40000, 1200, TCP::FLAG_ACK | TCP::FLAG_PSH, std::string(100, 'c'));
+    add(40000, 1300, TCP::FLAG_ACK, std::string(100, 'd'));
+
+    // the PSH ends the first run, the other flow passes in its place
+    ASSERT_EQ(_gro.coalesce(_burst, _frames), 3u);
+    ASSERT_EQ(_frames[0], &_burst.frames[0]);
+    ASSERT_EQ(_frames[1], &_burst.frames[1]);
+    ASSERT_EQ(_frames[2], &_burst.frames[4]);
+    ASSERT_EQ(_gro.merged(), 2u);
+
+    Ethernet::Frame& head = *_frames[0];
+    ASSERT_EQ(head.getChainLength(), 200u);
+    ASSERT_EQ(data(head), std::string(100, 'a') + std::string(100, 'b') + std::string(100, 'c'));
+    ASSERT_EQ(Inet::checksum(head.getPayload(), IP::HEADER_SIZE), 0);
+    ASSERT_EQ(head.offload()._gsoType, Ethernet::Offload::GSO_TCPV4);
+    ASSERT_EQ(head.offload()._gsoSize, 100u);
+    ASSERT_TRUE(head.offload().checksumValid());
+    ASSERT_TRUE(head.getPayload()[IP::HEADER_SIZE + 13] & TCP::FLAG_PSH);
+
+    ASSERT_EQ(data(*_frames[1]), "x");
+    ASSERT_EQ(_frames[1]->getNext(), nullptr);
+}
+
+TEST_F(GROTest, keepsOrderAndChecksums)
+{
+    add(40000, 1000, TCP::FLAG_ACK, std::string(100, 'a'));
+    add(40000, 1200, TCP::FLAG_ACK, std::string(100, 'b'));
+    add(40000, 1300, TCP::FLAG_ACK, std::string(150, 'c'));
+    Ethernet::Frame& corrupt = add(40000, 1450, TCP::FLAG_ACK, std::string(150, 'd'));
+    corrupt.getData()[corrupt.getBufferSize() - 1] ^= 0x01;
+    add(40000, 1600, TCP::FLAG_ACK | TCP::FLAG_FIN, "");
+    add(40000, 1601, TCP::FLAG_ACK, "e");
+    add(40000, 1602, TCP::FLAG_ACK, "f");
+
+    // a gap, a longer segment, a bad checksum and a FIN each go by themselves; the last two merge
+    ASSERT_EQ(_gro.coalesce(_burst, _frames), 6u);
+    ASSERT_EQ(_gro.merged(), 1u);
+    for (size_t i = 0; i < 6; ++i) {
+        ASSERT_EQ(_frames[i], &_burst.frames[i]);
+    }
+    ASSERT_EQ(data(*_frames[5]), "ef");
+    ASSERT_FALSE(_frames[3]->offload().checksumValid());
+}
+
+TEST_F(GROTest, oneAcknowledgement)
+{
+    constexpr size_t SEGMENTS = 8;
+    constexpr size_t SIZE     = 1000;
+
+    _ip.tcp().listen(PORT);
+
+    Ethernet::Frame frame;
+    segment(frame, 40000, 999, 0, TCP::FLAG_SYN);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::reply());
+    TCP::Seq iss;
+    Memory::Codec<TCP::Seq>::load(iss, frame.getData() + TCP_OFFSET + 4);
+
+    segment(frame, 40000, 1000, iss + 1, TCP::FLAG_ACK);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::accept());
+
+    for (size_t i = 0; i < SEGMENTS; ++i) {
+        Ethernet::Frame& frame = _burst.frames[_burst.count++];
+        segment(frame, 40000, static_cast<TCP::Seq>(1000 + i * SIZE), iss + 1, TCP::FLAG_ACK, std::string(SIZE, 'a' + i));
+    }
+    ASSERT_EQ(_gro.coalesce(_burst, _frames), 1u);
+
+    // the whole run is taken and acknowledged at once
+    Ethernet::Frame& head = *_frames[0];
+    ASSERT_EQ(_ip.handleMessage(head), Verdict::reply());
+    ASSERT_EQ(head.getNext(), nullptr);
+
+    TCP::Seq ack;
+    Memory::Codec<TCP::Seq>::load(ack, head.getData() + TCP_OFFSET + 8);
+    ASSERT_EQ(ack, 1000 + SEGMENTS * SIZE);
+
+    TCP::Connection *connection = _ip.tcp().find(TCP::Key{SERVER, CLIENT, PORT, 40000});
+    ASSERT_NE(connection, nullptr);
+    ASSERT_EQ(_ip.tcp().table().stats(connection)._bytesIn, SEGMENTS * SIZE);
+    // the SYN, its ACK and the run
+    ASSERT_EQ(_ip.tcp().table().stats(connection)._segmentsIn, 3u);
+}
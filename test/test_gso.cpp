@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "arp.hpp"
+#include "checksum.hpp"
+#include "ethernet.hpp"
+#include "gro.hpp"
+#include "gso.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+#include "verdict.hpp"
+
+class GSOTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t IP_OFFSET  = Ethernet::HeaderLayout::SIZE;
+        static constexpr std::size_t TCP_OFFSET = IP_OFFSET + IP::HEADER_SIZE;
+        static constexpr std::size_t PAYLOAD    = 4000;
+        static constexpr IPAddr      LOCAL      = 0x0a090002;
+        static constexpr IPAddr      REMOTE     = 0x0a090001;
+
+        ARP::CacheManager _arp;
+        IP::Manager       _ip{_arp};
+        std::string       _data;
+
+        void SetUp() override
+        {
+            MacAddr remote;
+            remote.addr = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+            _arp.cache().update(REMOTE, remote, Event::Clock::now());
+            _ip.routes().add(0, 0, IP::NextHop{});
+
+            for (std::size_t i = 0; i < PAYLOAD; ++i) {
+                _data.push_back(static_cast<char>(i * 7));
+            }
+        }
+
+        /* one TCP segment with all of _data, as output() hands it to the device */
+        void gsoFrame(Ethernet::Frame& frame, uint8_t flags)
+        {
+            frame.allocPacket(TCP::HEADER_SIZE + PAYLOAD);
+            TCP::HeaderLayout::store(frame.getData(), 7, 40000, 1000, 2000, static_cast<TCP::OffsetFlags>(5 << 12 | flags),
+                                     TCP::DEFAULT_WINDOW, 0, 0);
+            std::memcpy(frame.getData() + TCP::HEADER_SIZE, _data.data(), PAYLOAD);
+            frame.setBufferSize(TCP::HEADER_SIZE + PAYLOAD);
+
+            ASSERT_EQ(_ip.output(frame, LOCAL, REMOTE, IP::PRO_TCP, true), Verdict::reply());
+            ASSERT_EQ(frame.offload()._gsoType, Ethernet::Offload::GSO_TCPV4);
+        }
+
+        /* the segment as the device would send it */
+        std::vector<char> wire(const GSO::Segment& segment)
+        {
+            std::vector<char> frame(segment._headers.begin(), segment._headers.begin() + segment._headerLength);
+            frame.insert(frame.end(), segment._payload, segment._payload + segment._payloadSize);
+            return frame;
+        }
+};
+
+TEST_F(GSOTest, segments)
+{
+    constexpr std::size_t SEGMENT_SIZE = Ethernet::MTU - IP::HEADER_SIZE - TCP::HEADER_SIZE;
+
+    Ethernet::Frame frame;
+    gsoFrame(frame, TCP::FLAG_ACK | TCP::FLAG_PSH | TCP::FLAG_FIN | TCP::FLAG_CWR);
+
+    GSO::Segmenter segmenter{frame};
+    ASSERT_EQ(segmenter.segments(), 3u);
+
+    IP::ID firstId = 0;
+    std::string data;
+    GSO::Segment segment;
+    for (std::size_t i = 0; segmenter.next(segment); ++i) {
+        std::vector<char> packet = wire(segment);
+        std::size_t size = (i < 2) ? SEGMENT_SIZE : PAYLOAD - 2 * SEGMENT_SIZE;
+        ASSERT_EQ(segment._payloadSize, size);
+        ASSERT_EQ(packet.size(), TCP_OFFSET + TCP::HEADER_SIZE + size);
+
+        IP::Header ip;
+        ASSERT_TRUE(ip.readFromBuffer(packet.data() + IP_OFFSET, packet.size() - IP_OFFSET));
+        ASSERT_EQ(ip.getPayloadSize(), TCP::HEADER_SIZE + size);
+        ASSERT_EQ(Inet::checksum(packet.data() + IP_OFFSET, IP::HEADER_SIZE), 0);
+
+        IP::ID id;
+        Memory::Codec<IP::ID>::load(id, packet.data() + IP_OFFSET + IP::IP_ID_OFFSET);
+        if (i == 0) {
+            firstId = id;
+        }
+        ASSERT_EQ(id, static_cast<IP::ID>(firstId + i));
+
+        TCP::Header tcp;
+        ASSERT_TRUE(tcp.readFromBuffer(packet.data() + TCP_OFFSET, TCP::HEADER_SIZE + size));
+        ASSERT_EQ(tcp.getSeq(), 1000 + i * SEGMENT_SIZE);
+        ASSERT_EQ(tcp.getAck(), 2000u);
+        ASSERT_EQ(Inet::checksum(packet.data() + TCP_OFFSET, TCP::HEADER_SIZE + size,
+                  Inet::pseudoHeader(LOCAL, REMOTE, IP::PRO_TCP, static_cast<uint16_t>(TCP::HEADER_SIZE + size))), 0);
+
+        // FIN and PSH end the run, CWR starts it
+        uint8_t flags = static_cast<uint8_t>(packet[TCP_OFFSET + 13]);
+        ASSERT_EQ(flags, TCP::FLAG_ACK | (i == 2 ? TCP::FLAG_PSH | TCP::FLAG_FIN : 0) | (i == 0 ? TCP::FLAG_CWR : 0));
+
+        data.append(segment._payload, segment._payloadSize);
+    }
+    ASSERT_EQ(data, _data);
+}
+
+TEST_F(GSOTest, coalescesBack)
+{
+    Ethernet::Frame frame;
+    gsoFrame(frame, TCP::FLAG_ACK | TCP::FLAG_PSH);
+
+    // what GSO cuts up, GRO puts back together
+    Ethernet::Burst burst;
+    GSO::Segmenter segmenter{frame};
+    GSO::Segment segment;
+    while (segmenter.next(segment)) {
+        std::vector<char> packet = wire(segment);
+        Ethernet::Frame& received = burst.frames[burst.count++];
+        received.allocPacket();
+        std::memcpy(received.getData(), packet.data(), packet.size());
+        received.setBufferSize(packet.size());
+        received.parseBuffer();
+    }
+
+    GRO::Coalescer gro;
+    GRO::Frames frames;
+    ASSERT_EQ(gro.coalesce(burst, frames), 1u);
+
+    Ethernet::Frame& head = *frames[0];
+    ASSERT_EQ(Inet::checksum(head.getPayload(), IP::HEADER_SIZE), 0);
+    ASSERT_EQ(head.getPayloadSize() + head.getChainLength(), IP::HEADER_SIZE + TCP::HEADER_SIZE + PAYLOAD);
+
+    std::string data(head.getPayload() + IP::HEADER_SIZE + TCP::HEADER_SIZE, head.getPayload() + head.getPayloadSize());
+    for (Ethernet::Frame *next = head.getNext(); next != nullptr; next = next->getNext()) {
+        data.append(next->getData(), next->getBufferSize());
+    }
+    ASSERT_EQ(data, _data);
+}
+
+TEST_F(GSOTest, completeChecksum)
+{
+    Ethernet::Frame frame;
+    gsoFrame(frame, TCP::FLAG_ACK);
+
+    // in one piece, as a device with checksum offload but no TSO would get it
+    frame.offload()._gsoType = Ethernet::Offload::GSO_NONE;
+    GSO::completeChecksum(frame);
+
+    ASSERT_FALSE(frame.offload()._flags & Ethernet::Offload::CHECKSUM_PARTIAL);
+    ASSERT_EQ(Inet::checksum(frame.getData() + TCP_OFFSET, TCP::HEADER_SIZE + PAYLOAD,
+              Inet::pseudoHeader(LOCAL, REMOTE, IP::PRO_TCP, TCP::HEADER_SIZE + PAYLOAD)), 0);
+
+    // a plain frame is left alone
+    std::vector<char> before(frame.getData(), frame.getData() + frame.getBufferSize());
+    GSO::completeChecksum(frame);
+    ASSERT_EQ(std::memcmp(before.data(), frame.getData(), before.size()), 0);
+}
@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+#include "arp.hpp"
+#include "ethernet.hpp"
+#include "ip.hpp"
+#include "layout.hpp"
+
+static_assert(Ethernet::HeaderLayout::SIZE == 14);
+static_assert(ARP::HeaderLayout::SIZE == 8);
+static_assert(ARP::PayloadIPv4Layout::SIZE == 20);
+static_assert(IP::HEADER_SIZE == 20);
+static_assert(IP::IP_CHECKSUM_OFFSET == 10);
+static_assert(IP::IP_DST_OFFSET == 16);
+
+class LayoutTest : public testing::Test
+{
+    protected:
+        // 20 bytes IPv4 header of an ICMP echo request from 10.9.0.1 to 10.9.0.2.
+        const unsigned char _ipHeader[20] = {
+            0x45, 0x00, 0x00, 0x54, 0x12, 0x34, 0x40, 0x00, 0x40, 0x01,
+            0xab, 0xcd, 0x0a, 0x09, 0x00, 0x01, 0x0a, 0x09, 0x00, 0x02
+        };
+
+        IP::Fields1  _f1;
+        IP::TOS      _tos;
+        IP::Length16 _length;
+        IP::ID       _id;
+        IP::Fields2  _f2;
+        IP::TTL      _ttl;
+        IP::Protocol _proto;
+        IP::Checksum _checksum;
+        IPAddr       _srcAddr;
+        IPAddr       _dstAddr;
+};
+
+TEST_F(LayoutTest, readIPHeader)
+{
+    const char *buffer = reinterpret_cast<const char*>(_ipHeader);
+
+    ASSERT_TRUE(IP::HeaderLayout::read(buffer, sizeof(_ipHeader), _f1, _tos, _length, _id, _f2,
+                _ttl, _proto, _checksum, _srcAddr, _dstAddr));
+
+    ASSERT_EQ(_f1._version, 4);
+    ASSERT_EQ(_f1._ihl, 5);
+    ASSERT_EQ(_tos, 0);
+    ASSERT_EQ(_length, 0x54);
+    ASSERT_EQ(_id, 0x1234);
+    ASSERT_EQ(_f2._flags, IP::FLAG_NOFRAG);
+    ASSERT_EQ(_f2._fragOffset, 0);
+    ASSERT_EQ(_ttl, 0x40);
+    ASSERT_EQ(_proto, IP::PRO_ICMP);
+    ASSERT_EQ(_checksum, 0xabcd);
+    ASSERT_EQ(_srcAddr, 0x0a090001u);
+    ASSERT_EQ(_dstAddr, 0x0a090002u);
+}
+
+TEST_F(LayoutTest, writeRoundTrip)
+{
+    const char *buffer = reinterpret_cast<const char*>(_ipHeader);
+    IP::HeaderLayout::load(buffer, _f1, _tos, _length, _id, _f2, _ttl, _proto, _checksum, _srcAddr, _dstAddr);
+
+    char output[IP::HEADER_SIZE];
+    ASSERT_TRUE(IP::HeaderLayout::write(output, sizeof(output), _f1, _tos, _length, _id, _f2,
+                _ttl, _proto, _checksum, _srcAddr, _dstAddr));
+    ASSERT_EQ(std::memcmp(output, _ipHeader, sizeof(output)), 0);
+}
+
+TEST_F(LayoutTest, shortBuffer)
+{
+    const char *buffer = reinterpret_cast<const char*>(_ipHeader);
+    _ttl = 0;
+
+    ASSERT_FALSE(IP::HeaderLayout::read(buffer, IP::HEADER_SIZE - 1, _f1, _tos, _length, _id, _f2,
+                _ttl, _proto, _checksum, _srcAddr, _dstAddr));
+    ASSERT_EQ(_ttl, 0);
+
+    char output[IP::HEADER_SIZE - 1];
+    ASSERT_FALSE(IP::HeaderLayout::write(output, sizeof(output), _f1, _tos, _length, _id, _f2,
+                _ttl, _proto, _checksum, _srcAddr, _dstAddr));
+}
+
+TEST_F(LayoutTest, ethernetHeader)
+{
+    const unsigned char raw[14] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06
+    };
+
+    MacAddr dst;
+    MacAddr src;
+    EtherType type;
+    ASSERT_TRUE(Ethernet::HeaderLayout::read(reinterpret_cast<const char*>(raw), sizeof(raw), dst, src, type));
+
+    ASSERT_EQ(dst.addr[0], 0xff);
+    ASSERT_EQ(src.addr[0], 0x02);
+    ASSERT_EQ(src.addr[5], 0x01);
+    ASSERT_EQ(type, PRO_ARP);
+
+    char output[sizeof(raw)];
+    Ethernet::HeaderLayout::store(output, dst, src, type);
+    ASSERT_EQ(std::memcmp(output, raw, sizeof(raw)), 0);
+}
@@ -2,6 +2,9 @@
 
 #include <vector>
 #include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
 
 #include "memorypool.hpp"
 
@@ -25,21 +28,19 @@ class ObjectPoolTest : public testing::Test
 
 TEST_F(ObjectPoolTest, Constructor)
 {
-    auto memPtr = _objectPool.memory();
-
-    ASSERT_EQ(memPtr->size(), _size);
+    ASSERT_EQ(_objectPool.totalBlocks(), _size);
+    ASSERT_EQ(_objectPool.freeBlocks()->size(), _size);
 }
 
 TEST_F(ObjectPoolTest, normalAllocation)
 {
-    auto memPtr = _objectPool.memory();
     auto stackPtr = _objectPool.freeBlocks();
     std::size_t topBlock = stackPtr->top();
 
     TestClass* object = _objectPool.allocate();
 
     ASSERT_NE(topBlock, stackPtr->top());
-    ASSERT_EQ(&((*memPtr)[topBlock]), object);
+    ASSERT_EQ(_objectPool.block(topBlock), object);
 }
 
 TEST_F(ObjectPoolTest, normalDeallocation)
@@ -68,7 +69,7 @@ TEST_F(ObjectPoolTest, overAllocation)
         }
         catch( const std::runtime_error& err) {
         
-            ASSERT_STREQ("memorypool.cpp: Memory::ObjectPool<T>::allocate(): there aren't any free blocks", err.what());
+            ASSERT_STREQ("memorypool.hpp: Memory::ObjectPool<T>::allocate(): there aren't any free blocks", err.what());
             throw;
         }
     }, std::runtime_error);
@@ -79,6 +80,67 @@ TEST_F(ObjectPoolTest, overAllocation)
     }
 }
 
+TEST_F(ObjectPoolTest, tryAllocation)
+{
+    std::vector<TestClass*> vec(_size);
+
+    for (std::size_t i = 0; i < _size; ++i) {
+        vec[i] = _objectPool.tryAllocate();       
+        ASSERT_NE(vec[i], nullptr);
+    }
+
+    ASSERT_EQ(_objectPool.tryAllocate(), nullptr);
+
+    for (std::size_t i = 0; i < _size; ++i) {
+        _objectPool.deallocate(vec[i]);       
+    }
+}
+
+TEST(GrowableObjectPoolTest, growAndShrink)
+{
+    constexpr std::size_t slab = 100;
+    constexpr std::size_t max = 300;
+    Memory::ObjectPool<TestClass> objectPool{slab, max};
+
+    std::vector<TestClass*> vec;
+    for (std::size_t i = 0; i < max; ++i) {
+        vec.push_back(objectPool.allocate());
+    }
+    ASSERT_EQ(objectPool.totalBlocks(), max);
+    ASSERT_EQ(objectPool.tryAllocate(), nullptr);
+
+    // blocks from every slab go back to the right index.
+    for (std::size_t i = 0; i < max; ++i) {
+        objectPool.deallocate(vec[i]);
+        ASSERT_EQ(objectPool.block(objectPool.freeBlocks()->top()), vec[i]);
+    }
+
+    objectPool.shrink();
+    ASSERT_EQ(objectPool.totalBlocks(), slab);
+    ASSERT_EQ(objectPool.freeBlocks()->size(), slab);
+
+    // growing again after a shrink.
+    vec.clear();
+    for (std::size_t i = 0; i < 2 * slab; ++i) {
+        vec.push_back(objectPool.allocate());
+    }
+    ASSERT_EQ(objectPool.totalBlocks(), 2 * slab);
+
+    objectPool.shrink();
+    ASSERT_EQ(objectPool.totalBlocks(), 2 * slab);
+
+    for (TestClass* object : vec) {
+        objectPool.deallocate(object);
+    }
+}
+
+TEST(GrowableObjectPoolTest, emptySlab)
+{
+    using Pool = Memory::ObjectPool<TestClass>;
+
+    ASSERT_THROW(Pool(0, 100), std::runtime_error);
+}
+
 TEST_F(ObjectPoolTest, nullDeallocation)
 {
     TestClass* object = nullptr;
@@ -88,12 +150,193 @@ TEST_F(ObjectPoolTest, nullDeallocation)
         }
         catch( const std::runtime_error& err) {
         
-            ASSERT_STREQ("memorypool.cpp: Memory::ObjectPool<T>::deallocate(): block is nullptr", err.what());
+            ASSERT_STREQ("memorypool.hpp: Memory::ObjectPool<T>::deallocate(): block is nullptr", err.what());
             throw;
         }
     }, std::runtime_error);
 }
 
+class ConcurrentObjectPoolTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t _size = 1000;
+        Memory::ConcurrentObjectPool<TestClass> _objectPool;
+
+        ConcurrentObjectPoolTest() : _objectPool{_size} {}
+};
+
+TEST_F(ConcurrentObjectPoolTest, Constructor)
+{
+    ASSERT_EQ(_objectPool.totalBlocks(), _size);
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+}
+
+TEST_F(ConcurrentObjectPoolTest, normalAllocation)
+{
+    std::unordered_set<TestClass*> objects;
+
+    for (std::size_t i = 0; i < _size; ++i) {
+        TestClass* object = _objectPool.allocate();
+
+        ASSERT_GE(object, _objectPool.block(0));
+        ASSERT_LE(object, _objectPool.block(_size - 1));
+        ASSERT_TRUE(objects.insert(object).second) << "block handed out twice";
+    }
+    ASSERT_EQ(_objectPool.freeBlocks(), 0);
+
+    ASSERT_THROW(_objectPool.allocate(), std::runtime_error);
+    ASSERT_EQ(_objectPool.tryAllocate(), nullptr);
+
+    for (TestClass* object : objects) {
+        _objectPool.deallocate(object);
+    }
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+}
+
+TEST_F(ConcurrentObjectPoolTest, nullDeallocation)
+{
+    ASSERT_THROW(_objectPool.deallocate(nullptr), std::runtime_error);
+}
+
+TEST(GrowableConcurrentObjectPoolTest, grow)
+{
+    constexpr std::size_t slab = 64;
+    constexpr std::size_t max = 256;
+    Memory::ConcurrentObjectPool<TestClass> objectPool{slab, max};
+
+    std::unordered_set<TestClass*> objects;
+    for (std::size_t i = 0; i < max; ++i) {
+        ASSERT_TRUE(objects.insert(objectPool.allocate()).second) << "block handed out twice";
+    }
+    ASSERT_EQ(objectPool.totalBlocks(), max);
+    ASSERT_EQ(objectPool.tryAllocate(), nullptr);
+
+    for (TestClass* object : objects) {
+        objectPool.deallocate(object);
+    }
+    ASSERT_EQ(objectPool.freeBlocks(), max);
+}
+
+TEST_F(ConcurrentObjectPoolTest, crossThreadDeallocation)
+{
+    // every thread frees the blocks allocated by the previous one.
+    constexpr std::size_t threads = 4;
+    constexpr std::size_t rounds = 2000;
+    constexpr std::size_t batch = 50;
+
+    std::mutex lock;
+    std::vector<std::vector<int*>> handOff(threads);
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            for (std::size_t r = 0; r < rounds; ++r) {
+                std::vector<int*> owned;
+                for (std::size_t i = 0; i < batch; ++i) {
+                    int* stamp = reinterpret_cast<int*>(_objectPool.allocate());
+                    *stamp = static_cast<int>(t);
+                    owned.push_back(stamp);
+                }
+
+                for (int* stamp : owned) {
+                    ASSERT_EQ(*stamp, static_cast<int>(t)) << "block shared by two threads";
+                }
+
+                // keep the hand-off bounded when the next thread is already done.
+                std::vector<int*> foreign;
+                {
+                    std::lock_guard<std::mutex> guard{lock};
+                    foreign.swap(handOff[(t + 1) % threads]);
+                    if (handOff[t].size() < 2 * batch) {
+                        handOff[t].insert(handOff[t].end(), owned.begin(), owned.end());
+                    } else {
+                        foreign.insert(foreign.end(), owned.begin(), owned.end());
+                    }
+                }
+
+                for (int* stamp : foreign) {
+                    _objectPool.deallocate(stamp);
+                }
+            }
+        });
+    }
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    for (auto& blocks : handOff) {
+        for (int* stamp : blocks) {
+            _objectPool.deallocate(stamp);
+        }
+    }
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+}
+
+TEST_F(ConcurrentObjectPoolTest, threadExitReclaimsMagazine)
+{
+    // the blocks a thread freed into its magazine aren't stranded once it is gone
+    std::thread([this]() {
+        std::vector<TestClass*> objects;
+        for (std::size_t i = 0; i < 10; ++i) {
+            objects.push_back(_objectPool.allocate());
+        }
+        for (TestClass* object : objects) {
+            _objectPool.deallocate(object);
+        }
+    }).join();
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+
+    std::vector<TestClass*> objects;
+    for (std::size_t i = 0; i < _size; ++i) {
+        objects.push_back(_objectPool.allocate());
+    }
+    ASSERT_EQ(_objectPool.tryAllocate(), nullptr);
+
+    for (TestClass* object : objects) {
+        _objectPool.deallocate(object);
+    }
+}
+
+TEST_F(ConcurrentObjectPoolTest, threadSlotsAreReused)
+{
+    for (std::size_t i = 0; i < 4 * Memory::MAX_THREADS; ++i) {
+        std::size_t slot = Memory::NO_SLOT;
+        std::thread([&]() {
+            _objectPool.deallocate(_objectPool.allocate());
+            slot = Memory::threadSlot();
+        }).join();
+        ASSERT_LT(slot, Memory::MAX_THREADS) << "thread " << i << " got no slot";
+    }
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+}
+
+TEST_F(ConcurrentObjectPoolTest, remoteFreesReturnToOwner)
+{
+    std::vector<TestClass*> objects;
+    for (std::size_t i = 0; i < _size; ++i) {
+        objects.push_back(_objectPool.allocate());
+    }
+
+    // freed by another thread, the blocks wait on our remote list and come back to us
+    std::thread([&]() {
+        for (TestClass* object : objects) {
+            _objectPool.deallocate(object);
+        }
+    }).join();
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+
+    for (std::size_t i = 0; i < _size; ++i) {
+        objects[i] = _objectPool.allocate();
+    }
+    ASSERT_EQ(_objectPool.tryAllocate(), nullptr);
+
+    for (TestClass* object : objects) {
+        _objectPool.deallocate(object);
+    }
+    ASSERT_EQ(_objectPool.freeBlocks(), _size);
+}
+
 #define PERFORMANCE_TESTS   1000
 
 TEST_F(ObjectPoolTest, objectPoolPerformance)
@@ -111,3 +354,11 @@ TEST_F(ObjectPoolTest, DefaultNewPerformance)
         delete object;
     }
 }
+
+TEST_F(ConcurrentObjectPoolTest, objectPoolPerformance)
+{
+    for (int i = 0; i < PERFORMANCE_TESTS; ++i) {
+        TestClass* object = _objectPool.allocate();       
+        _objectPool.deallocate(object);
+    }
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "packetbuffer.hpp"
+
+class PacketBufferTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t _headroom = Memory::PacketBuffer::DEFAULT_HEADROOM;
+        Memory::BuddyPool& _pool;
+        std::size_t _topBlocks;
+
+        PacketBufferTest() 
+            : _pool{Memory::packetBufferPool()}, 
+              _topBlocks{(*_pool.orderBlocksList())[_pool.totalOrder() - 1].size()} {}
+
+        ~PacketBufferTest()
+        {
+            EXPECT_EQ((*_pool.orderBlocksList())[_pool.totalOrder() - 1].size(), _topBlocks) << "buffer leaked";
+        }
+};
+
+TEST_F(PacketBufferTest, SizeClasses)
+{
+    Memory::PacketBuffer arp = Memory::PacketBuffer::allocate(60);
+    Memory::PacketBuffer full = Memory::PacketBuffer::allocate(1518);
+
+    ASSERT_TRUE(arp);
+    ASSERT_EQ(arp.capacity(), 128);
+    ASSERT_EQ(arp.headroom(), _headroom);
+    ASSERT_EQ(arp.length(), 0);
+    ASSERT_EQ(arp.tailroom(), 128 - _headroom);
+
+    ASSERT_TRUE(full);
+    ASSERT_EQ(full.capacity(), 2048);
+}
+
+TEST_F(PacketBufferTest, PushPull)
+{
+    Memory::PacketBuffer buffer = Memory::PacketBuffer::allocate(100);
+
+    char* payload = buffer.put(20);
+    std::memset(payload, 'p', 20);
+    ASSERT_EQ(buffer.length(), 20);
+
+    char* header = buffer.push(14);
+    ASSERT_EQ(header + 14, payload);
+    ASSERT_EQ(buffer.length(), 34);
+    ASSERT_EQ(buffer.headroom(), _headroom - 14);
+
+    ASSERT_EQ(buffer.pull(14), payload);
+    ASSERT_EQ(buffer.length(), 20);
+
+    ASSERT_EQ(buffer.push(_headroom + 1), nullptr);
+    ASSERT_EQ(buffer.pull(21), nullptr);
+    ASSERT_EQ(buffer.put(buffer.tailroom() + 1), nullptr);
+
+    buffer.trim(5);
+    ASSERT_EQ(buffer.length(), 15);
+
+    buffer.reset();
+    ASSERT_EQ(buffer.length(), 0);
+    ASSERT_EQ(buffer.headroom(), _headroom);
+}
+
+TEST_F(PacketBufferTest, LargeBlocks)
+{
+    Memory::PacketBuffer big = Memory::PacketBuffer::allocate(65535);
+
+    ASSERT_TRUE(big);
+    ASSERT_EQ(big.capacity(), Memory::PacketBuffer::LARGE_SIZE);
+    ASSERT_NE(big.put(65535), nullptr);
+
+    // a released block is handed out again rather than going back to the heap
+    const char* data = big.data();
+    big = Memory::PacketBuffer{};
+    big = Memory::PacketBuffer::allocate(4000);
+    ASSERT_EQ(big.capacity(), Memory::PacketBuffer::LARGE_SIZE);
+    ASSERT_EQ(big.data(), data);
+}
+
+TEST_F(PacketBufferTest, HeapFallback)
+{
+    std::size_t size = Memory::PacketBuffer::LARGE_SIZE;
+    Memory::PacketBuffer huge = Memory::PacketBuffer::allocate(size);
+
+    ASSERT_TRUE(huge);
+    ASSERT_EQ(huge.capacity(), size + _headroom);
+    ASSERT_NE(huge.put(size), nullptr);
+}
+
+TEST_F(PacketBufferTest, MoveAndExhaustion)
+{
+    std::vector<Memory::PacketBuffer> buffers;
+    while (true) {
+        Memory::PacketBuffer buffer = Memory::PacketBuffer::allocate(1500);
+        if (!buffer) {
+            break;
+        }
+        buffers.push_back(std::move(buffer));
+    }
+
+    ASSERT_EQ(buffers.size(), _topBlocks);
+    ASSERT_FALSE(Memory::PacketBuffer::allocate(1500));
+
+    Memory::PacketBuffer moved = std::move(buffers.back());
+    buffers.pop_back();
+    ASSERT_TRUE(moved);
+}
+
+TEST_F(PacketBufferTest, BorrowAndOwn)
+{
+    std::vector<char> ring(256, 'x');
+
+    Memory::PacketBuffer buffer = Memory::PacketBuffer::borrow(ring.data(), 200, 32);
+    ASSERT_TRUE(buffer.borrowed());
+    ASSERT_EQ(buffer.data(), ring.data() + 32);
+    ASSERT_EQ(buffer.tailroom(), 168);
+    std::memcpy(buffer.put(4), "abcd", 4);
+
+    // the copy keeps headroom and tailroom, the ring is left alone when it goes
+    ASSERT_TRUE(buffer.own());
+    ASSERT_FALSE(buffer.borrowed());
+    ASSERT_NE(buffer.data(), ring.data() + 32);
+    ASSERT_EQ(std::string(buffer.data(), buffer.length()), "abcd");
+    ASSERT_EQ(buffer.headroom(), 32);
+    ASSERT_GE(buffer.tailroom(), 164);
+
+    Memory::PacketBuffer other = Memory::PacketBuffer::borrow(ring.data(), 200, 32);
+    other = Memory::PacketBuffer{};
+    ASSERT_EQ(ring[32], 'a');
+}
+
+TEST_F(PacketBufferTest, ReleasedByAnotherThread)
+{
+    auto& topBlocks = (*_pool.orderBlocksList())[_pool.totalOrder() - 1];
+    std::vector<Memory::PacketBuffer> buffers;
+    for (int i = 0; i < 8; ++i) {
+        buffers.push_back(Memory::PacketBuffer::allocate(1518));
+    }
+    ASSERT_EQ(topBlocks.size(), _topBlocks - 8);
+
+    // another thread can't touch our pool, the blocks wait until our next allocation
+    std::thread([&buffers] { buffers.clear(); }).join();
+    ASSERT_EQ(topBlocks.size(), _topBlocks - 8);
+
+    Memory::PacketBuffer buffer = Memory::PacketBuffer::allocate(60);
+    ASSERT_TRUE(buffer);
+    ASSERT_EQ(topBlocks.size(), _topBlocks - 1);
+}
+
+TEST_F(PacketBufferTest, PoolOutlivesItsThread)
+{
+    // the thread is gone before its buffer is released, its pool is taken over by the next thread
+    Memory::PacketBuffer buffer;
+    Memory::BuddyPool* pool = nullptr;
+    std::thread([&] {
+        buffer = Memory::PacketBuffer::allocate(100);
+        pool = &Memory::packetBufferPool();
+    }).join();
+    ASSERT_TRUE(buffer);
+    std::memset(buffer.data(), 'a', 100);
+    buffer = Memory::PacketBuffer{};
+
+    std::thread([pool] {
+        Memory::BuddyPool& taken = Memory::packetBufferPool();
+        ASSERT_EQ(&taken, pool);
+
+        auto& topBlocks = (*taken.orderBlocksList())[taken.totalOrder() - 1];
+        Memory::PacketBuffer buffer = Memory::PacketBuffer::allocate(2048 - _headroom);
+        buffer = Memory::PacketBuffer{};
+        ASSERT_EQ(topBlocks.size(), 2048);
+    }).join();
+}
@@ -0,0 +1,240 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include "arp.hpp"
+#include "checksum.hpp"
+#include "ethernet.hpp"
+#include "ip.hpp"
+#include "reassembly.hpp"
+#include "timerwheel.hpp"
+#include "verdict.hpp"
+
+using namespace std::chrono_literals;
+
+class ReassemblyTest : public testing::Test
+{
+    protected:
+        static constexpr std::size_t IP_OFFSET   = Ethernet::HeaderLayout::SIZE;
+        static constexpr std::size_t ICMP_OFFSET = IP_OFFSET + IP::HEADER_SIZE;
+        static constexpr std::size_t ICMP_SIZE   = 72;
+
+        ARP::CacheManager     _arp;
+        IP::Manager           _ip{_arp};
+        Verdict::DropCounters _drops;
+
+        // ICMP echo request from 10.9.0.1 to 10.9.0.2 with 64 bytes of data
+        std::vector<unsigned char> _icmp;
+
+        void SetUp() override
+        {
+            _icmp = {0x08, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x01};
+            for (std::size_t i = 0; i < ICMP_SIZE - 8; ++i) {
+                _icmp.push_back(static_cast<unsigned char>(i));
+            }
+
+            uint16_t checksum = Inet::checksum(_icmp.data(), _icmp.size());
+            std::memcpy(_icmp.data() + IP::ICMP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+            MacAddr sender;
+            sender.addr = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+            _arp.cache().update(0x0a090001, sender, Event::Clock::now());
+            _ip.routes().add(0, 0, IP::NextHop{});
+        }
+
+        /* the bytes [offset, offset + length) of the ICMP message as a fragment of datagram id */
+        Ethernet::Frame fragment(uint16_t id, std::size_t offset, std::size_t length, bool more, uint32_t src = 0x0a090001)
+        {
+            std::vector<unsigned char> packet = {
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00
+            };
+            packet.resize(ICMP_OFFSET);
+            IP::HeaderLayout::store(reinterpret_cast<char*>(packet.data() + IP_OFFSET), IP::Fields1(IP::VER_IPV4, 5), 0,
+                    static_cast<IP::Length16>(IP::HEADER_SIZE + length), id,
+                    IP::Fields2(more ? IP::FLAG_MORE : 0, static_cast<uint16_t>(offset / 8)), IP::DEFAULT_TTL,
+                    static_cast<IP::Protocol>(IP::PRO_ICMP), 0, src, 0x0a090002);
+            uint16_t checksum = Inet::checksum(packet.data() + IP_OFFSET, IP::HEADER_SIZE);
+            std::memcpy(packet.data() + IP_OFFSET + IP::IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+            packet.insert(packet.end(), _icmp.begin() + offset, _icmp.begin() + offset + length);
+
+            Ethernet::Frame frame;
+            frame.allocPacket();
+            std::memcpy(frame.getData(), packet.data(), packet.size());
+            frame.setBufferSize(packet.size());
+            frame.parseBuffer();
+            return frame;
+        }
+
+        Verdict::Result send(Ethernet::Frame frame)
+        {
+            return _ip.handleMessage(frame);
+        }
+
+        /* hand a fragment straight to reassembler, true if it completed a datagram */
+        bool add(IP::Reassembler& reassembler, Ethernet::Frame frame, Verdict::Result& verdict)
+        {
+            IP::Header header;
+            header.readFromBuffer(frame.getPayload(), frame.getPayloadSize());
+            return reassembler.add(frame, header, verdict);
+        }
+};
+
+TEST_F(ReassemblyTest, echoFromFragments)
+{
+    // out of order, the reply comes back once the last hole is filled
+    Ethernet::Frame last = fragment(0x42, 48, 24, false);
+    ASSERT_EQ(_ip.handleMessage(last), Verdict::accept());
+    ASSERT_FALSE(last.hasBuffer());
+    ASSERT_EQ(send(fragment(0x42, 0, 24, true)), Verdict::accept());
+    ASSERT_EQ(_ip.reassembly().datagrams(), 1u);
+
+    Ethernet::Frame middle = fragment(0x42, 24, 24, true);
+    ASSERT_EQ(_ip.handleMessage(middle), Verdict::reply());
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+    ASSERT_EQ(_ip.reassembly().memory(), 0u);
+
+    const char *data = middle.getData();
+    ASSERT_EQ(middle.getBufferSize(), ICMP_OFFSET + ICMP_SIZE);
+    ASSERT_EQ(Inet::checksum(data + IP_OFFSET, IP::HEADER_SIZE), 0);
+    ASSERT_EQ(Inet::checksum(data + ICMP_OFFSET, ICMP_SIZE), 0);
+    ASSERT_EQ(static_cast<uint8_t>(data[ICMP_OFFSET]), IP::TYPE_REPLY);
+    ASSERT_EQ(std::memcmp(data + ICMP_OFFSET + 8, _icmp.data() + 8, ICMP_SIZE - 8), 0);
+
+    // the flags and offset of the rebuilt header are those of an unfragmented datagram
+    ASSERT_EQ(data[IP_OFFSET + 6] & 0x3f, 0);
+    ASSERT_EQ(data[IP_OFFSET + 7], 0);
+}
+
+TEST_F(ReassemblyTest, overlapAndDuplicates)
+{
+    ASSERT_EQ(send(fragment(1, 0, 24, true)), Verdict::accept());
+    ASSERT_EQ(send(fragment(1, 0, 24, true)), Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_DUPLICATE));
+    ASSERT_EQ(_ip.reassembly().datagrams(), 1u);
+
+    // an overlap with different bounds takes the whole datagram with it
+    ASSERT_EQ(send(fragment(1, 16, 16, true)), Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_OVERLAP));
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+    ASSERT_EQ(_ip.reassembly().memory(), 0u);
+    ASSERT_EQ(send(fragment(1, 48, 24, false)), Verdict::accept());
+}
+
+TEST_F(ReassemblyTest, invalidFragments)
+{
+    // all but the last fragment carry multiples of 8 bytes
+    ASSERT_EQ(send(fragment(2, 0, 20, true)), Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_INVALID));
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+
+    // the end can't move once the last fragment is in, nor fall before data already received
+    ASSERT_EQ(send(fragment(3, 24, 8, false)), Verdict::accept());
+    ASSERT_EQ(send(fragment(3, 40, 8, true)), Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_INVALID));
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+
+    ASSERT_EQ(send(fragment(4, 24, 24, true)), Verdict::accept());
+    ASSERT_EQ(send(fragment(4, 16, 8, false)), Verdict::drop(Verdict::Reason::IPV4_FRAGMENT_INVALID));
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+}
+
+TEST_F(ReassemblyTest, timeout)
+{
+    Event::Clock::time_point start = Event::Clock::now();
+    Event::TimerWheel timers{1ms, start};
+    _ip.attach(timers, nullptr, &_drops);
+
+    ASSERT_EQ(send(fragment(5, 0, 24, true)), Verdict::accept());
+    ASSERT_EQ(send(fragment(5, 48, 24, false)), Verdict::accept());
+
+    timers.advance(start + IP::REASSEMBLY_TIMEOUT - 1ms);
+    ASSERT_EQ(_ip.reassembly().datagrams(), 1u);
+
+    timers.advance(start + IP::REASSEMBLY_TIMEOUT);
+    ASSERT_EQ(_ip.reassembly().datagrams(), 0u);
+    ASSERT_EQ(_ip.reassembly().memory(), 0u);
+    ASSERT_EQ(_drops.get(Verdict::Reason::IPV4_REASSEMBLY_TIMEOUT), 2u);
+
+    // the id is free again
+    ASSERT_EQ(send(fragment(5, 24, 24, true)), Verdict::accept());
+}
+
+TEST_F(ReassemblyTest, boundedByContextsAndMemory)
+{
+    Event::TimerWheel timers;
+    Verdict::Result verdict;
+    std::size_t charge = fragment(0, 0, 24, true).getBuffer().capacity();
+
+    // two contexts: a third datagram evicts the least recently extended one
+    IP::Reassembler contexts{2};
+    contexts.attach(timers, &_drops);
+    ASSERT_FALSE(add(contexts, fragment(10, 0, 24, true), verdict));
+    ASSERT_FALSE(add(contexts, fragment(11, 0, 24, true), verdict));
+    ASSERT_FALSE(add(contexts, fragment(10, 24, 24, true), verdict));
+    ASSERT_FALSE(add(contexts, fragment(12, 0, 24, true), verdict));
+    ASSERT_EQ(verdict, Verdict::accept());
+    ASSERT_EQ(contexts.datagrams(), 2u);
+    ASSERT_EQ(_drops.get(Verdict::Reason::IPV4_REASSEMBLY_EVICTED), 1u);
+    ASSERT_TRUE(add(contexts, fragment(10, 48, 24, false), verdict));
+
+    // room for three fragment buffers: a flood from other sources pushes out the oldest
+    IP::Reassembler memory{64, 3 * charge};
+    memory.attach(timers, &_drops);
+    ASSERT_FALSE(add(memory, fragment(20, 0, 24, true), verdict));
+    ASSERT_FALSE(add(memory, fragment(20, 48, 24, false), verdict));
+    for (uint32_t src = 1; src <= 10; ++src) {
+        ASSERT_FALSE(add(memory, fragment(20, 0, 24, true, 0x0a0a0000 + src), verdict));
+        ASSERT_EQ(verdict, Verdict::accept());
+        ASSERT_LE(memory.memory(), 3 * charge);
+    }
+    ASSERT_EQ(memory.datagrams(), 3u);
+    ASSERT_EQ(_drops.get(Verdict::Reason::IPV4_REASSEMBLY_EVICTED), 1u + 2u + 7u);
+
+    // a datagram that can't fit on its own is dropped
+    IP::Reassembler tiny{64, charge};
+    ASSERT_FALSE(add(tiny, fragment(30, 0, 24, true), verdict));
+    ASSERT_FALSE(add(tiny, fragment(30, 24, 24, true), verdict));
+    ASSERT_EQ(verdict, Verdict::drop(Verdict::Reason::IPV4_REASSEMBLY_EVICTED));
+    ASSERT_EQ(tiny.datagrams(), 0u);
+    ASSERT_EQ(tiny.memory(), 0u);
+}
+
+TEST_F(ReassemblyTest, fragmentedReply)
+{
+    // a 4000 byte echo request arrives in three fragments, and so does its reply leave
+    _icmp.resize(4000);
+    for (std::size_t i = 8; i < _icmp.size(); ++i) {
+        _icmp[i] = static_cast<unsigned char>(i * 7);
+    }
+    std::memset(_icmp.data() + IP::ICMP_CHECKSUM_OFFSET, 0, 2);
+    uint16_t checksum = Inet::checksum(_icmp.data(), _icmp.size());
+    std::memcpy(_icmp.data() + IP::ICMP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    Event::TimerWheel timers;
+    std::vector<Ethernet::Frame> sent;
+    _ip.attach(timers, [&](Ethernet::Frame& frame) { sent.push_back(std::move(frame)); return true; });
+
+    ASSERT_EQ(send(fragment(7, 0, 1480, true)), Verdict::accept());
+    ASSERT_EQ(send(fragment(7, 2960, 1040, false)), Verdict::accept());
+    Ethernet::Frame last = fragment(7, 1480, 1480, true);
+    ASSERT_EQ(_ip.handleMessage(last), Verdict::reply());
+    sent.push_back(std::move(last));
+    ASSERT_EQ(sent.size(), 3u);
+
+    // the reply's fragments fit the MTU and make up the echo request with the type changed
+    IP::Reassembler reassembler;
+    Verdict::Result verdict;
+    for (std::size_t i = 0; i < sent.size(); ++i) {
+        ASSERT_LE(sent[i].getBufferSize(), IP_OFFSET + Ethernet::MTU);
+        ASSERT_EQ(Inet::checksum(sent[i].getData() + IP_OFFSET, IP::HEADER_SIZE), 0);
+
+        IP::Header header;
+        header.readFromBuffer(sent[i].getPayload(), sent[i].getPayloadSize());
+        ASSERT_EQ(reassembler.add(sent[i], header, verdict), i + 1 == sent.size());
+    }
+
+    Ethernet::Frame& reply = sent.back();
+    const char *data = reply.getData();
+    ASSERT_EQ(reply.getBufferSize(), ICMP_OFFSET + _icmp.size());
+    ASSERT_EQ(static_cast<uint8_t>(data[ICMP_OFFSET]), IP::TYPE_REPLY);
+    ASSERT_EQ(Inet::checksum(data + ICMP_OFFSET, _icmp.size()), 0);
+    ASSERT_EQ(std::memcmp(data + ICMP_OFFSET + 8, _icmp.data() + 8, _icmp.size() - 8), 0);
+}
@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "route.hpp"
+
+class RouteTableTest : public testing::Test
+{
+    protected:
+        IP::RouteTable _routes;
+
+        /* the gateway the address is routed to, 0 without a route */
+        IPAddr via(IPAddr addr)
+        {
+            const IP::NextHop *nextHop = _routes.lookup(addr);
+            return nextHop ? nextHop->_gateway : 0;
+        }
+};
+
+TEST_F(RouteTableTest, longestPrefixAcrossLevels)
+{
+    ASSERT_EQ(_routes.lookup(0x0a000001), nullptr);
+
+    // added from the longest, a shorter prefix never hides a longer one
+    ASSERT_TRUE(_routes.add(0x0a010203, 32, IP::NextHop{5, 0}));
+    ASSERT_TRUE(_routes.add(0x0a010200, 24, IP::NextHop{4, 0}));
+    ASSERT_TRUE(_routes.add(0x0a010000, 20, IP::NextHop{3, 0}));
+    ASSERT_TRUE(_routes.add(0x0a000000, 8, IP::NextHop{2, 0}));
+    ASSERT_TRUE(_routes.add(0, 0, IP::NextHop{1, 0}));
+    ASSERT_EQ(_routes.size(), 5u);
+
+    ASSERT_EQ(via(0x0a010203), 5u);
+    ASSERT_EQ(via(0x0a010204), 4u);
+    ASSERT_EQ(via(0x0a010304), 3u);
+    ASSERT_EQ(via(0x0a020304), 2u);
+    ASSERT_EQ(via(0x0b000000), 1u);
+
+    // the prefix is masked, and adding it again replaces the next hop
+    ASSERT_TRUE(_routes.add(0x0a0102ff, 24, IP::NextHop{6, 0}));
+    ASSERT_EQ(_routes.size(), 5u);
+    ASSERT_EQ(via(0x0a010204), 6u);
+    ASSERT_EQ(via(0x0a010203), 5u);
+
+    ASSERT_FALSE(_routes.add(0, 33, IP::NextHop{}));
+}
+
+TEST_F(RouteTableTest, removeFallsBackAndFreesGroups)
+{
+    size_t groups = _routes.freeGroups();
+
+    ASSERT_TRUE(_routes.add(0x0a000000, 8, IP::NextHop{2, 0}));
+    ASSERT_TRUE(_routes.add(0x0a010200, 24, IP::NextHop{4, 0}));
+    ASSERT_TRUE(_routes.add(0x0a010203, 32, IP::NextHop{5, 0}));
+    ASSERT_EQ(_routes.freeGroups(), groups - 2);
+
+    ASSERT_TRUE(_routes.remove(0x0a010203, 32));
+    ASSERT_EQ(via(0x0a010203), 4u);
+    ASSERT_TRUE(_routes.remove(0x0a010200, 24));
+    ASSERT_EQ(via(0x0a010203), 2u);
+    ASSERT_EQ(_routes.freeGroups(), groups);
+
+    ASSERT_FALSE(_routes.remove(0x0a010200, 24));
+    ASSERT_TRUE(_routes.remove(0x0a000000, 8));
+    ASSERT_EQ(_routes.lookup(0x0a010203), nullptr);
+    ASSERT_EQ(_routes.size(), 0u);
+}
+
+TEST_F(RouteTableTest, equalSiblingsAreNotFolded)
+{
+    size_t groups = _routes.freeGroups();
+
+    ASSERT_TRUE(_routes.add(0, 0, IP::NextHop{1, 0}));
+    ASSERT_TRUE(_routes.add(0x0a000000, 17, IP::NextHop{2, 0}));
+    ASSERT_TRUE(_routes.add(0x0a008000, 17, IP::NextHop{2, 0}));
+    ASSERT_TRUE(_routes.add(0x0a000100, 24, IP::NextHop{3, 0}));
+
+    // both halves of the group hold the same entry, it still can't stand for the /16 above it
+    ASSERT_TRUE(_routes.remove(0x0a000100, 24));
+    ASSERT_TRUE(_routes.remove(0x0a000000, 17));
+    ASSERT_EQ(via(0x0a000001), 1u);
+    ASSERT_EQ(via(0x0a008001), 2u);
+
+    ASSERT_TRUE(_routes.remove(0x0a008000, 17));
+    ASSERT_EQ(via(0x0a008001), 1u);
+    ASSERT_EQ(_routes.freeGroups(), groups);
+}
+
+TEST_F(RouteTableTest, groupsRunOut)
+{
+    IP::RouteTable routes{3};
+
+    ASSERT_TRUE(routes.add(0x0a010203, 32, IP::NextHop{1, 0}));
+    ASSERT_TRUE(routes.add(0x0a020300, 24, IP::NextHop{2, 0}));
+    ASSERT_FALSE(routes.add(0x0a030405, 32, IP::NextHop{3, 0}));
+    ASSERT_EQ(routes.lookup(0x0a030405), nullptr);
+
+    // a route that fits the groups it has needs none
+    ASSERT_TRUE(routes.add(0x0a010207, 32, IP::NextHop{4, 0}));
+    ASSERT_EQ(routes.lookup(0x0a010207)->_gateway, 4u);
+}
+
+TEST_F(RouteTableTest, matchesLinearSearch)
+{
+    struct Route
+    {
+        IPAddr   prefix;
+        unsigned depth;
+        IPAddr   gateway;
+    };
+
+    std::mt19937 random{11};
+    std::vector<Route> routes;
+
+    // prefixes clustered in 10.0.0.0/12 so they nest and share groups
+    auto address = [&]() { return 0x0a000000 | (random() & 0x000fffff); };
+    for (IPAddr gateway = 1; gateway <= 300; ++gateway) {
+        unsigned depth = 8 + random() % 25;
+        IPAddr prefix = address() & (~IPAddr{0} << (32 - depth));
+        if (_routes.add(prefix, depth, IP::NextHop{gateway, 0})) {
+            routes.erase(std::remove_if(routes.begin(), routes.end(), [&](const Route& route) {
+                return route.prefix == prefix && route.depth == depth;
+            }), routes.end());
+            routes.push_back({prefix, depth, gateway});
+        }
+
+        // and some go again
+        if (gateway % 3 == 0) {
+            Route route = routes[random() % routes.size()];
+            ASSERT_TRUE(_routes.remove(route.prefix, route.depth));
+            routes.erase(std::find_if(routes.begin(), routes.end(), [&](const Route& other) {
+                return route.prefix == other.prefix && route.depth == other.depth;
+            }));
+        }
+    }
+
+    for (int i = 0; i < 20000; ++i) {
+        IPAddr addr = address();
+        IPAddr expected = 0;
+        unsigned best = 0;
+        for (const Route& route : routes) {
+            if ((addr & (~IPAddr{0} << (32 - route.depth))) == route.prefix && route.depth >= best) {
+                expected = route.gateway;
+                best = route.depth;
+            }
+        }
+
+        ASSERT_EQ(via(addr), expected);
+    }
+}
@@ -0,0 +1,322 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "checksum.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+
+class TCPTest : public testing::Test
+{
+    protected:
+        static constexpr IPAddr CLIENT_ADDR = 0x0a090001;
+        static constexpr IPAddr SERVER_ADDR = 0x0a090002;
+        static constexpr TCP::Port PORT     = 7;
+
+        TCP::Manager _client{64};
+        TCP::Manager _server{64};
+
+        TCP::Key _clientKey{CLIENT_ADDR, SERVER_ADDR, 40000, PORT};
+        TCP::Key _serverKey{SERVER_ADDR, CLIENT_ADDR, PORT, 40000};
+
+        std::vector<char> _segment = std::vector<char>(TCP::MAX_REPLY_SIZE);
+        size_t            _length = 0;
+
+        /* hand the last segment to to, which replies into _segment */
+        Verdict::Result deliver(TCP::Manager& to, IPAddr src, IPAddr dst)
+        {
+            std::vector<char> in(_segment.begin(), _segment.begin() + _length);
+            Verdict::Result result = to.handleSegment(src, dst, in.data(), in.size(), _segment.data(), _length);
+            if (result != Verdict::reply()) {
+                _length = 0;
+            }
+            return result;
+        }
+
+        Verdict::Result toServer(void) { return deliver(_server, CLIENT_ADDR, SERVER_ADDR); }
+        Verdict::Result toClient(void) { return deliver(_client, SERVER_ADDR, CLIENT_ADDR); }
+
+        /* a segment from the client with data appended, checksum filled in */
+        void clientSegment(TCP::Seq seq, TCP::Seq ack, uint8_t flags, const std::string& data = "")
+        {
+            _length = TCP::HEADER_SIZE + data.size();
+            _segment.assign(std::max(_length, TCP::MAX_REPLY_SIZE), 0);
+
+            TCP::OffsetFlags offsetFlags = static_cast<TCP::OffsetFlags>(5 << 12 | flags);
+            TCP::HeaderLayout::store(_segment.data(), _clientKey._localPort, _clientKey._remotePort, seq, ack,
+                                     offsetFlags, TCP::DEFAULT_WINDOW, 0, 0);
+            std::memcpy(_segment.data() + TCP::HEADER_SIZE, data.data(), data.size());
+
+            TCP::Checksum checksum = Inet::checksum(_segment.data(), _length,
+                    Inet::pseudoHeader(CLIENT_ADDR, SERVER_ADDR, IP::PRO_TCP, _length));
+            std::memcpy(_segment.data() + TCP::CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+        }
+
+        TCP::Header parse(void)
+        {
+            TCP::Header header;
+            EXPECT_TRUE(header.readFromBuffer(_segment.data(), _length));
+            return header;
+        }
+
+        void establish(void)
+        {
+            _server.listen(PORT);
+            _length = _client.connect(_clientKey, _segment.data());
+            ASSERT_EQ(toServer(), Verdict::reply());
+            ASSERT_EQ(toClient(), Verdict::reply());
+            ASSERT_EQ(toServer(), Verdict::accept());
+
+            ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::ESTABLISHED);
+            ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::ESTABLISHED);
+        }
+};
+
+TEST_F(TCPTest, parseHeader)
+{
+    _server.listen(PORT);
+    _length = _client.connect(_clientKey, _segment.data());
+    ASSERT_EQ(_length, TCP::HEADER_SIZE + TCP::MSS_OPTION_SIZE);
+
+    TCP::Header header = parse();
+    ASSERT_EQ(header.flags(), TCP::FLAG_SYN);
+    ASSERT_EQ(header.headerLength(), TCP::HEADER_SIZE + TCP::MSS_OPTION_SIZE);
+    ASSERT_EQ(header.getPayloadSize(), 0u);
+    ASSERT_EQ(header.sequenceLength(), 1u);
+
+    // data offset past the end of the buffer
+    _segment[12] = static_cast<char>(0xf0);
+    ASSERT_FALSE(header.readFromBuffer(_segment.data(), _length));
+    ASSERT_FALSE(header.readFromBuffer(_segment.data(), TCP::HEADER_SIZE - 1));
+}
+
+TEST_F(TCPTest, handshake)
+{
+    _server.listen(PORT);
+    _length = _client.connect(_clientKey, _segment.data());
+    TCP::Seq clientISS = _client.find(_clientKey)->_iss;
+
+    ASSERT_EQ(toServer(), Verdict::reply());
+    TCP::Header synAck = parse();
+    ASSERT_EQ(synAck.flags(), TCP::FLAG_SYN | TCP::FLAG_ACK);
+    ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::SYN_RECEIVED);
+    ASSERT_EQ(_server.find(_serverKey)->_mss, TCP::LOCAL_MSS);
+    ASSERT_EQ(_server.find(_serverKey)->_rcvNxt, clientISS + 1);
+
+    ASSERT_EQ(toClient(), Verdict::reply());
+    ASSERT_EQ(parse().flags(), TCP::FLAG_ACK);
+    ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::ESTABLISHED);
+
+    ASSERT_EQ(toServer(), Verdict::accept());
+    ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::ESTABLISHED);
+    ASSERT_EQ(_server.find(_serverKey)->_sndUna, _client.find(_clientKey)->_rcvNxt);
+}
+
+TEST_F(TCPTest, seeded)
+{
+    // the same seed gives the same ISS, however far apart the connections are opened
+    TCP::Manager first{64};
+    TCP::Manager second{64};
+    first.seed(1);
+    second.seed(1);
+
+    ASSERT_GT(first.connect(_clientKey, _segment.data()), 0u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    ASSERT_GT(second.connect(_clientKey, _segment.data()), 0u);
+    ASSERT_EQ(first.find(_clientKey)->_iss, second.find(_clientKey)->_iss);
+
+    ASSERT_THROW(first.seed(2), std::runtime_error);
+}
+
+TEST_F(TCPTest, dataAndPassiveClose)
+{
+    establish();
+    TCP::Connection client = *_client.find(_clientKey);
+
+    clientSegment(client._sndNxt, client._rcvNxt, TCP::FLAG_ACK | TCP::FLAG_PSH, "hello");
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().getAck(), client._sndNxt + 5);
+    ASSERT_EQ(_server.table().stats(_server.find(_serverKey))._bytesIn, 5u);
+
+    // a retransmission is acknowledged again without being counted twice
+    clientSegment(client._sndNxt, client._rcvNxt, TCP::FLAG_ACK | TCP::FLAG_PSH, "hello");
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().getAck(), client._sndNxt + 5);
+    ASSERT_EQ(_server.table().stats(_server.find(_serverKey))._bytesIn, 5u);
+
+    // out of order data gets a duplicate ACK
+    clientSegment(client._sndNxt + 10, client._rcvNxt, TCP::FLAG_ACK, "later");
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().getAck(), client._sndNxt + 5);
+
+    // the server answers the FIN with its own
+    clientSegment(client._sndNxt + 5, client._rcvNxt, TCP::FLAG_ACK | TCP::FLAG_FIN);
+    ASSERT_EQ(toServer(), Verdict::reply());
+    TCP::Header fin = parse();
+    ASSERT_EQ(fin.flags(), TCP::FLAG_FIN | TCP::FLAG_ACK);
+    ASSERT_EQ(fin.getAck(), client._sndNxt + 6);
+    ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::LAST_ACK);
+
+    clientSegment(client._sndNxt + 6, fin.getSeq() + 1, TCP::FLAG_ACK);
+    ASSERT_EQ(toServer(), Verdict::accept());
+    ASSERT_EQ(_server.find(_serverKey), nullptr);
+    ASSERT_EQ(_server.table().size(), 0u);
+}
+
+TEST_F(TCPTest, activeClose)
+{
+    establish();
+
+    _length = _client.close(_clientKey, _segment.data());
+    ASSERT_NE(_length, 0u);
+    ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::FIN_WAIT_1);
+
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().flags(), TCP::FLAG_FIN | TCP::FLAG_ACK);
+
+    // the server's FIN acknowledges ours as well
+    std::vector<char> fin(_segment.begin(), _segment.begin() + _length);
+    ASSERT_EQ(toClient(), Verdict::reply());
+    ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::TIME_WAIT);
+    TCP::Seq ack = parse().getAck();
+
+    ASSERT_EQ(toServer(), Verdict::accept());
+    ASSERT_EQ(_server.find(_serverKey), nullptr);
+
+    // a retransmitted FIN in TIME_WAIT is acknowledged again
+    std::copy(fin.begin(), fin.end(), _segment.begin());
+    _length = fin.size();
+    ASSERT_EQ(toClient(), Verdict::reply());
+    ASSERT_EQ(parse().flags(), TCP::FLAG_ACK);
+    ASSERT_EQ(parse().getAck(), ack);
+    ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::TIME_WAIT);
+    ASSERT_EQ(_client.close(_clientKey, _segment.data()), 0u);
+}
+
+TEST_F(TCPTest, resets)
+{
+    // nothing listens on the port
+    clientSegment(1000, 0, TCP::FLAG_SYN);
+    ASSERT_EQ(toServer(), Verdict::reply());
+    TCP::Header rst = parse();
+    ASSERT_EQ(rst.flags(), TCP::FLAG_RST | TCP::FLAG_ACK);
+    ASSERT_EQ(rst.getAck(), 1001u);
+
+    clientSegment(1000, 0, TCP::FLAG_RST);
+    ASSERT_EQ(toServer(), Verdict::drop(Verdict::Reason::TCP_NO_CONNECTION));
+
+    // the RST for the SYN refuses the client's connection
+    _length = _client.connect(_clientKey, _segment.data());
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(toClient(), Verdict::accept());
+    ASSERT_EQ(_client.find(_clientKey), nullptr);
+}
+
+TEST_F(TCPTest, challengeAck)
+{
+    establish();
+    TCP::Connection client = *_client.find(_clientKey);
+
+    // a RST in the window but not at rcvNxt, or a SYN, only gets an ACK back (RFC 5961)
+    clientSegment(client._sndNxt + 100, 0, TCP::FLAG_RST);
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().flags(), TCP::FLAG_ACK);
+    ASSERT_EQ(parse().getAck(), client._sndNxt);
+
+    clientSegment(client._sndNxt, 0, TCP::FLAG_SYN);
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(parse().flags(), TCP::FLAG_ACK);
+
+    clientSegment(client._sndNxt + 100000, 0, TCP::FLAG_RST);
+    ASSERT_EQ(toServer(), Verdict::drop(Verdict::Reason::TCP_SEQUENCE));
+    ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::ESTABLISHED);
+
+    clientSegment(client._sndNxt, 0, TCP::FLAG_RST);
+    ASSERT_EQ(toServer(), Verdict::accept());
+    ASSERT_EQ(_server.find(_serverKey), nullptr);
+}
+
+TEST_F(TCPTest, badChecksum)
+{
+    _server.listen(PORT);
+    clientSegment(1000, 0, TCP::FLAG_SYN);
+    _segment[TCP::CHECKSUM_OFFSET] ^= 0x5a;
+
+    ASSERT_EQ(toServer(), Verdict::drop(Verdict::Reason::TCP_CHECKSUM));
+    ASSERT_EQ(_server.table().size(), 0u);
+}
+
+TEST_F(TCPTest, timers)
+{
+    Event::Clock::time_point start = Event::Clock::now();
+    Event::TimerWheel timers{std::chrono::milliseconds{1}, start};
+    _client.attach(timers);
+    _server.attach(timers);
+
+    establish();
+    ASSERT_EQ(timers.size(), 0u);
+
+    _length = _client.close(_clientKey, _segment.data());
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(toClient(), Verdict::reply());
+    ASSERT_EQ(toServer(), Verdict::accept());
+    ASSERT_EQ(_client.find(_clientKey)->_state, TCP::State::TIME_WAIT);
+    ASSERT_EQ(timers.size(), 1u);
+
+    timers.advance(start + TCP::TIME_WAIT_TIMEOUT - std::chrono::seconds{1});
+    ASSERT_NE(_client.find(_clientKey), nullptr);
+    timers.advance(start + TCP::TIME_WAIT_TIMEOUT);
+    ASSERT_EQ(_client.find(_clientKey), nullptr);
+
+    // a half open connection is dropped after the handshake timeout
+    _length = _client.connect(_clientKey, _segment.data());
+    ASSERT_EQ(toServer(), Verdict::reply());
+    ASSERT_EQ(_server.find(_serverKey)->_state, TCP::State::SYN_RECEIVED);
+
+    timers.advance(start + TCP::TIME_WAIT_TIMEOUT + TCP::HANDSHAKE_TIMEOUT);
+    ASSERT_EQ(_server.find(_serverKey), nullptr);
+    ASSERT_EQ(_client.find(_clientKey), nullptr);
+    ASSERT_EQ(timers.size(), 0u);
+}
+
+TEST(ConnectionTableTest, insertFindErase)
+{
+    TCP::ConnectionTable table{100};
+    ASSERT_GE(table.capacity(), 200u);
+
+    std::vector<TCP::Key> keys;
+    for (TCP::Port port = 1; port <= 100; ++port) {
+        keys.push_back(TCP::Key{1, 2, 80, port});
+        ASSERT_NE(table.insert(keys.back(), TCP::State::ESTABLISHED), nullptr);
+    }
+
+    ASSERT_EQ(table.size(), 100u);
+    ASSERT_EQ(table.insert(TCP::Key{1, 2, 80, 1000}, TCP::State::ESTABLISHED), nullptr);
+    ASSERT_EQ(table.insert(keys[0], TCP::State::ESTABLISHED), nullptr);
+
+    for (const TCP::Key& key : keys) {
+        table.stats(table.find(key))._bytesIn = key._remotePort;
+    }
+
+    // every second entry goes, the backward shift keeps the rest reachable with their stats
+    for (size_t i = 0; i < keys.size(); i += 2) {
+        table.erase(table.find(keys[i]));
+    }
+
+    ASSERT_EQ(table.size(), 50u);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        TCP::Connection *connection = table.find(keys[i]);
+        if (i % 2 == 0) {
+            ASSERT_EQ(connection, nullptr);
+        } else {
+            ASSERT_NE(connection, nullptr);
+            ASSERT_TRUE(connection->_key == keys[i]);
+            ASSERT_EQ(table.stats(connection)._bytesIn, keys[i]._remotePort);
+        }
+    }
+}
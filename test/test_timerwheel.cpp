@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "timerwheel.hpp"
+
+using namespace std::chrono_literals;
+
+class TimerWheelTest : public testing::Test
+{
+    protected:
+        Event::Clock::time_point _start = Event::Clock::now();
+        Event::TimerWheel        _wheel{1ms, _start};
+        std::vector<int>         _fired;
+
+        Event::TimerId add(Event::Clock::duration delay, int value)
+        {
+            return _wheel.schedule(delay, [this, value]() { _fired.push_back(value); });
+        }
+
+        std::size_t advanceTo(Event::Clock::duration elapsed)
+        {
+            return _wheel.advance(_start + elapsed);
+        }
+};
+
+TEST_F(TimerWheelTest, firesInOrderAcrossLevels)
+{
+    // one per level, added out of order
+    add(5h, 5);
+    add(70ms, 1);
+    add(5s, 3);
+    add(3ms, 0);
+    add(5min, 4);
+    add(300ms, 2);
+    ASSERT_EQ(_wheel.size(), 6u);
+
+    ASSERT_EQ(advanceTo(2ms), 0u);
+    ASSERT_EQ(advanceTo(3ms), 1u);
+    ASSERT_EQ(advanceTo(69ms), 0u);
+    ASSERT_EQ(advanceTo(70ms), 1u);
+    ASSERT_EQ(advanceTo(299ms), 0u);
+    ASSERT_EQ(advanceTo(10min), 3u);
+    ASSERT_EQ(advanceTo(5h - 1ms), 0u);
+    ASSERT_EQ(advanceTo(5h), 1u);
+
+    ASSERT_EQ(_fired, (std::vector<int>{0, 1, 2, 3, 4, 5}));
+    ASSERT_EQ(_wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, cancelAndReschedule)
+{
+    Event::TimerId first = add(10ms, 1);
+    Event::TimerId second = add(10ms, 2);
+    Event::TimerId third = add(100ms, 3);
+
+    ASSERT_TRUE(_wheel.cancel(second));
+    ASSERT_FALSE(_wheel.cancel(second));
+    ASSERT_FALSE(_wheel.pending(second));
+
+    ASSERT_TRUE(_wheel.reschedule(third, 5ms));
+    ASSERT_EQ(advanceTo(5ms), 1u);
+    ASSERT_EQ(advanceTo(10ms), 1u);
+    ASSERT_EQ(_fired, (std::vector<int>{3, 1}));
+
+    // the fired timer's id is stale even after its node is reused
+    ASSERT_FALSE(_wheel.reschedule(first, 1ms));
+    Event::TimerId reused = add(1ms, 4);
+    ASSERT_FALSE(_wheel.cancel(first));
+    ASSERT_TRUE(_wheel.pending(reused));
+}
+
+TEST_F(TimerWheelTest, callbacksSchedule)
+{
+    // a periodic timer rearms itself from its callback
+    int count = 0;
+    std::function<void()> tick = [&]() {
+        if (++count < 5) {
+            _wheel.schedule(20ms, [&tick]() { tick(); });
+        }
+    };
+    _wheel.schedule(20ms, [&tick]() { tick(); });
+
+    advanceTo(1s);
+    ASSERT_EQ(count, 5);
+    ASSERT_EQ(_wheel.size(), 0u);
+}
+
+TEST_F(TimerWheelTest, timeout)
+{
+    ASSERT_EQ(_wheel.timeoutMs(_start), -1);
+
+    add(40ms, 1);
+    ASSERT_EQ(_wheel.timeoutMs(_start), 40);
+    ASSERT_EQ(_wheel.timeoutMs(_start + 30ms), 10);
+    ASSERT_EQ(_wheel.timeoutMs(_start + 50ms), 0);
+
+    // a long timer only needs a wakeup at the next cascade
+    _wheel.cancel(add(10s, 2));
+    add(10s, 2);
+    ASSERT_LE(_wheel.timeoutMs(_start), 40);
+    advanceTo(40ms);
+    ASSERT_GT(_wheel.timeoutMs(_start + 40ms), 0);
+    ASSERT_LE(_wheel.timeoutMs(_start + 40ms), 10000 - 40);
+
+    advanceTo(10s);
+    ASSERT_EQ(_fired, (std::vector<int>{1, 2}));
+}
+
+TEST_F(TimerWheelTest, matchesDeadlines)
+{
+    // random timers fire in the advance() that passes their deadline, never earlier or later
+    std::mt19937 random{7};
+    std::vector<int64_t> deadlines;
+    std::vector<Event::TimerId> ids;
+    std::vector<int64_t> firedAt;
+    std::vector<int64_t> firedAfter;
+
+    int64_t now = 0;
+    int64_t previous = 0;
+    auto fire = [&](size_t index) {
+        firedAt[index] = now;
+        firedAfter[index] = previous;
+    };
+    for (int round = 0; round < 200; ++round) {
+        for (int i = 0; i < 20; ++i) {
+            int64_t delay = 1 + random() % 600000;
+            size_t index = deadlines.size();
+            deadlines.push_back(now + delay);
+            firedAt.push_back(-1);
+            firedAfter.push_back(-1);
+            ids.push_back(_wheel.schedule(std::chrono::milliseconds{delay}, [&fire, index]() { fire(index); }));
+        }
+
+        // some are cancelled, cancelled ones never fire
+        size_t victim = random() % ids.size();
+        if (_wheel.cancel(ids[victim])) {
+            deadlines[victim] = -1;
+        }
+
+        previous = now;
+        now += random() % 5000;
+        _wheel.advance(_start + std::chrono::milliseconds{now});
+    }
+    previous = now;
+    now += 600000;
+    _wheel.advance(_start + std::chrono::milliseconds{now});
+
+    for (size_t i = 0; i < deadlines.size(); ++i) {
+        if (deadlines[i] < 0) {
+            ASSERT_EQ(firedAt[i], -1);
+            continue;
+        }
+        ASSERT_GE(firedAt[i], deadlines[i]);
+        ASSERT_GT(deadlines[i], firedAfter[i]);
+    }
+    ASSERT_EQ(_wheel.size(), 0u);
+}
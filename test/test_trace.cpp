@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "trace.hpp"
+
+class TraceTest : public testing::Test
+{
+    protected:
+        Trace::Ring& _ring;
+        uint64_t     _start;
+
+        TraceTest() : _ring{Trace::localRing()}, _start{_ring.pushed()} {}
+
+        /* records pushed by this test only */
+        std::vector<Trace::Record> recent(void)
+        {
+            std::vector<Trace::Record> records = _ring.snapshot();
+            std::size_t count = _ring.pushed() - _start;
+
+            if (count < records.size()) {
+                records.erase(records.begin(), records.end() - count);
+            }
+            return records;
+        }
+};
+
+TEST_F(TraceTest, recordEvents)
+{
+    Trace::packet(Trace::Event::IP_RX, 1 << 16 | 84, 0x0a090001, 0x0a090002);
+    Trace::packet(Trace::Event::ICMP_REPLY, 7 << 16 | 1, 56);
+
+    std::vector<Trace::Record> records = recent();
+    ASSERT_EQ(records.size(), 2);
+
+    ASSERT_EQ(records[0]._event, static_cast<uint16_t>(Trace::Event::IP_RX));
+    ASSERT_EQ(records[0]._level, Trace::LEVEL_PACKET);
+    ASSERT_EQ(records[0]._arg1, 0x0a090001u);
+    ASSERT_EQ(records[1]._event, static_cast<uint16_t>(Trace::Event::ICMP_REPLY));
+    ASSERT_EQ(records[1]._arg1, 56u);
+    ASSERT_LE(records[0]._timestamp, records[1]._timestamp);
+}
+
+TEST_F(TraceTest, disabledLevel)
+{
+    Trace::emit<Trace::LEVEL_OFF>(Trace::Event::FRAME_RX, 60);
+    Trace::debug(Trace::Event::FRAME_RX, 60);
+
+    std::size_t expected = (Trace::LEVEL >= Trace::LEVEL_DEBUG) ? 1 : 0;
+    ASSERT_EQ(_ring.pushed() - _start, expected);
+}
+
+TEST_F(TraceTest, overwriteOldest)
+{
+    for (uint32_t i = 0; i < Trace::Ring::SIZE + 10; ++i) {
+        Trace::packet(Trace::Event::FRAME_RX, i);
+    }
+
+    std::vector<Trace::Record> records = _ring.snapshot();
+    // the slot the producer writes next is never trusted.
+    ASSERT_EQ(records.size(), Trace::Ring::SIZE - 1);
+    ASSERT_EQ(records.front()._arg0, 11u);
+    ASSERT_EQ(records.back()._arg0, Trace::Ring::SIZE + 9);
+}
+
+TEST_F(TraceTest, dumpAndDecode)
+{
+    std::string path = testing::TempDir() + "charmtcp_trace_test.bin";
+
+    Trace::packet(Trace::Event::ARP_RX, 1, 0x0a090001, 0x0a090002);
+    std::thread([] {
+        Trace::packet(Trace::Event::ICMP_RX, 8 << 8, 64);
+    }).join();
+
+    ASSERT_TRUE(Trace::dump(path));
+
+    std::ostringstream output;
+    ASSERT_TRUE(Trace::decode(path, output));
+    std::remove(path.c_str());
+
+    std::string text = output.str();
+    ASSERT_NE(text.find("ARP_RX opcode: 1 sender: 10.9.0.1 target: 10.9.0.2"), std::string::npos);
+    ASSERT_NE(text.find("ICMP_RX type: 8 code: 0 payload size: 64"), std::string::npos);
+}
+
+TEST_F(TraceTest, decodeInvalid)
+{
+    std::string path = testing::TempDir() + "charmtcp_trace_invalid.bin";
+    {
+        std::FILE *file = std::fopen(path.c_str(), "w");
+        std::fputs("not a trace", file);
+        std::fclose(file);
+    }
+
+    std::ostringstream output;
+    ASSERT_FALSE(Trace::decode(path, output));
+    std::remove(path.c_str());
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "arp.hpp"
+#include "checksum.hpp"
+#include "ethernet.hpp"
+#include "ip.hpp"
+#include "tcp.hpp"
+#include "verdict.hpp"
+
+class VerdictTest : public testing::Test
+{
+    protected:
+        ARP::CacheManager _arp;
+        IP::Manager       _ip{_arp};
+
+        // ICMP echo request from 10.9.0.1 to 10.9.0.2 with 8 bytes of data, checksums unset.
+        std::vector<unsigned char> _echo = {
+            0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00,
+            0x45, 0x00, 0x00, 0x24, 0x12, 0x34, 0x40, 0x00, 0x40, 0x01, 0x00, 0x00,
+            0x0a, 0x09, 0x00, 0x01, 0x0a, 0x09, 0x00, 0x02,
+            0x08, 0x00, 0x00, 0x00, 0x00, 0x07, 0x00, 0x01,
+            0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68
+        };
+
+        // ARP request: who has 10.9.0.2, tell 10.9.0.1.
+        std::vector<unsigned char> _arpRequest = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06,
+            0x00, 0x01, 0x08, 0x00, 0x06, 0x04, 0x00, 0x01,
+            0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0a, 0x09, 0x00, 0x01,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0x09, 0x00, 0x02
+        };
+
+        static constexpr std::size_t IP_OFFSET   = Ethernet::HeaderLayout::SIZE;
+        static constexpr std::size_t ICMP_OFFSET = IP_OFFSET + IP::HEADER_SIZE;
+
+        void fillChecksums(std::vector<unsigned char>& packet)
+        {
+            uint16_t checksum = Inet::checksum(packet.data() + IP_OFFSET, IP::HEADER_SIZE);
+            std::memcpy(packet.data() + IP_OFFSET + IP::IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+            checksum = Inet::checksum(packet.data() + ICMP_OFFSET, 16);
+            std::memcpy(packet.data() + ICMP_OFFSET + IP::ICMP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+        }
+
+        void SetUp() override
+        {
+            _ip.routes().add(0, 0, IP::NextHop{});
+        }
+
+        /* learn the MAC of 10.9.0.1 from its ARP request, so replies to it go out at once */
+        void resolveSender(void)
+        {
+            Ethernet::Frame frame = makeFrame(_arpRequest);
+            _arp.handleMessage(frame);
+        }
+
+        Ethernet::Frame makeFrame(const std::vector<unsigned char>& packet)
+        {
+            Ethernet::Frame frame;
+            frame.allocPacket();
+            std::memcpy(frame.getData(), packet.data(), packet.size());
+            frame.setBufferSize(packet.size());
+            frame.parseBuffer();
+            return frame;
+        }
+};
+
+TEST_F(VerdictTest, echoReply)
+{
+    resolveSender();
+    fillChecksums(_echo);
+    Ethernet::Frame frame = makeFrame(_echo);
+
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::reply());
+
+    const char *data = frame.getData();
+    ASSERT_EQ(frame.getBufferSize(), _echo.size());
+    ASSERT_EQ(std::memcmp(data, _echo.data() + 6, 6), 0);
+    ASSERT_EQ(static_cast<uint8_t>(data[ICMP_OFFSET]), IP::TYPE_REPLY);
+    ASSERT_EQ(std::memcmp(data + IP_OFFSET + IP::IP_DST_OFFSET, _echo.data() + IP_OFFSET + IP::IP_SRC_OFFSET, 4), 0);
+    ASSERT_EQ(Inet::checksum(data + IP_OFFSET, IP::HEADER_SIZE), 0);
+    ASSERT_EQ(Inet::checksum(data + ICMP_OFFSET, 16), 0);
+}
+
+TEST_F(VerdictTest, ipDrops)
+{
+    std::vector<unsigned char> badChecksum = _echo;
+    fillChecksums(badChecksum);
+    badChecksum[IP_OFFSET + IP::IP_CHECKSUM_OFFSET] ^= 0xff;
+    Ethernet::Frame frame = makeFrame(badChecksum);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::IPV4_CHECKSUM));
+
+    std::vector<unsigned char> expired = _echo;
+    expired[IP_OFFSET + IP::IP_TTL_OFFSET] = 0;
+    fillChecksums(expired);
+    frame = makeFrame(expired);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::IPV4_TTL));
+
+    std::vector<unsigned char> udp = _echo;
+    udp[IP_OFFSET + IP::IP_TTL_OFFSET + 1] = 17;
+    fillChecksums(udp);
+    frame = makeFrame(udp);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::IPV4_PROTOCOL));
+
+    std::vector<unsigned char> ipv6 = _echo;
+    ipv6[IP_OFFSET] = 0x65;
+    fillChecksums(ipv6);
+    frame = makeFrame(ipv6);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::IPV4_VERSION));
+
+    std::vector<unsigned char> truncated(_echo.begin(), _echo.begin() + IP_OFFSET + 10);
+    frame = makeFrame(truncated);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::TRUNCATED));
+}
+
+TEST_F(VerdictTest, tcpReset)
+{
+    // SYN from 10.9.0.1:40000 to the closed port 10.9.0.2:7
+    std::vector<unsigned char> syn(_echo.begin(), _echo.begin() + ICMP_OFFSET);
+    syn.resize(ICMP_OFFSET + TCP::HEADER_SIZE);
+    syn[IP_OFFSET + 3] = IP::HEADER_SIZE + TCP::HEADER_SIZE;
+    syn[IP_OFFSET + IP::IP_TTL_OFFSET + 1] = IP::PRO_TCP;
+    TCP::HeaderLayout::store(reinterpret_cast<char*>(syn.data() + ICMP_OFFSET), 40000, 7, 1000, 0, 
+                             static_cast<TCP::OffsetFlags>(5 << 12 | TCP::FLAG_SYN), TCP::DEFAULT_WINDOW, 0, 0);
+
+    uint16_t checksum = Inet::checksum(syn.data() + ICMP_OFFSET, TCP::HEADER_SIZE, 
+            Inet::pseudoHeader(0x0a090001, 0x0a090002, IP::PRO_TCP, TCP::HEADER_SIZE));
+    std::memcpy(syn.data() + ICMP_OFFSET + TCP::CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+    checksum = Inet::checksum(syn.data() + IP_OFFSET, IP::HEADER_SIZE);
+    std::memcpy(syn.data() + IP_OFFSET + IP::IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    resolveSender();
+    Ethernet::Frame frame = makeFrame(syn);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::reply());
+    ASSERT_EQ(frame.getBufferSize(), ICMP_OFFSET + TCP::HEADER_SIZE);
+
+    const char *data = frame.getData();
+    ASSERT_EQ(std::memcmp(data + IP_OFFSET + IP::IP_DST_OFFSET, syn.data() + IP_OFFSET + IP::IP_SRC_OFFSET, 4), 0);
+    ASSERT_EQ(Inet::checksum(data + IP_OFFSET, IP::HEADER_SIZE), 0);
+    ASSERT_EQ(Inet::checksum(data + ICMP_OFFSET, TCP::HEADER_SIZE, 
+            Inet::pseudoHeader(0x0a090002, 0x0a090001, IP::PRO_TCP, TCP::HEADER_SIZE)), 0);
+    ASSERT_EQ(static_cast<uint8_t>(data[ICMP_OFFSET + 13]), TCP::FLAG_RST | TCP::FLAG_ACK);
+}
+
+TEST_F(VerdictTest, replyRouting)
+{
+    fillChecksums(_echo);
+
+    // the sender isn't resolved yet, the reply waits for it
+    Ethernet::Frame frame = makeFrame(_echo);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::accept());
+    ASSERT_EQ(_arp.pending(0x0a090001), 1u);
+
+    // through a gateway it is the gateway that gets resolved
+    ASSERT_TRUE(_ip.routes().add(0x0a090000, 24, IP::NextHop{0x0a0900fe, 0}));
+    frame = makeFrame(_echo);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::accept());
+    ASSERT_EQ(_arp.pending(0x0a0900fe), 1u);
+
+    ASSERT_TRUE(_ip.routes().remove(0x0a090000, 24));
+    ASSERT_TRUE(_ip.routes().remove(0, 0));
+    frame = makeFrame(_echo);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::IPV4_NO_ROUTE));
+}
+
+TEST_F(VerdictTest, checksumOffload)
+{
+    // the device vouches for the TCP checksum, so even a wrong one gets its RST
+    std::vector<unsigned char> syn(_echo.begin(), _echo.begin() + ICMP_OFFSET);
+    syn.resize(ICMP_OFFSET + TCP::HEADER_SIZE);
+    syn[IP_OFFSET + 3] = IP::HEADER_SIZE + TCP::HEADER_SIZE;
+    syn[IP_OFFSET + IP::IP_TTL_OFFSET + 1] = IP::PRO_TCP;
+    TCP::HeaderLayout::store(reinterpret_cast<char*>(syn.data() + ICMP_OFFSET), 40000, 7, 1000, 0, 
+                             static_cast<TCP::OffsetFlags>(5 << 12 | TCP::FLAG_SYN), TCP::DEFAULT_WINDOW, 0x1234, 0);
+    uint16_t checksum = Inet::checksum(syn.data() + IP_OFFSET, IP::HEADER_SIZE);
+    std::memcpy(syn.data() + IP_OFFSET + IP::IP_CHECKSUM_OFFSET, &checksum, sizeof(checksum));
+
+    resolveSender();
+    Ethernet::Frame frame = makeFrame(syn);
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::drop(Verdict::Reason::TCP_CHECKSUM));
+
+    frame = makeFrame(syn);
+    frame.offload()._flags = Ethernet::Offload::CHECKSUM_VALID;
+    ASSERT_EQ(_ip.handleMessage(frame), Verdict::reply());
+    ASSERT_EQ(frame.offload()._flags, 0);
+}
+
+TEST_F(VerdictTest, segmentationOffload)
+{
+    constexpr std::size_t PAYLOAD = 4000;
+
+    resolveSender();
+    Ethernet::Frame frame;
+    frame.allocPacket(TCP::HEADER_SIZE + PAYLOAD);
+    TCP::HeaderLayout::store(frame.getData(), 7, 40000, 1000, 2000, 
+                             static_cast<TCP::OffsetFlags>(5 << 12 | TCP::FLAG_ACK), TCP::DEFAULT_WINDOW, 0, 0);
+    frame.setBufferSize(TCP::HEADER_SIZE + PAYLOAD);
+
+    // over the MTU with DF, only TCP can be cut up into segments
+    ASSERT_EQ(_ip.output(frame, 0x0a090002, 0x0a090001, IP::PRO_ICMP, true), Verdict::drop(Verdict::Reason::IPV4_TOO_BIG));
+
+    // one frame and one header, the device or GSO cuts it and finishes the checksums
+    ASSERT_EQ(_ip.output(frame, 0x0a090002, 0x0a090001, IP::PRO_TCP, true), Verdict::reply());
+    ASSERT_EQ(frame.getBufferSize(), ICMP_OFFSET + TCP::HEADER_SIZE + PAYLOAD);
+
+    const Ethernet::Offload& offload = frame.offload();
+    ASSERT_EQ(offload._gsoType, Ethernet::Offload::GSO_TCPV4);
+    ASSERT_EQ(offload._flags, Ethernet::Offload::CHECKSUM_PARTIAL);
+    ASSERT_EQ(offload._headerLength, ICMP_OFFSET + TCP::HEADER_SIZE);
+    ASSERT_EQ(offload._gsoSize, Ethernet::MTU - IP::HEADER_SIZE - TCP::HEADER_SIZE);
+    ASSERT_EQ(offload._checksumStart, ICMP_OFFSET);
+    ASSERT_EQ(offload._checksumOffset, TCP::CHECKSUM_OFFSET);
+
+    const char *data = frame.getData();
+    ASSERT_EQ(Inet::checksum(data + IP_OFFSET, IP::HEADER_SIZE), 0);
+    uint16_t pseudo = Inet::fold(Inet::pseudoHeader(0x0a090002, 0x0a090001, IP::PRO_TCP, TCP::HEADER_SIZE + PAYLOAD));
+    ASSERT_EQ(std::memcmp(data + ICMP_OFFSET + TCP::CHECKSUM_OFFSET, &pseudo, sizeof(pseudo)), 0);
+}
+
+TEST_F(VerdictTest, arpRequest)
+{
+    Ethernet::Frame frame = makeFrame(_arpRequest);
+
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::reply());
+    ASSERT_EQ(frame.getBufferSize(), Ethernet::MIN_FRAME_SIZE - sizeof(CRC32));
+    ASSERT_EQ(frame.getType(), PRO_ARP);
+
+    // opcode 2, the target is the requester.
+    const char *data = frame.getData();
+    ASSERT_EQ(static_cast<uint8_t>(data[IP_OFFSET + 7]), ARP::OP_REPLY);
+    ASSERT_EQ(std::memcmp(data + IP_OFFSET + 18, _arpRequest.data() + IP_OFFSET + 8, 10), 0);
+}
+
+TEST_F(VerdictTest, arpAging)
+{
+    Event::Clock::time_point start = Event::Clock::now();
+    Event::TimerWheel timers{std::chrono::milliseconds{1}, start};
+    _arp.attach(timers);
+
+    Ethernet::Frame frame = makeFrame(_arpRequest);
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::reply());
+    ASSERT_EQ(_arp.size(), 1u);
+    ASSERT_NE(_arp.lookup(0x0a090001), nullptr);
+
+    // hearing from the host again pushes the expiry out
+    timers.advance(start + ARP::ENTRY_TIMEOUT / 2);
+    frame = makeFrame(_arpRequest);
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::reply());
+
+    timers.advance(start + ARP::ENTRY_TIMEOUT + ARP::SWEEP_INTERVAL);
+    ASSERT_EQ(_arp.size(), 1u);
+    timers.advance(start + ARP::ENTRY_TIMEOUT * 3 / 2 + ARP::SWEEP_INTERVAL);
+    ASSERT_EQ(_arp.size(), 0u);
+}
+
+TEST_F(VerdictTest, arpDrops)
+{
+    std::vector<unsigned char> reply = _arpRequest;
+    reply[IP_OFFSET + 7] = ARP::OP_REPLY;
+    Ethernet::Frame frame = makeFrame(reply);
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::accept());
+
+    std::vector<unsigned char> opcode = _arpRequest;
+    opcode[IP_OFFSET + 7] = 3;
+    frame = makeFrame(opcode);
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::drop(Verdict::Reason::ARP_OPCODE));
+
+    std::vector<unsigned char> hwType = _arpRequest;
+    hwType[IP_OFFSET + 1] = 6;
+    frame = makeFrame(hwType);
+    ASSERT_EQ(_arp.handleMessage(frame), Verdict::drop(Verdict::Reason::ARP_HW_TYPE));
+}
+
+TEST(DropCountersTest, count)
+{
+    Verdict::DropCounters drops;
+
+    drops.count(Verdict::Reason::IPV4_CHECKSUM);
+    drops.count(Verdict::Reason::IPV4_CHECKSUM);
+    drops.count(Verdict::Reason::RUNT, 5);
+
+    ASSERT_EQ(drops.get(Verdict::Reason::IPV4_CHECKSUM), 2u);
+    ASSERT_EQ(drops.get(Verdict::Reason::RUNT), 5u);
+    ASSERT_EQ(drops.get(Verdict::Reason::IPV4_TTL), 0u);
+    ASSERT_EQ(drops.total(), 7u);
+
+    std::ostringstream os;
+    drops.debugPrint(os);
+    ASSERT_NE(os.str().find("bad IP checksum: 2"), std::string::npos);
+}